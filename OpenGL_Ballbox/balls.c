@@ -0,0 +1,988 @@
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <float.h>
+#include "balls.h"
+#include "../OpenGL_Stage/jobs.h"
+
+static float* allocateArray(int count) {
+    // aligned_alloc() wants the size to be a multiple of the alignment.
+    size_t bytes = ((size_t)count*sizeof(float) + BALL_ALIGNMENT - 1) / BALL_ALIGNMENT * BALL_ALIGNMENT;
+    return aligned_alloc(BALL_ALIGNMENT, bytes > 0 ? bytes : BALL_ALIGNMENT);
+}
+
+int initBalls(BallSystem* balls, int capacity, float halfSize, unsigned int seed) {
+    memset(balls, 0, sizeof(BallSystem));
+    balls->x = allocateArray(capacity);
+    balls->y = allocateArray(capacity);
+    balls->z = allocateArray(capacity);
+    balls->vx = allocateArray(capacity);
+    balls->vy = allocateArray(capacity);
+    balls->vz = allocateArray(capacity);
+    balls->radius = allocateArray(capacity);
+    balls->color = (unsigned char*)allocateArray(capacity);  // 4 bytes per ball, the size of a float
+    if ( ! balls->x || ! balls->y || ! balls->z || ! balls->vx || ! balls->vy || ! balls->vz || ! balls->radius
+            || ! balls->color ) {
+        freeBalls(balls);
+        return 0;
+    }
+    balls->capacity = capacity;
+    balls->halfSize = halfSize;
+    balls->random = seed ? seed : 1;
+    return 1;
+}
+
+void freeBalls(BallSystem* balls) {
+    int i;
+    free(balls->x);
+    free(balls->y);
+    free(balls->z);
+    free(balls->vx);
+    free(balls->vy);
+    free(balls->vz);
+    free(balls->radius);
+    free(balls->color);
+    free(balls->contacts);
+    free(balls->times);
+    free(balls->boxes);
+    free(balls->ballCells);
+    free(balls->cellStarts);
+    free(balls->entries);
+    free(balls->ballSegments);
+    free(balls->extraBoxes);
+    free(balls->extraCells);
+    free(balls->wallTimes);
+    free(balls->states);
+    free(balls->slotBalls);
+    free(balls->ballSlots);
+    free(balls->ballHits);
+    free(balls->partnerStarts);
+    free(balls->partners);
+    free(balls->queue);
+    free(balls->firstHits);
+    free(balls->sortedHits);
+    for (i = 0; i < balls->chunkCapacity; i++) {
+        free(balls->chunks[i].pairs);
+        free(balls->chunks[i].times);
+    }
+    free(balls->chunks);
+    memset(balls, 0, sizeof(BallSystem));
+}
+
+int addBall(BallSystem* balls, float x, float y, float z, float vx, float vy, float vz, float radius) {
+    int n = balls->count;
+    if (n == balls->capacity)
+        return -1;
+    balls->x[n] = x;
+    balls->y[n] = y;
+    balls->z[n] = z;
+    balls->vx[n] = vx;
+    balls->vy[n] = vy;
+    balls->vz[n] = vz;
+    balls->radius[n] = radius;
+    memset(balls->color + 4*n, 255, 4);
+    if (radius > balls->maxRadius)
+        balls->maxRadius = radius;
+    balls->count++;
+    return n;
+}
+
+void removeBall(BallSystem* balls, int ball) {
+    int last = --balls->count;
+    balls->x[ball] = balls->x[last];
+    balls->y[ball] = balls->y[last];
+    balls->z[ball] = balls->z[last];
+    balls->vx[ball] = balls->vx[last];
+    balls->vy[ball] = balls->vy[last];
+    balls->vz[ball] = balls->vz[last];
+    balls->radius[ball] = balls->radius[last];
+    memcpy(balls->color + 4*ball, balls->color + 4*last, 4);
+}
+
+/*  A random number from 0 to 1, from a xorshift generator, so that the same
+    seed always gives the same balls.  */
+static float nextRandom(BallSystem* balls) {
+    unsigned int r = balls->random;
+    r ^= r << 13;
+    r ^= r >> 17;
+    r ^= r << 5;
+    balls->random = r;
+    return (r >> 8) * (1.0f / 16777216);
+}
+
+//  A velocity component of 3 to 13 units per second, in either direction.
+static float randomSpeed(BallSystem* balls) {
+    float speed = nextRandom(balls) * 10 + 3;
+    return nextRandom(balls) < 0.5f ? -speed : speed;
+}
+
+void randomizeVelocity(BallSystem* balls, int ball) {
+    balls->vx[ball] = randomSpeed(balls);
+    balls->vy[ball] = randomSpeed(balls);
+    balls->vz[ball] = randomSpeed(balls);
+}
+
+void setBallColor(BallSystem* balls, int ball, float red, float green, float blue) {
+    balls->color[4*ball] = (unsigned char)(red * 255 + 0.5f);
+    balls->color[4*ball+1] = (unsigned char)(green * 255 + 0.5f);
+    balls->color[4*ball+2] = (unsigned char)(blue * 255 + 0.5f);
+    balls->color[4*ball+3] = 255;
+}
+
+//  A light color, 0.5 to 1 in each component, as in createWorld().
+static void setRandomColor(BallSystem* balls, int ball) {
+    float red = 0.5f + 0.5f*nextRandom(balls);
+    float green = 0.5f + 0.5f*nextRandom(balls);
+    float blue = 0.5f + 0.5f*nextRandom(balls);
+    setBallColor(balls, ball, red, green, blue);
+}
+
+int addRandomBalls(BallSystem* balls, int count, float radius) {
+    float limit = balls->halfSize - radius;
+    int i;
+    for (i = 0; i < count; i++) {
+        float x = (2*nextRandom(balls) - 1) * limit;
+        float y = (2*nextRandom(balls) - 1) * limit;
+        float z = (2*nextRandom(balls) - 1) * limit;
+        int ball = addBall(balls, x, y, z, 0, 0, 0, radius);
+        if (ball < 0)
+            break;
+        randomizeVelocity(balls, ball);
+        setRandomColor(balls, ball);
+    }
+    return i;
+}
+
+/*  One coordinate of one ball: if the ball has moved outside the cube,
+    reflect it back in, as updateForFrame() does.  */
+static void bounce(float* position, float* velocity, float limit) {
+    if (*position > limit) {
+        *position -= 2*(*position - limit);
+        *velocity = -fabsf(*velocity);
+    }
+    else if (*position < -limit) {
+        *position += 2*(-limit - *position);
+        *velocity = fabsf(*velocity);
+    }
+}
+
+typedef struct MoveJob {
+    BallSystem* balls;
+    float dt;
+} MoveJob;
+
+static void moveChunk(void* data, int start, int end, int chunk) {
+    MoveJob* job = data;
+    BallSystem* balls = job->balls;
+    float dt = job->dt;
+    int i;
+    for (i = start; i < end; i++) {
+        float limit = balls->halfSize - balls->radius[i];
+        balls->x[i] += balls->vx[i] * dt;
+        balls->y[i] += balls->vy[i] * dt;
+        balls->z[i] += balls->vz[i] * dt;
+        bounce(&balls->x[i], &balls->vx[i], limit);
+        bounce(&balls->y[i], &balls->vy[i], limit);
+        bounce(&balls->z[i], &balls->vz[i], limit);
+    }
+}
+
+static int clampInt(int x, int low, int high) {
+    return x < low ? low : x > high ? high : x;
+}
+
+static float clampFloat(float x, float low, float high) {
+    return x < low ? low : x > high ? high : x;
+}
+
+//  The time of impact for a pair or a wall that is not hit.
+#define NO_HIT FLT_MAX
+
+typedef struct PairJob {
+    BallSystem* balls;
+    float dt;           // 0 to find only the pairs that overlap now
+    float padding;      // how much larger than the balls their boxes are, as a fraction of the radius
+    float narrowSize;   // the width of the narrower cells of findPairs()
+} PairJob;
+
+//  The cell that holds a point, on one axis.  Points outside the cube go to the nearest cell.
+static int cellOf(const BallSystem* balls, float coordinate) {
+    return clampInt((int)((coordinate + balls->halfSize) / balls->cellSize), 0, balls->cellsPerSide - 1);
+}
+
+//  The cell that holds the center of a box.
+static int boxCell(const BallSystem* balls, const float* box) {
+    int n = balls->cellsPerSide;
+    return (cellOf(balls, (box[2] + box[5]) / 2) * n + cellOf(balls, (box[1] + box[4]) / 2)) * n
+           + cellOf(balls, (box[0] + box[3]) / 2);
+}
+
+/*  Sets box to the box around ball i on its path from time from to time to
+    of the step, with its radius made larger by padding.  */
+static void pathBox(const BallSystem* balls, int i, float from, float to, float padding, float* box) {
+    float r = balls->radius[i] * (1 + padding);
+    float ends[3][2] = { { balls->x[i] + balls->vx[i]*from, balls->x[i] + balls->vx[i]*to },
+                         { balls->y[i] + balls->vy[i]*from, balls->y[i] + balls->vy[i]*to },
+                         { balls->z[i] + balls->vz[i]*from, balls->z[i] + balls->vz[i]*to } };
+    int axis;
+    for (axis = 0; axis < 3; axis++) {
+        int forward = ends[axis][1] > ends[axis][0];
+        box[axis] = ends[axis][ ! forward ] - r;
+        box[axis+3] = ends[axis][forward] + r;
+    }
+}
+
+/*  The time from now at which a ball next reaches a wall, moving as it is
+    now, or NO_HIT.  */
+static float wallDelay(const BallState* ball, float halfSize) {
+    float limit = halfSize - ball->radius, first = NO_HIT;
+    float position[3] = { ball->x, ball->y, ball->z };
+    float velocity[3] = { ball->vx, ball->vy, ball->vz };
+    int axis;
+    for (axis = 0; axis < 3; axis++) {
+        float s;
+        if (velocity[axis] > 0)
+            s = (limit - position[axis]) / velocity[axis];
+        else if (velocity[axis] < 0)
+            s = (-limit - position[axis]) / velocity[axis];
+        else
+            continue;
+        if (s < 0)
+            s = 0;  // already outside
+        if (s < first)
+            first = s;
+    }
+    return first;
+}
+
+//  Copies ball i out of the arrays, at time 0 of the step.
+static void loadBall(const BallSystem* balls, int i, BallState* ball) {
+    ball->x = balls->x[i];
+    ball->y = balls->y[i];
+    ball->z = balls->z[i];
+    ball->time = 0;
+    ball->vx = balls->vx[i];
+    ball->vy = balls->vy[i];
+    ball->vz = balls->vz[i];
+    ball->radius = balls->radius[i];
+}
+
+//  Copies ball i back into the arrays.
+static void storeBall(BallSystem* balls, int i, const BallState* ball) {
+    balls->x[i] = ball->x;
+    balls->y[i] = ball->y;
+    balls->z[i] = ball->z;
+    balls->vx[i] = ball->vx;
+    balls->vy[i] = ball->vy;
+    balls->vz[i] = ball->vz;
+}
+
+/*  Finds the box around the path of each ball during the step, and counts
+    the balls in each chunk that move too far to fit in the narrower cells.
+    With dt more than 0, also finds the time each ball reaches a wall, for
+    the balls whose boxes cross one.  */
+static void boxChunk(void* data, int start, int end, int chunk) {
+    PairJob* job = data;
+    BallSystem* balls = job->balls;
+    float dt = job->dt, limit = balls->halfSize;
+    int i, fast = 0;
+    for (i = start; i < end; i++) {
+        float* box = &balls->boxes[6*i];
+        pathBox(balls, i, 0, dt, job->padding, box);
+        fast += box[3] - box[0] > job->narrowSize || box[4] - box[1] > job->narrowSize
+                || box[5] - box[2] > job->narrowSize;
+        if (dt > 0) {
+            BallState ball;
+            loadBall(balls, i, &ball);
+            balls->wallTimes[i] = box[0] < -limit || box[1] < -limit || box[2] < -limit
+                                  || box[3] > limit || box[4] > limit || box[5] > limit ? wallDelay(&ball, limit) : NO_HIT;
+        }
+    }
+    balls->chunks[chunk].fast = fast;
+}
+
+/*  Finds the cell of the center of the box of each ball, and the number of
+    sub-steps its path is split into: one if the box fits in a cell, or
+    enough that the box of each sub-step does.  sortIntoCells() puts them in
+    the grid.  */
+static void cellChunk(void* data, int start, int end, int chunk) {
+    PairJob* job = data;
+    BallSystem* balls = job->balls;
+    int i;
+    for (i = start; i < end; i++) {
+        const float* box = &balls->boxes[6*i];
+        float room = balls->cellSize - 2*balls->radius[i]*(1 + job->padding);
+        float travel = fmaxf(box[3] - box[0], fmaxf(box[4] - box[1], box[5] - box[2])) - 2*balls->radius[i]*(1 + job->padding);
+        balls->ballCells[i] = boxCell(balls, box);
+        balls->ballSegments[i] = travel <= room || balls->cellsPerSide == 1 ? 1 : (int)ceilf(travel / room);
+    }
+}
+
+/*  The time at which balls a and b, which have each been moved up to their
+    own times within the step, next touch while moving closer together, or
+    NO_HIT if they never do.  If they already overlap by more than a
+    little, the time is now, so that they are pushed apart.  */
+static float pairImpact(const BallState* a, const BallState* b) {
+    float from = a->time > b->time ? a->time : b->time;
+    float dx = b->x + b->vx*(from - b->time) - a->x - a->vx*(from - a->time);
+    float dy = b->y + b->vy*(from - b->time) - a->y - a->vy*(from - a->time);
+    float dz = b->z + b->vz*(from - b->time) - a->z - a->vz*(from - a->time);
+    float wx = b->vx - a->vx, wy = b->vy - a->vy, wz = b->vz - a->vz;
+    float touch = a->radius + b->radius;
+    float c = dx*dx + dy*dy + dz*dz - touch*touch;
+    float half = dx*wx + dy*wy + dz*wz;  // half of the b of the quadratic
+    float square = wx*wx + wy*wy + wz*wz, discriminant, s;
+    if (c < -1e-3f*touch*touch)
+        return from;
+    if (half >= 0)
+        return NO_HIT;  // moving apart
+    /* The distance is touch when square*s*s + 2*half*s + c = 0; the first
+       root is the time they meet. */
+    discriminant = half*half - square*c;
+    if (discriminant < 0)
+        return NO_HIT;  // they miss
+    s = (-half - sqrtf(discriminant)) / square;
+    return s > 0 ? from + s : from;
+}
+
+static void addPair(BallChunk* chunk, int a, int b, float time) {
+    if (chunk->count == chunk->capacity) {
+        chunk->capacity = chunk->capacity ? 2*chunk->capacity : 256;
+        chunk->pairs = realloc(chunk->pairs, chunk->capacity*2*sizeof(int));
+        chunk->times = realloc(chunk->times, chunk->capacity*sizeof(float));
+    }
+    chunk->pairs[2*chunk->count] = a;
+    chunk->pairs[2*chunk->count+1] = b;
+    chunk->times[chunk->count] = time;
+    chunk->count++;
+}
+
+/*  Is entry e, of a ball in n sub-steps, the one that holds time s of a step
+    of dt seconds?  */
+static int holdsTime(const BallEntry* e, int n, float s, float dt) {
+    return e->segment == clampInt((int)(s / dt * n), 0, n - 1);
+}
+
+/*  Adds the balls of entries p and q of the grid as a pair if they overlap,
+    or with dt more than 0, if they come within the distance at which they
+    touch, made larger by BALL_EPSILON, during the step, moving as they are
+    now.  */
+static void testPair(const PairJob* job, BallChunk* chunk, const BallEntry* p, const BallEntry* q) {
+    const BallSystem* balls = job->balls;
+    const BallState* a = &balls->states[p->slot];
+    const BallState* b = &balls->states[q->slot];
+    float dx, dy, dz, touch, s = 0;
+    // One branch for the six comparisons, since about half the boxes tested miss.
+    if ((p->box[0] > q->box[3]) | (q->box[0] > p->box[3]) | (p->box[1] > q->box[4])
+            | (q->box[1] > p->box[4]) | (p->box[2] > q->box[5]) | (q->box[2] > p->box[5]) || p->slot == q->slot)
+        return;
+    dx = b->x - a->x;
+    dy = b->y - a->y;
+    dz = b->z - a->z;
+    touch = a->radius + b->radius;
+    if (job->dt > 0) {
+        // Move to the time of the closest approach within the step.
+        float wx = b->vx - a->vx, wy = b->vy - a->vy, wz = b->vz - a->vz;
+        float square = wx*wx + wy*wy + wz*wz;
+        s = square > 0 ? clampFloat(-(dx*wx + dy*wy + dz*wz) / square, 0, job->dt) : 0;
+        dx += wx*s;
+        dy += wy*s;
+        dz += wz*s;
+        touch *= 1 + BALL_EPSILON;
+    }
+    if (dx*dx + dy*dy + dz*dz >= touch*touch)
+        return;
+    /* A ball that is split into sub-steps is in the grid once for each, so
+       the pair can be found more than once; only the sub-steps that hold the
+       closest approach, whose boxes always overlap, keep it. */
+    if ((p->segment >= 0 && ! holdsTime(p, balls->ballSegments[balls->slotBalls[p->slot]], s, job->dt))
+            || (q->segment >= 0 && ! holdsTime(q, balls->ballSegments[balls->slotBalls[q->slot]], s, job->dt)))
+        return;
+    addPair(chunk, p->slot, q->slot, job->dt > 0 ? pairImpact(a, b) : 0);
+}
+
+/*  Compares entries first to end-1 of the grid with entries other to
+    otherEnd-1.  */
+static void compareBalls(const PairJob* job, BallChunk* chunk, int first, int end, int other, int otherEnd,
+                         int sameCell) {
+    const BallEntry* entries = job->balls->entries;
+    int a, b;
+    for (a = first; a < end; a++)
+        for (b = sameCell ? a + 1 : other; b < otherEnd; b++)
+            testPair(job, chunk, &entries[a], &entries[b]);
+}
+
+/*  Finds the pairs for a range of cells.  The boxes in the grid are no wider
+    than a cell, so two boxes that overlap have their centers in the same
+    cell or in neighboring cells.  Each pair of neighboring cells is visited
+    once: every cell is compared with itself and with the 13 of its 26
+    neighbors that come after it in the order of the cells.  */
+static void pairChunk(void* data, int start, int end, int chunkNumber) {
+    PairJob* job = data;
+    BallSystem* balls = job->balls;
+    BallChunk* chunk = &balls->chunks[chunkNumber];
+    int n = balls->cellsPerSide, cell, dx, dy, dz;
+    chunk->count = 0;
+    for (cell = start; cell < end; cell++) {
+        int first = balls->cellStarts[cell], last = balls->cellStarts[cell+1];
+        int cx = cell % n, cy = cell / n % n, cz = cell / (n*n);
+        if (first == last)
+            continue;
+        compareBalls(job, chunk, first, last, first, last, 1);
+        for (dz = 0; dz <= 1; dz++)
+            for (dy = dz ? -1 : 0; dy <= 1; dy++)
+                for (dx = dz || dy ? -1 : 1; dx <= 1; dx++) {
+                    int x = cx + dx, y = cy + dy, z = cz + dz, other;
+                    if (x < 0 || x >= n || y < 0 || y >= n || z >= n)
+                        continue;
+                    other = (z * n + y) * n + x;
+                    compareBalls(job, chunk, first, last, balls->cellStarts[other], balls->cellStarts[other+1], 0);
+                }
+    }
+}
+
+static void reserveChunks(BallSystem* balls, int chunkCount) {
+    if (chunkCount > balls->chunkCapacity) {
+        balls->chunks = realloc(balls->chunks, chunkCount*sizeof(BallChunk));
+        memset(balls->chunks + balls->chunkCapacity, 0, (chunkCount - balls->chunkCapacity)*sizeof(BallChunk));
+        balls->chunkCapacity = chunkCount;
+    }
+}
+
+/*  Allocates the scratch arrays that have one entry per ball.  */
+static void reserveBallScratch(BallSystem* balls) {
+    int count = balls->count;
+    if (count > balls->ballCapacity) {
+        balls->ballCapacity = count;
+        free(balls->boxes);
+        free(balls->ballCells);
+        free(balls->ballSegments);
+        free(balls->wallTimes);
+        free(balls->states);
+        free(balls->slotBalls);
+        free(balls->ballSlots);
+        free(balls->ballHits);
+        free(balls->partnerStarts);
+        balls->boxes = malloc(count*6*sizeof(float));
+        balls->ballCells = malloc(count*sizeof(int));
+        balls->ballSegments = malloc(count*sizeof(int));
+        balls->wallTimes = malloc(count*sizeof(float));
+        balls->states = (BallState*)allocateArray(count * (sizeof(BallState) / sizeof(float)));
+        balls->slotBalls = malloc(count*sizeof(int));
+        balls->ballSlots = malloc(count*sizeof(int));
+        balls->ballHits = malloc(count*sizeof(int));
+        balls->partnerStarts = malloc((count + 1)*sizeof(int));
+    }
+}
+
+//  Copies each ball into its slot.
+static void stateChunk(void* data, int start, int end, int chunk) {
+    BallSystem* balls = data;
+    int i;
+    for (i = start; i < end; i++)
+        loadBall(balls, i, &balls->states[balls->ballSlots[i]]);
+}
+
+//  Puts an entry for the ball in slot into the grid, at the next place for cell.
+static void placeEntry(BallSystem* balls, int cell, const float* box, int slot, int segment) {
+    BallEntry* entry = &balls->entries[balls->cellStarts[cell]++];
+    memcpy(entry->box, box, 6*sizeof(float));
+    entry->slot = slot;
+    entry->segment = segment;
+}
+
+/*  Puts the balls into the grid, sorted by cell with a counting sort.
+
+    Each ball gets a slot in the order of the cells, and is copied into
+    balls->states there, so that balls that are near each other in the cube
+    are near each other in memory.  A ball that fits in a cell is one entry
+    of the grid, at the same place as its slot.  If there are balls split
+    into sub-steps, which are one entry per sub-step, each with the box
+    around its path for that part of the step, the entries are sorted again
+    on their own.  */
+static void sortIntoCells(BallSystem* balls, float dt) {
+    int count = balls->count, cellCount = balls->cellsPerSide * balls->cellsPerSide * balls->cellsPerSide;
+    int* starts = balls->cellStarts;
+    int i, j, extra = 0, entries;
+
+    balls->extraCount = 0;
+    for (i = 0; i < count; i++) {
+        int segments = balls->ballSegments[i];
+        if (segments == 1)
+            continue;
+        if (balls->extraCount + segments > balls->extraCapacity) {
+            balls->extraCapacity = 2*(balls->extraCount + segments);
+            balls->extraBoxes = realloc(balls->extraBoxes, balls->extraCapacity*6*sizeof(float));
+            balls->extraCells = realloc(balls->extraCells, balls->extraCapacity*sizeof(int));
+        }
+        for (j = 0; j < segments; j++) {
+            float* box = &balls->extraBoxes[6*balls->extraCount];
+            pathBox(balls, i, dt*j/segments, dt*(j+1)/segments, BALL_EPSILON, box);
+            balls->extraCells[balls->extraCount++] = boxCell(balls, box);
+        }
+    }
+    entries = count + balls->extraCount;
+    if (entries > balls->entryCapacity) {
+        balls->entryCapacity = entries + entries / 4;
+        free(balls->entries);
+        balls->entries = (BallEntry*)allocateArray(balls->entryCapacity * (sizeof(BallEntry) / sizeof(float)));
+    }
+
+    memset(starts, 0, (cellCount + 1)*sizeof(int));
+    for (i = 0; i < count; i++)
+        starts[balls->ballCells[i] + 1]++;
+    for (i = 0; i < cellCount; i++)
+        starts[i+1] += starts[i];
+    for (i = 0; i < count; i++) {
+        int cell = balls->ballCells[i], slot = starts[cell];
+        balls->ballSlots[i] = slot;
+        balls->slotBalls[slot] = i;
+        if (balls->extraCount == 0)
+            placeEntry(balls, cell, &balls->boxes[6*i], slot, -1);
+        else
+            starts[cell]++;
+    }
+    jobsParallelFor(count, BALL_GRAIN, stateChunk, balls);
+
+    if (balls->extraCount > 0) {
+        memset(starts, 0, (cellCount + 1)*sizeof(int));
+        for (i = 0; i < count; i++)
+            if (balls->ballSegments[i] == 1)
+                starts[balls->ballCells[i] + 1]++;
+        for (i = 0; i < balls->extraCount; i++)
+            starts[balls->extraCells[i] + 1]++;
+        for (i = 0; i < cellCount; i++)
+            starts[i+1] += starts[i];
+        for (i = 0; i < count; i++) {
+            if (balls->ballSegments[i] == 1)
+                placeEntry(balls, balls->ballCells[i], &balls->boxes[6*i], balls->ballSlots[i], -1);
+            else
+                for (j = 0; j < balls->ballSegments[i]; j++, extra++)
+                    placeEntry(balls, balls->extraCells[extra], &balls->extraBoxes[6*extra], balls->ballSlots[i], j);
+        }
+    }
+    // The fill moved each start to the start of the next cell; shift them back.
+    for (i = cellCount; i > 0; i--)
+        starts[i] = starts[i-1];
+    starts[0] = 0;
+}
+
+/*  The number of cells along each side of the cube for cells at least
+    width wide, but with no more than about two cells per ball; empty cells
+    still cost time to visit.  */
+static int sidesFor(const BallSystem* balls, double width) {
+    int n = width > 0 ? (int)(2 * balls->halfSize / width) : 1, most = (int)cbrt(2.0 * balls->count) + 1;
+    if (n > most)
+        n = most;
+    return n > 1 ? n : 1;
+}
+
+/*  The broadphase: puts the pairs of balls whose paths in a step of dt
+    seconds come within touching distance into the contacts array, with
+    their times of impact.  With dt 0, it finds the pairs that overlap.  */
+static int findPairs(BallSystem* balls, float dt) {
+    PairJob job = { balls, dt, dt > 0 ? BALL_EPSILON : 0, 0 };
+    int count = balls->count, i, cellCount, chunkCount, total, n, fast = 0;
+    double diameter = 2 * balls->maxRadius * (1 + job.padding);
+
+    /* The cells are as wide as the largest ball, or if the paths of many of
+       the balls are too long for that, BALL_CELL_SCALE times as wide, so
+       that only the fast balls are split into sub-steps. */
+    reserveBallScratch(balls);
+    n = sidesFor(balls, diameter);
+    job.narrowSize = 2 * balls->halfSize / n;
+    chunkCount = jobsChunkCount(count, BALL_GRAIN);
+    reserveChunks(balls, chunkCount);
+    jobsParallelFor(count, BALL_GRAIN, boxChunk, &job);
+    for (i = 0; i < chunkCount; i++)
+        fast += balls->chunks[i].fast;
+    if (fast > count / BALL_FAST_SHARE)
+        n = sidesFor(balls, BALL_CELL_SCALE * diameter);
+    balls->cellsPerSide = n;
+    balls->cellSize = 2 * balls->halfSize / n;
+    cellCount = n * n * n;
+    if (cellCount + 1 > balls->cellCapacity) {
+        balls->cellCapacity = cellCount + 1;
+        free(balls->cellStarts);
+        balls->cellStarts = malloc(balls->cellCapacity*sizeof(int));
+    }
+    jobsParallelFor(count, BALL_GRAIN, cellChunk, &job);
+    sortIntoCells(balls, dt);
+
+    // Find the pairs, then join the chunks' lists in order.
+    chunkCount = jobsChunkCount(cellCount, BALL_CELL_GRAIN);
+    reserveChunks(balls, chunkCount);
+    jobsParallelFor(cellCount, BALL_CELL_GRAIN, pairChunk, &job);
+    total = 0;
+    for (i = 0; i < chunkCount; i++)
+        total += balls->chunks[i].count;
+    if (total > balls->contactCapacity) {
+        balls->contactCapacity = total;
+        free(balls->contacts);
+        free(balls->times);
+        balls->contacts = malloc(total*2*sizeof(int));
+        balls->times = malloc(total*sizeof(float));
+    }
+    balls->contactCount = 0;
+    for (i = 0; i < chunkCount; i++) {
+        memcpy(balls->contacts + 2*balls->contactCount, balls->chunks[i].pairs,
+               balls->chunks[i].count*2*sizeof(int));
+        memcpy(balls->times + balls->contactCount, balls->chunks[i].times, balls->chunks[i].count*sizeof(float));
+        balls->contactCount += balls->chunks[i].count;
+    }
+    return balls->contactCount;
+}
+
+/*  Changes the pairs in the contacts array from slots to ball numbers.  */
+static void contactBalls(BallSystem* balls) {
+    int k;
+    for (k = 0; k < 2*balls->contactCount; k++)
+        balls->contacts[k] = balls->slotBalls[balls->contacts[k]];
+}
+
+int findContacts(BallSystem* balls) {
+    findPairs(balls, 0);
+    contactBalls(balls);
+    return balls->contactCount;
+}
+
+/*  Bounces ball a off ball b, which must be at the same time.  If they are
+    moving closer together, their velocities change as in an elastic
+    collision; if they overlap, they are pushed apart.  */
+static void collide(const BallSystem* balls, BallState* a, BallState* b) {
+    float dx = b->x - a->x, dy = b->y - a->y, dz = b->z - a->z;
+    float ra = a->radius, rb = b->radius, touch = ra + rb;
+    float distance = sqrtf(dx*dx + dy*dy + dz*dz), nx, ny, nz;
+    float inverseMassA = 1 / (ra*ra*ra), inverseMassB = 1 / (rb*rb*rb);
+    float shareA = inverseMassA / (inverseMassA + inverseMassB), shareB = 1 - shareA;
+    float approach, overlap, limitA = balls->halfSize - ra, limitB = balls->halfSize - rb;
+    if (distance > 0) {
+        nx = dx / distance;
+        ny = dy / distance;
+        nz = dz / distance;
+    }
+    else {  // The centers are at the same place; push them apart along x.
+        nx = 1;
+        ny = nz = 0;
+    }
+
+    /* The speed of b towards a, along the line between the centers.  An
+       elastic collision reverses it; the change is split between the balls
+       in inverse proportion to their masses. */
+    approach = (a->vx - b->vx)*nx + (a->vy - b->vy)*ny + (a->vz - b->vz)*nz;
+    if (approach > 0) {
+        float change = 2 * approach;
+        a->vx -= change * shareA * nx;
+        a->vy -= change * shareA * ny;
+        a->vz -= change * shareA * nz;
+        b->vx += change * shareB * nx;
+        b->vy += change * shareB * ny;
+        b->vz += change * shareB * nz;
+    }
+
+    // Separate the balls, moving the lighter one farther, but not out of the cube.
+    overlap = touch - distance;
+    if (overlap > 0) {
+        a->x = clampFloat(a->x - overlap * shareA * nx, -limitA, limitA);
+        a->y = clampFloat(a->y - overlap * shareA * ny, -limitA, limitA);
+        a->z = clampFloat(a->z - overlap * shareA * nz, -limitA, limitA);
+        b->x = clampFloat(b->x + overlap * shareB * nx, -limitB, limitB);
+        b->y = clampFloat(b->y + overlap * shareB * ny, -limitB, limitB);
+        b->z = clampFloat(b->z + overlap * shareB * nz, -limitB, limitB);
+    }
+}
+
+void stepBallsDiscrete(BallSystem* balls, float dt) {
+    MoveJob job = { balls, dt };
+    int k;
+    jobsParallelFor(balls->count, BALL_GRAIN, moveChunk, &job);
+    findContacts(balls);
+    balls->hitCount = 0;
+    for (k = 0; k < balls->contactCount; k++) {
+        int a = balls->contacts[2*k], b = balls->contacts[2*k+1];
+        float dx = balls->x[b] - balls->x[a], dy = balls->y[b] - balls->y[a], dz = balls->z[b] - balls->z[a];
+        float touch = balls->radius[a] + balls->radius[b];
+        // An earlier pair in the list may already have moved one of them apart.
+        if (dx*dx + dy*dy + dz*dz < touch*touch) {
+            BallState ballA, ballB;
+            loadBall(balls, a, &ballA);
+            loadBall(balls, b, &ballB);
+            collide(balls, &ballA, &ballB);
+            storeBall(balls, a, &ballA);
+            storeBall(balls, b, &ballB);
+            balls->hitCount++;
+        }
+    }
+}
+
+//------------------------------ continuous steps ------------------------------
+
+/*  The time at which a ball, which has been moved up to its own time in the
+    step, next reaches a wall, or NO_HIT.  */
+static float wallImpact(const BallState* ball, float halfSize) {
+    float delay = wallDelay(ball, halfSize);
+    return delay == NO_HIT ? NO_HIT : ball->time + delay;
+}
+
+/*  Reverses the velocity of a ball on every axis where it is at a wall and
+    moving out, and puts it exactly at the wall.  */
+static void bounceOffWalls(BallState* ball, float halfSize) {
+    float limit = halfSize - ball->radius, slack = 1e-4f * halfSize;
+    float* position[3] = { &ball->x, &ball->y, &ball->z };
+    float* velocity[3] = { &ball->vx, &ball->vy, &ball->vz };
+    int axis;
+    for (axis = 0; axis < 3; axis++) {
+        if (*position[axis] >= limit - slack && *velocity[axis] > 0) {
+            *position[axis] = limit;
+            *velocity[axis] = -*velocity[axis];
+        }
+        else if (*position[axis] <= -limit + slack && *velocity[axis] < 0) {
+            *position[axis] = -limit;
+            *velocity[axis] = -*velocity[axis];
+        }
+    }
+}
+
+//  Moves a ball along its path up to the given time.
+static void advanceBall(BallState* ball, float time) {
+    float s = time - ball->time;
+    ball->x += ball->vx * s;
+    ball->y += ball->vy * s;
+    ball->z += ball->vz * s;
+    ball->time = time;
+}
+
+static int earlier(const BallHit* p, const BallHit* q) {
+    if (p->time != q->time)
+        return p->time < q->time;
+    if (p->a != q->a)
+        return p->a < q->a;
+    return p->b < q->b;
+}
+
+//  A hit of ball a with ball b, or with a wall if b is -1, as of the balls' hits so far.
+static BallHit makeHit(const BallSystem* balls, float time, int a, int b) {
+    BallHit hit;
+    hit.time = time;
+    hit.a = a < b || b < 0 ? a : b;
+    hit.b = a < b || b < 0 ? b : a;
+    hit.versionA = balls->ballHits[hit.a];
+    hit.versionB = hit.b < 0 ? 0 : balls->ballHits[hit.b];
+    return hit;
+}
+
+/*  Sorts the first hits by time, with a radix sort of the bits of the
+    times, which for times of 0 or more are in the same order as the times.
+    The sort is stable, so hits at the same time stay in the order they were
+    found in, which is the same for any number of threads.  */
+static void sortFirstHits(BallSystem* balls) {
+    int counts[1 << 11], pass, k;
+    for (pass = 0; pass < 3; pass++) {
+        BallHit* from = balls->firstHits;
+        BallHit* to = balls->sortedHits;
+        int sum = 0;
+        memset(counts, 0, sizeof(counts));
+        for (k = 0; k < balls->firstCount; k++) {
+            unsigned int bits;
+            memcpy(&bits, &from[k].time, sizeof(bits));
+            counts[bits >> 11*pass & 2047]++;
+        }
+        for (k = 0; k < 1 << 11; k++) {
+            int n = counts[k];
+            counts[k] = sum;
+            sum += n;
+        }
+        for (k = 0; k < balls->firstCount; k++) {
+            unsigned int bits;
+            memcpy(&bits, &from[k].time, sizeof(bits));
+            to[counts[bits >> 11*pass & 2047]++] = from[k];
+        }
+        balls->firstHits = to;
+        balls->sortedHits = from;
+    }
+}
+
+static void pushHit(BallSystem* balls, float time, int a, int b) {
+    BallHit hit = makeHit(balls, time, a, b);
+    int slot;
+    if (balls->queueCount == balls->queueCapacity) {
+        balls->queueCapacity = balls->queueCapacity ? 2*balls->queueCapacity : 1024;
+        balls->queue = realloc(balls->queue, balls->queueCapacity*sizeof(BallHit));
+    }
+    for (slot = balls->queueCount++; slot > 0 && earlier(&hit, &balls->queue[(slot-1)/2]); slot = (slot-1)/2)
+        balls->queue[slot] = balls->queue[(slot-1)/2];
+    balls->queue[slot] = hit;
+}
+
+//  Puts hit at slot of the queue, or below it, where it is no earlier than its parent.
+static void siftDown(BallSystem* balls, int slot, BallHit hit) {
+    int child;
+    while ((child = 2*slot + 1) < balls->queueCount) {
+        if (child + 1 < balls->queueCount && earlier(&balls->queue[child+1], &balls->queue[child]))
+            child++;
+        if ( ! earlier(&balls->queue[child], &hit) )
+            break;
+        balls->queue[slot] = balls->queue[child];
+        slot = child;
+    }
+    balls->queue[slot] = hit;
+}
+
+static BallHit popHit(BallSystem* balls) {
+    BallHit first = balls->queue[0], last = balls->queue[--balls->queueCount];
+    siftDown(balls, 0, last);
+    return first;
+}
+
+/*  Queues the next hits of ball i, after it has changed velocity.  */
+static void scheduleHits(BallSystem* balls, int i, float dt) {
+    float time;
+    int k;
+    if (balls->ballHits[i] >= BALL_MAX_HITS)
+        return;
+    time = wallImpact(&balls->states[i], balls->halfSize);
+    if (time <= dt)
+        pushHit(balls, time, i, -1);
+    for (k = balls->partnerStarts[i]; k < balls->partnerStarts[i+1]; k++) {
+        int j = balls->partners[k];
+        if (balls->ballHits[j] >= BALL_MAX_HITS)
+            continue;
+        time = pairImpact(&balls->states[i], &balls->states[j]);
+        if (time <= dt)
+            pushHit(balls, time, i, j);
+    }
+}
+
+/*  Makes a list of the pairs of each ball from the contacts array, with a
+    counting sort, so that its hits can be worked out again after it
+    bounces.  */
+static void listPartners(BallSystem* balls) {
+    int count = balls->count, k;
+    int* starts = balls->partnerStarts;
+    if (2*balls->contactCount > balls->partnerCapacity) {
+        balls->partnerCapacity = 2*balls->contactCount;
+        free(balls->partners);
+        balls->partners = malloc(balls->partnerCapacity*sizeof(int));
+    }
+    memset(starts, 0, (count + 1)*sizeof(int));
+    for (k = 0; k < 2*balls->contactCount; k++)
+        starts[balls->contacts[k] + 1]++;
+    for (k = 0; k < count; k++)
+        starts[k+1] += starts[k];
+    for (k = 0; k < balls->contactCount; k++) {
+        int a = balls->contacts[2*k], b = balls->contacts[2*k+1];
+        balls->partners[starts[a]++] = b;
+        balls->partners[starts[b]++] = a;
+    }
+    for (k = count; k > 0; k--)
+        starts[k] = starts[k-1];
+    starts[0] = 0;
+}
+
+/*  Brings a coordinate that is outside of -limit to limit back inside, as if
+    it had bounced off the walls as many times as it took.  Only needed for
+    balls that ran out of hits.  */
+static void foldIntoCube(float* position, float* velocity, float limit) {
+    float u, turns;
+    if (*position >= -limit && *position <= limit)
+        return;
+    if (limit <= 0) {
+        *position = 0;
+        return;
+    }
+    u = (*position + limit) / (2*limit);
+    turns = floorf(u);
+    u -= turns;
+    if (fmodf(turns, 2) == 0)
+        *position = -limit + 2*limit*u;
+    else {
+        *position = limit - 2*limit*u;
+        *velocity = -*velocity;
+    }
+}
+
+/*  Moves every ball the rest of the way to the end of the step, and copies
+    it back from its slot into the arrays.  */
+static void finishChunk(void* data, int start, int end, int chunk) {
+    MoveJob* job = data;
+    BallSystem* balls = job->balls;
+    int i;
+    for (i = start; i < end; i++) {
+        BallState* ball = &balls->states[balls->ballSlots[i]];
+        float limit = balls->halfSize - ball->radius;
+        advanceBall(ball, job->dt);
+        foldIntoCube(&ball->x, &ball->vx, limit);
+        foldIntoCube(&ball->y, &ball->vy, limit);
+        foldIntoCube(&ball->z, &ball->vz, limit);
+        storeBall(balls, i, ball);
+    }
+}
+
+void stepBalls(BallSystem* balls, float dt) {
+    MoveJob job = { balls, dt };
+    int i, k, next;
+    if (balls->count == 0 || dt <= 0)
+        return;
+    findPairs(balls, dt);
+    listPartners(balls);
+    memset(balls->ballHits, 0, balls->count*sizeof(int));
+
+    /* The first hits, from the pairs and the wall times that the broadphase
+       found, are sorted once and taken in order; only the hits worked out
+       again after a bounce go into the queue, which stays small.  Taking the
+       earlier of the two each time, bounce the balls in order of time. */
+    balls->queueCount = 0;
+    balls->hitCount = 0;
+    if (balls->contactCount + balls->count > balls->firstCapacity) {
+        balls->firstCapacity = balls->contactCount + balls->count;
+        free(balls->firstHits);
+        free(balls->sortedHits);
+        balls->firstHits = malloc(balls->firstCapacity*sizeof(BallHit));
+        balls->sortedHits = malloc(balls->firstCapacity*sizeof(BallHit));
+    }
+    balls->firstCount = 0;
+    for (k = 0; k < balls->contactCount; k++)
+        if (balls->times[k] <= dt)
+            balls->firstHits[balls->firstCount++] = makeHit(balls, balls->times[k], balls->contacts[2*k],
+                                                            balls->contacts[2*k+1]);
+    for (i = 0; i < balls->count; i++)
+        if (balls->wallTimes[i] <= dt)
+            balls->firstHits[balls->firstCount++] = makeHit(balls, balls->wallTimes[i], balls->ballSlots[i], -1);
+    sortFirstHits(balls);
+    next = 0;
+    while (next < balls->firstCount || balls->queueCount > 0) {
+        BallHit hit;
+        if (balls->queueCount > 0 && (next == balls->firstCount || earlier(&balls->queue[0], &balls->firstHits[next])))
+            hit = popHit(balls);
+        else
+            hit = balls->firstHits[next++];
+        if (hit.versionA != balls->ballHits[hit.a] || (hit.b >= 0 && hit.versionB != balls->ballHits[hit.b]))
+            continue;  // One of the balls has bounced since the hit was queued.
+        advanceBall(&balls->states[hit.a], hit.time);
+        balls->ballHits[hit.a]++;
+        if (hit.b < 0)
+            bounceOffWalls(&balls->states[hit.a], balls->halfSize);
+        else {
+            advanceBall(&balls->states[hit.b], hit.time);
+            balls->ballHits[hit.b]++;
+            collide(balls, &balls->states[hit.a], &balls->states[hit.b]);
+            scheduleHits(balls, hit.b, dt);
+        }
+        scheduleHits(balls, hit.a, dt);
+        balls->hitCount++;
+    }
+    jobsParallelFor(balls->count, BALL_GRAIN, finishChunk, &job);
+    contactBalls(balls);
+}
+
+double kineticEnergy(const BallSystem* balls) {
+    double sum = 0;
+    int i;
+    for (i = 0; i < balls->count; i++) {
+        double r = balls->radius[i];
+        double speedSquared = (double)balls->vx[i]*balls->vx[i] + (double)balls->vy[i]*balls->vy[i]
+                              + (double)balls->vz[i]*balls->vz[i];
+        sum += 0.5 * r*r*r * speedSquared;
+    }
+    return sum;
+}
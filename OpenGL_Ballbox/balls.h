@@ -0,0 +1,219 @@
+/*  Header file for balls.c, the simulation for the Ballbox program: balls that
+    fly around inside a cube, bounce off its walls and, unlike in
+    Three.js_Ballbox/code.html, also bounce off each other.
+
+    The balls are stored as a "structure of arrays", one array for each
+    coordinate of the positions and velocities and one for the radii, so that
+    a step streams through plain float arrays and the arrays can be handed
+    straight to OpenGL for drawing.
+
+    When two balls hit, the velocities along the line between their centers
+    change as in an elastic collision, which keeps both momentum and kinetic
+    energy.  The mass of a ball is proportional to the cube of its radius.
+
+    stepBallsDiscrete() does a step the simple way, in three parts:
+
+       1. Every ball moves by its velocity, and bounces off the walls of the
+          cube exactly as in updateForFrame().
+       2. The "broadphase" finds the pairs of balls that overlap.  The balls
+          are sorted into a uniform grid of cubic cells at least as wide as
+          the largest ball, so that two balls that touch are in the same cell
+          or in neighboring cells, and each ball is only compared with the
+          few balls around it.
+       3. Each overlapping pair that is moving closer together bounces, and
+          the balls are pushed apart so they no longer overlap.
+
+    That only notices a hit if the balls overlap at the end of the step, so
+    with long steps or fast balls, balls pass through each other, and the
+    reflection off a wall can leave a ball outside the cube.
+
+    stepBalls() avoids that with "continuous" collision detection.  Each
+    ball is swept along its path for the step: the broadphase works with the
+    box around the whole path instead of the ball, and keeps only the pairs
+    whose paths come within touching distance, for which the time of impact
+    is solved for exactly.  The grid cells are as wide as the largest ball,
+    or BALL_CELL_SCALE times as wide if many balls move farther than that in
+    a step; the path of a ball too fast for a cell is split into sub-steps
+    short enough to fit, and each goes into the grid on its own.  The time
+    each ball reaches a wall is solved for too, on the same threads, for the
+    balls whose boxes cross a wall.  The balls are copied into slots in the
+    order of the cells, as BallStates, so that balls that hit are close
+    together in memory.
+
+    The hits found by the broadphase are sorted by time once, and the hits
+    worked out after bounces go into a small queue ordered by time.  Taking
+    the earliest of either, the balls involved are moved up to the time of
+    the hit and bounced, and their next hits are worked out again from
+    their new velocities, until there are no more hits before the end of
+    the step.  Then every ball moves the rest of the way.  So each ball is
+    sub-stepped at its own times of impact, while the great majority of
+    balls, which hit nothing, move just once, as in the discrete step.
+
+    A ball takes part in at most BALL_MAX_HITS hits per step, which keeps a
+    tight cluster of balls from using up the step with ever smaller
+    bounces.  A hit with a ball that was not found by the broadphase (only
+    possible after a bounce has changed a ball's path) is caught in the next
+    step, where the two balls overlap and are pushed apart.
+
+    The broadphase and the final moves are split into jobs with
+    OpenGL_Stage/jobs.c; each chunk of the grid collects its own pairs, and
+    the chunks are joined in order.  Bounces change two balls at a time, so
+    they are done on one thread, in order of time, with ties always taken in
+    the same order.  The results are therefore the same for any number of
+    threads.  */
+
+#ifndef BALLS_H
+#define BALLS_H
+
+#define BALL_ALIGNMENT 64
+
+//  Balls per job in part 1.
+#define BALL_GRAIN 8192
+
+//  Grid cells per job in part 2.
+#define BALL_CELL_GRAIN 2048
+
+/*  The grid cells are as wide as the largest ball, or this many times as
+    wide if more than one ball in BALL_FAST_SHARE would have to be split into
+    sub-steps to fit in the narrower cells.  */
+#define BALL_CELL_SCALE 2.0f
+#define BALL_FAST_SHARE 8
+
+/*  The broadphase of stepBalls() keeps the pairs of balls that come within
+    the distance at which they touch, made larger by this fraction, so that
+    no hit is lost to rounding.  */
+#define BALL_EPSILON 0.01f
+
+//  The most hits per ball per step in stepBalls().
+#define BALL_MAX_HITS 16
+
+//  The pairs found by one chunk of cells, with their times of impact.
+typedef struct BallChunk {
+    int* pairs;
+    float* times;
+    int count, capacity;
+    int fast;   // the balls of one chunk of balls whose paths are too long for the narrower cells
+} BallChunk;
+
+/*  A ball, or one sub-step of a ball, in the grid.  */
+typedef struct BallEntry {
+    float box[6];      // around its path: 3 low corner coordinates, 3 high
+    int slot;          // the ball's slot in the states array
+    int segment;       // which sub-step of the ball this is, or -1 for its whole path
+} BallEntry;
+
+/*  A ball as stepBalls() works with it while it bounces: everything a hit
+    reads and changes, in 32 bytes instead of spread over seven arrays.  */
+typedef struct BallState {
+    float x, y, z;
+    float time;    // the time within the step that the ball has been moved to
+    float vx, vy, vz;
+    float radius;
+} BallState;
+
+//  A hit in the queue of stepBalls(): ball a with ball b, or with a wall if b is -1.
+typedef struct BallHit {
+    float time;
+    int a, b;
+    int versionA, versionB;  // the hits of a and b so far; if either has changed, the hit is out of date
+} BallHit;
+
+//  A set of balls in a cube.  The arrays are aligned to BALL_ALIGNMENT bytes.
+typedef struct BallSystem {
+    int count, capacity;
+    float* x;
+    float* y;
+    float* z;
+    float* vx;     // velocities, in units per second
+    float* vy;
+    float* vz;
+    float* radius;
+    unsigned char* color;   // red, green, blue and alpha bytes, 4 per ball, for drawing
+    float halfSize;     // the cube goes from -halfSize to halfSize on each axis
+    float maxRadius;    // the largest radius of any ball added so far
+    unsigned int random;   // state of the random number generator used by addRandomBalls()
+
+    /*  After findContacts() or stepBallsDiscrete(), contacts[2*k] and
+        contacts[2*k+1] are the numbers of the two balls of overlapping pair
+        k, for k up to contactCount-1.  After stepBalls(), they are the pairs
+        that could have hit during the step, and times[k] is the time of
+        impact of pair k, or more than the step if it did not hit at first.  */
+    int* contacts;
+    float* times;
+    int contactCount, contactCapacity;
+    int hitCount;       // the bounces in the last step, off walls and off balls
+
+    // Scratch space for the grid, kept from step to step.
+    float cellSize;
+    int cellsPerSide;
+    int cellCapacity, ballCapacity, chunkCapacity, entryCapacity;
+    float* boxes;       // the box around the path of each ball: 3 low corner coordinates, 3 high
+    int* ballCells;     // the cell of the center of each ball's box, which sorts the balls into slots
+    int* ballSegments;  // the number of sub-steps of each ball, 1 for most
+    float* wallTimes;   // the time each ball first reaches a wall, or more than the step
+    int* cellStarts;    // the entries of cell c are cellStarts[c] to cellStarts[c+1]-1
+    BallEntry* entries; // the entries of the grid, sorted by cell
+    float* extraBoxes;  // the boxes of the sub-steps, in order of ball, 6 floats each
+    int* extraCells;    // and their cells
+    int extraCount, extraCapacity;
+    BallChunk* chunks;
+
+    // Scratch space for the queue of hits in stepBalls().
+    BallState* states;  // a copy of each ball in its slot, written back to the arrays at the end of the step
+    int* slotBalls;     // the ball in each slot
+    int* ballSlots;     // the slot of each ball
+    int* ballHits;      // the number of hits of each ball in the step
+    int* partnerStarts; // the pairs of ball i are partners[partnerStarts[i]] to partners[partnerStarts[i+1]-1]
+    int* partners;
+    BallHit* firstHits; // the hits found by the broadphase, sorted by time
+    BallHit* sortedHits;
+    int firstCount, firstCapacity;
+    BallHit* queue;     // a binary heap of the hits found after bounces, earliest first
+    int queueCount, queueCapacity, partnerCapacity;
+} BallSystem;
+
+/*  Allocates the arrays for up to capacity balls in a cube whose sides go
+    from -halfSize to halfSize.  There are no balls yet.  Returns 0 if there
+    is not enough memory.  */
+int initBalls(BallSystem* balls, int capacity, float halfSize, unsigned int seed);
+
+//  Frees the arrays.
+void freeBalls(BallSystem* balls);
+
+/*  Adds a white ball, and returns its number, or -1 if the arrays are full.  */
+int addBall(BallSystem* balls, float x, float y, float z, float vx, float vy, float vz, float radius);
+
+/*  Adds count balls of the given radius at random places in the cube, each
+    moving at 3 to 13 units per second on each axis and with a random light
+    color, like createWorld().
+    Returns the number that fit in the arrays.  */
+int addRandomBalls(BallSystem* balls, int count, float radius);
+
+/*  Gives a ball a random velocity like the ones from addRandomBalls().  */
+void randomizeVelocity(BallSystem* balls, int ball);
+
+//  Sets the color of a ball; the components go from 0 to 1.
+void setBallColor(BallSystem* balls, int ball, float red, float green, float blue);
+
+/*  Removes a ball.  The last ball takes its number, so that the arrays stay
+    packed.  */
+void removeBall(BallSystem* balls, int ball);
+
+/*  Advances the simulation by dt seconds, with continuous collision
+    detection: every hit with a wall or another ball during the step is
+    found and bounced at its time of impact.  */
+void stepBalls(BallSystem* balls, float dt);
+
+/*  Advances the simulation by dt seconds the simple way: moves the balls,
+    bounces them off the walls, then finds the overlapping pairs and bounces
+    them off each other.  */
+void stepBallsDiscrete(BallSystem* balls, float dt);
+
+/*  Finds the overlapping pairs, as in part 2 of a step, and puts them in the
+    contacts array.  Returns the number of pairs.  */
+int findContacts(BallSystem* balls);
+
+//  The total kinetic energy, taking the mass of a ball to be radius cubed.
+double kineticEnergy(const BallSystem* balls);
+
+#endif
@@ -0,0 +1,244 @@
+/**
+ * A benchmark for balls.c.  For a thousand up to a million balls, it times
+ * stepBallsDiscrete() and stepBalls(), the continuous version, with 1/60
+ * second steps.  The balls always fill a tenth of the cube, so with more
+ * balls they are smaller.  That is done twice: first with the speeds of the
+ * original program, 3 to 13 units per second on each axis, with which the
+ * small balls move several times their radius in a step; then with the
+ * speeds scaled by the radius, so that, as in the original program, a ball
+ * moves at most a quarter of its radius.  Up to 20000 balls, it also checks
+ * the pairs from
+ * findContacts() against the simple method that compares every ball with
+ * every other one.  The kinetic energy after the continuous steps is shown
+ * as a fraction of the energy at the start; since every bounce is elastic,
+ * it should stay very close to 1.  Next, two small tests show what the
+ * continuous steps are for: two fast balls meeting head on, and a fast ball
+ * with a long step at a wall.  Finally, it runs the largest
+ * count with 1, 2, 4, ... threads, up to the number of cores, and checks
+ * that every thread count gives the same result.  No window or OpenGL
+ * context is needed.  Usage:
+ *
+ *        bench_balls [maxCount [steps]]
+ *
+ * The default goes up to 1000000 balls, with 60 steps for each count.
+ * Compile with
+ *
+ *        gcc -O2 -o bench_balls bench_balls.c balls.c ../OpenGL_Stage/jobs.c -lm -pthread
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <time.h>
+#include <unistd.h>
+#include "balls.h"
+#include "../OpenGL_Stage/jobs.h"
+
+#define HALF_SIZE 10     // as in the original, the cube is 20 units on a side
+#define FILL 0.1         // the fraction of the cube's volume taken up by the balls
+#define BRUTE_FORCE_LIMIT 20000
+#define ORIGINAL_RADIUS 1.5f
+
+static double now() {
+    struct timespec t;
+    clock_gettime(CLOCK_MONOTONIC, &t);
+    return t.tv_sec + t.tv_nsec * 1e-9;
+}
+
+/*  Sets up count balls, with the radius that makes them fill FILL of the
+    cube.  If scaled is 1, the speeds are scaled by the radius.  Returns 0 if
+    there is not enough memory.  */
+static int setUp(BallSystem* balls, int count, int scaled) {
+    double side = 2 * HALF_SIZE;
+    float radius = (float)cbrt(FILL * side*side*side / (count * 4 * M_PI / 3));
+    int i;
+    if ( ! initBalls(balls, count, HALF_SIZE, 7) )
+        return 0;
+    addRandomBalls(balls, count, radius);
+    if (scaled)
+        for (i = 0; i < count; i++) {
+            balls->vx[i] *= radius / ORIGINAL_RADIUS;
+            balls->vy[i] *= radius / ORIGINAL_RADIUS;
+            balls->vz[i] *= radius / ORIGINAL_RADIUS;
+        }
+    return 1;
+}
+
+static int comparePairs(const void* a, const void* b) {
+    const int* p = a;
+    const int* q = b;
+    if (p[0] != q[0])
+        return p[0] < q[0] ? -1 : 1;
+    return p[1] < q[1] ? -1 : p[1] > q[1];
+}
+
+/*  Puts the smaller ball number of each pair first, and sorts the pairs.  */
+static void sortPairs(int* pairs, int count) {
+    int k;
+    for (k = 0; k < count; k++)
+        if (pairs[2*k] > pairs[2*k+1]) {
+            int t = pairs[2*k];
+            pairs[2*k] = pairs[2*k+1];
+            pairs[2*k+1] = t;
+        }
+    qsort(pairs, count, 2*sizeof(int), comparePairs);
+}
+
+/*  Checks findContacts() against comparing every ball with every other ball.  */
+static int checkContacts(BallSystem* balls) {
+    int count = findContacts(balls), bruteCount = 0, capacity = count + 16, a, b, same;
+    int* brute = malloc(capacity*2*sizeof(int));
+    int* found = malloc((count + 1)*2*sizeof(int));
+    for (a = 0; a < balls->count; a++)
+        for (b = a + 1; b < balls->count; b++) {
+            float dx = balls->x[b] - balls->x[a], dy = balls->y[b] - balls->y[a], dz = balls->z[b] - balls->z[a];
+            float touch = balls->radius[a] + balls->radius[b];
+            if (dx*dx + dy*dy + dz*dz < touch*touch) {
+                if (bruteCount == capacity) {
+                    capacity *= 2;
+                    brute = realloc(brute, capacity*2*sizeof(int));
+                }
+                brute[2*bruteCount] = a;
+                brute[2*bruteCount+1] = b;
+                bruteCount++;
+            }
+        }
+    memcpy(found, balls->contacts, count*2*sizeof(int));
+    sortPairs(found, count);
+    same = count == bruteCount && memcmp(found, brute, count*2*sizeof(int)) == 0;
+    free(brute);
+    free(found);
+    return same;
+}
+
+/*  A checksum of all of the positions and velocities, bit for bit.  */
+static unsigned long long checksum(const BallSystem* balls) {
+    const float* arrays[6] = { balls->x, balls->y, balls->z, balls->vx, balls->vy, balls->vz };
+    unsigned long long sum = 0;
+    int a, i;
+    for (a = 0; a < 6; a++)
+        for (i = 0; i < balls->count; i++) {
+            unsigned int bits;
+            memcpy(&bits, &arrays[a][i], sizeof(bits));
+            sum = sum * 1000003 + bits;
+        }
+    return sum;
+}
+
+typedef void (*Step)(BallSystem*, float);
+
+/*  Two small balls meet head on, each moving farther in one step than their
+    diameter.  Returns 1 if they bounced back.  */
+static int headOn(Step step) {
+    BallSystem balls;
+    int bounced;
+    initBalls(&balls, 2, HALF_SIZE, 1);
+    addBall(&balls, -1, 0, 0, 100, 0, 0, 0.1f);
+    addBall(&balls, 1, 0, 0, -100, 0, 0, 0.1f);
+    step(&balls, 1/60.0f);
+    bounced = balls.x[0] < balls.x[1] && balls.vx[0] < 0;
+    freeBalls(&balls);
+    return bounced;
+}
+
+/*  A ball moves one and a half times across the cube in each step.  Returns
+    1 if it is always inside the cube after a step.  */
+static int staysInside(Step step) {
+    BallSystem balls;
+    float limit = HALF_SIZE - 0.5f;
+    int inside = 1, k;
+    initBalls(&balls, 1, HALF_SIZE, 1);
+    addBall(&balls, 0, 0, 0, 300, 0, 0, 0.5f);
+    for (k = 0; k < 10; k++) {
+        step(&balls, 0.1f);
+        if (fabsf(balls.x[0]) > limit)
+            inside = 0;
+    }
+    freeBalls(&balls);
+    return inside;
+}
+
+/*  Times both kinds of steps for a thousand up to maxCount balls, and
+    returns the largest count that fit in memory.  */
+static int compareSteps(int maxCount, int steps, int scaled) {
+    int count, step, lastCount = 0;
+    for (count = 1000; count <= maxCount; count *= 10) {
+        BallSystem discrete, balls;
+        double energy, start, discreteTime, continuousTime;
+        long long hits = 0;
+        const char* check = "-";
+        if ( ! setUp(&discrete, count, scaled) || ! setUp(&balls, count, scaled) ) {
+            printf("%8s %10d  not enough memory\n", "", count);
+            break;
+        }
+        if (count <= BRUTE_FORCE_LIMIT)
+            check = checkContacts(&balls) ? "same" : "DIFFERENT";
+        start = now();
+        for (step = 0; step < steps; step++)
+            stepBallsDiscrete(&discrete, 1/60.0f);
+        discreteTime = (now() - start) * 1000 / steps;
+        energy = kineticEnergy(&balls);
+        start = now();
+        for (step = 0; step < steps; step++) {
+            stepBalls(&balls, 1/60.0f);
+            hits += balls.hitCount;
+        }
+        continuousTime = (now() - start) * 1000 / steps;
+        if (count <= BRUTE_FORCE_LIMIT && ! checkContacts(&balls))
+            check = "DIFFERENT";
+        printf("%8s %10d %8.4f %12.3f %13.3f %7.2fx %10.1f %12.8f %s\n", scaled ? "scaled" : "original", count,
+               balls.radius[0], discreteTime, continuousTime, continuousTime / discreteTime, (double)hits / steps,
+               kineticEnergy(&balls) / energy, check);
+        freeBalls(&discrete);
+        freeBalls(&balls);
+        lastCount = count;
+    }
+    return lastCount;
+}
+
+int main(int argc, char** argv) {
+    int maxCount = argc > 1 ? atoi(argv[1]) : 1000000;
+    int steps = argc > 2 ? atoi(argv[2]) : 60;
+    int cores = (int)sysconf(_SC_NPROCESSORS_ONLN);
+    int step, threads, lastCount;
+    double baseTime = 0;
+    unsigned long long baseSum = 0;
+
+    jobsInit(0);
+    printf("%8s %10s %8s %12s %12s %8s %10s %12s %s\n", "speeds", "balls", "radius", "discrete ms", "continuous ms",
+           "ratio", "hits/step", "energy", "check");
+    lastCount = compareSteps(maxCount, steps, 0);
+    compareSteps(maxCount, steps, 1);
+
+    printf("\nTwo balls of radius 0.1 meeting head on at 100 units per second:\n");
+    printf("    discrete:   %s\n", headOn(stepBallsDiscrete) ? "bounced" : "PASSED THROUGH");
+    printf("    continuous: %s\n", headOn(stepBalls) ? "bounced" : "PASSED THROUGH");
+    printf("A ball at 300 units per second with 1/10 second steps:\n");
+    printf("    discrete:   %s\n", staysInside(stepBallsDiscrete) ? "stayed in the cube" : "LEFT THE CUBE");
+    printf("    continuous: %s\n", staysInside(stepBalls) ? "stayed in the cube" : "LEFT THE CUBE");
+
+    printf("\n%d balls, %d cores\n", lastCount, cores);
+    printf("%8s %12s %8s %s\n", "threads", "ms/step", "speedup", "check");
+    for (threads = 1; threads <= cores || threads == 1; threads *= 2) {
+        BallSystem balls;
+        unsigned long long sum;
+        double start, elapsed;
+        jobsInit(threads);
+        if ( ! setUp(&balls, lastCount, 0) )
+            break;
+        start = now();
+        for (step = 0; step < steps; step++)
+            stepBalls(&balls, 1/60.0f);
+        elapsed = (now() - start) * 1000 / steps;
+        sum = checksum(&balls);
+        if (threads == 1) {
+            baseTime = elapsed;
+            baseSum = sum;
+        }
+        printf("%8d %12.3f %7.2fx %s\n", threads, elapsed, baseTime / elapsed, sum == baseSum ? "same" : "DIFFERENT");
+        freeBalls(&balls);
+    }
+    jobsShutdown();
+    return 0;
+}
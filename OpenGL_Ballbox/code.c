@@ -0,0 +1,356 @@
+/*
+ * This program shows an animation of randomly colored balls bouncing around
+ * inside a cube, which is shown as a transparent box.  It is the native
+ * version of Three.js_Ballbox/code.html, except that the balls also bounce
+ * off each other: they are simulated by balls.c, on all of the cores, with
+ * OpenGL_Stage/jobs.c.  They are drawn by spheres.c with one instanced draw
+ * call, from the simulation's own arrays, so the program can show a million
+ * balls.  As in the original, the balls reflect the Coliseum cube map; it
+ * is loaded by OpenGL_Stage/texture.c in the background, and the balls are
+ * drawn without it until it is ready.
+ *
+ *      CONTROLS
+ *      ~ Mouse drag: Rotates the view
+ *      ~ Mouse click on a ball: Splits the ball into two white balls of half the size
+ *      ~ I: Toggle between sphere meshes and ray-cast impostors
+ *      ~ C: Toggle between continuous and discrete collision detection
+ *
+ * Run with -count N for N balls instead of BALL_COUNT; when there are so
+ * many that they would fill more than a tenth of the cube, they are made
+ * smaller.  With more than IMPOSTOR_COUNT balls, the program starts out
+ * drawing impostors; -mesh or -impostors picks the way at the start.  The
+ * -uncapped and -stats options are those of OpenGL_Stage/frameloop.c; the
+ * statistics include the time for the simulation step and for the upload.
+ * Compile this program with:
+ *
+ *        gcc -O2 -o code code.c balls.c spheres.c ../OpenGL_Stage/polyhedron.c ../OpenGL_Stage/mesh.c \
+ *            ../OpenGL_Stage/meshopt.c ../OpenGL_Stage/geodesic.c ../OpenGL_Stage/meshbuffer.c \
+ *            ../OpenGL_Stage/shader.c ../OpenGL_Stage/mat4.c ../OpenGL_Stage/frameloop.c \
+ *            ../OpenGL_Stage/jobs.c ../OpenGL_Stage/texture.c -lGL -lglut -ljpeg -lm -pthread
+ */
+
+#include "../OpenGL_Stage/shader.h"  // Includes <GL/gl.h>, with the functions needed for shaders.
+#include <GL/freeglut.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <math.h>
+#include "../OpenGL_Stage/polyhedron.h"
+#include "../OpenGL_Stage/mat4.h"
+#include "../OpenGL_Stage/frameloop.h"
+#include "../OpenGL_Stage/jobs.h"
+#include "../OpenGL_Stage/texture.h"
+#include "balls.h"
+#include "spheres.h"
+
+#define BALL_COUNT 15        // number of balls at the start
+#define BALL_RADIUS 1.5f     // their radius; the cube is 20 units on a side
+#define HALF_SIZE 10
+#define FILL 0.1             // the largest fraction of the cube that the balls at the start take up
+#define SPLIT_ROOM 1024      // room in the arrays for balls made by splitting
+#define MIN_SPLIT_RADIUS 0.05f
+#define IMPOSTOR_COUNT 20000
+#define UPDATES_PER_SECOND 60
+
+int width = 800, height = 600;  // size of the window
+
+BallSystem balls;
+SphereRenderer spheres;
+int sphereMode = SPHERES_MESH;
+int continuous = 1;          // Are hits found with continuous collision detection, rather than discretely?
+
+float rotation[16];          // the rotation of the view, which the mouse changes
+float viewDistance;          // the distance from the eye to the center of the cube
+float projection[16];
+
+// The faces of the cube map that the balls reflect, in the order that loadCubeMap() wants.
+const char* environmentPaths[6] = {
+    "../Three.js_Ballbox/Coliseum/posx.jpg", "../Three.js_Ballbox/Coliseum/negx.jpg",
+    "../Three.js_Ballbox/Coliseum/posy.jpg", "../Three.js_Ballbox/Coliseum/negy.jpg",
+    "../Three.js_Ballbox/Coliseum/posz.jpg", "../Three.js_Ballbox/Coliseum/negz.jpg",
+};
+Texture* environment;  // loaded in the background; started by initGL()
+
+double stepMilliseconds, uploadMilliseconds;
+
+static double now() {
+    struct timespec t;
+    clock_gettime(CLOCK_MONOTONIC, &t);
+    return t.tv_sec + t.tv_nsec * 1e-9;
+}
+
+/* Computes the viewing transform: the rotation, then the eye is moved back from the cube. */
+void getView(float* view) {
+    float translation[16];
+    mat4Translation(translation, 0, 0, -viewDistance);
+    mat4Multiply(view, translation, rotation);
+}
+
+/**
+ * Draws the transparent cube and its edges.  As in the original, the faces are
+ * white with an opacity of 0.3, lit by the light at the eye.  The back faces
+ * are drawn before the front faces, so that they blend in the right order, and
+ * the faces do not write depths, so they never hide a ball.
+ */
+void drawCube() {
+    float white[4] = { 1, 1, 1, 0.3f };
+    glEnable(GL_LIGHTING);
+    glMaterialfv(GL_FRONT_AND_BACK, GL_AMBIENT_AND_DIFFUSE, white);
+    glEnable(GL_BLEND);
+    glDepthMask(GL_FALSE);
+    glEnable(GL_POLYGON_OFFSET_FILL);  // keeps the edges visible
+    glEnable(GL_CULL_FACE);
+    glCullFace(GL_FRONT);
+    glutSolidCube(2*HALF_SIZE);
+    glCullFace(GL_BACK);
+    glutSolidCube(2*HALF_SIZE);
+    glDisable(GL_CULL_FACE);
+    glDisable(GL_POLYGON_OFFSET_FILL);
+    glDepthMask(GL_TRUE);
+    glDisable(GL_BLEND);
+    glDisable(GL_LIGHTING);
+    glColor3f(1, 1, 1);
+    glutWireCube(2*HALF_SIZE);
+}
+
+void display() {
+    float view[16];
+    double start = now();
+    glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+    uploadSpheres(&spheres, balls.x, balls.y, balls.z, balls.radius, balls.color, balls.count);
+    uploadMilliseconds = (now() - start) * 1000;
+    getView(view);
+    glLoadMatrixf(view);
+    updateTextures(TEXTURE_UPLOAD_BYTES);
+    markTextureUsed(environment);
+    setSphereEnvironment(&spheres, environment->state == TEXTURE_READY ? environment->name : 0, view);
+    drawSpheres(&spheres, sphereMode);
+    drawCube();
+    glutSwapBuffers();
+    frameLoopEndFrame();
+}
+
+/**
+ * Called by the frame loop UPDATES_PER_SECOND times per second.  Moves the
+ * balls, bouncing them off the walls and off each other.
+ */
+void update(double dt) {
+    double start = now();
+    if (continuous)
+        stepBalls(&balls, (float)dt);
+    else
+        stepBallsDiscrete(&balls, (float)dt);
+    stepMilliseconds = (now() - start) * 1000;
+}
+
+/**
+ * Finds the ball under the mouse, by intersecting the ray through the mouse
+ * position with every ball, as a Raycaster does.  Returns its number, or -1
+ * if the ray misses all of the balls, and puts the point where the ray hits
+ * the ball in hit.
+ */
+int pickBall(int x, int y, float* hit) {
+    float view[16], viewProjection[16], inverse[16], nearPoint[3], farPoint[3], direction[3];
+    float ndc[3], length, nearest = INFINITY;
+    int i, picked = -1;
+    getView(view);
+    mat4Multiply(viewProjection, projection, view);
+    if ( ! mat4Invert(inverse, viewProjection) )
+        return -1;
+    ndc[0] = 2.0f * x / width - 1;
+    ndc[1] = 1 - 2.0f * y / height;
+    ndc[2] = -1;
+    mat4TransformPoint(inverse, ndc, nearPoint);
+    ndc[2] = 1;
+    mat4TransformPoint(inverse, ndc, farPoint);
+    for (i = 0; i < 3; i++)
+        direction[i] = farPoint[i] - nearPoint[i];
+    length = sqrtf(direction[0]*direction[0] + direction[1]*direction[1] + direction[2]*direction[2]);
+    for (i = 0; i < 3; i++)
+        direction[i] /= length;
+    for (i = 0; i < balls.count; i++) {
+        float dx = balls.x[i] - nearPoint[0], dy = balls.y[i] - nearPoint[1], dz = balls.z[i] - nearPoint[2];
+        float b = dx*direction[0] + dy*direction[1] + dz*direction[2];
+        float discriminant = b*b - (dx*dx + dy*dy + dz*dz) + balls.radius[i]*balls.radius[i];
+        float t;
+        if (discriminant < 0)
+            continue;
+        t = b - sqrtf(discriminant);
+        if (t > 0 && t < nearest) {
+            nearest = t;
+            picked = i;
+        }
+    }
+    if (picked >= 0)
+        for (i = 0; i < 3; i++)
+            hit[i] = nearPoint[i] + nearest * direction[i];
+    return picked;
+}
+
+/**
+ * Replaces the ball under the mouse, if there is one, by two white balls of
+ * half its radius, starting from the point where the mouse ray hit it and
+ * flying off in random directions.  The new balls are moved inside the cube
+ * if the point is too close to a wall.
+ */
+void splitBall(int x, int y) {
+    float hit[3], radius, limit;
+    int ball = pickBall(x, y, hit), i, k;
+    if (ball < 0 || balls.radius[ball] < MIN_SPLIT_RADIUS)
+        return;
+    radius = balls.radius[ball] / 2;
+    limit = HALF_SIZE - radius;
+    for (k = 0; k < 3; k++)
+        hit[k] = hit[k] > limit ? limit : hit[k] < -limit ? -limit : hit[k];
+    removeBall(&balls, ball);
+    for (k = 0; k < 2; k++) {
+        i = addBall(&balls, hit[0], hit[1], hit[2], 0, 0, 0, radius);
+        if (i >= 0)
+            randomizeVelocity(&balls, i);
+    }
+    glutPostRedisplay();
+}
+
+/* Called when the user hits a key */
+void doKeyboard(unsigned char key, int x, int y) {
+    // i key pressed - toggles meshes and impostors
+    if (key == 'i' || key == 'I') {
+        sphereMode = sphereMode == SPHERES_MESH ? SPHERES_IMPOSTORS : SPHERES_MESH;
+        printf("Drawing %s.\n", sphereMode == SPHERES_MESH ? "sphere meshes" : "impostors");
+    }
+    // c key pressed - toggles continuous and discrete collision detection
+    else if (key == 'c' || key == 'C') {
+        continuous = !continuous;
+        printf("%s collision detection.\n", continuous ? "Continuous" : "Discrete");
+    }
+}
+
+/**
+ * Responds to the left mouse button.  Dragging rotates the view about the
+ * axes of the screen, like TrackballControls; a click that does not move the
+ * mouse splits the ball under it.
+ */
+int dragging = 0, moved = 0;
+int prevX, prevY;  // previous mouse position during a drag
+
+void doMouse(int button, int state, int x, int y) {
+    if (button != GLUT_LEFT_BUTTON)
+        return;  // only respond to left mouse button
+    if (state == GLUT_DOWN) {
+        dragging = 1;
+        moved = 0;
+        prevX = x;
+        prevY = y;
+    }
+    else if (dragging) {
+        dragging = 0;
+        if ( ! moved )
+            splitBall(x, y);
+    }
+}
+
+void doMotion(int x, int y) {
+    float turn[16];
+    int dx = x - prevX, dy = y - prevY;
+    if ( ! dragging || (abs(dx) + abs(dy) < 3 && ! moved) )
+        return;
+    moved = 1;
+    // Turn about the axis, in view coordinates, perpendicular to the motion of the mouse.
+    mat4Rotation(turn, sqrtf(dx*dx + dy*dy) * 0.4f, dy, dx, 0);
+    mat4Multiply(rotation, turn, rotation);
+    prevX = x;
+    prevY = y;
+}
+
+/**
+ * When the window is resized, we need to reset the OpenGL viewport and the
+ * projection to match the size.
+ */
+void doResize(int w, int h) {
+    width = w;
+    height = h > 0 ? h : 1;
+    glViewport(0, 0, width, height);
+    mat4Perspective(projection, 30, (float)width / height, 0.1f, 500);
+    glMatrixMode(GL_PROJECTION);
+    glLoadMatrixf(projection);
+    glMatrixMode(GL_MODELVIEW);
+}
+
+/* Initialize the OpenGL context.  Called from main() */
+int initGL() {
+    float ambient[4] = { 0.063f, 0.063f, 0.063f, 1 };  // 0x101010, as in the original
+    float lightDirection[4] = { 0, 0, 1, 0 };          // a light shining from the eye
+    float lookAt[16];
+    createPolyhedra();
+    // A coarser mesh is plenty when the balls are small.
+    if ( ! initSphereRenderer(&spheres, balls.count > 1000 ? 2 : 3) )
+        return 0;
+    texturesInit();
+    environment = loadCubeMap(environmentPaths);
+    glClearColor(0, 0, 0, 1);
+    glEnable(GL_DEPTH_TEST);
+    glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
+    glPolygonOffset(1, 1);
+    glLightModelfv(GL_LIGHT_MODEL_AMBIENT, ambient);
+    glMatrixMode(GL_MODELVIEW);
+    glLoadIdentity();
+    glLightfv(GL_LIGHT0, GL_POSITION, lightDirection);  // in view coordinates, since the modelview is the identity
+    glEnable(GL_LIGHT0);
+    glEnable(GL_NORMALIZE);
+
+    // The camera starts at (25,40,50), looking at the center of the cube.
+    mat4LookAt(lookAt, 25, 40, 50, 0, 0, 0, 0, 1, 0);
+    memcpy(rotation, lookAt, sizeof(rotation));
+    rotation[12] = rotation[13] = rotation[14] = 0;
+    viewDistance = sqrtf(25*25 + 40*40 + 50*50);
+    return 1;
+}
+
+int main(int argc, char** argv) {
+    double maxFramesPerSecond = 60;
+    int showStats = 0, count = BALL_COUNT, mode = -1, i;
+    float radius;
+    glutInit(&argc, argv);
+    frameLoopParseArgs(argc, argv, &maxFramesPerSecond, &showStats);
+    for (i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "-count") == 0 && i < argc - 1)
+            count = atoi(argv[i+1]);
+        else if (strcmp(argv[i], "-mesh") == 0)
+            mode = SPHERES_MESH;
+        else if (strcmp(argv[i], "-impostors") == 0)
+            mode = SPHERES_IMPOSTORS;
+    }
+    if (count < 1)
+        count = 1;
+    if (mode >= 0)
+        sphereMode = mode;
+    else if (count > IMPOSTOR_COUNT)
+        sphereMode = SPHERES_IMPOSTORS;
+    radius = (float)cbrt(FILL * 8*HALF_SIZE*HALF_SIZE*HALF_SIZE / (count * 4 * M_PI / 3));
+    if (radius > BALL_RADIUS)
+        radius = BALL_RADIUS;
+    if ( ! initBalls(&balls, count + SPLIT_ROOM, HALF_SIZE, (unsigned int)time(NULL)) ) {
+        printf("Not enough memory for %d balls.\n", count);
+        return 1;
+    }
+    addRandomBalls(&balls, count, radius);
+    jobsInit(0);
+    glutInitDisplayMode(GLUT_DOUBLE | GLUT_DEPTH);
+    glutInitWindowSize(width, height);
+    glutCreateWindow("Ballbox");
+    if ( ! initGL() ) {
+        printf("This program needs OpenGL 3.3.\n");
+        return 1;
+    }
+    glutDisplayFunc(display);
+    glutReshapeFunc(doResize);
+    glutKeyboardFunc(doKeyboard);
+    glutMouseFunc(doMouse);
+    glutMotionFunc(doMotion);
+    frameLoopAddCounter("step", &stepMilliseconds);
+    frameLoopAddCounter("upload", &uploadMilliseconds);
+    frameLoopStart(UPDATES_PER_SECOND, update, maxFramesPerSecond, showStats);
+    glutMainLoop();
+    return 0;
+}
@@ -0,0 +1,237 @@
+#include <stdio.h>
+#include <string.h>
+#include "spheres.h"
+#include "../OpenGL_Stage/geodesic.h"
+#include "../OpenGL_Stage/meshopt.h"
+#include "../OpenGL_Stage/mat4.h"
+
+/*  The lighting, shared by both fragment shaders: a light at the eye, which
+    is at the origin of view coordinates, and the ambient light, 0x101010,
+    of the original program.  With an environment map, the lit color is
+    multiplied by the reflected environment, which is how a three.js
+    MeshLambertMaterial combines its color with its envMap.  */
+#define SHADE_FUNCTION \
+    "uniform bool u_hasEnvironment;\n" \
+    "uniform samplerCube u_environmentMap;\n" \
+    "uniform mat3 u_environmentRotation;  // from view directions to world directions\n" \
+    "vec4 shade(vec3 position, vec3 normal, vec4 color) {\n" \
+    "    vec3 V = normalize(-position);\n" \
+    "    vec3 lit = color.rgb * (0.063 + max(dot(normal, V), 0.0));\n" \
+    "    if (u_hasEnvironment) {\n" \
+    "        vec3 R = u_environmentRotation * reflect(-V, normal);\n" \
+    "        lit *= texture(u_environmentMap, vec3(-R.x, R.y, R.z)).rgb;\n" \
+    "    }\n" \
+    "    return vec4(lit, color.a);\n" \
+    "}\n"
+
+#define INSTANCE_ATTRIBUTES \
+    "in float a_x;  // the center and radius of the sphere, one of each per instance\n" \
+    "in float a_y;\n" \
+    "in float a_z;\n" \
+    "in float a_radius;\n" \
+    "in vec4 a_color;\n"
+
+static const char* meshVertexShaderSource =
+    "#version 150 compatibility\n"
+    INSTANCE_ATTRIBUTES
+    "out vec3 v_position;\n"
+    "out vec3 v_normal;\n"
+    "flat out vec4 v_color;\n"
+    "void main() {\n"
+    "    // The mesh is a sphere of radius 1 at the origin, so a vertex is also its normal.\n"
+    "    vec4 position = vec4(vec3(a_x, a_y, a_z) + a_radius * gl_Vertex.xyz, 1.0);\n"
+    "    vec4 eyePosition = gl_ModelViewMatrix * position;\n"
+    "    v_position = eyePosition.xyz;\n"
+    "    v_normal = gl_NormalMatrix * gl_Vertex.xyz;\n"
+    "    v_color = a_color;\n"
+    "    gl_Position = gl_ProjectionMatrix * eyePosition;\n"
+    "}\n";
+
+static const char* meshFragmentShaderSource =
+    "#version 150 compatibility\n"
+    "in vec3 v_position;\n"
+    "in vec3 v_normal;\n"
+    "flat in vec4 v_color;\n"
+    SHADE_FUNCTION
+    "void main() {\n"
+    "    gl_FragColor = shade(v_position, normalize(v_normal), v_color);\n"
+    "}\n";
+
+static const char* impostorVertexShaderSource =
+    "#version 150 compatibility\n"
+    INSTANCE_ATTRIBUTES
+    "out vec3 v_position;   // the point on the square, in view coordinates\n"
+    "flat out vec3 v_center;\n"
+    "flat out float v_radius;\n"
+    "flat out vec4 v_color;\n"
+    "void main() {\n"
+    "    vec3 center = (gl_ModelViewMatrix * vec4(a_x, a_y, a_z, 1.0)).xyz;\n"
+    "    float distanceSquared = dot(center, center);\n"
+    "    float radiusSquared = a_radius * a_radius;\n"
+    "    v_center = center;\n"
+    "    v_radius = a_radius;\n"
+    "    v_color = a_color;\n"
+    "    if (distanceSquared <= radiusSquared) {\n"
+    "        gl_Position = vec4(0.0, 0.0, 2.0, 1.0);  // the eye is inside the sphere; draw nothing\n"
+    "        return;\n"
+    "    }\n"
+    "    // The square goes through the center, facing the eye.  The lines from the\n"
+    "    // eye that touch the sphere make a cone, which cuts that plane in a circle\n"
+    "    // of radius r*d/sqrt(d*d - r*r), where d is the distance to the center.\n"
+    "    vec3 back = center / sqrt(distanceSquared);\n"
+    "    vec3 right = normalize(abs(back.y) < 0.99 ? cross(back, vec3(0.0, 1.0, 0.0)) : vec3(1.0, 0.0, 0.0));\n"
+    "    vec3 up = cross(right, back);\n"
+    "    float size = a_radius * sqrt(distanceSquared / (distanceSquared - radiusSquared));\n"
+    "    v_position = center + size * (gl_Vertex.x * right + gl_Vertex.y * up);\n"
+    "    gl_Position = gl_ProjectionMatrix * vec4(v_position, 1.0);\n"
+    "}\n";
+
+static const char* impostorFragmentShaderSource =
+    "#version 150 compatibility\n"
+    "#extension GL_ARB_conservative_depth : enable\n"
+    "#ifdef GL_ARB_conservative_depth\n"
+    "// The visible part of a sphere is in front of the square, so the depth only\n"
+    "// gets smaller, and the depth test can still be done before the shader runs.\n"
+    "layout(depth_less) out float gl_FragDepth;\n"
+    "#endif\n"
+    "in vec3 v_position;\n"
+    "flat in vec3 v_center;\n"
+    "flat in float v_radius;\n"
+    "flat in vec4 v_color;\n"
+    SHADE_FUNCTION
+    "void main() {\n"
+    "    // Solve |t*ray - center| = radius for the nearest t.\n"
+    "    vec3 ray = normalize(v_position);\n"
+    "    float b = dot(ray, v_center);\n"
+    "    float discriminant = b*b - (dot(v_center, v_center) - v_radius*v_radius);\n"
+    "    if (discriminant < 0.0)\n"
+    "        discard;\n"
+    "    vec3 hit = ray * (b - sqrt(discriminant));\n"
+    "    vec4 clip = gl_ProjectionMatrix * vec4(hit, 1.0);\n"
+    "    gl_FragDepth = 0.5 * (gl_DepthRange.diff * clip.z / clip.w + gl_DepthRange.near + gl_DepthRange.far);\n"
+    "    gl_FragColor = shade(hit, (hit - v_center) / v_radius, v_color);\n"
+    "}\n";
+
+static const char* attributeNames[5] = { "a_x", "a_y", "a_z", "a_radius", "a_color" };
+
+static int createSphereProgram(SphereRenderer* spheres, int mode, const char* name,
+                               const char* vertexSource, const char* fragmentSource) {
+    int i;
+    spheres->programs[mode] = createProgram(name, vertexSource, fragmentSource);
+    if ( ! spheres->programs[mode] )
+        return 0;
+    for (i = 0; i < 5; i++)
+        spheres->locations[mode][i] = glGetAttribLocation(spheres->programs[mode], attributeNames[i]);
+    spheres->hasEnvironmentLocations[mode] = glGetUniformLocation(spheres->programs[mode], "u_hasEnvironment");
+    spheres->environmentRotationLocations[mode] = glGetUniformLocation(spheres->programs[mode],
+                                                                       "u_environmentRotation");
+    glUseProgram(spheres->programs[mode]);
+    glUniform1i(glGetUniformLocation(spheres->programs[mode], "u_environmentMap"), 1);
+    glUseProgram(0);
+    return 1;
+}
+
+int initSphereRenderer(SphereRenderer* spheres, int meshLevels) {
+    static const float corners[8] = { -1, -1,  1, -1,  -1, 1,  1, 1 };  // a triangle strip
+    Polyhedron sphere;
+    TriMesh mesh;
+    memset(spheres, 0, sizeof(SphereRenderer));
+    if ( ! hasGLVersion(3, 3) ) {
+        printf("Instanced spheres need OpenGL 3.3.\n");
+        return 0;
+    }
+    if ( ! createSphereProgram(spheres, SPHERES_MESH, "sphere meshes",
+                               meshVertexShaderSource, meshFragmentShaderSource)
+            || ! createSphereProgram(spheres, SPHERES_IMPOSTORS, "sphere impostors",
+                                     impostorVertexShaderSource, impostorFragmentShaderSource) ) {
+        freeSphereRenderer(spheres);
+        return 0;
+    }
+
+    sphere = createGeodesicSphere(meshLevels);
+    mesh = compilePolyhedronSmooth(sphere);
+    optimizeMesh(&mesh, 1e-6f);
+    uploadTriMesh(&spheres->mesh, &mesh);
+    freeTriMesh(&mesh);
+    freePolyhedron(&sphere);
+
+    glGenBuffers(1, &spheres->cornerBuffer);
+    glBindBuffer(GL_ARRAY_BUFFER, spheres->cornerBuffer);
+    glBufferData(GL_ARRAY_BUFFER, sizeof(corners), corners, GL_STATIC_DRAW);
+    glGenBuffers(1, &spheres->instanceBuffer);
+    glBindBuffer(GL_ARRAY_BUFFER, 0);
+    return 1;
+}
+
+void freeSphereRenderer(SphereRenderer* spheres) {
+    glDeleteProgram(spheres->programs[SPHERES_MESH]);
+    glDeleteProgram(spheres->programs[SPHERES_IMPOSTORS]);
+    freeMeshBuffer(&spheres->mesh);
+    glDeleteBuffers(1, &spheres->cornerBuffer);
+    glDeleteBuffers(1, &spheres->instanceBuffer);
+    memset(spheres, 0, sizeof(SphereRenderer));
+}
+
+void setSphereEnvironment(SphereRenderer* spheres, GLuint environmentMap, const float* viewMatrix) {
+    spheres->environmentMap = environmentMap;
+    if (environmentMap)
+        mat4ViewToWorldRotation(spheres->environmentRotation, viewMatrix);
+}
+
+void uploadSpheres(SphereRenderer* spheres, const float* x, const float* y, const float* z,
+                   const float* radius, const unsigned char* color, int count) {
+    GLsizeiptr arrayBytes = (GLsizeiptr)count * sizeof(float);
+    glBindBuffer(GL_ARRAY_BUFFER, spheres->instanceBuffer);
+    if (count > spheres->instanceCapacity)
+        spheres->instanceCapacity = count + count/2;
+    // Orphan the previous frame's spheres instead of waiting for the GPU to finish with them.
+    glBufferData(GL_ARRAY_BUFFER, (GLsizeiptr)spheres->instanceCapacity * 5 * sizeof(float), NULL, GL_STREAM_DRAW);
+    glBufferSubData(GL_ARRAY_BUFFER, 0, arrayBytes, x);
+    glBufferSubData(GL_ARRAY_BUFFER, arrayBytes, arrayBytes, y);
+    glBufferSubData(GL_ARRAY_BUFFER, 2*arrayBytes, arrayBytes, z);
+    glBufferSubData(GL_ARRAY_BUFFER, 3*arrayBytes, arrayBytes, radius);
+    glBufferSubData(GL_ARRAY_BUFFER, 4*arrayBytes, arrayBytes, color);  // 4 bytes per sphere, like a float
+    glBindBuffer(GL_ARRAY_BUFFER, 0);
+    spheres->count = count;
+}
+
+void drawSpheres(SphereRenderer* spheres, int mode) {
+    const GLint* locations = spheres->locations[mode];
+    size_t arrayBytes = (size_t)spheres->count * sizeof(float);
+    int i;
+    if (spheres->count == 0)
+        return;
+    glUseProgram(spheres->programs[mode]);
+    glUniform1i(spheres->hasEnvironmentLocations[mode], spheres->environmentMap != 0);
+    glUniformMatrix3fv(spheres->environmentRotationLocations[mode], 1, GL_FALSE, spheres->environmentRotation);
+    glActiveTexture(GL_TEXTURE1);
+    glBindTexture(GL_TEXTURE_CUBE_MAP, spheres->environmentMap);
+    glActiveTexture(GL_TEXTURE0);
+    if (mode == SPHERES_MESH)
+        bindMeshBufferPositions(&spheres->mesh);
+    else {
+        glBindBuffer(GL_ARRAY_BUFFER, spheres->cornerBuffer);
+        glVertexPointer(2, GL_FLOAT, 0, 0);
+        glEnableClientState(GL_VERTEX_ARRAY);
+    }
+    // Each array of the simulation is one attribute, advancing once per instance.
+    glBindBuffer(GL_ARRAY_BUFFER, spheres->instanceBuffer);
+    for (i = 0; i < 5; i++) {
+        if (i < 4)
+            glVertexAttribPointer(locations[i], 1, GL_FLOAT, GL_FALSE, 0, (const char*)NULL + i*arrayBytes);
+        else
+            glVertexAttribPointer(locations[i], 4, GL_UNSIGNED_BYTE, GL_TRUE, 0, (const char*)NULL + i*arrayBytes);
+        glVertexAttribDivisor(locations[i], 1);
+        glEnableVertexAttribArray(locations[i]);
+    }
+    if (mode == SPHERES_MESH)
+        glDrawElementsInstanced(GL_TRIANGLES, spheres->mesh.indexCount, GL_UNSIGNED_INT, 0, spheres->count);
+    else
+        glDrawArraysInstanced(GL_TRIANGLE_STRIP, 0, 4, spheres->count);
+    for (i = 0; i < 5; i++) {
+        glDisableVertexAttribArray(locations[i]);
+        glVertexAttribDivisor(locations[i], 0);
+    }
+    unbindMeshBuffer();
+    glUseProgram(0);
+}
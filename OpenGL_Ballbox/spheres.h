@@ -0,0 +1,80 @@
+/*  Header file for spheres.c, which draws any number of spheres with a
+    single instanced draw call.
+
+    Three.js_Ballbox/code.html makes a THREE.Mesh and a material for every
+    ball, so each ball costs a draw call and its own state changes.  Here the
+    spheres are instances: the centers, radii and colors are copied, as they
+    are, from the arrays of the simulation into one buffer, and each array
+    is a per-instance vertex attribute.  Nothing per sphere is done on the
+    CPU, apart from that copy.
+
+    There are two ways to draw the instances:
+
+        SPHERES_MESH draws a geodesic sphere from OpenGL_Stage/geodesic.c
+        for each instance.  It looks the same as a sphere mesh drawn on its
+        own, but a fine mesh is a lot of triangles when there are many
+        spheres, and small spheres turn into triangles of a pixel or less.
+
+        SPHERES_IMPOSTORS draws a square for each instance, facing the eye
+        and just large enough to cover the sphere.  The fragment shader
+        finds where the ray through each pixel hits the sphere, discards the
+        pixels that miss, and writes the depth of the hit point, so the
+        spheres are perfectly round at any size and intersect each other
+        correctly.  That is four vertices per sphere, which makes scenes of a
+        million spheres possible.
+
+    Both are lit per pixel by a light at the eye, with the ambient light of
+    the original program, and can reflect an environment map, as the balls
+    of the original do.  The impostors assume a perspective projection,
+    and both assume that the modelview matrix does not scale.
+
+    Requires OpenGL 3.3 (for instanced attributes).  */
+
+#ifndef SPHERES_H
+#define SPHERES_H
+
+#include "../OpenGL_Stage/meshbuffer.h"
+
+#define SPHERES_MESH 0
+#define SPHERES_IMPOSTORS 1
+
+//  The shaders, meshes and instance buffer for drawing spheres.
+typedef struct SphereRenderer {
+    GLuint programs[2];     // one for each way of drawing, indexed by SPHERES_MESH or SPHERES_IMPOSTORS
+    GLint locations[2][5];  // the attribute locations of x, y, z, radius and color in each program
+    MeshBuffer mesh;        // a geodesic sphere of radius 1
+    GLuint cornerBuffer;    // the corners of an impostor's square
+    GLuint instanceBuffer;  // all of the x, then y, z and radius, as floats, then the colors
+    int instanceCapacity;
+    int count;              // the number of spheres uploaded
+    GLuint environmentMap;  // a cube map, bound to texture unit 1 for drawing, or 0 for none
+    float environmentRotation[9];
+    GLint hasEnvironmentLocations[2], environmentRotationLocations[2];
+} SphereRenderer;
+
+/*  Compiles the shaders and makes the sphere mesh, a geodesic sphere with
+    20*4^meshLevels triangles.  Returns 0, after printing a message, if the
+    OpenGL version is too old or something fails.  createPolyhedra() must
+    have been called.  */
+int initSphereRenderer(SphereRenderer* spheres, int meshLevels);
+
+//  Deletes the shaders and buffers.
+void freeSphereRenderer(SphereRenderer* spheres);
+
+/*  Copies the centers, radii and colors of count spheres into the instance
+    buffer.  color holds red, green, blue and alpha bytes, 4 per sphere.  The
+    arrays can be those of a BallSystem from balls.c.  */
+void uploadSpheres(SphereRenderer* spheres, const float* x, const float* y, const float* z,
+                   const float* radius, const unsigned char* color, int count);
+
+/*  Sets the cube map that the spheres reflect, such as one loaded with
+    loadCubeMap() from OpenGL_Stage/texture.c, or turns reflections off if
+    environmentMap is 0.  viewMatrix is the viewing transform for the frame;
+    the map is looked up with directions in world coordinates.  */
+void setSphereEnvironment(SphereRenderer* spheres, GLuint environmentMap, const float* viewMatrix);
+
+/*  Draws the uploaded spheres, with the current modelview and projection
+    matrices, in the given way.  No shader is current afterwards.  */
+void drawSpheres(SphereRenderer* spheres, int mode);
+
+#endif
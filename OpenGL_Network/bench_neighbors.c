@@ -0,0 +1,118 @@
+/**
+ * A benchmark for neighbors.c.  For 10 thousand up to a million points,
+ * scattered over a 1000 by 800 area, it times findNeighborPairs() with a
+ * distance that gives each point about NEIGHBORS neighbors on average.  Up
+ * to 20000 points, it also checks the pairs against the simple method that
+ * compares every point with every other one, and times that.  Usage:
+ *
+ *        bench_neighbors [maxCount [threads]]
+ *
+ * threads is the number of threads for jobs.c; the default is one per
+ * core.  Compile with
+ *
+ *        gcc -O2 -o bench_neighbors bench_neighbors.c neighbors.c particles.c ../OpenGL_Stage/jobs.c -lm -pthread
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <time.h>
+#include "neighbors.h"
+#include "../OpenGL_Stage/jobs.h"
+
+#define NEIGHBORS 8
+#define BRUTE_FORCE_LIMIT 20000
+
+static double now() {
+    struct timespec t;
+    clock_gettime(CLOCK_MONOTONIC, &t);
+    return t.tv_sec + t.tv_nsec * 1e-9;
+}
+
+static int comparePairs(const void* a, const void* b) {
+    const unsigned int* p = a;
+    const unsigned int* q = b;
+    if (p[0] != q[0])
+        return p[0] < q[0] ? -1 : 1;
+    return p[1] < q[1] ? -1 : p[1] > q[1];
+}
+
+/*  Puts each pair in the order (smaller, larger) and sorts the list, so that
+    two lists of the same pairs become identical.  */
+static void normalizePairs(unsigned int* pairs, int count) {
+    int i;
+    for (i = 0; i < count; i++)
+        if (pairs[2*i] > pairs[2*i+1]) {
+            unsigned int t = pairs[2*i];
+            pairs[2*i] = pairs[2*i+1];
+            pairs[2*i+1] = t;
+        }
+    qsort(pairs, count, 2*sizeof(unsigned int), comparePairs);
+}
+
+static int bruteForce(const ParticleSystem* particles, float distance, unsigned int* pairs) {
+    int i, j, count = 0;
+    for (i = 0; i < particles->count; i++)
+        for (j = i + 1; j < particles->count; j++) {
+            float dx = particles->x[j] - particles->x[i], dy = particles->y[j] - particles->y[i];
+            if (dx*dx + dy*dy < distance*distance) {
+                pairs[2*count] = i;
+                pairs[2*count+1] = j;
+                count++;
+            }
+        }
+    return count;
+}
+
+int main(int argc, char** argv) {
+    int maxCount = argc > 1 ? atoi(argv[1]) : 1000000;
+    int threads = argc > 2 ? atoi(argv[2]) : 0;
+    NeighborGrid grid;
+    int count, i;
+
+    jobsInit(threads);
+    initNeighborGrid(&grid);
+    printf("%d threads\n", jobsThreadCount());
+    printf("%10s %10s %10s %14s %14s %s\n", "points", "distance", "pairs", "grid ms", "all-pairs ms", "check");
+    for (count = 10000; count <= maxCount; count *= 10) {
+        ParticleSystem particles;
+        float distance = sqrtf(2.0f * NEIGHBORS * 1000 * 800 / ((float)M_PI * count));
+        double start, gridTime;
+        int pairs, frames = 0;
+        if ( ! initParticles(&particles, count, 1000, 800, 0, 11) )
+            break;
+        srand(5);
+        for (i = 0; i < count; i++) {
+            particles.x[i] = rand() / (float)RAND_MAX * 1000;
+            particles.y[i] = rand() / (float)RAND_MAX * 800;
+        }
+        findNeighborPairs(&grid, &particles, distance, 1 << 30);  // warm up the scratch arrays
+        start = now();
+        do {
+            pairs = findNeighborPairs(&grid, &particles, distance, 1 << 30);
+            frames++;
+        } while (now() - start < 0.5);
+        gridTime = (now() - start) / frames * 1000;
+        printf("%10d %10.2f %10d %14.3f", count, distance, pairs, gridTime);
+
+        if (count <= BRUTE_FORCE_LIMIT) {
+            unsigned int* expected = malloc((size_t)count * 4 * NEIGHBORS * 2 * sizeof(unsigned int));
+            int expectedCount;
+            start = now();
+            expectedCount = bruteForce(&particles, distance, expected);
+            printf(" %14.3f", (now() - start) * 1000);
+            normalizePairs(expected, expectedCount);
+            normalizePairs(grid.pairs, pairs);
+            printf(" %s\n", expectedCount == pairs && memcmp(expected, grid.pairs, pairs*2*sizeof(unsigned int)) == 0
+                            ? "same" : "DIFFERENT");
+            free(expected);
+        }
+        else
+            printf(" %14s\n", "-");
+        freeParticles(&particles);
+    }
+    freeNeighborGrid(&grid);
+    jobsShutdown();
+    return 0;
+}
@@ -0,0 +1,125 @@
+/**
+ * A benchmark for particles.c.  It times updateParticles() and
+ * updateParticlesScalar() for 10 thousand to 10 million points on one
+ * thread, and checks that both versions give exactly the same positions.
+ * Then it times updateParticles() for the largest count with 1, 2, 4, ...
+ * threads, up to the number of cores, and checks that every thread count
+ * gives the same result, including the headTowards() pass.  No window or
+ * OpenGL context is needed.  Usage:
+ *
+ *        bench_particles [maxCount [seconds]]
+ *
+ * The default goes up to 10000000 points, timing each case for about
+ * 0.5 seconds.  Compile with
+ *
+ *        gcc -O2 -o bench_particles bench_particles.c particles.c ../OpenGL_Stage/jobs.c -lm -pthread
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include "particles.h"
+#include "../OpenGL_Stage/jobs.h"
+
+static double now() {
+    struct timespec t;
+    clock_gettime(CLOCK_MONOTONIC, &t);
+    return t.tv_sec + t.tv_nsec * 1e-9;
+}
+
+typedef void (*Update)(ParticleSystem*);
+
+/*  Runs update until at least the given time has passed, and returns the
+    number of points updated per second.  */
+static double measure(ParticleSystem* particles, Update update, double seconds) {
+    long long steps = 0;
+    double start = now(), elapsed;
+    do {
+        update(particles);
+        steps++;
+        elapsed = now() - start;
+    } while (elapsed < seconds);
+    return steps * (double)particles->count / elapsed;
+}
+
+/*  A checksum of all of the positions and velocities, bit for bit.  */
+static unsigned long long checksum(const ParticleSystem* particles) {
+    const float* arrays[4] = { particles->x, particles->y, particles->vx, particles->vy };
+    unsigned long long sum = 0;
+    int a, i;
+    for (a = 0; a < 4; a++)
+        for (i = 0; i < particles->count; i++) {
+            unsigned int bits;
+            memcpy(&bits, &arrays[a][i], sizeof(bits));
+            sum = sum * 1000003 + bits;
+        }
+    return sum;
+}
+
+/*  Runs a fixed script of updates, with the mouse pulling the points
+    around now and then, and returns the checksum of the result.  */
+static unsigned long long runScript(ParticleSystem* particles) {
+    int step;
+    for (step = 0; step < 200; step++) {
+        if (step % 50 == 0)
+            headTowards(particles, 100 + step, 700 - 2*step);
+        updateParticles(particles);
+    }
+    return checksum(particles);
+}
+
+int main(int argc, char** argv) {
+    int maxCount = argc > 1 ? atoi(argv[1]) : 10000000;
+    double seconds = argc > 2 ? atof(argv[2]) : 0.5;
+    int cores = (int)sysconf(_SC_NPROCESSORS_ONLN);
+    int count, step, threads, lastCount = 0;
+    double baseRate = 0;
+    unsigned long long baseSum = 0;
+
+    printf("%10s %18s %18s %8s %s\n", "points", "scalar points/s", "SIMD points/s", "speedup", "check");
+    for (count = 10000; count <= maxCount; count *= 10) {
+        ParticleSystem a, b;
+        double scalar, simd;
+        int same;
+        // A small area, so that many points bounce on every update.
+        if ( ! initParticles(&a, count, 1000, 800, 32, 7) || ! initParticles(&b, count, 1000, 800, 32, 7) ) {
+            printf("%10d  not enough memory\n", count);
+            break;
+        }
+        for (step = 0; step < 500; step++) {
+            updateParticlesScalar(&a);
+            updateParticles(&b);
+        }
+        same = memcmp(a.x, b.x, count*sizeof(float)) == 0 && memcmp(a.y, b.y, count*sizeof(float)) == 0
+                && memcmp(a.vx, b.vx, count*sizeof(float)) == 0 && memcmp(a.vy, b.vy, count*sizeof(float)) == 0;
+        scalar = measure(&a, updateParticlesScalar, seconds);
+        simd = measure(&b, updateParticles, seconds);
+        printf("%10d %18.3e %18.3e %7.2fx %s\n", count, scalar, simd, simd / scalar, same ? "same" : "DIFFERENT");
+        freeParticles(&a);
+        freeParticles(&b);
+        lastCount = count;
+    }
+
+    printf("\n%d points, %d cores\n", lastCount, cores);
+    printf("%8s %18s %8s %s\n", "threads", "points/s", "speedup", "check");
+    for (threads = 1; threads <= cores || threads == 1; threads *= 2) {
+        ParticleSystem particles;
+        unsigned long long sum;
+        double rate;
+        jobsInit(threads);
+        if ( ! initParticles(&particles, lastCount, 1000, 800, 32, 7) )
+            break;
+        sum = runScript(&particles);
+        rate = measure(&particles, updateParticles, seconds);
+        if (threads == 1) {
+            baseRate = rate;
+            baseSum = sum;
+        }
+        printf("%8d %18.3e %7.2fx %s\n", threads, rate, rate / baseRate, sum == baseSum ? "same" : "DIFFERENT");
+        freeParticles(&particles);
+    }
+    jobsShutdown();
+    return 0;
+}
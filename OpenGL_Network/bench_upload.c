@@ -0,0 +1,177 @@
+/**
+ * A benchmark for OpenGL_Stage/streambuffer.c.  It streams a buffer of point
+ * positions to the GPU, frame after frame, in four ways, and reports the
+ * bandwidth of each, for buffers of 64 KB up to 32 MB (the positions of
+ * 4 million points):
+ *
+ *      bufferData      glBufferData() with the data, for new storage every frame;
+ *      orphan+subData  glBufferData() with no data, then glBufferSubData(),
+ *                      as the Network program does with -orphan;
+ *      subData         glBufferSubData() into the same storage every frame,
+ *                      which must wait for the GPU to finish with it, or copy it;
+ *      persistent      memcpy() into the next slot of a persistently mapped
+ *                      StreamBuffer, fenced after each frame.
+ *
+ * Every frame draws the positions as points into a framebuffer of 1 pixel,
+ * so that the GPU really reads them, and the time includes a glFinish() at
+ * the end of the run.  It opens a window only to get an OpenGL context, and
+ * needs OpenGL 3.2; the persistent case needs ARB_buffer_storage.  Usage:
+ *
+ *        bench_upload [maxMegabytes [seconds]]
+ *
+ * The default goes up to 32 MB, timing each case for about 0.5 seconds.
+ * Compile with
+ *
+ *        gcc -O2 -o bench_upload bench_upload.c ../OpenGL_Stage/streambuffer.c ../OpenGL_Stage/shader.c -lGL -lglut
+ */
+
+#include "../OpenGL_Stage/shader.h"
+#include <GL/freeglut.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include "../OpenGL_Stage/streambuffer.h"
+
+static const char* vertexShaderSource =
+    "#version 150 compatibility\n"
+    "in vec2 a_position;\n"
+    "void main() {\n"
+    "    gl_Position = vec4(a_position * 1e-6, 0.0, 1.0);  // every point in the one pixel\n"
+    "}\n";
+
+static const char* fragmentShaderSource =
+    "#version 150 compatibility\n"
+    "void main() {\n"
+    "    gl_FragColor = vec4(1.0);\n"
+    "}\n";
+
+enum { BUFFER_DATA, ORPHAN_SUB_DATA, SUB_DATA, PERSISTENT, METHOD_COUNT };
+static const char* methodNames[METHOD_COUNT] = { "bufferData", "orphan+subData", "subData", "persistent" };
+
+static GLint positionLocation;
+
+static double now() {
+    struct timespec t;
+    clock_gettime(CLOCK_MONOTONIC, &t);
+    return t.tv_sec + t.tv_nsec * 1e-9;
+}
+
+/*  Streams bytes of data with the method for frames until at least the
+    given time has passed, and returns the bandwidth in MB per second, or 0
+    if the method is not available.  */
+static double measure(int method, const float* data, int bytes, double seconds) {
+    StreamBuffer stream;
+    GLuint buffer = 0;
+    long long frames = 0;
+    double start, elapsed;
+    if (method == PERSISTENT) {
+        if ( ! initStreamBuffer(&stream, bytes, 1) )
+            return 0;
+        if ( ! stream.persistent ) {
+            freeStreamBuffer(&stream);
+            return 0;
+        }
+    }
+    else {
+        glGenBuffers(1, &buffer);
+        glBindBuffer(GL_ARRAY_BUFFER, buffer);
+        glBufferData(GL_ARRAY_BUFFER, bytes, NULL, GL_STREAM_DRAW);
+    }
+    glFinish();
+    start = now();
+    do {
+        GLintptr offset = 0;
+        switch (method) {
+            case BUFFER_DATA:
+                glBufferData(GL_ARRAY_BUFFER, bytes, data, GL_STREAM_DRAW);
+                break;
+            case ORPHAN_SUB_DATA:
+                glBufferData(GL_ARRAY_BUFFER, bytes, NULL, GL_STREAM_DRAW);
+                glBufferSubData(GL_ARRAY_BUFFER, 0, bytes, data);
+                break;
+            case SUB_DATA:
+                glBufferSubData(GL_ARRAY_BUFFER, 0, bytes, data);
+                break;
+            case PERSISTENT:
+                memcpy(beginStreamSlot(&stream), data, bytes);
+                offset = finishStreamSlot(&stream, bytes);
+                break;
+        }
+        glVertexAttribPointer(positionLocation, 2, GL_FLOAT, GL_FALSE, 0, (const char*)NULL + offset);
+        glDrawArrays(GL_POINTS, 0, bytes / (2*sizeof(float)));
+        if (method == PERSISTENT)
+            fenceStreamSlot(&stream);
+        frames++;
+        elapsed = now() - start;
+    } while (elapsed < seconds);
+    glFinish();
+    elapsed = now() - start;
+    glBindBuffer(GL_ARRAY_BUFFER, 0);
+    if (method == PERSISTENT)
+        freeStreamBuffer(&stream);
+    else
+        glDeleteBuffers(1, &buffer);
+    return frames * (double)bytes / elapsed / 1e6;
+}
+
+int main(int argc, char** argv) {
+    int maxMegabytes = 32, bytes, method;
+    double seconds = 0.5;
+    GLuint program, framebuffer, colorBuffer;
+    float* data;
+    glutInit(&argc, argv);
+    if (argc > 1)
+        maxMegabytes = atoi(argv[1]);
+    if (argc > 2)
+        seconds = atof(argv[2]);
+    glutInitDisplayMode(GLUT_RGBA);
+    glutInitWindowSize(64, 64);
+    glutCreateWindow("bench_upload");
+    if ( ! hasGLVersion(3, 2) ) {
+        printf("This benchmark needs OpenGL 3.2.\n");
+        return 1;
+    }
+    printf("%s\n", (const char*)glGetString(GL_RENDERER));
+
+    program = createProgram("bench_upload", vertexShaderSource, fragmentShaderSource);
+    if ( ! program )
+        return 1;
+    glUseProgram(program);
+    positionLocation = glGetAttribLocation(program, "a_position");
+    glEnableVertexAttribArray(positionLocation);
+    glGenFramebuffers(1, &framebuffer);
+    glGenRenderbuffers(1, &colorBuffer);
+    glBindRenderbuffer(GL_RENDERBUFFER, colorBuffer);
+    glRenderbufferStorage(GL_RENDERBUFFER, GL_RGBA8, 1, 1);
+    glBindFramebuffer(GL_FRAMEBUFFER, framebuffer);
+    glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_RENDERBUFFER, colorBuffer);
+    glViewport(0, 0, 1, 1);
+
+    data = malloc((size_t)maxMegabytes << 20);
+    if (data == NULL) {
+        printf("Not enough memory for %d MB.\n", maxMegabytes);
+        return 1;
+    }
+    for (bytes = 0; bytes < maxMegabytes << 20; bytes += sizeof(float))
+        data[bytes / sizeof(float)] = rand() % 1000;
+
+    printf("%10s", "KB");
+    for (method = 0; method < METHOD_COUNT; method++)
+        printf("  %14s", methodNames[method]);
+    printf("     (MB per second)\n");
+    for (bytes = 64 << 10; bytes <= maxMegabytes << 20; bytes *= 8) {
+        printf("%10d", bytes >> 10);
+        for (method = 0; method < METHOD_COUNT; method++) {
+            double rate = measure(method, data, bytes, seconds);
+            if (rate > 0)
+                printf("  %14.0f", rate);
+            else
+                printf("  %14s", "-");
+            fflush(stdout);
+        }
+        printf("\n");
+    }
+    free(data);
+    return 0;
+}
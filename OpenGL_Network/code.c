@@ -0,0 +1,584 @@
+/*
+ * A 2D program in which points move around in the window, bouncing off the
+ * edges.  It is the native version of WebGL_Network/code.html: the points
+ * are simulated by particles.c, which can move millions of them on all of
+ * the cores with OpenGL_Stage/jobs.c, and their positions are streamed to
+ * the GPU for every frame.  The lines connect each point to the points near
+ * it, found by neighbors.c, and fade out with distance.  Each point has a
+ * color, size and shape of its own, as vertex attributes, so all of them
+ * are drawn with one call whatever their shapes.  In alpha mode, the
+ * transparent points are composited by OpenGL_Stage/transparency.c, which
+ * needs no sorting and gives the same picture in any order.
+ *
+ *      CONTROLS
+ *      ~ Left mouse click: Moves squares towards mouse position
+ *      ~ Left mouse click and drag: Continuously moves squares towards mouse position
+ *      ~ Shift and left mouse click: Reset all squares position
+ *      ~ Space: Toggle between red-colored and multi-colored squares
+ *      ~ A: Toggle when alpha transparency and no transparency
+ *      ~ O: Toggle between order-independent transparency and blending in drawing order, in alpha mode
+ *      ~ 1: square shapes
+ *      ~ 2: disk shapes
+ *      ~ 3: ring shapes
+ *      ~ 4: a random shape for each point
+ *      ~ S: Toggle between points of one size and points of random sizes
+ *      ~ L: Toggle between having lines and having no lines
+ *      ~ C: Toggle between multi-colored lines or white-colored lines
+ *      ~ N: Toggle between lines between nearby points and a loop through all points
+ *
+ * The positions are written every frame into a persistently mapped buffer
+ * with three slots, by OpenGL_Stage/streambuffer.c, when the OpenGL has
+ * ARB_buffer_storage; run with -orphan to upload them with glBufferData()
+ * and glBufferSubData() instead, and bench_upload to compare the two.
+ *
+ * Run with -count N for N points instead of POINT_COUNT, and with -uncapped
+ * or -stats for the frame loop options of OpenGL_Stage/frameloop.c; the
+ * statistics include the time for the update, for finding the neighbors,
+ * for the upload and for waiting for a slot of the stream buffer.  Compile
+ * this program with:
+ *
+ *        gcc -O2 -o code code.c particles.c neighbors.c ../OpenGL_Stage/frameloop.c ../OpenGL_Stage/shader.c \
+ *            ../OpenGL_Stage/jobs.c ../OpenGL_Stage/transparency.c ../OpenGL_Stage/streambuffer.c -lGL -lglut -lm -pthread
+ */
+
+#include "../OpenGL_Stage/shader.h"  // Includes <GL/gl.h>, with the functions needed for shaders.
+#include <GL/freeglut.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <stddef.h>
+#include <string.h>
+#include <time.h>
+#include <math.h>
+#include "../OpenGL_Stage/frameloop.h"
+#include "../OpenGL_Stage/jobs.h"
+#include "../OpenGL_Stage/transparency.h"
+#include "../OpenGL_Stage/streambuffer.h"
+#include "particles.h"
+#include "neighbors.h"
+
+static const char* vertexShaderSource =
+    "#version 120\n"
+    "attribute float a_x;      // vertex position in standard window pixel coords\n"
+    "attribute float a_y;\n"
+    "uniform float u_width;    // width of window\n"
+    "uniform float u_height;   // height of window\n"
+    "attribute vec4 a_color;   // vertex color\n"
+    "attribute float a_size;   // of the point, in pixels\n"
+    "attribute float a_shape;  // of the point: 1 for a square, 2 for a disk, 3 for a ring\n"
+    "varying vec4 v_color;\n"
+    "varying float v_shape;\n"
+    "void main() {\n"
+    "    float x,y;  // vertex position in clip coordinates\n"
+    "    x = a_x/u_width * 2.0 - 1.0;\n"
+    "    y = 1.0 - a_y/u_height * 2.0;\n"
+    "    gl_Position = vec4(x, y, 0.0, 1.0);\n"
+    "    gl_PointSize = a_size;\n"
+    "    v_color = a_color;\n"
+    "    v_shape = a_shape;\n"
+    "}\n";
+
+static const char* fragmentShaderSource =
+    "#version 120\n"
+    TRANSPARENCY_GLSL
+    "varying vec4 v_color;\n"
+    "varying float v_shape;\n"
+    "uniform int u_primitive; // indicates whether lines (1) or shapes (2) or being drawn\n"
+    "uniform int u_lineColor; // indicate whether different color (1) or same color (2) lines are drawn\n"
+    "uniform bool u_transparent; // Is this the order-independent transparent pass?\n"
+    "void main() {\n"
+    "    vec4 color = v_color;\n"
+    "    if ( (u_primitive == 1) && (u_lineColor == 2) )\n"
+    "        color = vec4( 1,1,1,1 );\n"
+    "    int pointStyle = u_primitive == 2 ? int(v_shape + 0.5) : 1;  // lines have no shape\n"
+    "    if (pointStyle == 2) {\n"
+    "        // discarding points after a certain distance from (0.5, 0.5) to create a circle\n"
+    "        float dist = distance( vec2( 0.5, 0.5 ), gl_PointCoord );\n"
+    "        if (dist > 0.5)\n"
+    "            discard;\n"
+    "        // setting alpha based on distance so effect is fully opaque at centre with a transparency transition further away\n"
+    "        color.a = 1.0 - dist;\n"
+    "    }\n"
+    "    else if (pointStyle == 3) {\n"
+    "        float dist = distance( vec2( 0.5, 0.5 ), gl_PointCoord );\n"
+    "        if ( (dist > 0.5) || (dist < 0.4) )\n"
+    "            discard;\n"
+    "    }\n"
+    "    if (u_transparent)\n"
+    "        writeTransparent(color);\n"
+    "    else\n"
+    "        gl_FragData[0] = color;\n"
+    "}\n";
+
+/*  The shaders for the network lines.  The geometry shader sees both ends of
+ *  each line, so it can fade the line out as it gets longer.  */
+static const char* lineVertexShaderSource =
+    "#version 150 compatibility\n"
+    "in float a_x;\n"
+    "in float a_y;\n"
+    "in vec4 a_color;\n"
+    "uniform float u_width;\n"
+    "uniform float u_height;\n"
+    "out vec4 v_color;\n"
+    "out vec2 v_pixel;\n"
+    "void main() {\n"
+    "    v_pixel = vec2(a_x, a_y);\n"
+    "    // Behind the points, which only matters to the weights of the transparent pass.\n"
+    "    gl_Position = vec4(a_x/u_width * 2.0 - 1.0, 1.0 - a_y/u_height * 2.0, 0.5, 1.0);\n"
+    "    v_color = a_color;\n"
+    "}\n";
+
+static const char* lineGeometryShaderSource =
+    "#version 150 compatibility\n"
+    "layout(lines) in;\n"
+    "layout(line_strip, max_vertices = 2) out;\n"
+    "in vec4 v_color[];\n"
+    "in vec2 v_pixel[];\n"
+    "uniform float u_distance;  // lines of this length or more are invisible\n"
+    "uniform int u_lineColor;\n"
+    "out vec4 g_color;\n"
+    "void main() {\n"
+    "    float fade = 1.0 - distance(v_pixel[0], v_pixel[1]) / u_distance;\n"
+    "    for (int i = 0; i < 2; i++) {\n"
+    "        g_color = vec4(u_lineColor == 1 ? v_color[i].rgb : vec3(1.0), fade);\n"
+    "        gl_Position = gl_in[i].gl_Position;\n"
+    "        EmitVertex();\n"
+    "    }\n"
+    "    EndPrimitive();\n"
+    "}\n";
+
+static const char* lineFragmentShaderSource =
+    "#version 150 compatibility\n"
+    TRANSPARENCY_GLSL
+    "in vec4 g_color;\n"
+    "uniform bool u_transparent;\n"
+    "void main() {\n"
+    "    if (u_transparent)\n"
+    "        writeTransparent(g_color);\n"
+    "    else\n"
+    "        gl_FragData[0] = g_color;\n"
+    "}\n";
+
+#define POINT_COUNT 20
+#define POINT_SIZE 64    // the largest points; with varied sizes, they go down to half of this
+#define UPDATES_PER_SECOND 60  // the velocities are in pixels per update, as they were per frame in the WebGL version
+
+int width = 1000, height = 700;  // size of the window
+
+/*  Points closer than NETWORK_DISTANCE are connected.  With many points, the
+ *  distance shrinks so that each point has about NEIGHBORS neighbors on
+ *  average; otherwise the number of lines would grow as the square of the
+ *  number of points.  */
+#define NETWORK_DISTANCE 150
+#define NEIGHBORS 8
+#define MAX_PAIRS 4000000
+
+ParticleSystem particles;
+
+/**
+ * How each point looks: its color, size and shape, packed into 8 bytes, so
+ * that with its position a point takes 16 bytes on the GPU.  The shapes are
+ * an attribute rather than a uniform, so points of every shape are drawn by
+ * the same glDrawArrays() call, however many there are.  The styles are
+ * only uploaded when they change; the positions are uploaded every frame.
+ */
+typedef struct PointStyle {
+    unsigned char color[4];  // RGBA, read as normalized floats
+    unsigned short size;     // in pixels
+    unsigned char shape;     // SQUARE, DISK or RING
+    unsigned char unused;
+} PointStyle;
+
+enum { SQUARE = 1, DISK, RING, MIXED_SHAPES };
+
+GLint u_width_loc, u_height_loc, u_primitive_loc, u_lineColor_loc, u_transparent_loc;
+GLint a_x_loc, a_y_loc, a_color_loc, a_size_loc, a_shape_loc;
+GLuint coordsBuffer;    // the x coordinates of the points, followed by the y coordinates
+StreamBuffer positionStream;  // the same, in slots of a mapped buffer, if streaming
+int streaming = 0;      // Are the positions written into positionStream?  (Set by main() and initGL().)
+GLuint styleBuffer;
+GLuint pointProgram;
+GLuint lineProgram;     // 0 if geometry shaders are not available
+GLint line_width_loc, line_height_loc, line_distance_loc, line_lineColor_loc, line_transparent_loc;
+GLuint pairBuffer;      // GL_LINES indices for the network lines
+NeighborGrid neighborGrid;
+Transparency transparency;  // for drawing the points and lines in any order in alpha mode
+int transparencyReady = 0;  // Could it be made?  (Set by initGL().)
+
+PointStyle* styles;        // the color, size and shape of each point
+int stylesChanged = 1;     // Do the styles need to be uploaded?
+int multicolor = 1;        // Keep track of whether multi-colored squares should be enabled or not
+int shapes = SQUARE;       // SQUARE, DISK, RING, or MIXED_SHAPES for a random shape for each point
+int variedSizes = 0;       // Do the points have random sizes, rather than all POINT_SIZE?
+int alpha = 0;
+int orderIndependent = 1;  // In alpha mode, are the points composited with transparency.c, rather than blended in order?
+int lines = 1;
+int lineColors = 1;
+int network = 1;           // Are the lines between nearby points, rather than a loop through all points?
+
+double updateMilliseconds, neighborMilliseconds, uploadMilliseconds;  // shown with the frame statistics
+
+static double now() {
+    struct timespec t;
+    clock_gettime(CLOCK_MONOTONIC, &t);
+    return t.tv_sec + t.tv_nsec * 1e-9;
+}
+
+/**
+ * Sends the positions to the GPU.  With a stream buffer, they are copied
+ * straight into the slot of positionStream that the GPU will read them
+ * from, which is mapped memory; fenceStreamSlot() in display() marks when
+ * the GPU is done with it.  Otherwise, the buffer is "orphaned" first:
+ * asking for new storage lets the driver hand out fresh memory instead of
+ * waiting until the GPU has finished drawing the previous frame from the
+ * old data.  The styles are only uploaded when they change.
+ */
+void uploadPositions() {
+    int bytes = particles.count*sizeof(float);
+    GLintptr offset = 0;
+    if (streaming) {
+        char* slot = beginStreamSlot(&positionStream);
+        memcpy(slot, particles.x, bytes);
+        memcpy(slot + bytes, particles.y, bytes);
+        offset = finishStreamSlot(&positionStream, 2*bytes);
+    }
+    else {
+        glBindBuffer(GL_ARRAY_BUFFER, coordsBuffer);
+        glBufferData(GL_ARRAY_BUFFER, 2*bytes, NULL, GL_STREAM_DRAW);
+        glBufferSubData(GL_ARRAY_BUFFER, 0, bytes, particles.x);
+        glBufferSubData(GL_ARRAY_BUFFER, bytes, bytes, particles.y);
+    }
+    glVertexAttribPointer(a_x_loc, 1, GL_FLOAT, GL_FALSE, 0, (const char*)NULL + offset);
+    glVertexAttribPointer(a_y_loc, 1, GL_FLOAT, GL_FALSE, 0, (const char*)NULL + offset + bytes);
+    if (stylesChanged) {
+        glBindBuffer(GL_ARRAY_BUFFER, styleBuffer);
+        glBufferData(GL_ARRAY_BUFFER, particles.count*sizeof(PointStyle), styles, GL_STATIC_DRAW);
+        glVertexAttribPointer(a_color_loc, 4, GL_UNSIGNED_BYTE, GL_TRUE, sizeof(PointStyle), 0);
+        glVertexAttribPointer(a_size_loc, 1, GL_UNSIGNED_SHORT, GL_FALSE, sizeof(PointStyle),
+                              (const char*)NULL + offsetof(PointStyle, size));
+        glVertexAttribPointer(a_shape_loc, 1, GL_UNSIGNED_BYTE, GL_FALSE, sizeof(PointStyle),
+                              (const char*)NULL + offsetof(PointStyle, shape));
+        stylesChanged = 0;
+    }
+    glBindBuffer(GL_ARRAY_BUFFER, 0);
+}
+
+/**
+ * Draws a line between every two points that are less than the network
+ * distance apart.  The pairs come from neighbors.c, and are uploaded as an
+ * index buffer into the positions that are already on the GPU.
+ */
+void drawNetwork(int transparent) {
+    double start = now();
+    float distance = sqrtf(NEIGHBORS * (float)width * height / ((float)M_PI * particles.count));
+    if (distance > NETWORK_DISTANCE)
+        distance = NETWORK_DISTANCE;
+    findNeighborPairs(&neighborGrid, &particles, distance, MAX_PAIRS);
+    neighborMilliseconds = (now() - start) * 1000;
+
+    start = now();
+    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, pairBuffer);
+    glBufferData(GL_ELEMENT_ARRAY_BUFFER, neighborGrid.pairCount*2*sizeof(unsigned int), NULL, GL_STREAM_DRAW);
+    glBufferSubData(GL_ELEMENT_ARRAY_BUFFER, 0, neighborGrid.pairCount*2*sizeof(unsigned int), neighborGrid.pairs);
+    uploadMilliseconds += (now() - start) * 1000;
+
+    glUseProgram(lineProgram);
+    glUniform1f(line_width_loc, width);
+    glUniform1f(line_height_loc, height);
+    glUniform1f(line_distance_loc, distance);
+    glUniform1i(line_lineColor_loc, lineColors ? 1 : 2);
+    glUniform1i(line_transparent_loc, transparent);
+    glEnable(GL_BLEND);
+    glDrawElements(GL_LINES, neighborGrid.pairCount*2, GL_UNSIGNED_INT, 0);
+    if ( ! alpha )
+        glDisable(GL_BLEND);
+    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, 0);
+    glUseProgram(pointProgram);
+}
+
+/**
+ *  Called by GLUT to render each frame.  In alpha mode, the lines and the
+ *  points are drawn as the transparent pass of transparency.c, so that
+ *  overlapping points look the same whatever order they are drawn in,
+ *  without sorting them; pressing O blends them in order instead, over
+ *  each other as they come.
+ */
+void display() {
+    double start = now();
+    int transparent = alpha && orderIndependent && transparencyReady;
+    uploadPositions();
+    uploadMilliseconds = (now() - start) * 1000;
+
+    glClear(GL_COLOR_BUFFER_BIT);
+    if (transparent)
+        beginTransparency(&transparency, width, height, 0);
+    glUniform1i(u_transparent_loc, transparent);
+    if (lines && network && lineProgram)
+        drawNetwork(transparent);
+    else if (lines) {
+        glUniform1i(u_primitive_loc, 1);
+        glDrawArrays(GL_LINE_LOOP, 0, particles.count);
+    }
+    glUniform1i(u_primitive_loc, 2);
+    glDrawArrays(GL_POINTS, 0, particles.count);
+    if (transparent) {
+        endTransparency(&transparency);
+        glUseProgram(pointProgram);
+    }
+    if (streaming)
+        fenceStreamSlot(&positionStream);  // the last draw call that reads the positions
+
+    if (glGetError() != GL_NO_ERROR) {
+        printf("During render GL error has been detected.\n");
+    }
+    glutSwapBuffers();
+    frameLoopEndFrame();
+}
+
+/**
+ * Used to create multi-colored squares when the space bar is pressed
+ * to enable that feature
+ */
+void createColors() {
+    int i, j;
+    // Generating random colours for the squares
+    for (i = 0; i < particles.count; i++)
+        for (j = 0; j < 4; j++)
+            styles[i].color[j] = rand() % 256;
+    stylesChanged = 1;
+}
+
+/**
+ * Gives every point the shape, or with MIXED_SHAPES a random one, and
+ * POINT_SIZE or a random size, according to shapes and variedSizes.
+ */
+void createShapes() {
+    int i;
+    for (i = 0; i < particles.count; i++) {
+        styles[i].shape = shapes == MIXED_SHAPES ? SQUARE + rand() % 3 : shapes;
+        styles[i].size = variedSizes ? POINT_SIZE/2 + rand() % (POINT_SIZE/2 + 1) : POINT_SIZE;
+    }
+    stylesChanged = 1;
+}
+
+/**
+ * Called by the frame loop UPDATES_PER_SECOND times per second.  Adds
+ * velocities to point positions, and makes points that move past the edge
+ * of the window bounce.
+ */
+void update(double dt) {
+    double start = now();
+    updateParticles(&particles);
+    updateMilliseconds = (now() - start) * 1000;
+}
+
+/* Called when the user hits a key */
+void doKeyboard(unsigned char key, int x, int y) {
+    // space bar pressed - toggles color modes
+    if (key == ' ') {
+        if (multicolor) {
+            multicolor = 0;
+            glVertexAttrib3f(a_color_loc, 1, 0, 0);  // set attribute color to red
+            glDisableVertexAttribArray(a_color_loc);
+        }
+        else {
+            multicolor = 1;
+            createColors();
+            glEnableVertexAttribArray(a_color_loc);
+        }
+    }
+    // a key pressed - toggles alpha modes
+    else if (key == 'a' || key == 'A') {
+        alpha = !alpha;
+        if (alpha)
+            glEnable(GL_BLEND);
+        else
+            glDisable(GL_BLEND);
+    }
+    // o key pressed - toggles order-independent transparency in alpha mode
+    else if (key == 'o' || key == 'O') {
+        orderIndependent = !orderIndependent;
+    }
+    // number keys pressed - square, disk and ring shapes, or all three
+    else if (key >= '1' && key <= '4') {
+        shapes = key - '0';
+        createShapes();
+    }
+    // s key pressed - toggles random sizes
+    else if (key == 's' || key == 'S') {
+        variedSizes = !variedSizes;
+        createShapes();
+    }
+    // l key pressed - toggles line modes
+    else if (key == 'l' || key == 'L') {
+        lines = !lines;
+    }
+    // c key pressed - toggles line color modes
+    else if (key == 'c' || key == 'C') {
+        lineColors = !lineColors;
+        glUniform1i(u_lineColor_loc, lineColors ? 1 : 2);
+    }
+    // n key pressed - toggles network lines and the loop
+    else if (key == 'n' || key == 'N') {
+        network = !network;
+    }
+}
+
+/**
+ * Responds to left mouse click; points all head toward mouse location
+ * when mouse is clicked and as it is dragged.  Except if shift key is down,
+ * all the data is reinitialized instead.
+ */
+int dragging = 0;
+
+void doMouse(int button, int state, int x, int y) {
+    if (button != GLUT_LEFT_BUTTON)
+        return;  // only respond to left mouse button
+    if (state == GLUT_UP) {
+        dragging = 0;
+        return;
+    }
+    if (glutGetModifiers() & GLUT_ACTIVE_SHIFT) {
+        resetParticles(&particles);
+        return;
+    }
+    headTowards(&particles, x, y);
+    dragging = 1;
+}
+
+void doMotion(int x, int y) {
+    if (dragging)
+        headTowards(&particles, x, y);
+}
+
+/**
+ * When the window is resized, we need to reset the OpenGL viewport to match
+ * the size, and reset the values of the uniform variables in the shader that
+ * represent the window size.
+ */
+void doResize(int w, int h) {
+    width = w;
+    height = h;
+    glViewport(0, 0, width, height);
+    glUniform1f(u_width_loc, width);
+    glUniform1f(u_height_loc, height);
+    resizeParticles(&particles, width, height);
+}
+
+/* Initialize the OpenGL context.  Called from main() */
+int initGL() {
+    GLuint prog = createProgram("network", vertexShaderSource, fragmentShaderSource);
+    if ( ! prog )
+        return 0;
+    pointProgram = prog;
+    glUseProgram(prog);
+    u_width_loc = glGetUniformLocation(prog, "u_width");
+    u_height_loc = glGetUniformLocation(prog, "u_height");
+    glUniform1f(u_width_loc, width);
+    glUniform1f(u_height_loc, height);
+    glEnable(GL_VERTEX_PROGRAM_POINT_SIZE);  // let the shader set the point size
+    glEnable(GL_POINT_SPRITE);               // and give it gl_PointCoord
+
+    a_x_loc = glGetAttribLocation(prog, "a_x");
+    a_y_loc = glGetAttribLocation(prog, "a_y");
+    glGenBuffers(1, &coordsBuffer);
+    glEnableVertexAttribArray(a_x_loc);
+    glEnableVertexAttribArray(a_y_loc);
+
+    a_color_loc = glGetAttribLocation(prog, "a_color");
+    a_size_loc = glGetAttribLocation(prog, "a_size");
+    a_shape_loc = glGetAttribLocation(prog, "a_shape");
+    glGenBuffers(1, &styleBuffer);
+    glEnableVertexAttribArray(a_color_loc);
+    glEnableVertexAttribArray(a_size_loc);
+    glEnableVertexAttribArray(a_shape_loc);
+
+    // used when enabling the alpha component for alpha transparency (i.e. pressing a key)
+    glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
+
+    u_primitive_loc = glGetUniformLocation(prog, "u_primitive");
+    u_transparent_loc = glGetUniformLocation(prog, "u_transparent");
+    u_lineColor_loc = glGetUniformLocation(prog, "u_lineColor");
+    glUniform1i(u_lineColor_loc, 1);
+    glClearColor(0, 0, 0, 1);
+
+    // The network lines read the same attribute arrays, so their program is
+    // relinked with the attributes at the same locations as in prog.
+    if ( hasGLVersion(3, 2) )
+        lineProgram = createProgramWithGeometry("network lines", lineVertexShaderSource,
+                                                lineGeometryShaderSource, lineFragmentShaderSource);
+    if (lineProgram) {
+        GLint linked;
+        glBindAttribLocation(lineProgram, a_x_loc, "a_x");
+        glBindAttribLocation(lineProgram, a_y_loc, "a_y");
+        glBindAttribLocation(lineProgram, a_color_loc, "a_color");
+        glLinkProgram(lineProgram);
+        glGetProgramiv(lineProgram, GL_LINK_STATUS, &linked);
+        if ( ! linked ) {
+            glDeleteProgram(lineProgram);
+            lineProgram = 0;
+        }
+    }
+    if (lineProgram) {
+        line_width_loc = glGetUniformLocation(lineProgram, "u_width");
+        line_height_loc = glGetUniformLocation(lineProgram, "u_height");
+        line_distance_loc = glGetUniformLocation(lineProgram, "u_distance");
+        line_lineColor_loc = glGetUniformLocation(lineProgram, "u_lineColor");
+        line_transparent_loc = glGetUniformLocation(lineProgram, "u_transparent");
+        glGenBuffers(1, &pairBuffer);
+        initNeighborGrid(&neighborGrid);
+    }
+    else
+        printf("Network lines need OpenGL 3.2; drawing a loop through the points instead.\n");
+    transparencyReady = initTransparency(&transparency);
+    if ( streaming && initStreamBuffer(&positionStream, 2*particles.count*sizeof(float), 1)
+                   && ! positionStream.persistent )
+        freeStreamBuffer(&positionStream);  // unmapped, it would only add a copy to glBufferSubData()
+    streaming = streaming && positionStream.persistent;
+    glUseProgram(prog);
+    return 1;
+}
+
+int main(int argc, char** argv) {
+    double maxFramesPerSecond = 60;
+    int showStats = 0, count = POINT_COUNT, i;
+    glutInit(&argc, argv);
+    frameLoopParseArgs(argc, argv, &maxFramesPerSecond, &showStats);
+    streaming = 1;
+    for (i = 1; i < argc; i++)
+        if (strcmp(argv[i], "-count") == 0 && i < argc - 1)
+            count = atoi(argv[i+1]);
+        else if (strcmp(argv[i], "-orphan") == 0)
+            streaming = 0;
+    if ( ! initParticles(&particles, count, width, height, POINT_SIZE/2, (unsigned int)time(NULL)) ) {
+        printf("Not enough memory for %d points.\n", count);
+        return 1;
+    }
+    styles = malloc( count*sizeof(PointStyle) );
+    if (styles == NULL) {
+        printf("Not enough memory for %d points.\n", count);
+        return 1;
+    }
+    createColors();
+    createShapes();
+    glutInitDisplayMode(GLUT_DOUBLE);
+    glutInitWindowSize(width, height);
+    glutCreateWindow("Network");
+    if ( ! hasGLVersion(2, 1) || ! initGL() ) {
+        printf("This program needs OpenGL 2.1.\n");
+        return 1;
+    }
+    jobsInit(0);  // start one job thread per core
+    glutDisplayFunc(display);
+    glutReshapeFunc(doResize);
+    glutKeyboardFunc(doKeyboard);
+    glutMouseFunc(doMouse);
+    glutMotionFunc(doMotion);
+    frameLoopAddCounter("update", &updateMilliseconds);
+    frameLoopAddCounter("neighbors", &neighborMilliseconds);
+    frameLoopAddCounter("upload", &uploadMilliseconds);
+    if (streaming)
+        frameLoopAddCounter("stream wait", &positionStream.waitMilliseconds);
+    frameLoopStart(UPDATES_PER_SECOND, update, maxFramesPerSecond, showStats);
+    glutMainLoop();
+    return 0;
+}
@@ -0,0 +1,172 @@
+#include <stdlib.h>
+#include <string.h>
+#include "neighbors.h"
+#include "../OpenGL_Stage/jobs.h"
+
+void initNeighborGrid(NeighborGrid* grid) {
+    memset(grid, 0, sizeof(NeighborGrid));
+}
+
+void freeNeighborGrid(NeighborGrid* grid) {
+    int i;
+    for (i = 0; i < grid->chunkCapacity; i++)
+        free(grid->chunks[i].pairs);
+    free(grid->chunks);
+    free(grid->pairs);
+    free(grid->pointCells);
+    free(grid->cellStarts);
+    free(grid->order);
+    free(grid->sortedX);
+    free(grid->sortedY);
+    initNeighborGrid(grid);
+}
+
+static int clampInt(int x, int low, int high) {
+    return x < low ? low : x > high ? high : x;
+}
+
+typedef struct CellJob {
+    NeighborGrid* grid;
+    const ParticleSystem* particles;
+} CellJob;
+
+/*  Finds the cell of each point.  Points outside of the area, which can
+    happen just after the window shrinks, go into the nearest edge cell.  */
+static void cellChunk(void* data, int start, int end, int chunk) {
+    CellJob* job = data;
+    NeighborGrid* grid = job->grid;
+    float scale = 1 / grid->cellSize;
+    int i;
+    for (i = start; i < end; i++) {
+        int column = clampInt((int)(job->particles->x[i] * scale), 0, grid->columns - 1);
+        int row = clampInt((int)(job->particles->y[i] * scale), 0, grid->rows - 1);
+        grid->pointCells[i] = row * grid->columns + column;
+    }
+}
+
+static void addPair(NeighborGrid* grid, NeighborChunk* chunk, unsigned int a, unsigned int b) {
+    if (chunk->count == chunk->capacity) {
+        if (chunk->count >= grid->maxPairs)
+            return;
+        chunk->capacity = chunk->capacity ? 2*chunk->capacity : 1024;
+        chunk->pairs = realloc(chunk->pairs, chunk->capacity*2*sizeof(unsigned int));
+    }
+    chunk->pairs[2*chunk->count] = a;
+    chunk->pairs[2*chunk->count+1] = b;
+    chunk->count++;
+}
+
+/*  Compares points first to end-1 of the sorted order with points other to
+    otherEnd-1.  */
+static void comparePoints(NeighborGrid* grid, NeighborChunk* chunk, int first, int end, int other, int otherEnd,
+                          int sameCell) {
+    float limit = grid->distance * grid->distance;
+    int a, b;
+    for (a = first; a < end; a++) {
+        float x = grid->sortedX[a], y = grid->sortedY[a];
+        for (b = sameCell ? a + 1 : other; b < otherEnd; b++) {
+            float dx = grid->sortedX[b] - x, dy = grid->sortedY[b] - y;
+            if (dx*dx + dy*dy < limit)
+                addPair(grid, chunk, grid->order[a], grid->order[b]);
+        }
+    }
+}
+
+/*  Finds the pairs for a range of cells.  Each pair of neighboring cells is
+    visited once: every cell is compared with itself and with the cells to
+    its right, below-left, below and below-right.  */
+static void pairChunk(void* data, int start, int end, int chunkNumber) {
+    NeighborGrid* grid = data;
+    NeighborChunk* chunk = &grid->chunks[chunkNumber];
+    static const int offsets[4][2] = { {1,0}, {-1,1}, {0,1}, {1,1} };
+    int cell, k;
+    chunk->count = 0;
+    for (cell = start; cell < end; cell++) {
+        int first = grid->cellStarts[cell], last = grid->cellStarts[cell+1];
+        int column = cell % grid->columns, row = cell / grid->columns;
+        if (first == last)
+            continue;
+        comparePoints(grid, chunk, first, last, first, last, 1);
+        for (k = 0; k < 4; k++) {
+            int c = column + offsets[k][0], r = row + offsets[k][1];
+            if (c < 0 || c >= grid->columns || r >= grid->rows)
+                continue;
+            int other = r * grid->columns + c;
+            comparePoints(grid, chunk, first, last, grid->cellStarts[other], grid->cellStarts[other+1], 0);
+        }
+    }
+}
+
+int findNeighborPairs(NeighborGrid* grid, const ParticleSystem* particles, float distance, int maxPairs) {
+    int count = particles->count, i, cellCount, chunkCount, total;
+    CellJob cellJob = { grid, particles };
+
+    grid->distance = distance;
+    grid->maxPairs = maxPairs;
+    grid->cellSize = distance;
+    grid->columns = (int)(particles->width / distance) + 1;
+    grid->rows = (int)(particles->height / distance) + 1;
+    cellCount = grid->columns * grid->rows;
+    if (count > grid->pointCapacity) {
+        grid->pointCapacity = count;
+        free(grid->pointCells);
+        free(grid->order);
+        free(grid->sortedX);
+        free(grid->sortedY);
+        grid->pointCells = malloc(count*sizeof(int));
+        grid->order = malloc(count*sizeof(int));
+        grid->sortedX = malloc(count*sizeof(float));
+        grid->sortedY = malloc(count*sizeof(float));
+    }
+    if (cellCount + 1 > grid->cellCapacity) {
+        grid->cellCapacity = cellCount + 1;
+        free(grid->cellStarts);
+        grid->cellStarts = malloc(grid->cellCapacity*sizeof(int));
+    }
+    chunkCount = jobsChunkCount(cellCount, NEIGHBOR_GRAIN);
+    if (chunkCount > grid->chunkCapacity) {
+        grid->chunks = realloc(grid->chunks, chunkCount*sizeof(NeighborChunk));
+        memset(grid->chunks + grid->chunkCapacity, 0, (chunkCount - grid->chunkCapacity)*sizeof(NeighborChunk));
+        grid->chunkCapacity = chunkCount;
+    }
+
+    // Sort the points by cell with a counting sort.
+    jobsParallelFor(count, PARTICLE_GRAIN, cellChunk, &cellJob);
+    memset(grid->cellStarts, 0, (cellCount + 1)*sizeof(int));
+    for (i = 0; i < count; i++)
+        grid->cellStarts[grid->pointCells[i] + 1]++;
+    for (i = 0; i < cellCount; i++)
+        grid->cellStarts[i+1] += grid->cellStarts[i];
+    for (i = 0; i < count; i++) {
+        int slot = grid->cellStarts[grid->pointCells[i]]++;
+        grid->order[slot] = i;
+        grid->sortedX[slot] = particles->x[i];
+        grid->sortedY[slot] = particles->y[i];
+    }
+    // The fill moved each start to the start of the next cell; shift them back.
+    for (i = cellCount; i > 0; i--)
+        grid->cellStarts[i] = grid->cellStarts[i-1];
+    grid->cellStarts[0] = 0;
+
+    // Find the pairs, then join the chunks' lists in order.
+    jobsParallelFor(cellCount, NEIGHBOR_GRAIN, pairChunk, grid);
+    total = 0;
+    for (i = 0; i < chunkCount; i++)
+        total += grid->chunks[i].count;
+    if (total > maxPairs)
+        total = maxPairs;
+    if (total > grid->pairCapacity) {
+        grid->pairCapacity = total;
+        free(grid->pairs);
+        grid->pairs = malloc(grid->pairCapacity*2*sizeof(unsigned int));
+    }
+    grid->pairCount = 0;
+    for (i = 0; i < chunkCount && grid->pairCount < total; i++) {
+        int n = grid->chunks[i].count;
+        if (n > total - grid->pairCount)
+            n = total - grid->pairCount;
+        memcpy(grid->pairs + 2*grid->pairCount, grid->chunks[i].pairs, n*2*sizeof(unsigned int));
+        grid->pairCount += n;
+    }
+    return grid->pairCount;
+}
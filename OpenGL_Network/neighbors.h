@@ -0,0 +1,64 @@
+/*  Header file for neighbors.c, which finds all of the pairs of points that
+    are closer together than some distance, for drawing the "network" lines
+    between nearby points.
+
+    Comparing every point with every other point takes time proportional to
+    the square of the number of points, which is too slow beyond a few
+    thousand points.  Instead, the points are sorted into a uniform grid of
+    square cells whose side is the distance.  Two points that are close
+    enough are then in the same cell or in neighboring cells, so each point
+    is only compared with the few points around it, and the time grows about
+    linearly with the number of points (as long as the distance is small
+    enough that each point has only a few neighbors).
+
+    The search over the cells is split into jobs with OpenGL_Stage/jobs.c.
+    Each chunk of cells collects its own pairs, and the chunks are joined in
+    order, so the list of pairs is the same for any number of threads.  */
+
+#ifndef NEIGHBORS_H
+#define NEIGHBORS_H
+
+#include "particles.h"
+
+//  Cells per job.
+#define NEIGHBOR_GRAIN 4096
+
+//  The pairs found by one chunk of cells.
+typedef struct NeighborChunk {
+    unsigned int* pairs;
+    int count, capacity;
+} NeighborChunk;
+
+/*  The grid and the pairs.  After findNeighborPairs(), pairs[2*k] and
+    pairs[2*k+1] are the numbers of the two points of pair k, for k from 0
+    to pairCount-1, ready to be used as a GL_LINES index buffer.  The other
+    fields are scratch space kept from frame to frame.  */
+typedef struct NeighborGrid {
+    unsigned int* pairs;
+    int pairCount;
+
+    float cellSize;
+    int columns, rows;
+    int pointCapacity, cellCapacity, pairCapacity, chunkCapacity;
+    int* pointCells;      // the cell of each point
+    int* cellStarts;      // the points of cell c are order[cellStarts[c]] to order[cellStarts[c+1]-1]
+    int* order;           // point numbers, sorted by cell
+    float* sortedX;       // their coordinates, in the same order, for fast access
+    float* sortedY;
+    NeighborChunk* chunks;
+    float distance;
+    int maxPairs;
+} NeighborGrid;
+
+//  Sets all of the fields of a new grid to zero.
+void initNeighborGrid(NeighborGrid* grid);
+
+//  Frees the arrays of a grid.
+void freeNeighborGrid(NeighborGrid* grid);
+
+/*  Finds the pairs of points that are less than distance apart.  If there
+    are more than maxPairs pairs, only the first maxPairs are kept.
+    Returns the number of pairs.  */
+int findNeighborPairs(NeighborGrid* grid, const ParticleSystem* particles, float distance, int maxPairs);
+
+#endif
@@ -0,0 +1,203 @@
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include "particles.h"
+#include "../OpenGL_Stage/jobs.h"
+
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+static float* allocateArray(int count) {
+    // aligned_alloc() wants the size to be a multiple of the alignment.
+    size_t bytes = ((size_t)count*sizeof(float) + PARTICLE_ALIGNMENT - 1) / PARTICLE_ALIGNMENT * PARTICLE_ALIGNMENT;
+    return aligned_alloc(PARTICLE_ALIGNMENT, bytes > 0 ? bytes : PARTICLE_ALIGNMENT);
+}
+
+int initParticles(ParticleSystem* particles, int count, float width, float height, float margin, unsigned int seed) {
+    memset(particles, 0, sizeof(ParticleSystem));
+    particles->x = allocateArray(count);
+    particles->y = allocateArray(count);
+    particles->vx = allocateArray(count);
+    particles->vy = allocateArray(count);
+    if ( ! particles->x || ! particles->y || ! particles->vx || ! particles->vy ) {
+        freeParticles(particles);
+        return 0;
+    }
+    particles->count = count;
+    particles->width = width;
+    particles->height = height;
+    particles->margin = margin;
+    particles->random = seed ? seed : 1;
+    resetParticles(particles);
+    return 1;
+}
+
+void freeParticles(ParticleSystem* particles) {
+    free(particles->x);
+    free(particles->y);
+    free(particles->vx);
+    free(particles->vy);
+    particles->x = particles->y = particles->vx = particles->vy = NULL;
+    particles->count = 0;
+}
+
+/*  A random number from 0 to 1, from a xorshift generator, so that the same
+    seed always gives the same points.  */
+static float nextRandom(ParticleSystem* particles) {
+    unsigned int r = particles->random;
+    r ^= r << 13;
+    r ^= r >> 17;
+    r ^= r << 5;
+    particles->random = r;
+    return (r >> 8) * (1.0f / 16777216);
+}
+
+void resetParticles(ParticleSystem* particles) {
+    int i;
+    for (i = 0; i < particles->count; i++) {
+        float speed = 2 + 4*nextRandom(particles);
+        float angle = 2*(float)M_PI*nextRandom(particles);
+        particles->x[i] = particles->width/2;
+        particles->y[i] = particles->height/2;
+        particles->vx[i] = speed*sinf(angle);
+        particles->vy[i] = speed*cosf(angle);
+    }
+}
+
+void resizeParticles(ParticleSystem* particles, float width, float height) {
+    particles->width = width;
+    particles->height = height;
+}
+
+/*  One coordinate of one point, exactly as updateData() does it.  */
+static void moveScalar(float* position, float* velocity, float low, float high) {
+    float p = *position + *velocity;
+    if (p < low && *velocity < 0) {
+        p += 2*(low - p);
+        *velocity = -*velocity;
+    }
+    else if (p > high && *velocity > 0) {
+        p -= 2*(p - high);
+        *velocity = -*velocity;
+    }
+    *position = p;
+}
+
+static void updateRangeScalar(ParticleSystem* particles, int first, int end) {
+    float left = particles->margin, right = particles->width - particles->margin;
+    float top = particles->margin, bottom = particles->height - particles->margin;
+    int i;
+    for (i = first; i < end; i++) {
+        moveScalar(&particles->x[i], &particles->vx[i], left, right);
+        moveScalar(&particles->y[i], &particles->vy[i], top, bottom);
+    }
+}
+
+#ifdef __SSE2__
+/*  Four points at once.  The two bounce tests become masks: a bounce at the
+    low edge replaces p with p + 2*(low - p), one at the high edge with
+    p - 2*(p - high), and either one flips the sign bit of the velocity.
+    The arithmetic is the same as in moveScalar(), so the results match.  */
+static inline void moveSIMD(float* position, float* velocity, __m128 low, __m128 high) {
+    const __m128 zero = _mm_setzero_ps(), two = _mm_set1_ps(2), sign = _mm_set1_ps(-0.0f);
+    __m128 v = _mm_load_ps(velocity);
+    __m128 p = _mm_add_ps(_mm_load_ps(position), v);
+    __m128 atLow = _mm_and_ps(_mm_cmplt_ps(p, low), _mm_cmplt_ps(v, zero));
+    __m128 atHigh = _mm_and_ps(_mm_cmpgt_ps(p, high), _mm_cmpgt_ps(v, zero));
+    __m128 fromLow = _mm_add_ps(p, _mm_mul_ps(two, _mm_sub_ps(low, p)));
+    __m128 fromHigh = _mm_sub_ps(p, _mm_mul_ps(two, _mm_sub_ps(p, high)));
+    p = _mm_or_ps(_mm_andnot_ps(atLow, p), _mm_and_ps(atLow, fromLow));
+    p = _mm_or_ps(_mm_andnot_ps(atHigh, p), _mm_and_ps(atHigh, fromHigh));
+    v = _mm_xor_ps(v, _mm_and_ps(_mm_or_ps(atLow, atHigh), sign));
+    _mm_store_ps(position, p);
+    _mm_store_ps(velocity, v);
+}
+#endif
+
+void updateParticleRange(ParticleSystem* particles, int first, int end) {
+#ifdef __SSE2__
+    __m128 left = _mm_set1_ps(particles->margin), right = _mm_set1_ps(particles->width - particles->margin);
+    __m128 top = _mm_set1_ps(particles->margin), bottom = _mm_set1_ps(particles->height - particles->margin);
+    int start = (first + 3) & ~3, i;
+    if (start > end)
+        start = end;
+    updateRangeScalar(particles, first, start);
+    for (i = start; i + 4 <= end; i += 4) {
+        moveSIMD(&particles->x[i], &particles->vx[i], left, right);
+        moveSIMD(&particles->y[i], &particles->vy[i], top, bottom);
+    }
+    updateRangeScalar(particles, i, end);
+#else
+    updateRangeScalar(particles, first, end);
+#endif
+}
+
+static void updateJob(void* data, int start, int end, int chunk) {
+    updateParticleRange((ParticleSystem*)data, start, end);
+}
+
+void updateParticles(ParticleSystem* particles) {
+    jobsParallelFor(particles->count, PARTICLE_GRAIN, updateJob, particles);
+}
+
+void updateParticlesScalar(ParticleSystem* particles) {
+    updateRangeScalar(particles, 0, particles->count);
+}
+
+static void headTowardsScalar(ParticleSystem* particles, float x, float y, int first, int end) {
+    int i;
+    for (i = first; i < end; i++) {
+        float dx = x - particles->x[i];
+        float dy = y - particles->y[i];
+        float dist = sqrtf(dx*dx + dy*dy);
+        if (dist > 0.1f) { // only if mouse and point are not too close.
+            float speed = sqrtf(particles->vx[i]*particles->vx[i] + particles->vy[i]*particles->vy[i]);
+            particles->vx[i] = dx/dist * speed;
+            particles->vy[i] = dy/dist * speed;
+        }
+    }
+}
+
+void headTowardsRange(ParticleSystem* particles, float x, float y, int first, int end) {
+#ifdef __SSE2__
+    // SSE square roots and divisions are rounded exactly like the scalar
+    // ones, so this matches headTowardsScalar() bit for bit.
+    const __m128 mouseX = _mm_set1_ps(x), mouseY = _mm_set1_ps(y), tooClose = _mm_set1_ps(0.1f);
+    int start = (first + 3) & ~3, i;
+    if (start > end)
+        start = end;
+    headTowardsScalar(particles, x, y, first, start);
+    for (i = start; i + 4 <= end; i += 4) {
+        __m128 dx = _mm_sub_ps(mouseX, _mm_load_ps(&particles->x[i]));
+        __m128 dy = _mm_sub_ps(mouseY, _mm_load_ps(&particles->y[i]));
+        __m128 vx = _mm_load_ps(&particles->vx[i]);
+        __m128 vy = _mm_load_ps(&particles->vy[i]);
+        __m128 dist = _mm_sqrt_ps(_mm_add_ps(_mm_mul_ps(dx, dx), _mm_mul_ps(dy, dy)));
+        __m128 speed = _mm_sqrt_ps(_mm_add_ps(_mm_mul_ps(vx, vx), _mm_mul_ps(vy, vy)));
+        __m128 turn = _mm_cmpgt_ps(dist, tooClose);
+        __m128 newVX = _mm_mul_ps(_mm_div_ps(dx, dist), speed);
+        __m128 newVY = _mm_mul_ps(_mm_div_ps(dy, dist), speed);
+        _mm_store_ps(&particles->vx[i], _mm_or_ps(_mm_andnot_ps(turn, vx), _mm_and_ps(turn, newVX)));
+        _mm_store_ps(&particles->vy[i], _mm_or_ps(_mm_andnot_ps(turn, vy), _mm_and_ps(turn, newVY)));
+    }
+    headTowardsScalar(particles, x, y, i, end);
+#else
+    headTowardsScalar(particles, x, y, first, end);
+#endif
+}
+
+typedef struct HeadTowardsJob {
+    ParticleSystem* particles;
+    float x, y;
+} HeadTowardsJob;
+
+static void headTowardsJob(void* data, int start, int end, int chunk) {
+    HeadTowardsJob* job = data;
+    headTowardsRange(job->particles, job->x, job->y, start, end);
+}
+
+void headTowards(ParticleSystem* particles, float x, float y) {
+    HeadTowardsJob job = { particles, x, y };
+    jobsParallelFor(particles->count, PARTICLE_GRAIN, headTowardsJob, &job);
+}
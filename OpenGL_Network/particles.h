@@ -0,0 +1,79 @@
+/*  Header file for particles.c, the simulation of the Network program: points
+    that move in straight lines across a window and bounce off its edges, as
+    in updateData() in WebGL_Network/code.html.
+
+    The points are stored as a "structure of arrays": one array of x
+    coordinates, one of y coordinates and one for each velocity component.
+    An update then streams through four plain float arrays, which the SIMD
+    version of updateParticles() handles four points at a time.
+
+    Positions are in pixels, with (0,0) at the upper left corner of the
+    window, and velocities are in pixels per update.  A point bounces when
+    its center comes within margin (half the point size) of an edge.
+
+    The updates are spread over all of the cores with jobsParallelFor() from
+    OpenGL_Stage/jobs.c, in chunks of PARTICLE_GRAIN points.  Every point is
+    updated on its own, with no sums or other results that combine points,
+    so the results are exactly the same for any number of threads.  (Until
+    jobsInit() is called, everything runs on the calling thread.)  */
+
+#ifndef PARTICLES_H
+#define PARTICLES_H
+
+//  A set of points.  The arrays are aligned to PARTICLE_ALIGNMENT bytes.
+typedef struct ParticleSystem {
+    int count;
+    float* x;
+    float* y;
+    float* vx;
+    float* vy;
+    float width, height;   // the area that the points bounce around in
+    float margin;
+    unsigned int random;   // state of the random number generator used by resetParticles()
+} ParticleSystem;
+
+#define PARTICLE_ALIGNMENT 64
+
+/*  Points per job.  A chunk of the four arrays is 128 KB, which stays in the
+    core's own cache while it is worked on; the number is a multiple of 16,
+    so each chunk starts on a PARTICLE_ALIGNMENT boundary.  */
+#define PARTICLE_GRAIN 8192
+
+/*  Allocates the arrays for count points and places them with
+    resetParticles().  Returns 0 if there is not enough memory.  */
+int initParticles(ParticleSystem* particles, int count, float width, float height, float margin, unsigned int seed);
+
+//  Frees the arrays.
+void freeParticles(ParticleSystem* particles);
+
+/*  Puts every point at the center of the area with a random velocity,
+    with a speed between 2 and 6 pixels per update, like createData().  */
+void resetParticles(ParticleSystem* particles);
+
+//  Changes the size of the area, for example when the window is resized.
+void resizeParticles(ParticleSystem* particles, float width, float height);
+
+/*  Moves every point by its velocity and makes the ones that pass an edge
+    bounce.  Uses SSE when the compiler supports it (as on any x86-64), and
+    otherwise the same code as updateParticlesScalar(); both give exactly
+    the same results.  The work is split into jobs.  */
+void updateParticles(ParticleSystem* particles);
+
+//  The same update, one point at a time, on the calling thread only.
+void updateParticlesScalar(ParticleSystem* particles);
+
+/*  Updates points first to end-1 only, which lets the work be split into
+    pieces.  first must be a multiple of 4 for the SIMD code to use aligned
+    loads; other values still work, but more slowly.  */
+void updateParticleRange(ParticleSystem* particles, int first, int end);
+
+/*  Turns every point towards (x,y) without changing its speed, like
+    headTowards() in the WebGL version.  Points closer than 0.1 pixel to
+    (x,y) are left alone.  Like updateParticles(), this uses SSE and is
+    split into jobs.  */
+void headTowards(ParticleSystem* particles, float x, float y);
+
+//  headTowards() for points first to end-1 only.
+void headTowardsRange(ParticleSystem* particles, float x, float y, int first, int end);
+
+#endif
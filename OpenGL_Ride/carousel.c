@@ -0,0 +1,368 @@
+#include <stdio.h>
+#include <stddef.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include "carousel.h"
+#include "../OpenGL_Stage/geodesic.h"
+#include "../OpenGL_Stage/meshopt.h"
+#include "../OpenGL_Stage/jsonmodel.h"
+
+#define CAROUSEL_ATTRIBUTES 6   // the four columns of a_model, a_time and a_material
+#define MORPH_TEXTURE_UNIT 1
+
+static const char* vertexShaderSource =
+    "#version 150 compatibility\n"
+    MORPH_GLSL
+    "in mat4 a_model;      // per instance\n"
+    "in float a_time;\n"
+    "in int " MATERIAL_ATTRIBUTE ";\n"
+    "uniform mat4 u_view;\n"
+    "uniform bool u_morph;  // Is this the horse, whose frames are in u_morphData?\n"
+    "out vec3 v_position;\n"
+    "out vec3 v_normal;\n"
+    "out vec3 v_objectNormal;\n"
+    "flat out int v_material;\n"
+    "void main() {\n"
+    "    vec3 position, normal;\n"
+    "    if (u_morph)\n"
+    "        morphVertex(a_time, position, normal);\n"
+    "    else {\n"
+    "        position = gl_Vertex.xyz;\n"
+    "        normal = gl_Normal;\n"
+    "    }\n"
+    "    // The cylinders are scaled by different amounts along their axes, so the\n"
+    "    // normals need the inverse transpose of the modelview transform.\n"
+    "    mat4 modelview = u_view * a_model;\n"
+    "    vec4 eyePosition = modelview * vec4(position, 1.0);\n"
+    "    v_position = eyePosition.xyz;\n"
+    "    v_normal = transpose(inverse(mat3(modelview))) * normal;\n"
+    "    v_objectNormal = normal;\n"
+    "    v_material = " MATERIAL_ATTRIBUTE ";\n"
+    "    gl_Position = gl_ProjectionMatrix * eyePosition;\n"
+    "}\n";
+
+/*  The lights of the original, as three.js computes them: a Lambert
+    material only has the diffuse part, and a Phong material (one with a
+    shininess) adds a specular highlight.  A textured material multiplies its
+    diffuse color by the texture, which is wrapped around the sphere as by
+    THREE.SphereGeometry.  */
+static const char* fragmentShaderSource =
+    "#version 150 compatibility\n"
+    MATERIAL_GLSL
+    "in vec3 v_position;\n"
+    "in vec3 v_normal;\n"
+    "in vec3 v_objectNormal;\n"
+    "flat in int v_material;\n"
+    "uniform bool u_textured;\n"
+    "uniform sampler2D u_texture;\n"
+    "uniform vec3 u_headlightColor;\n"
+    "uniform vec3 u_spotPosition;   // in view coordinates, like the other positions and directions\n"
+    "uniform vec3 u_spotDirection;  // from the target towards the light\n"
+    "uniform vec3 u_spotColor;\n"
+    "uniform float u_spotCosine;\n"
+    "uniform float u_spotExponent;\n"
+    "uniform vec3 u_pointPosition;\n"
+    "uniform vec3 u_pointColor;\n"
+    "vec3 light(Material m, vec3 diffuse, vec3 N, vec3 V, vec3 L, vec3 color) {\n"
+    "    float d = dot(N, L);\n"
+    "    if (d <= 0.0)\n"
+    "        return vec3(0.0);\n"
+    "    vec3 lit = d * diffuse;\n"
+    "    if (m.shininess > 0.0)\n"
+    "        lit += pow(max(dot(N, normalize(L + V)), 0.0), m.shininess) * m.specular.rgb;\n"
+    "    return lit * color;\n"
+    "}\n"
+    "vec2 sphereUV(vec3 n) {\n"
+    "    // u goes once around the y-axis, from -x towards +z, and v from the bottom\n"
+    "    // to the top.  Where u wraps from 1 to 0, the mipmap level would be picked\n"
+    "    // from the jump, so the derivatives come from whichever of u and u + 0.5\n"
+    "    // does not wrap at this pixel.\n"
+    "    float u = atan(n.z, -n.x) / 6.2831853;\n"
+    "    float u1 = fract(u), u2 = fract(u + 0.5) - 0.5;\n"
+    "    return vec2(fwidth(u1) <= fwidth(u2) ? u1 : u2, 1.0 - acos(clamp(n.y, -1.0, 1.0)) / 3.1415927);\n"
+    "}\n"
+    "void main() {\n"
+    "    Material m = getMaterial(v_material);\n"
+    "    vec3 N = normalize(v_normal);\n"
+    "    vec3 V = normalize(-v_position);\n"
+    "    vec3 diffuse = m.diffuse.rgb;\n"
+    "    if (u_textured)\n"
+    "        diffuse *= texture(u_texture, sphereUV(normalize(v_objectNormal))).rgb;\n"
+    "    vec3 color = m.ambient.rgb + light(m, diffuse, N, V, vec3(0.0, 0.0, 1.0), u_headlightColor);\n"
+    "    vec3 L = normalize(u_spotPosition - v_position);\n"
+    "    float spot = dot(u_spotDirection, L);\n"
+    "    if (spot > u_spotCosine)\n"
+    "        color += pow(spot, u_spotExponent) * light(m, diffuse, N, V, L, u_spotColor);\n"
+    "    color += light(m, diffuse, N, V, normalize(u_pointPosition - v_position), u_pointColor);\n"
+    "    gl_FragColor = vec4(color, 1.0);\n"
+    "}\n";
+
+/*  Makes a cylinder of height 1 around the y-axis, from y = -0.5 to y = 0.5,
+    with a bottom of radius 1 and a top of radius topRadius, like a
+    THREE.CylinderGeometry; with a topRadius of 0, it is a cone.  The side is
+    smooth, and the ends are flat disks.  */
+static TriMesh createCylinderMesh(float topRadius, int segments) {
+    TriMesh mesh;
+    int hasTop = topRadius > 0;
+    int sideTriangles = hasTop ? 2*segments : segments;
+    int capCount = hasTop ? 2 : 1;
+    int vertex = 0, index = 0, k, cap;
+    float slope = 1 - topRadius;   // how far the side leans in, per unit of height
+    float length = sqrtf(1 + slope*slope);
+    mesh.vertexCount = 2*segments + capCount*(segments + 1);
+    mesh.triangleCount = sideTriangles + capCount*segments;
+    mesh.positions = malloc( mesh.vertexCount*3*sizeof(float) );
+    mesh.normals = malloc( mesh.vertexCount*3*sizeof(float) );
+    mesh.colors = NULL;
+    mesh.indices = malloc( mesh.triangleCount*3*sizeof(unsigned int) );
+
+    // The side: a ring of vertices at the bottom, then one at the top.
+    for (k = 0; k < 2*segments; k++, vertex++) {
+        float angle = 2 * M_PI * (k % segments) / segments;
+        float radius = k < segments ? 1 : topRadius;
+        float* p = &mesh.positions[3*vertex];
+        float* n = &mesh.normals[3*vertex];
+        p[0] = radius * cosf(angle);
+        p[1] = k < segments ? -0.5f : 0.5f;
+        p[2] = radius * sinf(angle);
+        n[0] = cosf(angle) / length;
+        n[1] = slope / length;
+        n[2] = sinf(angle) / length;
+    }
+    for (k = 0; k < segments; k++) {
+        unsigned int b0 = k, b1 = (k + 1) % segments, t0 = segments + b0, t1 = segments + b1;
+        unsigned int* t = &mesh.indices[index];
+        t[0] = b0;  t[1] = t0;  t[2] = b1;
+        index += 3;
+        if (hasTop) {
+            t[3] = b1;  t[4] = t0;  t[5] = t1;
+            index += 3;
+        }
+    }
+
+    // The ends: a center and a ring, with the normal along the axis.
+    for (cap = 0; cap < capCount; cap++) {
+        float y = cap == 0 ? -0.5f : 0.5f, radius = cap == 0 ? 1 : topRadius;
+        int center = vertex;
+        for (k = -1; k < segments; k++, vertex++) {
+            float angle = 2 * M_PI * k / segments;
+            float* p = &mesh.positions[3*vertex];
+            float* n = &mesh.normals[3*vertex];
+            p[0] = k < 0 ? 0 : radius * cosf(angle);
+            p[1] = y;
+            p[2] = k < 0 ? 0 : radius * sinf(angle);
+            n[0] = n[2] = 0;
+            n[1] = cap == 0 ? -1 : 1;
+        }
+        for (k = 0; k < segments; k++) {
+            unsigned int a = center + 1 + k, b = center + 1 + (k + 1) % segments;
+            unsigned int* t = &mesh.indices[index];
+            t[0] = center;
+            t[1] = cap == 0 ? a : b;   // counterclockwise as seen from outside
+            t[2] = cap == 0 ? b : a;
+            index += 3;
+        }
+    }
+    return mesh;
+}
+
+static int loadHorse(const char* path, MorphMesh* morph) {
+    JsonModel model;
+    size_t length = strlen(path);
+    if (length > 5 && strcmp(path + length - 5, ".mesh") == 0)
+        return readMorphMesh(path, morph);
+    if ( ! readJsonModel(path, &model) )
+        return 0;
+    *morph = compileJsonModel(&model);
+    freeJsonModel(&model);
+    return 1;
+}
+
+static void uploadShape(MeshBuffer* buffer, TriMesh mesh) {
+    optimizeMesh(&mesh, 1e-6f);
+    uploadTriMesh(buffer, &mesh);
+    freeTriMesh(&mesh);
+}
+
+int initCarouselRenderer(CarouselRenderer* carousel, const char* horsePath,
+                         float materials[][MATERIAL_FLOATS], int materialCount) {
+    GLuint program;
+    MorphMesh horse;
+    MorphAnimator animator;
+    Polyhedron sphere;
+    int ok;
+    memset(carousel, 0, sizeof(CarouselRenderer));
+    if ( ! hasGLVersion(3, 3) ) {
+        printf("The instanced carousel needs OpenGL 3.3.\n");
+        return 0;
+    }
+    program = carousel->program = createProgram("carousel", vertexShaderSource, fragmentShaderSource);
+    if ( ! program )
+        return 0;
+    carousel->modelLocation = glGetAttribLocation(program, "a_model");
+    carousel->timeLocation = glGetAttribLocation(program, "a_time");
+    carousel->materialLocation = useMaterialBlock(program);
+    carousel->viewLocation = glGetUniformLocation(program, "u_view");
+    carousel->morphLocation = glGetUniformLocation(program, "u_morph");
+    carousel->texturedLocation = glGetUniformLocation(program, "u_textured");
+    carousel->headlightLocation = glGetUniformLocation(program, "u_headlightColor");
+    carousel->spotPositionLocation = glGetUniformLocation(program, "u_spotPosition");
+    carousel->spotDirectionLocation = glGetUniformLocation(program, "u_spotDirection");
+    carousel->spotColorLocation = glGetUniformLocation(program, "u_spotColor");
+    carousel->spotCosineLocation = glGetUniformLocation(program, "u_spotCosine");
+    carousel->spotExponentLocation = glGetUniformLocation(program, "u_spotExponent");
+    carousel->pointPositionLocation = glGetUniformLocation(program, "u_pointPosition");
+    carousel->pointColorLocation = glGetUniformLocation(program, "u_pointColor");
+    glUseProgram(program);
+    glUniform1i(glGetUniformLocation(program, "u_texture"), 0);
+    glUseProgram(0);
+
+    // The frames of the horse go into a texture buffer; the mesh is only needed for its triangles.
+    if ( ! loadHorse(horsePath, &horse) ) {
+        freeCarouselRenderer(carousel);
+        return 0;
+    }
+    ok = initMorphAnimator(&animator, &horse);
+    if (ok) {
+        ok = uploadMorphBuffer(&carousel->horseFrames, &animator);
+        freeMorphAnimator(&animator);
+    }
+    if ( ! ok ) {
+        freeMorphMesh(&horse);
+        freeCarouselRenderer(carousel);
+        return 0;
+    }
+    uploadTriMesh(&carousel->meshes[CAROUSEL_HORSE], &horse.mesh);
+    freeMorphMesh(&horse);
+
+    uploadShape(&carousel->meshes[CAROUSEL_CYLINDER], createCylinderMesh(1, CAROUSEL_SEGMENTS));
+    uploadShape(&carousel->meshes[CAROUSEL_CONE], createCylinderMesh(0, CAROUSEL_SEGMENTS));
+    sphere = createGeodesicSphere(3);
+    uploadShape(&carousel->meshes[CAROUSEL_SPHERE], compilePolyhedronSmooth(sphere));
+    freePolyhedron(&sphere);
+
+    carousel->materialBuffer = createMaterialBuffer(materials, materialCount);
+    glGenBuffers(1, &carousel->instanceBuffer);
+    return 1;
+}
+
+void freeCarouselRenderer(CarouselRenderer* carousel) {
+    int i;
+    glDeleteProgram(carousel->program);
+    for (i = 0; i < CAROUSEL_MESHES; i++)
+        freeMeshBuffer(&carousel->meshes[i]);
+    freeMorphBuffer(&carousel->horseFrames);
+    glDeleteBuffers(1, &carousel->materialBuffer);
+    glDeleteBuffers(1, &carousel->instanceBuffer);
+    memset(carousel, 0, sizeof(CarouselRenderer));
+}
+
+void uploadCarouselInstances(CarouselRenderer* carousel, const CarouselInstance* instances, int count) {
+    int i;
+    glBindBuffer(GL_ARRAY_BUFFER, carousel->instanceBuffer);
+    if (count > carousel->instanceCapacity)
+        carousel->instanceCapacity = count + count/2;
+    // Orphan the previous frame's instances instead of waiting for the GPU to finish with them.
+    glBufferData(GL_ARRAY_BUFFER, (GLsizeiptr)carousel->instanceCapacity * sizeof(CarouselInstance), NULL,
+                 GL_STREAM_DRAW);
+    glBufferSubData(GL_ARRAY_BUFFER, 0, (GLsizeiptr)count * sizeof(CarouselInstance), instances);
+    glBindBuffer(GL_ARRAY_BUFFER, 0);
+    // The instances of a mesh are one run in the sorted array.
+    for (i = 0; i < CAROUSEL_MESHES; i++)
+        carousel->first[i] = carousel->count[i] = 0;
+    for (i = 0; i < count; i++) {
+        int mesh = instances[i].mesh;
+        if (carousel->count[mesh] == 0)
+            carousel->first[mesh] = i;
+        carousel->count[mesh]++;
+    }
+}
+
+//  Transforms a point, or a direction if w is 0, from world to view coordinates.
+static void toView(const float* view, const float* v, float w, float* result) {
+    int i;
+    for (i = 0; i < 3; i++)
+        result[i] = view[i]*v[0] + view[4+i]*v[1] + view[8+i]*v[2] + view[12+i]*w;
+}
+
+static void setLights(CarouselRenderer* carousel, const float* view, const CarouselLights* lights) {
+    float spotPosition[3], pointPosition[3], axis[3], direction[3], length;
+    int i;
+    toView(view, lights->spotPosition, 1, spotPosition);
+    toView(view, lights->pointPosition, 1, pointPosition);
+    for (i = 0; i < 3; i++)
+        axis[i] = lights->spotPosition[i] - lights->spotTarget[i];
+    toView(view, axis, 0, direction);
+    length = sqrtf(direction[0]*direction[0] + direction[1]*direction[1] + direction[2]*direction[2]);
+    for (i = 0; i < 3 && length > 0; i++)
+        direction[i] /= length;
+    glUniform3fv(carousel->headlightLocation, 1, lights->headlightColor);
+    glUniform3fv(carousel->spotPositionLocation, 1, spotPosition);
+    glUniform3fv(carousel->spotDirectionLocation, 1, direction);
+    glUniform3fv(carousel->spotColorLocation, 1, lights->spotColor);
+    glUniform1f(carousel->spotCosineLocation, cosf(lights->spotAngle));
+    glUniform1f(carousel->spotExponentLocation, lights->spotExponent);
+    glUniform3fv(carousel->pointPositionLocation, 1, pointPosition);
+    glUniform3fv(carousel->pointColorLocation, 1, lights->pointColor);
+}
+
+//  Points the instance attributes at the instances of one mesh, which start at instance first.
+static void setInstanceArrays(CarouselRenderer* carousel, int first) {
+    const char* base = (const char*)NULL + first*sizeof(CarouselInstance);
+    int column;
+    for (column = 0; column < 4; column++)
+        glVertexAttribPointer(carousel->modelLocation + column, 4, GL_FLOAT, GL_FALSE, sizeof(CarouselInstance),
+                              base + offsetof(CarouselInstance, model) + column*4*sizeof(float));
+    glVertexAttribPointer(carousel->timeLocation, 1, GL_FLOAT, GL_FALSE, sizeof(CarouselInstance),
+                          base + offsetof(CarouselInstance, time));
+    glVertexAttribIPointer(carousel->materialLocation, 1, GL_INT, sizeof(CarouselInstance),
+                           base + offsetof(CarouselInstance, material));
+}
+
+void drawCarousel(CarouselRenderer* carousel, const float* view, const CarouselLights* lights,
+                  GLuint moonTexture) {
+    GLint locations[CAROUSEL_ATTRIBUTES];
+    int i, mesh;
+    for (i = 0; i < 4; i++)
+        locations[i] = carousel->modelLocation + i;
+    locations[4] = carousel->timeLocation;
+    locations[5] = carousel->materialLocation;
+    glUseProgram(carousel->program);
+    glUniformMatrix4fv(carousel->viewLocation, 1, GL_FALSE, view);
+    setLights(carousel, view, lights);
+    useMorphBuffer(&carousel->horseFrames, carousel->program, MORPH_TEXTURE_UNIT);
+    glBindTexture(GL_TEXTURE_2D, moonTexture);
+    glEnable(GL_CULL_FACE);
+    for (i = 0; i < CAROUSEL_ATTRIBUTES; i++) {
+        if (locations[i] < 0)
+            continue;
+        glVertexAttribDivisor(locations[i], 1);
+        glEnableVertexAttribArray(locations[i]);
+    }
+    for (mesh = 0; mesh < CAROUSEL_MESHES; mesh++) {
+        const MeshBuffer* buffer = &carousel->meshes[mesh];
+        if (carousel->count[mesh] == 0)
+            continue;
+        glUniform1i(carousel->morphLocation, mesh == CAROUSEL_HORSE);
+        glUniform1i(carousel->texturedLocation, mesh == CAROUSEL_SPHERE && moonTexture != 0);
+        bindMeshBufferPositions(buffer);
+        glBindBuffer(GL_ARRAY_BUFFER, buffer->normalBuffer);
+        glNormalPointer(GL_FLOAT, 0, 0);
+        glEnableClientState(GL_NORMAL_ARRAY);
+        glBindBuffer(GL_ARRAY_BUFFER, carousel->instanceBuffer);
+        setInstanceArrays(carousel, carousel->first[mesh]);
+        glDrawElementsInstanced(GL_TRIANGLES, buffer->indexCount, GL_UNSIGNED_INT, 0, carousel->count[mesh]);
+        glDisableClientState(GL_NORMAL_ARRAY);
+    }
+    for (i = 0; i < CAROUSEL_ATTRIBUTES; i++) {
+        if (locations[i] < 0)
+            continue;
+        glDisableVertexAttribArray(locations[i]);
+        glVertexAttribDivisor(locations[i], 0);
+    }
+    unbindMeshBuffer();
+    glDisable(GL_CULL_FACE);
+    glBindTexture(GL_TEXTURE_2D, 0);
+    glUseProgram(0);
+}
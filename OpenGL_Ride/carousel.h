@@ -0,0 +1,108 @@
+/*  Header file for carousel.c, which draws the carousel and the cage of
+    Three.js_Ride with one instanced draw call for each kind of mesh.
+
+    Three.js_Ride/code.html builds the ride out of THREE.Mesh objects, and
+    horseLoaded() clones the pole, with its horse, five times, each horse
+    with a material of its own, so every pole, horse, hat and ball is an
+    object of its own, with its own draw call and state changes.  Here
+    there are only four meshes, each uploaded once and shared by all of the
+    objects that use it:
+
+        CAROUSEL_HORSE      the horse of Three.js_Ride/resources/horse.js,
+                            galloping: its frames are blended in the vertex
+                            shader by OpenGL_Stage/morphbuffer.c;
+        CAROUSEL_CYLINDER   a cylinder of radius 1 and height 1, around the
+                            y-axis, for the poles, the bars of the cage and
+                            the bases of the hats;
+        CAROUSEL_CONE       a cone of the same size, for the tops of the hats;
+        CAROUSEL_SPHERE     a sphere of radius 1, for the balls, which are
+                            textured with the moon.
+
+    Everything that differs from object to object is in an instance: its
+    transform, its material and, for a horse, the time of its gallop.  The
+    instances of the whole scene are copied into one buffer, once per frame,
+    with uploadCarouselInstances(), and the colors come from a table of
+    materials in a uniform buffer, made by OpenGL_Stage/materials.c.
+
+    The lighting is that of the original: a white light shining from the
+    eye, a blue spotlight and a yellow point light, with MeshLambertMaterial
+    and MeshPhongMaterial computed per pixel.
+
+    Requires OpenGL 3.3 (for instanced attributes).  */
+
+#ifndef CAROUSEL_H
+#define CAROUSEL_H
+
+#include "../OpenGL_Stage/meshbuffer.h"
+#include "../OpenGL_Stage/morphbuffer.h"
+#include "../OpenGL_Stage/materials.h"
+
+#define CAROUSEL_HORSE 0
+#define CAROUSEL_CYLINDER 1
+#define CAROUSEL_CONE 2
+#define CAROUSEL_SPHERE 3
+#define CAROUSEL_MESHES 4
+
+#define CAROUSEL_SEGMENTS 56   // around a cylinder or a cone, as in the original
+
+//  One object: a mesh, where it is, and how it looks.
+typedef struct CarouselInstance {
+    float model[16];   // the modeling transform, from the mesh to world coordinates
+    float time;        // for a horse, the time in its gallop, in frames, as for morphAtTime()
+    int material;      // a row of the table of materials
+    int mesh;          // CAROUSEL_HORSE, CAROUSEL_CYLINDER, CAROUSEL_CONE or CAROUSEL_SPHERE
+    int padding;       // makes an instance 80 bytes, a multiple of 16
+} CarouselInstance;
+
+//  The positions and colors of the lights, which carousel.c transforms to view coordinates.
+typedef struct CarouselLights {
+    float headlightColor[3];    // a directional light, shining from the eye along -z
+    float spotPosition[3];      // in world coordinates
+    float spotTarget[3];
+    float spotColor[3];
+    float spotAngle;            // in radians, from the axis of the cone to its edge
+    float spotExponent;         // how quickly the light falls off towards the edge
+    float pointPosition[3];
+    float pointColor[3];
+} CarouselLights;
+
+//  The shader, meshes and buffers for drawing the scene.
+typedef struct CarouselRenderer {
+    GLuint program;
+    MeshBuffer meshes[CAROUSEL_MESHES];
+    MorphBuffer horseFrames;
+    GLuint materialBuffer;
+    GLuint instanceBuffer;
+    int instanceCapacity;
+    int first[CAROUSEL_MESHES];   // the instances of each mesh, in the buffer
+    int count[CAROUSEL_MESHES];
+    GLint modelLocation, timeLocation, materialLocation;
+    GLint viewLocation, morphLocation, texturedLocation;
+    GLint headlightLocation, spotPositionLocation, spotDirectionLocation, spotColorLocation;
+    GLint spotCosineLocation, spotExponentLocation, pointPositionLocation, pointColorLocation;
+} CarouselRenderer;
+
+/*  Compiles the shader, makes the meshes, reads the horse from a three.js
+    JSON model or a .mesh file of OpenGL_Stage/meshconvert.c, and uploads
+    the table of materials.  Returns 0, after printing a message, if the
+    OpenGL version is too old or something fails.  createPolyhedra() must
+    have been called.  */
+int initCarouselRenderer(CarouselRenderer* carousel, const char* horsePath,
+                         float materials[][MATERIAL_FLOATS], int materialCount);
+
+//  Deletes the shader and buffers.
+void freeCarouselRenderer(CarouselRenderer* carousel);
+
+/*  Copies count instances into the instance buffer, orphaning the buffer of
+    the previous frame.  The instances must be sorted by mesh, so that the
+    instances of each mesh can be drawn with one call.  */
+void uploadCarouselInstances(CarouselRenderer* carousel, const CarouselInstance* instances, int count);
+
+/*  Draws the uploaded instances, with one draw call per mesh, using the
+    current projection matrix and the given viewing transform.  moonTexture
+    is the 2D texture of the spheres, or 0 to draw them white while it
+    loads.  No shader is current afterwards.  */
+void drawCarousel(CarouselRenderer* carousel, const float* view, const CarouselLights* lights,
+                  GLuint moonTexture);
+
+#endif
@@ -0,0 +1,382 @@
+/*
+ * This program shows a carousel of five horses, with poles and two golden
+ * hats around a moon, next to a cage of golden bars and moons.  It is the
+ * native version of Three.js_Ride/code.html.  The original makes a
+ * THREE.Mesh for each part, cloning the pole and its horse for every horse;
+ * here the parts are nodes of a hierarchy, like the Object3Ds of three.js,
+ * but every part that looks the same shares one mesh, and carousel.c draws
+ * each mesh once, instanced, for all of the parts.  The motion is not coded
+ * by hand: the turn of the ride and the bobbing of the horses are tracks of
+ * OpenGL_Stage/animation.c, which drive the transforms of the nodes.  Each
+ * frame, updateForFrame() evaluates the tracks, works out the transforms of
+ * the parts from the hierarchy and copies them, with the times of the
+ * horses' gallops, into the instance buffer in one upload; when the frame
+ * has not changed, as while the animation is off, it does nothing.  While
+ * the ride turns, the horses gallop, each out of step with the others, and
+ * ride up and down their poles.
+ *
+ *      CONTROLS
+ *      ~ Mouse drag: Rotates the view around the scene, like OrbitControls,
+ *        with OpenGL_Stage/controls.c; the view coasts to a stop when let go
+ *      ~ A or space: Toggles the animation
+ *
+ * Run with -model FILE to read the horse from another three.js JSON model,
+ * or from a .mesh file made by OpenGL_Stage/meshconvert.c.  The -uncapped
+ * and -stats options are those of OpenGL_Stage/frameloop.c; the statistics
+ * include the time for the update of the instances.  Nothing is drawn while
+ * the animation is off and the view is still.  Compile this program with:
+ *
+ *        gcc -O2 -o code code.c carousel.c ../OpenGL_Stage/morphbuffer.c ../OpenGL_Stage/morph.c \
+ *            ../OpenGL_Stage/morphmesh.c ../OpenGL_Stage/jsonmodel.c ../OpenGL_Stage/polyhedron.c \
+ *            ../OpenGL_Stage/mesh.c ../OpenGL_Stage/meshopt.c ../OpenGL_Stage/geodesic.c \
+ *            ../OpenGL_Stage/meshbuffer.c ../OpenGL_Stage/materials.c ../OpenGL_Stage/shader.c \
+ *            ../OpenGL_Stage/mat4.c ../OpenGL_Stage/frameloop.c ../OpenGL_Stage/jobs.c \
+ *            ../OpenGL_Stage/texture.c ../OpenGL_Stage/animation.c ../OpenGL_Stage/controls.c -lGL -lglut -ljpeg -lm -pthread
+ */
+
+#include "../OpenGL_Stage/shader.h"  // Includes <GL/gl.h>, with the functions needed for shaders.
+#include <GL/freeglut.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <math.h>
+#include "../OpenGL_Stage/polyhedron.h"
+#include "../OpenGL_Stage/mat4.h"
+#include "../OpenGL_Stage/frameloop.h"
+#include "../OpenGL_Stage/texture.h"
+#include "../OpenGL_Stage/animation.h"
+#include "../OpenGL_Stage/controls.h"
+#include "carousel.h"
+
+#define HORSE_COUNT 5
+#define MAX_NODES 64
+#define UPDATES_PER_SECOND 60           // the frame number goes up by one per update, as per frame in the original
+#define GALLOP_FRAMES_PER_SECOND 15     // the horse's 15 frames take a second, as in three.js
+#define BOB_HEIGHT 0.5f                 // how far a horse rides up and down its pole
+#define BOB_SPEED 0.04f                 // radians per frame
+
+// The rows of the materials table.
+#define MOON 0
+#define GOLD 1
+#define GRAY 2
+#define HORSE_MATERIAL 3    // the first of HORSE_COUNT colors
+
+float materials[HORSE_MATERIAL + HORSE_COUNT][MATERIAL_FLOATS] = {
+    // A MeshLambertMaterial with the moon texture; the texture is multiplied by white.
+    { 0, 0, 0, 1,  1, 1, 1, 1,  0, 0, 0, 1,  0, 0 },
+    // MeshPhongMaterials of the colors "gold" and "gray", with three.js's default specular color and shininess.
+    { 0, 0, 0, 1,  1, 0.843f, 0, 1,  0.067f, 0.067f, 0.067f, 1,  30, 0 },
+    { 0, 0, 0, 1,  0.502f, 0.502f, 0.502f, 1,  0.067f, 0.067f, 0.067f, 1,  30, 0 },
+    // The MeshLambertMaterials of the horses: 0x0000FF, 0x3300FF, 0x6600FF, 0x9900FF and 0xCC00FF.
+    { 0, 0, 0, 1,  0, 0, 1, 1,  0, 0, 0, 1,  0, 0 },
+    { 0, 0, 0, 1,  0.2f, 0, 1, 1,  0, 0, 0, 1,  0, 0 },
+    { 0, 0, 0, 1,  0.4f, 0, 1, 1,  0, 0, 0, 1,  0, 0 },
+    { 0, 0, 0, 1,  0.6f, 0, 1, 1,  0, 0, 0, 1,  0, 0 },
+    { 0, 0, 0, 1,  0.8f, 0, 1, 1,  0, 0, 0, 1,  0, 0 },
+};
+
+// The lights of the original: a white light from the eye, a blue SpotLight and a yellow PointLight.
+CarouselLights lights = {
+    { 1, 1, 1 },
+    { 0, 2, 0 }, { 0, 0, 0 }, { 0, 0, 1 }, M_PI / 3, 10,   // the defaults of a THREE.SpotLight
+    { 0, 0, 0 }, { 1, 1, 0 },
+};
+
+/**
+ * A part of the scene, like an Object3D in three.js.  Node i is also node i
+ * of the animation system, which holds its position, rotation and scale
+ * relative to its parent.  A node may show a mesh, which is scaled by size
+ * first: the size is that of the geometry, so it does not apply to the
+ * children, as the radius and height of a CylinderGeometry do not.  A
+ * parent always comes before its children in the array.
+ */
+typedef struct Node {
+    int parent;            // -1 for a node in the scene itself
+    int mesh;              // -1 for a group that shows nothing of its own
+    int material;
+    float size[3];
+    float world[16];       // the transform to world coordinates, set by updateForFrame()
+    int instance;          // where the mesh's instance is in the array of instances
+} Node;
+
+Node nodes[MAX_NODES];
+int nodeCount;
+AnimationSystem animation;
+CarouselInstance instances[MAX_NODES];
+int instanceCount;
+
+int ride;                  // the node that the ride turns with
+int horses[HORSE_COUNT];
+
+CarouselRenderer carousel;
+Texture* moon;             // loaded in the background; the balls are white until it is ready
+const char* horsePath = "../Three.js_Ride/resources/horse.js";
+
+int width = 1200, height = 600;  // size of the window
+float projection[16];
+
+// The camera, like that of OrbitControls: on a sphere around the origin, at an azimuth and a polar angle.
+#define CAMERA_DISTANCE 30
+CameraControls camera;
+
+int animating = 0;         // Is the animation running?  It starts off, like the Animate checkbox.
+int frameNumber = 0;       // goes up by one per update while animating
+
+double updateMilliseconds;
+
+static double now() {
+    struct timespec t;
+    clock_gettime(CLOCK_MONOTONIC, &t);
+    return t.tv_sec + t.tv_nsec * 1e-9;
+}
+
+/* ---------------------------- THE SCENE ------------------*/
+
+/* Adds a node at a position in its parent, with no rotation and a scale of 1, and returns its number. */
+int addNode(int parent, int mesh, int material, float x, float y, float z) {
+    Node* node = &nodes[nodeCount];
+    memset(node, 0, sizeof(Node));
+    node->parent = parent;
+    node->mesh = mesh;
+    node->material = material;
+    addAnimationNode(&animation, x, y, z);
+    node->size[0] = node->size[1] = node->size[2] = 1;
+    return nodeCount++;
+}
+
+//  Adds a node that shows a mesh, with the size of its geometry.
+int addShape(int parent, int mesh, int material, float x, float y, float z,
+             float sizeX, float sizeY, float sizeZ) {
+    int node = addNode(parent, mesh, material, x, y, z);
+    nodes[node].size[0] = sizeX;
+    nodes[node].size[1] = sizeY;
+    nodes[node].size[2] = sizeZ;
+    return node;
+}
+
+/* A hat: a cone with a radius of 10 and a height of 2, on a thin base. */
+int objHat(int parent, float y) {
+    int hat = addNode(parent, -1, 0, 0, y, 0);
+    addShape(hat, CAROUSEL_CONE, GOLD, 0, 0, 0, 10, 2, 10);
+    addShape(hat, CAROUSEL_CYLINDER, GOLD, 0, -1.13f, 0, 10, 0.25f, 10);
+    setAnimationChannel(&animation, hat, ANIMATION_SCALE, 0.75f);
+    return hat;
+}
+
+/**
+ * The ride: the two hats, the moon between them and the five poles, each
+ * with a horse on it.  Every pole and every horse uses the same mesh; they
+ * differ only in their transforms, materials and gallops.
+ */
+void objRide() {
+    int i;
+    ride = addNode(-1, -1, 0, 6, 0, 0);
+    objHat(ride, 4);
+    setAnimationChannel(&animation, objHat(ride, -4), ANIMATION_ROTATE_X, M_PI);
+    addShape(ride, CAROUSEL_SPHERE, MOON, 0, 0, 0, 3, 3, 3);
+    for (i = 0; i < HORSE_COUNT; i++) {
+        float angle = M_PI / 180 * i * 72;
+        int pole = addShape(ride, CAROUSEL_CYLINDER, GRAY, 6.5f * cosf(angle), 0, 6.5f * sinf(angle),
+                            0.1f, 6.2f, 0.1f);
+        setAnimationChannel(&animation, pole, ANIMATION_ROTATE_Y, -M_PI / 180 * i * 70);
+        horses[i] = addNode(pole, CAROUSEL_HORSE, HORSE_MATERIAL + i, 0, -2, 0);
+        setAnimationChannel(&animation, horses[i], ANIMATION_SCALE, 0.02f);
+    }
+}
+
+/* The cage: a moon at each corner of a cube, and a golden bar along each edge. */
+void objCage() {
+    static const float ballPos[8][3] = { {-3,3,3}, {3,3,3}, {3,3,-3}, {-3,3,-3},
+                                         {-3,-3,-3}, {3,-3,-3}, {3,-3,3}, {-3,-3,3} };
+    static const float barPos[12][3] = { {0,3,3}, {0,3,-3}, {0,-3,3}, {0,-3,-3},
+                                         {3,3,0}, {-3,3,0}, {3,-3,0}, {-3,-3,0},
+                                         {3,0,3}, {-3,0,3}, {-3,0,-3}, {3,0,-3} };
+    int cage = addNode(-1, -1, 0, -10, 0, 0), i, bar;
+    for (i = 0; i < 8; i++)
+        addShape(cage, CAROUSEL_SPHERE, MOON, ballPos[i][0], ballPos[i][1], ballPos[i][2], 1, 1, 1);
+    for (i = 0; i < 12; i++) {
+        bar = addShape(cage, CAROUSEL_CYLINDER, GOLD, barPos[i][0], barPos[i][1], barPos[i][2], 0.2f, 6, 0.2f);
+        if (i < 4)
+            setAnimationChannel(&animation, bar, ANIMATION_ROTATE_Z, M_PI / 2);   // along x
+        else if (i < 8)
+            setAnimationChannel(&animation, bar, ANIMATION_ROTATE_X, M_PI / 2);   // along z
+    }
+}
+
+/**
+ * Builds the scene, with the tracks that animate it, then gives each node
+ * that shows a mesh an instance.  The instances are sorted by mesh, as
+ * uploadCarouselInstances() wants, and their meshes and materials never
+ * change; updateForFrame() fills in the rest.
+ */
+void createWorld() {
+    int mesh, i;
+    nodeCount = 0;
+    initAnimationSystem(&animation);
+    objRide();
+    objCage();
+    // The ride turns by 0.005 radians per frame, as in the original, and the
+    // horses ride up and down their poles, each out of step with the next.
+    addRampTrack(&animation, ride, ANIMATION_ROTATE_Y, 0, -0.005f);
+    for (i = 0; i < HORSE_COUNT; i++)
+        addWaveTrack(&animation, horses[i], ANIMATION_Y, -2, BOB_HEIGHT, BOB_SPEED, i * 2 * M_PI / HORSE_COUNT);
+    instanceCount = 0;
+    for (mesh = 0; mesh < CAROUSEL_MESHES; mesh++)
+        for (i = 0; i < nodeCount; i++)
+            if (nodes[i].mesh == mesh) {
+                nodes[i].instance = instanceCount;
+                memset(&instances[instanceCount], 0, sizeof(CarouselInstance));
+                instances[instanceCount].mesh = mesh;
+                instances[instanceCount].material = nodes[i].material;
+                instanceCount++;
+            }
+}
+
+/**
+ * Brings the scene to a frame, which can be between two updates: the
+ * tracks are evaluated at that time, and the gallop of each horse is set.
+ * Then it works out the world transform of every node, from the root down,
+ * and copies all of the instances into the instance buffer with one upload.
+ * If the frame is the one that is already in the buffer, nothing is done.
+ */
+void updateForFrame(float frame) {
+    float size[16];
+    int i;
+    if (evaluateAnimation(&animation, frame) == 0)
+        return;
+    for (i = 0; i < HORSE_COUNT; i++) {
+        CarouselInstance* horse = &instances[nodes[horses[i]].instance];
+        horse->time = frame * GALLOP_FRAMES_PER_SECOND / UPDATES_PER_SECOND + i * 3.7f;
+    }
+    for (i = 0; i < nodeCount; i++) {
+        Node* node = &nodes[i];
+        const float* local = &animation.matrices[16*i];
+        if (node->parent >= 0)
+            mat4Multiply(node->world, nodes[node->parent].world, local);
+        else
+            memcpy(node->world, local, sizeof(node->world));
+        if (node->mesh >= 0) {
+            mat4Scaling(size, node->size[0], node->size[1], node->size[2]);
+            mat4Multiply(instances[node->instance].model, node->world, size);
+        }
+    }
+    uploadCarouselInstances(&carousel, instances, instanceCount);
+}
+
+/* ---------------------------- DRAWING ------------------*/
+
+void display() {
+    float view[16];
+    double start = now();
+    updateForFrame(frameNumber + (animating ? (float)frameLoopAlpha() : 0));
+    updateMilliseconds = (now() - start) * 1000;
+    glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+    updateTextures(TEXTURE_UPLOAD_BYTES);
+    markTextureUsed(moon);
+    getControlsView(&camera, frameLoopAlpha(), view);
+    drawCarousel(&carousel, view, &lights, moon->state == TEXTURE_READY ? moon->name : 0);
+    glutSwapBuffers();
+    frameLoopEndFrame();
+}
+
+/* Called by the frame loop UPDATES_PER_SECOND times per second; advances the frame number while animating. */
+void update(double dt) {
+    if (animating)
+        frameNumber++;
+    updateControls(&camera, dt);
+}
+
+/* Called by the frame loop after its updates; the loop sleeps while this returns 0. */
+int isMoving() {
+    int loading = moon->state == TEXTURE_LOADING || (moon->state == TEXTURE_READY && moon->residentLevel > 0);
+    return animating || loading || controlsMoving(&camera);
+}
+
+/* ---------------------------- MOUSE AND KEYBOARD ------------------*/
+
+/* Called when the user hits a key */
+void doKeyboard(unsigned char key, int x, int y) {
+    // a key or space pressed - starts or stops the animation, like the Animate checkbox
+    if (key == 'a' || key == 'A' || key == ' ') {
+        animating = !animating;
+        printf("Animation %s.\n", animating ? "on" : "off");
+        frameLoopWake();
+    }
+}
+
+/**
+ * Responds to the left mouse button.  Dragging turns the camera around the
+ * origin, as OrbitControls does: across the whole width of the window is a
+ * full turn around the y-axis, and up and down tilts it, but never past the
+ * poles.  As in the original, the view cannot be zoomed or panned.
+ */
+void doMouse(int button, int state, int x, int y) {
+    controlsMouseButton(&camera, button, state, x, y);
+    frameLoopWake();
+}
+
+void doMotion(int x, int y) {
+    controlsMouseMotion(&camera, x, y);
+    frameLoopWake();
+}
+
+/**
+ * When the window is resized, we need to reset the OpenGL viewport and the
+ * projection to match the size.
+ */
+void doResize(int w, int h) {
+    width = w;
+    height = h > 0 ? h : 1;
+    glViewport(0, 0, width, height);
+    mat4Perspective(projection, 30, (float)width / height, 0.1f, 100);
+    resizeControls(&camera, width, height);
+    glMatrixMode(GL_PROJECTION);
+    glLoadMatrixf(projection);
+    glMatrixMode(GL_MODELVIEW);
+}
+
+/* Initialize the OpenGL context.  Called from main() */
+int initGL() {
+    float eye[3] = { 0, 0, CAMERA_DISTANCE }, center[3] = { 0, 0, 0 };
+    createPolyhedra();
+    if ( ! initCarouselRenderer(&carousel, horsePath, materials, HORSE_MATERIAL + HORSE_COUNT) )
+        return 0;
+    texturesInit();
+    // The ride's moon and the cage's moons are one texture.
+    moon = loadTexture("../Three.js_Ride/resources/moon.jpg");
+    glClearColor(0, 0, 0, 1);
+    glEnable(GL_DEPTH_TEST);
+    createWorld();
+    initControls(&camera, CONTROLS_ORBIT, eye, center, width, height);
+    camera.noZoom = camera.noPan = 1;
+    camera.fovy = 30;
+    return 1;
+}
+
+int main(int argc, char** argv) {
+    double maxFramesPerSecond = 60;
+    int showStats = 0, i;
+    glutInit(&argc, argv);
+    frameLoopParseArgs(argc, argv, &maxFramesPerSecond, &showStats);
+    for (i = 1; i < argc; i++)
+        if (strcmp(argv[i], "-model") == 0 && i < argc - 1)
+            horsePath = argv[i+1];
+    glutInitDisplayMode(GLUT_DOUBLE | GLUT_DEPTH);
+    glutInitWindowSize(width, height);
+    glutCreateWindow("Ride");
+    if ( ! initGL() ) {
+        printf("This program needs OpenGL 3.3 and the model of the horse.\n");
+        return 1;
+    }
+    glutDisplayFunc(display);
+    glutReshapeFunc(doResize);
+    glutKeyboardFunc(doKeyboard);
+    glutMouseFunc(doMouse);
+    glutMotionFunc(doMotion);
+    frameLoopAddCounter("update", &updateMilliseconds);
+    frameLoopStart(UPDATES_PER_SECOND, update, maxFramesPerSecond, showStats);
+    frameLoopSleepWhenStill(isMoving);
+    glutMainLoop();
+    return 0;
+}
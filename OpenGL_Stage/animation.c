@@ -0,0 +1,308 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include "animation.h"
+#include "jobs.h"
+
+void initAnimationSystem(AnimationSystem* system) {
+    memset(system, 0, sizeof(AnimationSystem));
+}
+
+void freeAnimationSystem(AnimationSystem* system) {
+    int c;
+    for (c = 0; c < ANIMATION_CHANNELS; c++)
+        free(system->channels[c]);
+    free(system->trackedChannels);
+    free(system->changed);
+    free(system->matrices);
+    free(system->waveTargets);
+    free(system->waveOffsets);
+    free(system->waveAmplitudes);
+    free(system->waveFrequencies);
+    free(system->wavePhases);
+    free(system->rampTargets);
+    free(system->rampOffsets);
+    free(system->rampRates);
+    free(system->trackTargets);
+    free(system->trackFirstKeys);
+    free(system->trackKeyCounts);
+    free(system->trackCursors);
+    free(system->trackInterpolations);
+    free(system->trackLoops);
+    free(system->keyTimes);
+    free(system->keyValues);
+    memset(system, 0, sizeof(AnimationSystem));
+}
+
+//  Returns 1, after doubling *capacity, if arrays of *capacity items have no room for item number count.
+static int grow(int count, int* capacity) {
+    if (count < *capacity)
+        return 0;
+    *capacity = *capacity ? 2 * *capacity : 64;
+    return 1;
+}
+
+#define GROW_ARRAY(array, capacity) array = realloc(array, (size_t)(capacity) * sizeof(*(array)))
+
+int addAnimationNode(AnimationSystem* system, float x, float y, float z) {
+    int node = system->nodeCount, c;
+    if (grow(node, &system->nodeCapacity)) {
+        for (c = 0; c < ANIMATION_CHANNELS; c++)
+            GROW_ARRAY(system->channels[c], system->nodeCapacity);
+        GROW_ARRAY(system->trackedChannels, system->nodeCapacity);
+        GROW_ARRAY(system->changed, system->nodeCapacity);
+        GROW_ARRAY(system->matrices, 16 * system->nodeCapacity);
+    }
+    for (c = 0; c < ANIMATION_CHANNELS; c++)
+        system->channels[c][node] = 0;
+    system->channels[ANIMATION_X][node] = x;
+    system->channels[ANIMATION_Y][node] = y;
+    system->channels[ANIMATION_Z][node] = z;
+    system->channels[ANIMATION_SCALE][node] = 1;
+    system->trackedChannels[node] = 0;
+    system->changed[node] = 1;
+    system->hasChanges = 1;
+    return system->nodeCount++;
+}
+
+void setAnimationChannel(AnimationSystem* system, int node, int channel, float value) {
+    system->channels[channel][node] = value;
+    system->changed[node] = 1;
+    system->hasChanges = 1;
+}
+
+/*  Claims a channel for a new track.  Returns the target of the track, or -1
+    if the channel already has a track.  */
+static int claimChannel(AnimationSystem* system, int node, int channel) {
+    if (system->trackedChannels[node] & (1 << channel)) {
+        printf("Channel %d of animation node %d already has a track.\n", channel, node);
+        return -1;
+    }
+    system->trackedChannels[node] |= 1 << channel;
+    system->evaluated = 0;
+    return node*ANIMATION_CHANNELS + channel;
+}
+
+int addWaveTrack(AnimationSystem* system, int node, int channel, float offset, float amplitude,
+                 float frequency, float phase) {
+    int target = claimChannel(system, node, channel), wave = system->waveCount;
+    if (target < 0)
+        return -1;
+    if (grow(wave, &system->waveCapacity)) {
+        GROW_ARRAY(system->waveTargets, system->waveCapacity);
+        GROW_ARRAY(system->waveOffsets, system->waveCapacity);
+        GROW_ARRAY(system->waveAmplitudes, system->waveCapacity);
+        GROW_ARRAY(system->waveFrequencies, system->waveCapacity);
+        GROW_ARRAY(system->wavePhases, system->waveCapacity);
+    }
+    system->waveTargets[wave] = target;
+    system->waveOffsets[wave] = offset;
+    system->waveAmplitudes[wave] = amplitude;
+    system->waveFrequencies[wave] = frequency;
+    system->wavePhases[wave] = phase;
+    return system->waveCount++;
+}
+
+int addRampTrack(AnimationSystem* system, int node, int channel, float offset, float rate) {
+    int target = claimChannel(system, node, channel), ramp = system->rampCount;
+    if (target < 0)
+        return -1;
+    if (grow(ramp, &system->rampCapacity)) {
+        GROW_ARRAY(system->rampTargets, system->rampCapacity);
+        GROW_ARRAY(system->rampOffsets, system->rampCapacity);
+        GROW_ARRAY(system->rampRates, system->rampCapacity);
+    }
+    system->rampTargets[ramp] = target;
+    system->rampOffsets[ramp] = offset;
+    system->rampRates[ramp] = rate;
+    return system->rampCount++;
+}
+
+int addKeyframeTrack(AnimationSystem* system, int node, int channel, int count, const float* times,
+                     const float* values, int interpolation, int loop) {
+    int target, track = system->trackCount;
+    if (count < 1) {
+        printf("A keyframe track needs at least one key.\n");
+        return -1;
+    }
+    target = claimChannel(system, node, channel);
+    if (target < 0)
+        return -1;
+    if (grow(track, &system->trackCapacity)) {
+        GROW_ARRAY(system->trackTargets, system->trackCapacity);
+        GROW_ARRAY(system->trackFirstKeys, system->trackCapacity);
+        GROW_ARRAY(system->trackKeyCounts, system->trackCapacity);
+        GROW_ARRAY(system->trackCursors, system->trackCapacity);
+        GROW_ARRAY(system->trackInterpolations, system->trackCapacity);
+        GROW_ARRAY(system->trackLoops, system->trackCapacity);
+    }
+    if (system->keyCount + count > system->keyCapacity) {
+        while (system->keyCount + count > system->keyCapacity)
+            system->keyCapacity = system->keyCapacity ? 2 * system->keyCapacity : 256;
+        GROW_ARRAY(system->keyTimes, system->keyCapacity);
+        GROW_ARRAY(system->keyValues, system->keyCapacity);
+    }
+    memcpy(&system->keyTimes[system->keyCount], times, count * sizeof(float));
+    memcpy(&system->keyValues[system->keyCount], values, count * sizeof(float));
+    system->trackTargets[track] = target;
+    system->trackFirstKeys[track] = system->keyCount;
+    system->trackKeyCounts[track] = count;
+    system->trackCursors[track] = 0;
+    system->trackInterpolations[track] = (unsigned char)interpolation;
+    system->trackLoops[track] = (unsigned char)(loop != 0);
+    system->keyCount += count;
+    return system->trackCount++;
+}
+
+//  What the jobs of evaluateAnimation() work on.
+typedef struct AnimationJob {
+    AnimationSystem* system;
+    float time;
+    int timeChanged;
+    int* madeCounts;    // matrices made by each chunk
+} AnimationJob;
+
+//  Sets the value of a channel, given as node*ANIMATION_CHANNELS + channel.
+static void setTarget(AnimationSystem* system, int target, float value) {
+    system->channels[target % ANIMATION_CHANNELS][target / ANIMATION_CHANNELS] = value;
+}
+
+static void waveJob(void* data, int start, int end, int chunk) {
+    const AnimationJob* job = (const AnimationJob*)data;
+    AnimationSystem* system = job->system;
+    int i;
+    for (i = start; i < end; i++)
+        setTarget(system, system->waveTargets[i], system->waveOffsets[i]
+                  + system->waveAmplitudes[i] * sinf(system->waveFrequencies[i] * job->time + system->wavePhases[i]));
+}
+
+static void rampJob(void* data, int start, int end, int chunk) {
+    const AnimationJob* job = (const AnimationJob*)data;
+    AnimationSystem* system = job->system;
+    int i;
+    for (i = start; i < end; i++)
+        setTarget(system, system->rampTargets[i], system->rampOffsets[i] + system->rampRates[i] * job->time);
+}
+
+/*  The value of a keyframe track at a time.  The search for the key starts
+    from the key of the last evaluation, and only does a binary search if the
+    time is not in that key's span or the next.  */
+static float sampleTrack(AnimationSystem* system, int track, float time) {
+    const float* times = &system->keyTimes[system->trackFirstKeys[track]];
+    const float* values = &system->keyValues[system->trackFirstKeys[track]];
+    int count = system->trackKeyCounts[track], k = system->trackCursors[track];
+    float first = times[0], last = times[count - 1], t;
+    if (system->trackLoops[track] && last > first) {
+        float span = last - first;
+        time = fmodf(time - first, span);
+        time += time < 0 ? first + span : first;
+    }
+    if (time <= first)
+        return values[0];
+    if (time >= last)
+        return values[count - 1];
+    // Now there is a k with times[k] <= time < times[k+1], and k+1 < count.
+    if ( ! (times[k] <= time && time < times[k + 1]) ) {
+        if (k + 2 < count && times[k + 1] <= time && time < times[k + 2])
+            k++;
+        else {
+            int low = 0, high = count - 1;
+            while (high - low > 1) {
+                int middle = (low + high) / 2;
+                if (times[middle] <= time)
+                    low = middle;
+                else
+                    high = middle;
+            }
+            k = low;
+        }
+        system->trackCursors[track] = k;
+    }
+    if (system->trackInterpolations[track] == ANIMATION_STEP)
+        return values[k];
+    t = (time - times[k]) / (times[k + 1] - times[k]);
+    return values[k] + t * (values[k + 1] - values[k]);
+}
+
+static void keyframeJob(void* data, int start, int end, int chunk) {
+    const AnimationJob* job = (const AnimationJob*)data;
+    AnimationSystem* system = job->system;
+    int i;
+    for (i = start; i < end; i++)
+        setTarget(system, system->trackTargets[i], sampleTrack(system, i, job->time));
+}
+
+//  Most nodes turn about one axis at most, so the angles that are 0 are worth skipping.
+static void cosineAndSine(float angle, float* cosine, float* sine) {
+    if (angle == 0) {
+        *cosine = 1;
+        *sine = 0;
+    }
+    else {
+        *cosine = cosf(angle);
+        *sine = sinf(angle);
+    }
+}
+
+/*  Makes the matrices of the nodes in the range that need them: the nodes
+    with tracks, if the time changed, and those whose channels were set.
+    The rotation is that of three.js for an Euler of order XYZ.  */
+static void matrixJob(void* data, int start, int end, int chunk) {
+    const AnimationJob* job = (const AnimationJob*)data;
+    AnimationSystem* system = job->system;
+    float* const* channels = system->channels;
+    int i, made = 0;
+    for (i = start; i < end; i++) {
+        float* m = &system->matrices[16*i];
+        float a, b, c, d, e, f, s;
+        if ( ! system->changed[i] && ! (job->timeChanged && system->trackedChannels[i]) )
+            continue;
+        cosineAndSine(channels[ANIMATION_ROTATE_X][i], &a, &b);
+        cosineAndSine(channels[ANIMATION_ROTATE_Y][i], &c, &d);
+        cosineAndSine(channels[ANIMATION_ROTATE_Z][i], &e, &f);
+        s = channels[ANIMATION_SCALE][i];
+        m[0] = s * c*e;
+        m[1] = s * (a*f + b*e*d);
+        m[2] = s * (b*f - a*e*d);
+        m[4] = -s * c*f;
+        m[5] = s * (a*e - b*f*d);
+        m[6] = s * (b*e + a*f*d);
+        m[8] = s * d;
+        m[9] = -s * b*c;
+        m[10] = s * a*c;
+        m[3] = m[7] = m[11] = 0;
+        m[12] = channels[ANIMATION_X][i];
+        m[13] = channels[ANIMATION_Y][i];
+        m[14] = channels[ANIMATION_Z][i];
+        m[15] = 1;
+        system->changed[i] = 0;
+        made++;
+    }
+    job->madeCounts[chunk] = made;
+}
+
+int evaluateAnimation(AnimationSystem* system, double time) {
+    AnimationJob job;
+    int chunks = jobsChunkCount(system->nodeCount, ANIMATION_NODE_GRAIN), made = 0, i;
+    job.timeChanged = ! system->evaluated || time != system->time;
+    if ( ! job.timeChanged && ! system->hasChanges )
+        return 0;
+    job.system = system;
+    job.time = (float)time;
+    if (job.timeChanged) {
+        // Every channel has at most one track, so the tracks can all be done at once, in any order.
+        jobsParallelFor(system->waveCount, ANIMATION_TRACK_GRAIN, waveJob, &job);
+        jobsParallelFor(system->rampCount, ANIMATION_TRACK_GRAIN, rampJob, &job);
+        jobsParallelFor(system->trackCount, ANIMATION_TRACK_GRAIN, keyframeJob, &job);
+    }
+    job.madeCounts = malloc( (chunks > 0 ? chunks : 1) * sizeof(int) );
+    jobsParallelFor(system->nodeCount, ANIMATION_NODE_GRAIN, matrixJob, &job);
+    for (i = 0; i < chunks; i++)
+        made += job.madeCounts[i];
+    free(job.madeCounts);
+    system->time = time;
+    system->evaluated = 1;
+    system->hasChanges = 0;
+    return made;
+}
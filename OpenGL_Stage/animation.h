@@ -0,0 +1,116 @@
+/*  Header file for animation.c, which animates the transforms of the nodes
+    of a scene with tracks, instead of with code written for each object,
+    such as the bobbing horses and the turning ride of Three.js_Ride, or the
+    circling lights of the light show in code.c.
+
+    Each node has the channels of a transform like that of a three.js
+    Object3D: a position, a rotation of Euler angles, in radians, about x,
+    then y, then z, and a uniform scale.  A channel keeps the value that it
+    was given, unless a track drives it.  There are three kinds of track:
+
+        a wave,      offset + amplitude * sin(frequency*time + phase);
+        a ramp,      offset + rate*time, such as a steady spin;
+        a keyframe   track, which goes from value to value at given times,
+                     linearly or in steps, and either loops or holds its
+                     first and last values.
+
+    Everything is kept as a "structure of arrays": each channel is one array
+    over all of the nodes, and each kind of track is a set of arrays over
+    all of the tracks of that kind, so evaluating the tracks is a few plain
+    loops that stream through memory.  They are spread over all of the
+    cores with jobsParallelFor() from jobs.c, as is the last step, which
+    makes the transform matrix of each animated node from its channels.
+
+    evaluateAnimation() remembers the time that it was last called with, so
+    calling it again at the same time costs nothing, as when the animation
+    is paused.  A keyframe track remembers the key that it was at, so a time
+    that moves forward finds its key at once, without a search.  */
+
+#ifndef ANIMATION_H
+#define ANIMATION_H
+
+//  The channels of a node.
+#define ANIMATION_X 0
+#define ANIMATION_Y 1
+#define ANIMATION_Z 2
+#define ANIMATION_ROTATE_X 3
+#define ANIMATION_ROTATE_Y 4
+#define ANIMATION_ROTATE_Z 5
+#define ANIMATION_SCALE 6
+#define ANIMATION_CHANNELS 7
+
+//  How a keyframe track gets from one key to the next.
+#define ANIMATION_STEP 0       // holds the value of a key until the next key
+#define ANIMATION_LINEAR 1
+
+#define ANIMATION_TRACK_GRAIN 1024   // tracks per job
+#define ANIMATION_NODE_GRAIN 256     // matrices per job
+
+//  The nodes, their tracks and the results.  The arrays grow as things are added.
+typedef struct AnimationSystem {
+    int nodeCount, nodeCapacity;
+    float* channels[ANIMATION_CHANNELS];   // channels[c][node]
+    unsigned char* trackedChannels;        // for each node, a bit for each channel that a track drives
+    unsigned char* changed;                // for each node, whether its matrix must be made again
+    float* matrices;                       // 16 per node: translate * rotate x * rotate y * rotate z * scale
+
+    int waveCount, waveCapacity;
+    int* waveTargets;                      // node*ANIMATION_CHANNELS + channel
+    float *waveOffsets, *waveAmplitudes, *waveFrequencies, *wavePhases;
+
+    int rampCount, rampCapacity;
+    int* rampTargets;
+    float *rampOffsets, *rampRates;
+
+    int trackCount, trackCapacity;         // the keyframe tracks
+    int* trackTargets;
+    int *trackFirstKeys, *trackKeyCounts;  // where the keys of a track are in the key arrays
+    int* trackCursors;                     // the key at or before the time of the last evaluation
+    unsigned char *trackInterpolations, *trackLoops;
+    int keyCount, keyCapacity;
+    float *keyTimes, *keyValues;
+
+    double time;                           // of the last evaluation
+    int evaluated;                         // Do the tracks have their values at that time?
+    int hasChanges;                        // Has any node been changed since then?
+} AnimationSystem;
+
+//  Makes a system with no nodes.
+void initAnimationSystem(AnimationSystem* system);
+
+//  Frees the arrays of a system and makes it empty.
+void freeAnimationSystem(AnimationSystem* system);
+
+/*  Adds a node at a position, with no rotation and a scale of 1, and
+    returns its number; the nodes are numbered from 0 in the order in which
+    they are added.  */
+int addAnimationNode(AnimationSystem* system, float x, float y, float z);
+
+/*  Sets a channel of a node.  If a track drives the channel, the track's
+    value replaces it at the next evaluation.  */
+void setAnimationChannel(AnimationSystem* system, int node, int channel, float value);
+
+/*  Add tracks that drive a channel of a node.  A channel can be driven by
+    only one track; these return -1, after printing a message, if the channel
+    already has one, and otherwise the number of the track among those of its
+    kind.  */
+int addWaveTrack(AnimationSystem* system, int node, int channel, float offset, float amplitude,
+                 float frequency, float phase);
+int addRampTrack(AnimationSystem* system, int node, int channel, float offset, float rate);
+
+/*  A keyframe track of count keys, at increasing times.  A track that loops
+    repeats the span from its first key to its last, so for a smooth loop the
+    last value should be the same as the first; a track that does not loop
+    holds its first value before the first key and its last value after the
+    last.  The keys are copied.  */
+int addKeyframeTrack(AnimationSystem* system, int node, int channel, int count, const float* times,
+                     const float* values, int interpolation, int loop);
+
+/*  Sets the channels that tracks drive to their values at the given time,
+    then remakes the matrices of the nodes that have tracks or whose
+    channels were set since the last evaluation.  Returns the number of
+    matrices that were made, which is 0 if nothing changed since the last
+    evaluation, at the same time.  */
+int evaluateAnimation(AnimationSystem* system, double time);
+
+#endif
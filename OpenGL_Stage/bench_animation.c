@@ -0,0 +1,118 @@
+/**
+ * A benchmark for animation.c.  It animates a crowd of nodes, each with a
+ * wave that bobs it up and down, a ramp that spins it and a looping keyframe
+ * track that pulses its size, and times evaluateAnimation() per frame, on
+ * 1, 2, 4, ... threads, up to the number of cores.  It also times an
+ * evaluation at the same time as the last one, which should find nothing
+ * to do, and checks the matrices against those of mat4.c.  No window or
+ * OpenGL context is needed.  Usage:
+ *
+ *        bench_animation [nodeCount [frames]]
+ *
+ * The default is 100000 nodes and 200 frames.  Compile with
+ *
+ *        gcc -O2 -o bench_animation bench_animation.c animation.c jobs.c mat4.c -lm -pthread
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <math.h>
+#include <time.h>
+#include <unistd.h>
+#include "animation.h"
+#include "jobs.h"
+#include "mat4.h"
+
+#define FRAMES_PER_SECOND 60
+
+static double now() {
+    struct timespec t;
+    clock_gettime(CLOCK_MONOTONIC, &t);
+    return t.tv_sec + t.tv_nsec * 1e-9;
+}
+
+//  Adds count nodes on a grid, each with its three tracks, out of step with the others.
+static void addCrowd(AnimationSystem* system, int count) {
+    static const float times[5] = { 0, 0.25f, 0.5f, 0.75f, 1 };
+    static const float sizes[5] = { 1, 1.2f, 1, 0.8f, 1 };
+    int side = (int)ceil(sqrt(count)), i;
+    for (i = 0; i < count; i++) {
+        int node = addAnimationNode(system, (float)(i % side), 0, (float)(i / side));
+        float keyTimes[5], offset = (i % 97) * 0.01f;
+        int k;
+        for (k = 0; k < 5; k++)
+            keyTimes[k] = times[k] + offset;
+        addWaveTrack(system, node, ANIMATION_Y, 0.5f, 0.25f, 4, i * 0.1f);
+        addRampTrack(system, node, ANIMATION_ROTATE_Y, i * 0.01f, 1 + (i % 5) * 0.1f);
+        addKeyframeTrack(system, node, ANIMATION_SCALE, 5, keyTimes, sizes, ANIMATION_LINEAR, 1);
+    }
+}
+
+//  The largest difference between the matrices of the system and those made with mat4.c.
+static double largestError(const AnimationSystem* system, int count) {
+    double largest = 0;
+    int i, k;
+    for (i = 0; i < count; i++) {
+        float m[16], t[16];
+        float* const* c = system->channels;
+        mat4Translation(m, c[ANIMATION_X][i], c[ANIMATION_Y][i], c[ANIMATION_Z][i]);
+        mat4Rotation(t, c[ANIMATION_ROTATE_X][i] * 180 / M_PI, 1, 0, 0);
+        mat4Multiply(m, m, t);
+        mat4Rotation(t, c[ANIMATION_ROTATE_Y][i] * 180 / M_PI, 0, 1, 0);
+        mat4Multiply(m, m, t);
+        mat4Rotation(t, c[ANIMATION_ROTATE_Z][i] * 180 / M_PI, 0, 0, 1);
+        mat4Multiply(m, m, t);
+        mat4Scaling(t, c[ANIMATION_SCALE][i], c[ANIMATION_SCALE][i], c[ANIMATION_SCALE][i]);
+        mat4Multiply(m, m, t);
+        for (k = 0; k < 16; k++)
+            if (fabs(m[k] - system->matrices[16*i + k]) > largest)
+                largest = fabs(m[k] - system->matrices[16*i + k]);
+    }
+    return largest;
+}
+
+int main(int argc, char** argv) {
+    int nodeCount = argc > 1 ? atoi(argv[1]) : 100000;
+    int frames = argc > 2 ? atoi(argv[2]) : 200;
+    int cores = (int)sysconf(_SC_NPROCESSORS_ONLN);
+    AnimationSystem system;
+    int frame, threads, made, tilted;
+    double start, singleTime = 0;
+
+    initAnimationSystem(&system);
+    start = now();
+    addCrowd(&system, nodeCount);
+    printf("%d nodes, %d tracks, made in %.1f ms; %d frames per run, %d cores\n", nodeCount,
+           system.waveCount + system.rampCount + system.trackCount, (now() - start)*1000, frames, cores);
+
+    printf("threads   ms/frame   speedup\n");
+    for (threads = 1; ; threads = threads*2 < cores ? threads*2 : cores) {
+        double time;
+        jobsInit(threads);
+        start = now();
+        for (frame = 0; frame < frames; frame++)
+            evaluateAnimation(&system, (double)frame / FRAMES_PER_SECOND);
+        time = (now() - start) / frames;
+        if (threads == 1)
+            singleTime = time;
+        printf("%7d   %8.3f   %7.2f\n", threads, time*1000, singleTime/time);
+        if (threads >= cores)
+            break;
+        jobsShutdown();
+    }
+
+    // A paused animation: the same time again, then with a few nodes changed by hand.
+    start = now();
+    made = evaluateAnimation(&system, (double)(frames - 1) / FRAMES_PER_SECOND);
+    printf("Same time again: %d matrices made, %.4f ms\n", made, (now() - start)*1000);
+    for (tilted = 0; tilted < 10 && tilted < nodeCount; tilted++)
+        setAnimationChannel(&system, tilted * (nodeCount / 10), ANIMATION_ROTATE_X, 0.3f);
+    start = now();
+    made = evaluateAnimation(&system, (double)(frames - 1) / FRAMES_PER_SECOND);
+    printf("Same time, %d nodes tilted: %d matrices made, %.4f ms\n", tilted, made, (now() - start)*1000);
+
+    printf("Largest difference from the matrices of mat4.c: %.2g\n", largestError(&system, nodeCount));
+    jobsShutdown();
+    freeAnimationSystem(&system);
+    return 0;
+}
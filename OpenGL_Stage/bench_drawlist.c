@@ -0,0 +1,101 @@
+/**
+ * A benchmark for drawlist.c.  It places a large number of objects on a
+ * big stage and times buildDrawList() with 1, 2, 4, ... threads, up to
+ * the number of cores.  No window or OpenGL context is needed.  Usage:
+ *
+ *        bench_drawlist [objectCount [frames]]
+ *
+ * The default is 100000 objects and 200 frames per thread count.  Compile with
+ *
+ *        gcc -O2 -o bench_drawlist bench_drawlist.c drawlist.c jobs.c mat4.c -lm -pthread
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+#include <unistd.h>
+#include "drawlist.h"
+#include "jobs.h"
+#include "mat4.h"
+
+static double now() {
+    struct timespec t;
+    clock_gettime(CLOCK_MONOTONIC, &t);
+    return t.tv_sec + t.tv_nsec * 1e-9;
+}
+
+/*  A checksum of the draw list, used to check that every thread count
+    produces exactly the same list.  */
+static unsigned long long checksum(const DrawList* list) {
+    unsigned long long sum = list->count;
+    int i;
+    for (i = 0; i < list->count; i++)
+        sum = sum * 1000003 + list->items[i].sortKey + list->items[i].object;
+    return sum;
+}
+
+int main(int argc, char** argv) {
+    int objectCount = argc > 1 ? atoi(argv[1]) : 100000;
+    int frames = argc > 2 ? atoi(argv[2]) : 200;
+    int cores = (int)sysconf(_SC_NPROCESSORS_ONLN);
+    int lodCounts[4] = { 5, 1, 1, 1 };  // a geodesic sphere chain and three single meshes
+    SceneObject* objects = malloc( objectCount*sizeof(SceneObject) );
+    DrawList list;
+    DrawView view;
+    int i, threads, frame;
+    double baseTime = 0;
+    unsigned long long baseSum = 0;
+
+    // A stage 1000 units across, with the objects scattered over it at random.
+    srand(42);
+    for (i = 0; i < objectCount; i++) {
+        objects[i].position[0] = (rand() / (float)RAND_MAX - 0.5f) * 1000;
+        objects[i].position[1] = rand() / (float)RAND_MAX * 5;
+        objects[i].position[2] = (rand() / (float)RAND_MAX - 0.5f) * 1000;
+        objects[i].yRotation = rand() % 360;
+        objects[i].scale = 0.5f + rand() / (float)RAND_MAX * 2;
+        objects[i].radius = 1.5f;
+        objects[i].mesh = rand() % 4;
+        objects[i].material = rand() % 19;
+    }
+
+    view.fovy = 40;
+    view.aspect = 2;
+    view.zNear = 1;
+    view.zFar = 1000;
+    view.viewportHeight = 1000;
+    view.lodCounts = lodCounts;
+    view.lodPixels = 8;
+    initDrawList(&list);
+
+    printf("%d objects, %d frames per run, %d cores\n", objectCount, frames, cores);
+    printf("threads   ms/frame   speedup   visible   same result\n");
+    for (threads = 1; ; threads = threads*2 < cores ? threads*2 : cores) {
+        jobsInit(threads);
+        double start = now();
+        for (frame = 0; frame < frames; frame++) {
+            // Orbit the camera so the visible set changes every frame.
+            float angle = frame * 360.0f / frames;
+            float rotation[16];
+            mat4LookAt(view.viewMatrix, 0, 60, 500, 0, 0, 0, 0, 1, 0);
+            mat4Rotation(rotation, angle, 0, 1, 0);
+            mat4Multiply(view.viewMatrix, view.viewMatrix, rotation);
+            buildDrawList(&list, objects, objectCount, &view);
+        }
+        double time = (now() - start) / frames;
+        unsigned long long sum = checksum(&list);
+        if (threads == 1) {
+            baseTime = time;
+            baseSum = sum;
+        }
+        printf("%7d   %8.3f   %7.2f   %7d   %s\n", threads, time*1000, baseTime/time, list.count,
+               sum == baseSum ? "yes" : "NO");
+        jobsShutdown();
+        if (threads >= cores)
+            break;
+    }
+
+    freeDrawList(&list);
+    free(objects);
+    return 0;
+}
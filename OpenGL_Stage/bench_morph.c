@@ -0,0 +1,161 @@
+/**
+ * A benchmark for morph.c.  It animates a carousel of horses, each galloping
+ * at a phase of its own, and times the blend of all of them per frame: one
+ * vertex at a time, with SSE, and with SSE on 1, 2, 4, ... threads, up to the
+ * number of cores.  It also checks that the normals of morphAtTime() match
+ * those recomputed from the triangles by blendMorph().  No window or OpenGL
+ * context is needed.  Usage:
+ *
+ *        bench_morph [horseCount [frames [model]]]
+ *
+ * The default is 500 horses, 200 frames and ../Three.js_Ride/resources/horse.js;
+ * the model can also be a mesh file made by meshconvert.  Compile with
+ *
+ *        gcc -O2 -o bench_morph bench_morph.c morph.c morphmesh.c jsonmodel.c mesh.c meshopt.c jobs.c -lm -pthread
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <time.h>
+#include <unistd.h>
+#include "morph.h"
+#include "jsonmodel.h"
+#include "jobs.h"
+
+#define FRAMES_PER_SECOND 60
+#define GALLOP_FRAMES_PER_SECOND 15   // the horse's 15 frames take a second, as in three.js
+
+static double now() {
+    struct timespec t;
+    clock_gettime(CLOCK_MONOTONIC, &t);
+    return t.tv_sec + t.tv_nsec * 1e-9;
+}
+
+static int loadMorphMesh(const char* path, MorphMesh* morph) {
+    JsonModel model;
+    size_t length = strlen(path);
+    if (length > 5 && strcmp(path + length - 5, ".mesh") == 0)
+        return readMorphMesh(path, morph);
+    if ( ! readJsonModel(path, &model) )
+        return 0;
+    *morph = compileJsonModel(&model);
+    freeJsonModel(&model);
+    return 1;
+}
+
+//  The times of the horses in a frame: each is out of step with the others.
+static void setTimes(float* times, int count, int frame) {
+    int i;
+    for (i = 0; i < count; i++)
+        times[i] = (float)frame * GALLOP_FRAMES_PER_SECOND / FRAMES_PER_SECOND + i * 0.37f;
+}
+
+//  Are all of the arrays of two blends, positions and normals, the same, apart from the padding?
+static int sameBlend(const MorphAnimator* animator, const float* a, const float* b) {
+    int array;
+    for (array = 0; array < MORPH_ARRAYS; array++)
+        if (memcmp(a + array*animator->stride, b + array*animator->stride,
+                   animator->vertexCount*sizeof(float)) != 0)
+            return 0;
+    return 1;
+}
+
+//  The largest angle, in degrees, between the normals of two blends.
+static double largestAngle(const MorphAnimator* animator, const float* a, const float* b) {
+    int stride = animator->stride, i;
+    double largest = 0;
+    for (i = 0; i < animator->vertexCount; i++) {
+        double dot = a[3*stride + i]*b[3*stride + i] + a[4*stride + i]*b[4*stride + i]
+                     + a[5*stride + i]*b[5*stride + i];
+        double angle = acos(dot > 1 ? 1 : dot) * 180 / M_PI;
+        if (angle > largest)
+            largest = angle;
+    }
+    return largest;
+}
+
+int main(int argc, char** argv) {
+    int horseCount = argc > 1 ? atoi(argv[1]) : 500;
+    int frames = argc > 2 ? atoi(argv[2]) : 200;
+    const char* path = argc > 3 ? argv[3] : "../Three.js_Ride/resources/horse.js";
+    int cores = (int)sysconf(_SC_NPROCESSORS_ONLN);
+    MorphMesh morph;
+    MorphAnimator animator;
+    float *times, *vertices, *check;
+    int floats, i, frame, threads;
+    double start, scalarTime, simdTime, worstAngle = 0;
+
+    if ( ! loadMorphMesh(path, &morph) || ! initMorphAnimator(&animator, &morph) )
+        return 1;
+    floats = morphVertexFloats(&animator);
+    times = malloc( horseCount*sizeof(float) );
+    vertices = allocateMorphVertices(&animator, horseCount);
+    check = allocateMorphVertices(&animator, 1);
+    printf("%d horses of %d vertices and %d frames, %d frames per run, %d cores\n", horseCount,
+           animator.vertexCount, animator.frameCount, frames, cores);
+
+    start = now();
+    for (frame = 0; frame < frames; frame++) {
+        setTimes(times, horseCount, frame);
+        for (i = 0; i < horseCount; i++)
+            morphAtTimeScalar(&animator, times[i], &vertices[(size_t)i*floats]);
+    }
+    scalarTime = (now() - start) / frames;
+    start = now();
+    for (frame = 0; frame < frames; frame++) {
+        setTimes(times, horseCount, frame);
+        for (i = 0; i < horseCount; i++)
+            morphAtTime(&animator, times[i], &vertices[(size_t)i*floats]);
+    }
+    simdTime = (now() - start) / frames;
+    printf("scalar    %8.3f ms/frame\n", scalarTime*1000);
+    printf("SIMD      %8.3f ms/frame  %5.2f times as fast\n", simdTime*1000, scalarTime/simdTime);
+
+    // The same results from both, and normals that match a full recomputation.
+    for (i = 0; i < horseCount && i < 64; i++) {
+        int pair[2];
+        float weights[2], t = times[i] - animator.frameCount * floorf(times[i] / animator.frameCount);
+        pair[0] = (int)t % animator.frameCount;
+        pair[1] = (pair[0] + 1) % animator.frameCount;
+        weights[1] = t - (int)t;
+        weights[0] = 1 - weights[1];
+        morphAtTimeScalar(&animator, times[i], check);
+        if ( ! sameBlend(&animator, check, &vertices[(size_t)i*floats]) ) {
+            printf("The SIMD and scalar blends DIFFER for horse %d!\n", i);
+            return 1;
+        }
+        blendMorph(&animator, 2, pair, weights, check);
+        if (largestAngle(&animator, check, &vertices[(size_t)i*floats]) > worstAngle)
+            worstAngle = largestAngle(&animator, check, &vertices[(size_t)i*floats]);
+    }
+    start = now();
+    for (i = 0; i < horseCount; i++)
+        blendMorph(&animator, 2, (const int[]){ i % animator.frameCount, (i + 1) % animator.frameCount },
+                   (const float[]){ 0.5f, 0.5f }, check);
+    printf("blendMorph() with normals from the triangles: %.3f ms for all horses\n", (now() - start)*1000);
+    printf("Largest angle between those normals and morphAtTime()'s: %.4f degrees\n", worstAngle);
+
+    printf("threads   ms/frame   speedup\n");
+    for (threads = 1; ; threads = threads*2 < cores ? threads*2 : cores) {
+        double time;
+        jobsInit(threads);
+        start = now();
+        for (frame = 0; frame < frames; frame++) {
+            setTimes(times, horseCount, frame);
+            morphInstances(&animator, horseCount, times, vertices);
+        }
+        time = (now() - start) / frames;
+        printf("%7d   %8.3f   %7.2f\n", threads, time*1000, simdTime/time);
+        jobsShutdown();
+        if (threads >= cores)
+            break;
+    }
+    free(times);
+    free(vertices);
+    free(check);
+    freeMorphAnimator(&animator);
+    freeMorphMesh(&morph);
+    return 0;
+}
@@ -4,39 +4,110 @@
  * and include a wireframe object that is drawn with lighting
  * turned off.
  *
+ * Dragging the mouse turns the camera around the stage, with controls.c:
+ * the left button orbits, the middle button zooms and the right button
+ * pans, and the camera coasts to a stop when it is let go.  The T key
+ * switches between an orbit, which keeps the stage level, and a
+ * trackball, which can roll it any way; Home puts the camera back.  The A
+ * key makes the stage spin.  The scene is animated by frameloop.c, which
+ * stops drawing while nothing moves.  Run with -uncapped to draw frames as
+ * fast as possible with vsync off, or -stats to show frame times.
+ *
+ * Run with -turntable N to write N frames of the stage instead, with the
+ * camera turned once around it in equal steps, to turntable000.png,
+ * turntable001.png and so on, or to the names given by -output, such as
+ * -output frames/stage%04d.ppm; names that end in .ppm are written as PPM.
+ * The frames are drawn offscreen, the size of the window, and framewriter.c
+ * reads them back and writes them on threads of its own, so the drawing
+ * never waits for the encoding or the disk.
+ *
+ * The camera, the lights, the materials and the textures mark what they
+ * change with frameLoopMarkChanged(), and a frame is drawn only when
+ * something was marked, however many events came in since the last one.
+ * The H key shows a panel of the keys over the scene, with overlay.c,
+ * which keeps the last scene in a framebuffer; when only the panel
+ * changes, just the rectangle of the panel is drawn again.
+ *
+ * Lighting is done per pixel by lighting.c, which can handle hundreds of
+ * point lights.  The L key turns on a light show of LIGHT_SHOW_COUNT
+ * moving lights, and the F key switches to fixed-function lighting.
+ * The materials table is uploaded once, by materials.c, and the shader
+ * looks up each object's material by its number.  The top light casts
+ * shadows, from a shadow map made by shadow.c; the S key turns them off.
+ * The glass balls are transparent, and are drawn after everything else as
+ * the transparent pass of transparency.c, which composites them correctly
+ * in any order, without sorting them by depth; the O key draws them with
+ * ordinary blending instead, in the order of the draw list, for comparison.
+ * The metals reflect the Coliseum cube map of Three.js_Ballbox, which
+ * texture.c decodes on threads of its own while the first frames are drawn
+ * without it.
+ *
  * This program uses GLU as well as GLUT, and it depends on polyhedron.c,
- * which requires the math library.  It can be compiled with
+ * which requires the math library, on mesh.c and meshopt.c, which
+ * compile the polyhedra into optimized triangle meshes, on geodesic.c,
+ * which makes the spheres, and on drawlist.c, jobs.c and mat4.c, which
+ * prepare the list of objects to draw on all of the cores, on frameloop.c,
+ * on animation.c, which moves the lights of the light show, on controls.c,
+ * which moves the camera, on overlay.c, on transparency.c, on
+ * framewriter.c, which needs libpng, and on lighting.c, materials.c,
+ * shadow.c, meshbuffer.c, texture.c, which needs libjpeg, and shader.c.
+ * It can be compiled with
  *
- *        gcc -o code code.c polyhedron.c -lGL -lglut -lGLU -lm
+ *        gcc -o code code.c polyhedron.c mesh.c meshopt.c geodesic.c \
+ *            drawlist.c jobs.c mat4.c frameloop.c animation.c controls.c \
+ *            overlay.c transparency.c framewriter.c lighting.c materials.c \
+ *            shadow.c meshbuffer.c texture.c shader.c \
+ *            -lGL -lglut -lGLU -ljpeg -lpng -lm -pthread
  */
 
-#include <GL/gl.h>
+#include "shader.h"     // Includes <GL/gl.h>, with the functions needed for shaders.
 #include <GL/freeglut.h>
 #include <stdio.h>      // (Can be used for debugging messages, with printf().)
 #include "polyhedron.h" // For access to the regular polyhedra from polyhedron.c.
+#include "meshopt.h"    // For compiling the polyhedra into optimized triangle meshes.
+#include "geodesic.h"   // For the geodesic spheres that replace glutSolidSphere().
+#include "drawlist.h"   // For culling, LOD selection and sorting of the objects on the stage.
+#include "jobs.h"       // For running that work on all of the cores.
+#include "mat4.h"
+#include "frameloop.h"  // For the animation loop.
+#include "lighting.h"   // For per-pixel lighting with many lights.
+#include "shadow.h"     // For the shadows of the top light.
+#include "texture.h"    // For the environment map.
+#include "animation.h"  // For moving the lights of the light show.
+#include "controls.h"   // For turning the camera with the mouse.
+#include "overlay.h"    // For the panel of keys, drawn over the scene.
+#include "transparency.h" // For the glass balls.
+#include "framewriter.h"  // For writing the frames of a turntable.
 #include <math.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
 
 // --------------------------- Data for some materials ---------------------------------------------------
 
 /**
  * One of the rows of this array corresponds to a set of material properties.  Items 0 to 3 in a row
  * specify an ambient color; items 4 through 7, a diffuse color; items 8 through 11, a specular color;
- * and item 12, a specular exponent (shininess value).  The data is adapted from the table on the page
- * http://devernay.free.fr/cours/opengl/materials.html
+ * item 12, a specular exponent (shininess value); and item 13, the reflectivity, which only the
+ * lighting shader uses.  The data is adapted from the table on the page
+ * http://devernay.free.fr/cours/opengl/materials.html  (The last row, "stage", is the
+ * flat gray of the stage itself.)  The metals were given reflectivities to show off the
+ * environment map.  The glass rows have a diffuse alpha below 1, which makes
+ * them transparent.
  */
-float materials[][13] = {
+float materials[][MATERIAL_FLOATS] = {
 	{ /* "emerald" */   0.0215f, 0.1745f, 0.0215f, 1.0f, 0.07568f, 0.61424f, 0.07568f, 1.0f, 0.633f, 0.727811f, 0.633f, 1.0f, 0.6f*128 },
 	{ /* "jade" */   0.135f, 0.2225f, 0.1575f, 1.0f, 0.54f, 0.89f, 0.63f, 1.0f, 0.316228f, 0.316228f, 0.316228f, 1.0f, 0.1f*128 },
 	{ /* "obsidian" */   0.05375f, 0.05f, 0.06625f, 1.0f, 0.18275f, 0.17f, 0.22525f, 1.0f, 0.332741f, 0.328634f, 0.346435f, 1.0f, 0.3f*128 },
 	{ /* "pearl" */   0.25f, 0.20725f, 0.20725f, 1.0f, 1.0f, 0.829f, 0.829f, 1.0f, 0.296648f, 0.296648f, 0.296648f, 1.0f, 0.088f*128 },
 	{ /* "ruby" */   0.1745f, 0.01175f, 0.01175f, 1.0f, 0.61424f, 0.04136f, 0.04136f, 1.0f, 0.727811f, 0.626959f, 0.626959f, 1.0f, 0.6f*128 },
 	{ /* "turquoise" */   0.1f, 0.18725f, 0.1745f, 1.0f, 0.396f, 0.74151f, 0.69102f, 1.0f, 0.297254f, 0.30829f, 0.306678f, 1.0f, 0.1f*128 },
-	{ /* "brass" */   0.329412f, 0.223529f, 0.027451f, 1.0f, 0.780392f, 0.568627f, 0.113725f, 1.0f, 0.992157f, 0.941176f, 0.807843f, 1.0f, 0.21794872f*128 },
-	{ /* "bronze" */   0.2125f, 0.1275f, 0.054f, 1.0f, 0.714f, 0.4284f, 0.18144f, 1.0f, 0.393548f, 0.271906f, 0.166721f, 1.0f, 0.2f*128 },
-	{ /* "chrome" */   0.25f, 0.25f, 0.25f, 1.0f, 0.4f, 0.4f, 0.4f, 1.0f, 0.774597f, 0.774597f, 0.774597f, 1.0f, 0.6f*128 },
-	{ /* "copper" */   0.19125f, 0.0735f, 0.0225f, 1.0f, 0.7038f, 0.27048f, 0.0828f, 1.0f, 0.256777f, 0.137622f, 0.086014f, 1.0f, 0.1f*128 },
-	{ /* "gold" */   0.24725f, 0.1995f, 0.0745f, 1.0f, 0.75164f, 0.60648f, 0.22648f, 1.0f, 0.628281f, 0.555802f, 0.366065f, 1.0f, 0.4f*128 },
-	{ /* "silver" */   0.19225f, 0.19225f, 0.19225f, 1.0f, 0.50754f, 0.50754f, 0.50754f, 1.0f, 0.508273f, 0.508273f, 0.508273f, 1.0f, 0.4f*128 },
+	{ /* "brass" */   0.329412f, 0.223529f, 0.027451f, 1.0f, 0.780392f, 0.568627f, 0.113725f, 1.0f, 0.992157f, 0.941176f, 0.807843f, 1.0f, 0.21794872f*128, 0.3f },
+	{ /* "bronze" */   0.2125f, 0.1275f, 0.054f, 1.0f, 0.714f, 0.4284f, 0.18144f, 1.0f, 0.393548f, 0.271906f, 0.166721f, 1.0f, 0.2f*128, 0.2f },
+	{ /* "chrome" */   0.25f, 0.25f, 0.25f, 1.0f, 0.4f, 0.4f, 0.4f, 1.0f, 0.774597f, 0.774597f, 0.774597f, 1.0f, 0.6f*128, 0.6f },
+	{ /* "copper" */   0.19125f, 0.0735f, 0.0225f, 1.0f, 0.7038f, 0.27048f, 0.0828f, 1.0f, 0.256777f, 0.137622f, 0.086014f, 1.0f, 0.1f*128, 0.2f },
+	{ /* "gold" */   0.24725f, 0.1995f, 0.0745f, 1.0f, 0.75164f, 0.60648f, 0.22648f, 1.0f, 0.628281f, 0.555802f, 0.366065f, 1.0f, 0.4f*128, 0.3f },
+	{ /* "silver" */   0.19225f, 0.19225f, 0.19225f, 1.0f, 0.50754f, 0.50754f, 0.50754f, 1.0f, 0.508273f, 0.508273f, 0.508273f, 1.0f, 0.4f*128, 0.4f },
 	{ /* "cyan plastic" */   0.0f, 0.1f, 0.06f, 1.0f, 0.0f, 0.50980392f, 0.50980392f, 1.0f, 0.50196078f, 0.50196078f, 0.50196078f, 1.0f, .25f*128 },
 	{ /* "green plastic" */   0.0f, 0.0f, 0.0f, 1.0f, 0.1f, 0.35f, 0.1f, 1.0f, 0.45f, 0.55f, 0.45f, 1.0f, .25f*128 },
 	{ /* "red plastic" */   0.0f, 0.0f, 0.0f, 1.0f, 0.5f, 0.0f, 0.0f, 1.0f, 0.7f, 0.6f, 0.6f, 1.0f, .25f*128 },
@@ -44,19 +115,210 @@ float materials[][13] = {
 	{ /* "green rubber" */   0.0f, 0.05f, 0.0f, 1.0f, 0.4f, 0.5f, 0.4f, 1.0f, 0.04f, 0.7f, 0.04f, 1.0f, .078125f*128 },
 	{ /* "red rubber" */   0.05f, 0.0f, 0.0f, 1.0f, 0.5f, 0.4f, 0.4f, 1.0f, 0.7f, 0.04f, 0.04f, 1.0f, .078125f*128 },
 	{ /* "mine" */   0.5f, 0.0f, 0.0f, 1.0f, 0.0f, 0.5f, 0.0f, 1.0f, 0.0f, 0.0f, 0.5f, 1.0f, 0.5f*128 },
+	{ /* "stage" */   0.6f, 0.6f, 0.6f, 1.0f, 0.6f, 0.6f, 0.6f, 1.0f, 0.0f, 0.0f, 0.0f, 1.0f, 0.0f },
+	{ /* "red glass" */   0.1f, 0.0f, 0.0f, 1.0f, 0.8f, 0.1f, 0.1f, 0.4f, 0.9f, 0.9f, 0.9f, 1.0f, 0.75f*128, 0.1f },
+	{ /* "green glass" */   0.0f, 0.1f, 0.0f, 1.0f, 0.1f, 0.8f, 0.1f, 0.4f, 0.9f, 0.9f, 0.9f, 1.0f, 0.75f*128, 0.1f },
+	{ /* "blue glass" */   0.0f, 0.0f, 0.1f, 1.0f, 0.1f, 0.2f, 0.9f, 0.4f, 0.9f, 0.9f, 0.9f, 1.0f, 0.75f*128, 0.1f },
 };
+int materialCount = sizeof(materials) / sizeof(materials[0]);
+#define STAGE_MATERIAL 19
+#define TRANSPARENT_MATERIAL(m) (materials[m][7] < 1)  // Does material m have a diffuse alpha below 1?
+
+GLuint materialBuffer; // the whole table, in a uniform buffer for the lighting shader; made by initGL()
 
 // ------------------------ OpenGL rendering and  initialization -----------------------
 
-double y_rotation_angle = 0, x_rotation_angle = 0;
+// The camera, which orbits the stage; update() moves it and display() interpolates.
+CameraControls camera;
+float cameraEye[3] = { 0, 8, 40 }, cameraTarget[3] = { 0, 1, 0 };
+int spinning = 0;              // Is the stage turning by itself?  (Toggled by the A key.)
+#define SPIN_SPEED 30          // degrees per second
+#define UPDATES_PER_SECOND 120
+
+TriMesh houseMesh, dodecahedronMesh, cubeMesh; // compiled in initGL()
+
+#define SPHERE_LOD_COUNT 5
+TriMesh sphereLODs[SPHERE_LOD_COUNT]; // geodesic spheres with 20*4^L triangles, made in initGL()
+
+/**
+ * The models that objects on the stage can be made of.  A model is a chain of
+ * levels of detail; if it comes from a polyhedron, the polyhedron is used to
+ * draw its edges.  The array is filled in by initGL(), which also copies each
+ * level into buffers on the GPU.
+ */
+typedef struct StageMesh {
+	Polyhedron* poly;  // NULL if the model has no edges to draw
+	TriMesh* levels;
+	int levelCount;
+	MeshBuffer buffers[SPHERE_LOD_COUNT];  // (No model has more levels than the sphere.)
+} StageMesh;
+
+enum { MESH_SPHERE, MESH_HOUSE, MESH_DODECAHEDRON, MESH_CUBE, MESH_COUNT };
+StageMesh stageMeshes[MESH_COUNT];
+int stageMeshLODCounts[MESH_COUNT];
+
+/**
+ * The objects on the stage that are drawn from compiled meshes:  position,
+ * rotation about the y-axis, scale, bounding radius (set by initGL()), mesh
+ * and material.  The GLUT shapes are drawn by draw().
+ */
+SceneObject stageObjects[] = {
+	{ { 0, 1.5, 0 }, 0, 2, 0, MESH_SPHERE, 17 },          // the ball in torusBall()
+	{ { -7, 0, 7 }, -30, 0.8, 0, MESH_HOUSE, 14 },
+	{ { 7, 1, 7 }, 180, 1, 0, MESH_DODECAHEDRON, 16 },
+	{ { 6, 1, -6 }, 0, 1, 0, MESH_CUBE, 2 },
+	{ { -1.5, 0.2, 4.5 }, 0, 1.2, 0, MESH_SPHERE, 20 },  // the glass balls, in a row that overlaps from the front
+	{ { 0, 0.2, 5.5 }, 0, 1.2, 0, MESH_SPHERE, 21 },
+	{ { 1.5, 0.2, 6.5 }, 0, 1.2, 0, MESH_SPHERE, 22 },
+};
+int stageObjectCount = sizeof(stageObjects) / sizeof(stageObjects[0]);
+
+DrawList drawList; // rebuilt for every frame by display()
+
+// ------------------------------ Lights ----------------------------------------------
+
+ClusteredLighting clusteredLighting;
+ShadowMap shadowMap;
+int clustered = 0;     // Is clustered lighting in use?  (Set by initGL(), toggled by the F key.)
+int lightShow = 0;     // Are the moving lights on?  (Toggled by the L key.)
+int shadows = 0;       // Does the top light cast shadows?  (Set by initGL(), toggled by the S key.)
+double lightTime = 0, previousLightTime = 0;  // for moving the lights; advanced by update()
+
+// The faces of the cube map that the metals reflect, in the order that loadCubeMap() wants.
+const char* environmentPaths[6] = {
+	"../Three.js_Ballbox/Coliseum/posx.jpg", "../Three.js_Ballbox/Coliseum/negx.jpg",
+	"../Three.js_Ballbox/Coliseum/posy.jpg", "../Three.js_Ballbox/Coliseum/negy.jpg",
+	"../Three.js_Ballbox/Coliseum/posz.jpg", "../Three.js_Ballbox/Coliseum/negz.jpg",
+};
+Texture* environment;  // loaded in the background; started by initGL()
+int shadowMapDrawn = 0;  // The top light never moves, so the map is only drawn again for changed objects.
+
+Overlay overlay;       // holds the last scene, for drawing the panel without it
+int overlayReady = 0;  // Could the overlay be made?  (Set by initGL().)
+int helpShown = 0;     // Is the panel of keys shown?  (Toggled by the H key.)
+
+Transparency transparency;  // the targets of the transparent pass, for the glass
+int transparencyReady = 0;  // Could they be made?  (Set by initGL().)
+int orderIndependent = 1;   // Is the glass drawn with transparency.c?  (Toggled by the O key.)
+
+int turntableFrames = 0;    // frames to write instead of showing the window  (Set by -turntable.)
+const char* turntablePattern = "turntable%03d.png";  // their file names  (Set by -output.)
+
+#define LIGHT_SHOW_COUNT 256
+#define STAGE_LIGHT_COUNT 2
+
+/**
+ * The top light hangs high above the middle of the stage, so that the objects
+ * cast shadows onto the stage.  It is the key light of the lighting shader.
+ */
+PointLight topLight = { { 0, 14, 0 }, 30, { 0.6, 0.6, 0.55 } };
+
+/**
+ * The other lights, for clustered lighting.  The first STAGE_LIGHT_COUNT are
+ * the stage lights that initGL() also sets up for fixed-function lighting;
+ * the rest are the light show, placed by moveLights().
+ */
+PointLight stageLights[STAGE_LIGHT_COUNT + LIGHT_SHOW_COUNT] = {
+	{ { -3.5, 1, 0 }, 8, { 0, 0.1, 0 } },   // left
+	{ { 3.5, 1, 0 }, 8, { 0, 0, 0.1 } },    // right
+};
+
+#define SHADOW_MAP_SIZE 2048
+#define SHADOW_FOVY 70      // enough for the light to see the whole stage
+DrawList shadowList;        // the objects that the top light sees; rebuilt by renderShadowMap()
+float* shadowInstances;     // their model matrices, grouped by mesh
+GLuint shadowCasterList;    // a display list that draws the GLUT shapes that cast shadows
+
+AnimationSystem lightShowAnimation;  // a node for each light of the light show, made by createLightShow()
+
+/**
+ * Gives each light of the light show its color, and the tracks that move
+ * it: they circle the stage in rings at different heights and speeds, and
+ * bob up and down.  A circle is two waves, a quarter of a turn apart.
+ */
+void createLightShow() {
+	int i;
+	initAnimationSystem(&lightShowAnimation);
+	for (i = 0; i < LIGHT_SHOW_COUNT; i++) {
+		PointLight* light = &stageLights[STAGE_LIGHT_COUNT + i];
+		int node = addAnimationNode(&lightShowAnimation, 0, 0, 0);
+		float ring = i % 8;
+		float speed = (0.3f + 0.1f*ring) * (i % 2 ? 1 : -1);
+		float start = i * 2 * M_PI / LIGHT_SHOW_COUNT * 8;
+		float distance = 2 + ring;
+		addWaveTrack(&lightShowAnimation, node, ANIMATION_X, 0, distance, speed, start + M_PI / 2);
+		addWaveTrack(&lightShowAnimation, node, ANIMATION_Y, 0.5f + 0.4f*ring, 0.5f, 1, i);
+		addWaveTrack(&lightShowAnimation, node, ANIMATION_Z, 0, distance, speed, start);
+		light->radius = 3;
+		light->color[0] = (float)(0.5 + 0.5*sin(i * 0.7));
+		light->color[1] = (float)(0.5 + 0.5*sin(i * 1.3 + 2));
+		light->color[2] = (float)(0.5 + 0.5*sin(i * 1.9 + 4));
+	}
+}
+
+/**
+ * Places the lights of the light show at the given time, from the
+ * positions that their tracks give.
+ */
+void moveLights(double time) {
+	float* const* channels = lightShowAnimation.channels;
+	int i;
+	if (evaluateAnimation(&lightShowAnimation, time) == 0)
+		return;
+	for (i = 0; i < LIGHT_SHOW_COUNT; i++) {
+		PointLight* light = &stageLights[STAGE_LIGHT_COUNT + i];
+		light->position[0] = channels[ANIMATION_X][i];
+		light->position[1] = channels[ANIMATION_Y][i];
+		light->position[2] = channels[ANIMATION_Z][i];
+	}
+}
+
+/**
+ * Turns lighting off or on, for drawing objects in a solid color.  With
+ * clustered lighting, that means switching between fixed-function drawing
+ * and the lighting shader.
+ */
+void lightingOff() {
+	glDisable(GL_LIGHTING);
+	if (clustered)
+		glUseProgram(0);
+}
+
+void lightingOn() {
+	glEnable(GL_LIGHTING);
+	if (clustered)
+		useClusteredLighting(&clusteredLighting);
+}
+
+/**
+ * Draws each light of the light show as a dot.
+ */
+void drawLightMarkers() {
+	int i;
+	lightingOff();
+	glPointSize(4);
+	glBegin(GL_POINTS);
+	for (i = 0; i < LIGHT_SHOW_COUNT; i++) {
+		glColor3fv( stageLights[STAGE_LIGHT_COUNT + i].color );
+		glVertex3fv( stageLights[STAGE_LIGHT_COUNT + i].position );
+	}
+	glEnd();
+	lightingOn();
+}
 
 // Methods for setting material and polhedron construction
 
 /**
  * Sets the OpenGL material properties for the specified
- * material m in the given array of materials
+ * material m in the given array of materials.  With clustered lighting,
+ * the table is already in materialBuffer, and only the number of the
+ * material is passed to the shader.
  */
-void setMaterial(float materials[][13], int m) {
+void setMaterial(float materials[][MATERIAL_FLOATS], int m) {
+	if (clustered) {
+		glVertexAttribI1i( clusteredLighting.materialLocation, m );
+		return;
+	}
 	glMaterialfv( GL_FRONT_AND_BACK, GL_AMBIENT, materials[m] );
 	glMaterialfv( GL_FRONT_AND_BACK, GL_DIFFUSE, &materials[m][4] );
 	glMaterialfv( GL_FRONT_AND_BACK, GL_SPECULAR, &materials[m][8] );
@@ -64,32 +326,33 @@ void setMaterial(float materials[][13], int m) {
 }
 
 /**
- * Constrcuts/Renders a given polyhedron
+ * Compiles a polyhedron into a triangle mesh, runs the mesh through the
+ * optimizer in meshopt.c and reports what the optimizer did.
+ */
+TriMesh compileMesh(const char* name, Polyhedron poly) {
+	TriMesh mesh = compilePolyhedron(poly);
+	MeshOptStats stats = optimizeMesh(&mesh, 1e-4f);
+	printf("%s: %d -> %d vertices, %d triangles, ACMR %.3f -> %.3f\n", name,
+			stats.vertexCountBefore, stats.vertexCountAfter, stats.triangleCountAfter,
+			stats.acmrBefore, stats.acmrAfter);
+	return mesh;
+}
+
+/**
+ * Constrcuts/Renders a given polyhedron.  The faces are drawn from mesh,
+ * the buffers of the compiled version of poly.
  */
-void drawPoly(Polyhedron poly) {
+void drawPoly(Polyhedron poly, const MeshBuffer* mesh) {
 
 	// drawing faces
 	glPolygonOffset(1,1);
-	int i,j = 0; // j is the index into the poly.faces array
-	for (i = 0; i < poly.faceCount; i++) {
-		if ( poly.faceColors != NULL )
-    		glColor3dv( &poly.faceColors[ i*3 ]  );  // Color for face number i.
-		glNormal3dv( &poly.normals[ i*3 ] ); // Normal for face number i
-		glEnable( GL_POLYGON_OFFSET_FILL );
-    	glBegin( GL_TRIANGLE_FAN );
-    	while ( poly.faces[j] != -1) { // Generate vertices for face number i.
-        	int vertexNum = poly.faces[j]; // Vertex number in poly.vertices array.
-        	glVertex3dv( &poly.vertices[ vertexNum*3 ] );
-        	j++;
-    	}
-    	j++;  // increment j past the -1 that ended the data for this face.
-    	glEnd();
-		glDisable( GL_POLYGON_OFFSET_FILL );
-	}
+	glEnable( GL_POLYGON_OFFSET_FILL );
+	drawMeshBuffer(mesh);
+	glDisable( GL_POLYGON_OFFSET_FILL );
 
 	// drawing edges
 	glLineWidth(3);
-	j=0;
+	int i,j = 0; // j is the index into the poly.faces array
 	for (i = 0; i < poly.faceCount; i++) {
 		glBegin( GL_LINE_LOOP );
 		while ( poly.faces[j] != -1) { // Generate vertices for face number i.
@@ -105,35 +368,39 @@ void drawPoly(Polyhedron poly) {
 // Methods for objects
 
 /**
- * Draws a sphere lying in a torus
+ * Draws the torus that a sphere lies in.  (The sphere is one of the
+ * stageObjects, drawn from the geodesic sphere chain.)  torusShape() is
+ * just the geometry, which is also drawn into the shadow map.
  */
-void torusBall() {
-	glPushMatrix();
-	glTranslated( 0, 1.5, 0 );
-	setMaterial(materials, 17);
-	glutSolidSphere( 2, 32, 32);
-	glPopMatrix();
-
+void torusShape() {
 	glPushMatrix();
 	glTranslated(0,0,0);
 	glRotatef( -90, 1, 0, 0 );
-	setMaterial(materials, 2);
 	glutSolidTorus( 0.75, 2, 32, 32);
 	glPopMatrix();
 }
 
+void torusBall() {
+	setMaterial(materials, 2);
+	torusShape();
+}
+
 /*
  * Constructs a teapot using glut and sets a
  * material and translation for it
  */
-void teapot() {
+void teapotShape() {
 	glPushMatrix();
-	setMaterial(materials, 6);
 	glTranslatef( -7, 0, -7 );
 	glutSolidTeapot(2);
 	glPopMatrix();
 }
 
+void teapot() {
+	setMaterial(materials, 6);
+	teapotShape();
+}
+
 /**
  * Wireframe objects are drawn with lighting disabled
  * When lighting is disabled, color is set by glColor*
@@ -141,50 +408,51 @@ void teapot() {
  */
 void wireframes() {
 	glPushMatrix();
-	glDisable(GL_LIGHTING);
+	lightingOff();
 	glLineWidth(0.5);
 	glColor3ub( 204, 0, 102 );
 	glTranslatef( 6, 1, -6 );
 	glutWireSphere( 2, 32, 32 );
-	glEnable(GL_LIGHTING);
+	lightingOn();
 	glPopMatrix();
 
 	glPushMatrix();
-	glDisable(GL_LIGHTING);
+	lightingOff();
 	glLineWidth(0.25);
 	glColor3ub( 115, 0, 230 );
 	glTranslatef( 7, -1, 7 );
 	glRotatef( -90, 1, 0, 0 );
 	glutWireCone( 2, 7, 32, 8 );
-	glEnable(GL_LIGHTING);
-	glPopMatrix();
-}
-
-void poly_houseIFS() {
-	glPushMatrix();
-	glTranslatef( -7, 0, 7 );
-	glScalef(0.8,0.8,0.8);
-	glRotatef( -30, 0, 1, 0 );
-	setMaterial( materials, 14 );
-	drawPoly(house);
+	lightingOn();
 	glPopMatrix();
 }
 
-void poly_dodecahedronIFS() {
-	glPushMatrix();
-	glTranslatef( 7, 1, 7 );
-	glRotatef( 180, 0, 1, 0 );
-	setMaterial( materials, 16 );
-	drawPoly(dodecahedron);
-	glPopMatrix();
-}
-
-void poly_cubeIFS() {
-	glPushMatrix();
-	glTranslatef( 6, 1, -6 );
-	setMaterial(materials, 2);
-	drawPoly(cube);
-	glPopMatrix();
+/**
+ * Draws the objects in the draw list, which is sorted by material so that
+ * each material is set only once.  (That matters only for fixed-function
+ * lighting; with the material table, a change of material costs nothing.)
+ * Only the transparent objects are drawn if transparent is 1, and only the
+ * opaque ones if it is 0.
+ */
+void drawStageObjects(int transparent) {
+	int i, material = -1;
+	for (i = 0; i < drawList.count; i++) {
+		const DrawItem* item = &drawList.items[i];
+		const StageMesh* mesh = &stageMeshes[item->mesh];
+		if ( TRANSPARENT_MATERIAL(item->material) != transparent )
+			continue;
+		if ( item->material != material ) {
+			material = item->material;
+			setMaterial( materials, material );
+		}
+		glPushMatrix();
+		glMultMatrixf( item->modelMatrix );
+		if ( mesh->poly != NULL )
+			drawPoly( *mesh->poly, &mesh->buffers[item->lod] );
+		else
+			drawMeshBuffer( &mesh->buffers[item->lod] );
+		glPopMatrix();
+	}
 }
 
 // Method for drawing
@@ -193,29 +461,141 @@ void draw() {
 	torusBall();
 	teapot();
 	wireframes();
-	poly_houseIFS();
-	poly_dodecahedronIFS();
-	poly_cubeIFS();
+	drawStageObjects(0);
 }
 
 /**
- * The display method is called when the panel needs to be drawn.
- * Here, it draws a stage and some objects on the stage.
+ * Draws the transparent objects, after everything opaque.  With the
+ * lighting shader and the scene in the overlay's framebuffer, whose depth
+ * buffer the transparent pass can share, they go through transparency.c.
+ * Otherwise they are blended over the scene in the order of the draw list,
+ * which is right only where they do not overlap.  Either way, they are
+ * depth tested against the opaque objects but do not hide each other.
  */
-void display() {
-    // called whenever the display needs to be redrawn
-    glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
-    glLoadIdentity();
-    gluLookAt( 0,8,40, 0,1,0, 0,1,0 );  // viewing transform
+void drawTransparentObjects() {
+	if ( clustered && transparencyReady && overlayReady && orderIndependent ) {
+		beginTransparency( &transparency, overlay.width, overlay.height, overlay.depthBuffer );
+		setTransparentLighting( &clusteredLighting, 1 );
+		useClusteredLighting( &clusteredLighting );
+		drawStageObjects(1);
+		setTransparentLighting( &clusteredLighting, 0 );
+		endTransparency( &transparency );
+		useClusteredLighting( &clusteredLighting );
+	}
+	else {
+		glEnable(GL_BLEND);
+		glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
+		glDepthMask(GL_FALSE);
+		drawStageObjects(1);
+		glDepthMask(GL_TRUE);
+		glDisable(GL_BLEND);
+	}
+}
 
-	// allows rotation of the entire scene (ie. includig the base)
-	glRotatef( y_rotation_angle, 0, 1, 0 );
-	//glRotatef( x_rotation_angle, 1, 0, 0 );
+/**
+ * Draws everything that casts a shadow into the shadow map, as seen from the
+ * top light.  A second draw list culls the stage objects against the light's
+ * frustum; its items are grouped by mesh and level of detail, so that each
+ * group is one instanced draw call.  The GLUT shapes are drawn from a display
+ * list.  Unlike drawing draw() a second time, nothing here sets materials or
+ * lighting state.
+ */
+void renderShadowMap(const float* projection) {
+	static const float target[3] = { 0, 0, 0 }, up[3] = { 0, 0, -1 };
+	int groupStarts[MESH_COUNT][SPHERE_LOD_COUNT], groupCounts[MESH_COUNT][SPHERE_LOD_COUNT];
+	int i, m, lod, start = 0;
+	DrawView view;
+
+	aimShadowMap( &shadowMap, topLight.position, target, up, SHADOW_FOVY, 4, 24 );
+	memcpy( view.viewMatrix, shadowMap.lightView, sizeof(view.viewMatrix) );
+	view.fovy = SHADOW_FOVY;
+	view.aspect = 1;
+	view.zNear = 4;
+	view.zFar = 24;
+	view.viewportHeight = SHADOW_MAP_SIZE;
+	view.lodCounts = stageMeshLODCounts;
+	view.lodPixels = 24; // shadows can do with coarser spheres
+	buildDrawList( &shadowList, stageObjects, stageObjectCount, &view );
+
+	// Group the matrices with a counting sort.
+	memset( groupCounts, 0, sizeof(groupCounts) );
+	for (i = 0; i < shadowList.count; i++)
+		groupCounts[shadowList.items[i].mesh][shadowList.items[i].lod]++;
+	for (m = 0; m < MESH_COUNT; m++)
+		for (lod = 0; lod < SPHERE_LOD_COUNT; lod++) {
+			groupStarts[m][lod] = start;
+			start += groupCounts[m][lod];
+			groupCounts[m][lod] = 0;
+		}
+	for (i = 0; i < shadowList.count; i++) {
+		const DrawItem* item = &shadowList.items[i];
+		int slot = groupStarts[item->mesh][item->lod] + groupCounts[item->mesh][item->lod]++;
+		memcpy( &shadowInstances[16*slot], item->modelMatrix, 16*sizeof(float) );
+	}
 
-    float gray[] = { 0.6f, 0.6f, 0.6f, 1 };
-    float zero[] = { 0, 0, 0, 1 };
-    glMaterialfv(GL_FRONT_AND_BACK, GL_AMBIENT_AND_DIFFUSE, gray);
-    glMaterialfv(GL_FRONT_AND_BACK, GL_SPECULAR, zero);
+	beginShadowPass( &shadowMap );
+	setShadowInstances( &shadowMap, shadowInstances, shadowList.count );
+	for (m = 0; m < MESH_COUNT; m++)
+		for (lod = 0; lod < stageMeshes[m].levelCount; lod++)
+			drawShadowInstances( &shadowMap, &stageMeshes[m].buffers[lod], groupStarts[m][lod], groupCounts[m][lod] );
+	glUseProgram(0);
+	glDisable(GL_LIGHTING);
+	glCallList( shadowCasterList );
+	glEnable(GL_LIGHTING);
+	endShadowPass( &shadowMap, glutGet(GLUT_WINDOW_WIDTH), glutGet(GLUT_WINDOW_HEIGHT), projection );
+}
+
+/**
+ * drawScene() draws the stage and the objects on it into the framebuffer
+ * that is bound, which is the scene cache of the overlay, if it could be
+ * made.  changes says what changed since the last scene that was drawn.
+ */
+void drawScene(int changes) {
+    DrawView view;
+    float projection[16], shadowMatrix[16];
+	double alpha = frameLoopAlpha();
+	getControlsView( &camera, alpha, view.viewMatrix );  // viewing transform
+
+	// Culling, LOD selection and sorting run on all of the cores; only the
+	// drawing below has to happen on this thread.
+	view.fovy = 20;
+	view.aspect = 2;
+	view.zNear = 1;
+	view.zFar = 100;
+	view.viewportHeight = glutGet(GLUT_WINDOW_HEIGHT);
+	view.lodCounts = stageMeshLODCounts;
+	view.lodPixels = 12; // the ball gets level 3 (1280 triangles) at the default view
+	buildDrawList( &drawList, stageObjects, stageObjectCount, &view );
+	mat4Perspective( projection, view.fovy, view.aspect, view.zNear, view.zFar );
+	if ( clustered && shadows && ( ! shadowMapDrawn || (changes & CHANGED_OBJECTS) ) ) {
+		renderShadowMap( projection );
+		shadowMapDrawn = 1;
+	}
+
+    glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+    glLoadMatrixf( view.viewMatrix );
+
+	if (clustered) {
+		int lightCount = STAGE_LIGHT_COUNT;
+		updateTextures( TEXTURE_UPLOAD_BYTES );
+		markTextureUsed( environment );
+		setEnvironmentMap( &clusteredLighting, environment->state == TEXTURE_READY ? environment->name : 0,
+				view.viewMatrix );
+		if (lightShow) {
+			moveLights( previousLightTime + (lightTime - previousLightTime) * alpha );
+			lightCount += LIGHT_SHOW_COUNT;
+		}
+		if (shadows)
+			getShadowMatrix( &shadowMap, view.viewMatrix, shadowMatrix );
+		setKeyLight( &clusteredLighting, &topLight, view.viewMatrix,
+				shadows ? shadowMap.depthTexture : 0, shadowMatrix );
+		updateClusteredLighting( &clusteredLighting, stageLights, lightCount, view.viewMatrix,
+				view.fovy, view.aspect, view.zNear, view.zFar,
+				glutGet(GLUT_WINDOW_WIDTH), glutGet(GLUT_WINDOW_HEIGHT) );
+		useClusteredLighting( &clusteredLighting );
+	}
+
+    setMaterial(materials, STAGE_MATERIAL);
 
     glPushMatrix();
     glTranslatef(0,-1.5,0); // Move top of stage down to y = 0
@@ -225,18 +605,102 @@ void display() {
 
     // TODO draw some shapes!
 	draw();
+	if (clustered && lightShow)
+		drawLightMarkers();
+	drawTransparentObjects();
+	if (clustered)
+		glUseProgram(0);
+}
 
-    glutSwapBuffers();  // (Required for double-buffered drawing, at the end of display().)
+/*  Sets lines to the text of the panel, if it is shown, and returns the number of lines.
+ */
+int getHelpLines(const char** lines) {
+	static char text[7][64];
+	if ( ! helpShown )
+		return 0;
+	snprintf(text[0], 64, "A   spin: %s", spinning ? "on" : "off");
+	snprintf(text[1], 64, "L   light show: %s", lightShow ? "on" : "off");
+	snprintf(text[2], 64, "F   lighting: %s", clustered ? "per pixel" : "fixed function");
+	snprintf(text[3], 64, "S   shadows: %s", clustered && shadows ? "on" : "off");
+	snprintf(text[4], 64, "T   camera: %s", camera.mode == CONTROLS_ORBIT ? "orbit" : "trackball");
+	snprintf(text[5], 64, "O   glass: %s", orderIndependent ? "order independent" : "in drawing order");
+	snprintf(text[6], 64, "Home   camera back to the start");
+	lines[0] = text[0];
+	lines[1] = text[1];
+	lines[2] = text[2];
+	lines[3] = text[3];
+	lines[4] = text[4];
+	lines[5] = text[5];
+	lines[6] = text[6];
+	lines[7] = "H   hide this panel";
+	return 8;
+}
+
+/**
+ * The display method is called when the panel needs to be drawn.
+ * Here, it draws a stage and some objects on the stage, and the panel
+ * over them.  The scene is drawn only if something in it changed.
+ */
+void display() {
+    // called whenever the display needs to be redrawn
+	int changes = frameLoopTakeChanges();
+	int width = glutGet(GLUT_WINDOW_WIDTH), height = glutGet(GLUT_WINDOW_HEIGHT);
+	const char* lines[OVERLAY_MAX_LINES];
+	int lineCount = getHelpLines(lines);
+
+	if ( ! overlayReady ) {
+		drawScene(CHANGED_ALL);
+		drawOverlayPanel(lines, lineCount, width, height, overlay.panel);
+		glutSwapBuffers();
+	}
+	else if ( (changes & CHANGED_SCENE) || ! overlaySceneCached(&overlay, width, height) ) {
+		beginOverlayScene(&overlay, width, height);
+		drawScene(changes);
+		endOverlayScene(&overlay);
+		presentOverlay(&overlay, lines, lineCount);
+		glutSwapBuffers();  // (Required for double-buffered drawing, at the end of display().)
+	}
+	else if ( changes == CHANGED_OVERLAY )
+		updateOverlayPanel(&overlay, lines, lineCount);  // only the panel, in the front buffer
+	else {
+		presentOverlay(&overlay, lines, lineCount);  // nothing changed, as when the window is uncovered
+		glutSwapBuffers();
+	}
+    frameLoopEndFrame();
 }
 
 /**
  * initGL() is called just once, by main(), to do initialization of OpenGL state
  * and other global state. Here, it sets up a projection, configures some lighting,
  * and enables the depth test.  It also calls createPolyhedra(), whcih is defined
- * in the included file, polyhedron.h.
+ * in the included file, polyhedron.h, and compiles the polyhedra that are drawn
+ * into triangle meshes.
  */
 void initGL() {
     createPolyhedra();
+    houseMesh = compileMesh("house", house);
+    dodecahedronMesh = compileMesh("dodecahedron", dodecahedron);
+    cubeMesh = compileMesh("cube", cube);
+    createGeodesicLODs(sphereLODs, SPHERE_LOD_COUNT);
+
+    StageMesh meshes[MESH_COUNT] = {
+        { NULL, sphereLODs, SPHERE_LOD_COUNT },
+        { &house, &houseMesh, 1 },
+        { &dodecahedron, &dodecahedronMesh, 1 },
+        { &cube, &cubeMesh, 1 },
+    };
+    int i, lod;
+    for (i = 0; i < MESH_COUNT; i++) {
+        stageMeshes[i] = meshes[i];
+        stageMeshLODCounts[i] = meshes[i].levelCount;
+        for (lod = 0; lod < meshes[i].levelCount; lod++)
+            uploadTriMesh(&stageMeshes[i].buffers[lod], &meshes[i].levels[lod]);
+    }
+    for (i = 0; i < stageObjectCount; i++) {
+        Polyhedron* poly = stageMeshes[stageObjects[i].mesh].poly;
+        stageObjects[i].radius = poly ? poly->maxVertexLength : 1;
+    }
+    initDrawList(&drawList);
     glClearColor(0.0, 0.0, 0.0, 1.0);
     glMatrixMode(GL_PROJECTION);
     glLoadIdentity();
@@ -248,13 +712,13 @@ void initGL() {
     glEnable(GL_LIGHT0);
 
     // TODO configure better lighting!
-	float lightColors[3][4] = { {0.1,0,0,1}, {0,0.1,0,1}, {0,0,0.1,1} };
-	float lightPositions[3][4] = { {0,2.5,0,1}, {-3.5,1,0,1}, {3.5,1,0,1} };
+	float lightColors[3][4] = { {0.6,0.6,0.55,1}, {0,0.1,0,1}, {0,0,0.1,1} };
+	float lightPositions[3][4] = { {0,14,0,1}, {-3.5,1,0,1}, {3.5,1,0,1} };
 
-	// top point light
+	// top point light (the same as topLight)
 	glEnable(GL_LIGHT1);
 	glLightfv(GL_LIGHT1, GL_POSITION, lightPositions[0]);
-	glLightfv(GL_LIGHT1, GL_AMBIENT, lightColors[0]);
+	glLightfv(GL_LIGHT1, GL_DIFFUSE, lightColors[0]);
 
 	// left point light
 	glEnable(GL_LIGHT2);
@@ -265,14 +729,35 @@ void initGL() {
 	glEnable(GL_LIGHT3);
 	glLightfv(GL_LIGHT3, GL_POSITION, lightPositions[2]);
 	glLightfv(GL_LIGHT3, GL_DIFFUSE, lightColors[2]);
+
+	// The same lights, and many more, for per-pixel lighting.
+	createLightShow();
+	materialBuffer = createMaterialBuffer(materials, materialCount);
+	clustered = materialBuffer != 0 && initClusteredLighting(&clusteredLighting);
+	if (clustered) {
+		texturesInit();
+		environment = loadCubeMap(environmentPaths);
+	}
+
+	overlayReady = initOverlay(&overlay);
+	transparencyReady = clustered && initTransparency(&transparency);
+
+	// Shadows of the top light, for the lighting shader.
+	if ( clustered && initShadowMap(&shadowMap, SHADOW_MAP_SIZE) ) {
+		shadows = 1;
+		initDrawList(&shadowList);
+		shadowInstances = malloc( stageObjectCount*16*sizeof(float) );
+		shadowCasterList = glGenLists(1);
+		glNewList(shadowCasterList, GL_COMPILE);
+		torusShape();
+		teapotShape();
+		glEndList();
+		frameLoopAddCounter("shadow pass", &shadowMap.gpuMilliseconds);
+	}
 }  // end initGL()
 
 // ------------------------------ mouse handling functions ----------------------------------
 
-int dragging;        // 0 or 1 to indicate whether a drag operation is in progress
-int dragButton;      // which button started the drag operation
-int prevX, prevY;    // previous mouse position during drag
-
 /*  mouseUpOrDown() is set up in main() to be called when the user presses or releases
  *  a button on the mouse.  The button paramter is one of the contants GLUT_LEFT_BUTTON,
  *  GLUT_MIDDLE_BUTTON, or GLUT_RIGHT_BUTTON.  The buttonState is GLUT_UP or GLUT_DOWN and
@@ -281,19 +766,9 @@ int prevX, prevY;    // previous mouse position during drag
  */
 void mouseUpOrDown(int button, int buttonState, int x, int y) {
        // called to respond to mouse press and mouse release events
-   if (buttonState == GLUT_DOWN) {  // a mouse button was pressed
-       if (dragging)
-          return;  // Ignore a second button press during a draw operation.
-       dragging = 1;
-       dragButton = button;
-       prevX = x;
-       prevY = y;
-   }
-   else {  // a mouse button was released
-       if ( ! dragging || button != dragButton )
-           return; // this mouse release does not end a drag operation.
-       dragging = 0;
-   }
+   resizeControls(&camera, glutGet(GLUT_WINDOW_WIDTH), glutGet(GLUT_WINDOW_HEIGHT));
+   controlsMouseButton(&camera, button, buttonState, x, y);
+   frameLoopWake();
 }
 
 /*  mouseDragged() is set up in main() to be called when the user moves the mouse,
@@ -302,30 +777,155 @@ void mouseUpOrDown(int button, int buttonState, int x, int y) {
  */
 void mouseDragged(int x, int y) {
         // called to respond when the mouse moves during a drag
-    if ( ! dragging )
-        return;
+    // (There is no need for glutPostRedisplay(); the frame loop redraws the scene.)
+    controlsMouseMotion(&camera, x, y);
+    frameLoopWake();
+}
+
+// ------------------------------ animation ----------------------------------
+
+/*  Is the environment map still loading, or streaming in?  Only display() copies its levels.
+ */
+int environmentLoading() {
+	return clustered && ( environment->state == TEXTURE_LOADING
+			|| (environment->state == TEXTURE_READY && environment->residentLevel > 0) );
+}
+
+/*  update() is called by the frame loop UPDATES_PER_SECOND times per second,
+ *  with dt = 1/UPDATES_PER_SECOND, to advance the animation.
+ */
+void update(double dt) {
+	camera.autoRotateSpeed = spinning ? SPIN_SPEED * M_PI / 180 : 0;
+	if ( updateControls(&camera, dt) )
+		frameLoopMarkChanged(CHANGED_CAMERA);
+	previousLightTime = lightTime;
+	lightTime += dt;
+	if (lightShow)
+		frameLoopMarkChanged(CHANGED_LIGHTS);
+	if ( environmentLoading() )
+		frameLoopMarkChanged(CHANGED_TEXTURES);  // display() streams it in
+}
 
-    // TODO Do something when the mouse moves!
+/*  isMoving() is called by the frame loop after its updates.  Nothing needs
+ *  to be drawn again while the camera and the lights are still and the
+ *  environment map has finished streaming in.
+ */
+int isMoving() {
+	return spinning || lightShow || environmentLoading() || controlsMoving(&camera);
+}
 
-    glutPostRedisplay();  // make OpenGL redraw the scene
-    prevX = x;
-    prevY = y;
-	y_rotation_angle = x*0.4; // 0.4 just used to slow down the rotation speed
-	//x_rotation_angle = ( y%30==0 ) ? ( x_rotation_angle ) : (y%30);
+/*  doKeyboard() is set up in main() to be called when the user types a key.
+ */
+void doKeyboard(unsigned char ch, int x, int y) {
+	// Each key marks what it changes, and the panel, which shows its setting.
+	if ( ch == 'a' || ch == 'A' ) {
+		spinning = ! spinning;
+		frameLoopMarkChanged(CHANGED_OVERLAY);  // the spin itself moves the camera at the next update
+	}
+	else if ( ch == 'l' || ch == 'L' ) {
+		lightShow = ! lightShow;
+		frameLoopMarkChanged(CHANGED_LIGHTS | CHANGED_OVERLAY);
+	}
+	else if ( (ch == 'f' || ch == 'F') && clusteredLighting.program != 0 ) {
+		clustered = ! clustered;
+		frameLoopMarkChanged(CHANGED_LIGHTS | CHANGED_MATERIALS | CHANGED_OVERLAY);
+	}
+	else if ( (ch == 's' || ch == 'S') && shadowMap.program != 0 ) {
+		shadows = ! shadows;
+		frameLoopMarkChanged(CHANGED_LIGHTS | CHANGED_OVERLAY);
+	}
+	else if ( ch == 't' || ch == 'T' ) {
+		setControlsMode(&camera, camera.mode == CONTROLS_ORBIT ? CONTROLS_TRACKBALL : CONTROLS_ORBIT);
+		frameLoopMarkChanged(CHANGED_CAMERA | CHANGED_OVERLAY);
+	}
+	else if ( ch == 'o' || ch == 'O' ) {
+		orderIndependent = ! orderIndependent;
+		frameLoopMarkChanged(CHANGED_MATERIALS | CHANGED_OVERLAY);
+	}
+	else if ( ch == 'h' || ch == 'H' ) {
+		helpShown = ! helpShown;
+		frameLoopMarkChanged(CHANGED_OVERLAY);
+	}
+}
+
+/*  doSpecialKey() is set up in main() to be called for keys such as Home.
+ */
+void doSpecialKey(int key, int x, int y) {
+	if ( key == GLUT_KEY_HOME ) {
+		resetControls(&camera);
+		frameLoopMarkChanged(CHANGED_CAMERA);
+	}
+}
+
+// ------------------------------ turntable ----------------------------------
+
+/*  renderTurntable() is called by main(), instead of starting the frame loop,
+ *  for -turntable.  It draws the frames into the scene cache of the overlay,
+ *  turning the camera the way that the A key spins the stage, and hands each
+ *  one to a FrameWriter, which reads it back while the next ones are drawn.
+ *  The environment map is loaded first, so that every frame has it.  Returns
+ *  the exit status for main().
+ */
+int renderTurntable() {
+	int width = glutGet(GLUT_WINDOW_WIDTH), height = glutGet(GLUT_WINDOW_HEIGHT);
+	float startTheta = camera.theta;
+	FrameWriter writer;
+	int i, failed;
+	if ( ! overlayReady ) {
+		printf("A turntable needs OpenGL 3.0, to draw offscreen.\n");
+		return 1;
+	}
+	if ( ! initFrameWriter(&writer, width, height, turntablePattern) )
+		return 1;
+	while ( environmentLoading() ) {
+		updateTextures( TEXTURE_UPLOAD_BYTES );
+		usleep(1000);
+	}
+	for (i = 0; i < turntableFrames; i++) {
+		setControlsAzimuth( &camera, startTheta - 2 * M_PI * i / turntableFrames );
+		beginOverlayScene( &overlay, width, height );
+		drawScene( i == 0 ? CHANGED_ALL : CHANGED_CAMERA );
+		captureFrame( &writer, i );  // the scene cache is still the read framebuffer
+		endOverlayScene( &overlay );
+	}
+	failed = finishFrameWriter( &writer );
+	printf("Wrote %d frames of %d by %d pixels; drawing waited %.0f ms for readback and writing.\n",
+			writer.written, width, height, writer.waitMilliseconds);
+	return failed != 0;
 }
 
 // ----------------- main routine -------------------------------------------------
 
 int main(int argc, char** argv) {
+    double maxFramesPerSecond = 60;
+    int showStats = 0, i;
     glutInit(&argc, argv); // Allows processing of certain GLUT command line options
+    frameLoopParseArgs(argc, argv, &maxFramesPerSecond, &showStats);
+    for (i = 1; i < argc; i++)
+        if (strcmp(argv[i], "-turntable") == 0 && i < argc - 1)
+            turntableFrames = atoi(argv[i+1]);
+        else if (strcmp(argv[i], "-output") == 0 && i < argc - 1)
+            turntablePattern = argv[i+1];
+    if (maxFramesPerSecond == 0)
+        spinning = 1;  // a benchmark run should have something to draw
     glutInitDisplayMode(GLUT_DOUBLE | GLUT_DEPTH);  // Use double buffering and a depth buffer.
     glutInitWindowSize(1000,500);       // size of display area, in pixels
     glutInitWindowPosition(100,100);    // location in window coordinates
     glutCreateWindow("Stage");          // parameter is window title
     initGL();                           // do OpenGL initialization for the window
+    initControls(&camera, CONTROLS_ORBIT, cameraEye, cameraTarget, 1000, 500);
+    camera.fovy = 20;                   // as for the projection, so that panning follows the mouse
+    jobsInit(0);                        // start one job thread per core
+    if (turntableFrames > 0)
+        return renderTurntable();       // write the frames and quit, without the event loop
     glutDisplayFunc(display);           // call display() to draw the scene
     glutMouseFunc(mouseUpOrDown);       // call mouseUpOrDown() for mousedown and mouseup events
     glutMotionFunc(mouseDragged);       // call mouseDragged() when mouse moves, only during a drag gesture
+    glutKeyboardFunc(doKeyboard);       // call doKeyboard() when a key is typed
+    glutSpecialFunc(doSpecialKey);      // call doSpecialKey() for keys such as Home
+    frameLoopStart(UPDATES_PER_SECOND, update, maxFramesPerSecond, showStats);
+    frameLoopSleepWhenStill(isMoving);  // no updates while nothing moves,
+    frameLoopTrackChanges();            // and no frames while nothing changes
     glutMainLoop(); // Run the event loop!  This function does not return.
     return 0;
 }
@@ -0,0 +1,355 @@
+#include <math.h>
+#include <float.h>
+#include <string.h>
+#include <GL/freeglut.h>
+#include "controls.h"
+
+#define EPS 0.000001f   // keeps the orbit off the poles, as in OrbitControls
+
+//  Quaternions are x, y, z, w, and rotate vectors as q v q*.
+
+static void quatMultiply(float* result, const float* a, const float* b) {
+    float q[4];
+    q[0] = a[3]*b[0] + a[0]*b[3] + a[1]*b[2] - a[2]*b[1];
+    q[1] = a[3]*b[1] - a[0]*b[2] + a[1]*b[3] + a[2]*b[0];
+    q[2] = a[3]*b[2] + a[0]*b[1] - a[1]*b[0] + a[2]*b[3];
+    q[3] = a[3]*b[3] - a[0]*b[0] - a[1]*b[1] - a[2]*b[2];
+    memcpy(result, q, sizeof(q));
+}
+
+//  The rotation by angle radians about the axis (x,y,z), which must have length 1.
+static void quatFromAxisAngle(float* q, float x, float y, float z, float angle) {
+    float s = sinf(angle / 2);
+    q[0] = x * s;
+    q[1] = y * s;
+    q[2] = z * s;
+    q[3] = cosf(angle / 2);
+}
+
+static void quatNormalize(float* q) {
+    float length = sqrtf(q[0]*q[0] + q[1]*q[1] + q[2]*q[2] + q[3]*q[3]);
+    int i;
+    for (i = 0; i < 4; i++)
+        q[i] /= length;
+}
+
+static void quatRotate(const float* q, const float* v, float* result) {
+    // v + 2w(u x v) + 2u x (u x v), where u is the vector part of q
+    float t[3], r[3];
+    t[0] = 2 * (q[1]*v[2] - q[2]*v[1]);
+    t[1] = 2 * (q[2]*v[0] - q[0]*v[2]);
+    t[2] = 2 * (q[0]*v[1] - q[1]*v[0]);
+    r[0] = v[0] + q[3]*t[0] + q[1]*t[2] - q[2]*t[1];
+    r[1] = v[1] + q[3]*t[1] + q[2]*t[0] - q[0]*t[2];
+    r[2] = v[2] + q[3]*t[2] + q[0]*t[1] - q[1]*t[0];
+    memcpy(result, r, sizeof(r));
+}
+
+/*  The orientation of a camera at azimuth theta and polar angle phi around
+    the target, looking at it with the y-axis up: a turn about x that tilts
+    the camera down from the horizon, then a turn about y.  */
+static void quatFromOrbit(float* q, float theta, float phi) {
+    float yaw[4], pitch[4];
+    quatFromAxisAngle(yaw, 0, 1, 0, theta);
+    quatFromAxisAngle(pitch, 1, 0, 0, phi - (float)M_PI / 2);
+    quatMultiply(q, yaw, pitch);
+}
+
+//  Sets theta and phi from the direction of the camera, and the rotation from them.
+static void makeOrbit(CameraControls* controls) {
+    static const float back[3] = { 0, 0, 1 };
+    float eye[3];
+    quatRotate(controls->rotation, back, eye);
+    controls->theta = atan2f(eye[0], eye[2]);
+    controls->phi = acosf(eye[1] < -1 ? -1 : eye[1] > 1 ? 1 : eye[1]);
+    quatFromOrbit(controls->rotation, controls->theta, controls->phi);
+}
+
+static void clampPhi(CameraControls* controls) {
+    float low = controls->minPolarAngle > EPS ? controls->minPolarAngle : EPS;
+    float high = controls->maxPolarAngle < (float)M_PI - EPS ? controls->maxPolarAngle : (float)M_PI - EPS;
+    if (controls->phi < low)
+        controls->phi = low;
+    else if (controls->phi > high)
+        controls->phi = high;
+}
+
+static void clampDistance(CameraControls* controls) {
+    if (controls->distance < controls->minDistance)
+        controls->distance = controls->minDistance;
+    else if (controls->distance > controls->maxDistance)
+        controls->distance = controls->maxDistance;
+}
+
+static void stop(CameraControls* controls) {
+    memset(controls->pending, 0, sizeof(controls->pending));
+    memset(controls->velocity, 0, sizeof(controls->velocity));
+    controls->dragAction = -1;
+}
+
+//  Copies the current state to the previous one, so that nothing is interpolated.
+static void settle(CameraControls* controls) {
+    memcpy(controls->previousTarget, controls->target, sizeof(controls->target));
+    memcpy(controls->previousRotation, controls->rotation, sizeof(controls->rotation));
+    controls->previousDistance = controls->distance;
+}
+
+void initControls(CameraControls* controls, int mode, const float* eye, const float* target,
+                  int width, int height) {
+    memset(controls, 0, sizeof(CameraControls));
+    memcpy(controls->homeEye, eye, sizeof(controls->homeEye));
+    memcpy(controls->homeTarget, target, sizeof(controls->homeTarget));
+    controls->mode = mode;
+    controls->rotateSpeed = 1;
+    controls->zoomSpeed = 1;
+    controls->panSpeed = 1;
+    controls->damping = 0.1f;
+    controls->minDistance = 0;
+    controls->maxDistance = FLT_MAX;
+    controls->minPolarAngle = 0;
+    controls->maxPolarAngle = (float)M_PI;
+    controls->fovy = 45;
+    resizeControls(controls, width, height);
+    resetControls(controls);
+}
+
+void resetControls(CameraControls* controls) {
+    float offset[3];
+    int i;
+    for (i = 0; i < 3; i++)
+        offset[i] = controls->homeEye[i] - controls->homeTarget[i];
+    memcpy(controls->target, controls->homeTarget, sizeof(controls->target));
+    controls->distance = sqrtf(offset[0]*offset[0] + offset[1]*offset[1] + offset[2]*offset[2]);
+    controls->theta = atan2f(offset[0], offset[2]);
+    controls->phi = controls->distance > 0 ? acosf(offset[1] / controls->distance) : (float)M_PI / 2;
+    if (controls->mode == CONTROLS_ORBIT)
+        clampPhi(controls);
+    quatFromOrbit(controls->rotation, controls->theta, controls->phi);
+    stop(controls);
+    settle(controls);
+}
+
+void setControlsAzimuth(CameraControls* controls, float theta) {
+    if (controls->mode != CONTROLS_ORBIT)
+        return;
+    controls->theta = theta;
+    quatFromOrbit(controls->rotation, controls->theta, controls->phi);
+    stop(controls);
+    settle(controls);
+}
+
+void resizeControls(CameraControls* controls, int width, int height) {
+    controls->width = width > 0 ? width : 1;
+    controls->height = height > 0 ? height : 1;
+}
+
+void setControlsMode(CameraControls* controls, int mode) {
+    if (mode == controls->mode)
+        return;
+    controls->mode = mode;
+    if (mode == CONTROLS_ORBIT) {
+        makeOrbit(controls);
+        clampPhi(controls);
+        quatFromOrbit(controls->rotation, controls->theta, controls->phi);
+        settle(controls);
+    }
+}
+
+/*  Adds a motion that is not a drag, such as a click of the wheel: with
+    inertia it becomes a speed that covers the same distance as it dies away.  */
+static void addImpulse(CameraControls* controls, int action, float across, float up) {
+    float rate;
+    if (controls->damping >= 1) {
+        controls->pending[action][0] += across;
+        controls->pending[action][1] += up;
+        return;
+    }
+    rate = controls->damping > 0 ? -60 * logf(1 - controls->damping) : 1;
+    controls->velocity[action][0] += across * rate;
+    controls->velocity[action][1] += up * rate;
+}
+
+void controlsMouseButton(CameraControls* controls, int button, int state, int x, int y) {
+    int action = -1;
+    if (button == 3 || button == 4) {  // the wheel
+        if (state == GLUT_DOWN && ! controls->noZoom)
+            addImpulse(controls, CONTROLS_ZOOM, 0, logf(0.95f) * controls->zoomSpeed * (button == 3 ? 1 : -1));
+        return;
+    }
+    if (state == GLUT_UP) {
+        if (button == controls->dragButton && controls->dragAction >= 0) {
+            if (controls->damping >= 1)
+                memset(controls->velocity, 0, sizeof(controls->velocity));
+            controls->dragAction = -1;
+        }
+        return;
+    }
+    if (controls->dragAction >= 0)
+        return;  // a second button during a drag does nothing
+    if (button == GLUT_LEFT_BUTTON && ! controls->noRotate)
+        action = CONTROLS_ROTATE;
+    else if (button == GLUT_MIDDLE_BUTTON && ! controls->noZoom)
+        action = CONTROLS_ZOOM;
+    else if (button == GLUT_RIGHT_BUTTON && ! controls->noPan)
+        action = CONTROLS_PAN;
+    if (action < 0)
+        return;
+    controls->dragAction = action;
+    controls->dragButton = button;
+    controls->velocity[action][0] = controls->velocity[action][1] = 0;  // grabbing stops it
+    controls->lastX = x;
+    controls->lastY = y;
+}
+
+void controlsMouseMotion(CameraControls* controls, int x, int y) {
+    float dx = (float)(x - controls->lastX), dy = (float)(controls->lastY - y);  // up is positive
+    float* pending;
+    if (controls->dragAction < 0)
+        return;
+    pending = controls->pending[controls->dragAction];
+    controls->lastX = x;
+    controls->lastY = y;
+    if (controls->dragAction == CONTROLS_ROTATE) {
+        if (controls->mode == CONTROLS_TRACKBALL) {
+            // as TrackballControls: half the width of the window is a radian, both ways
+            pending[0] += 2 * dx / controls->width * controls->rotateSpeed;
+            pending[1] += 2 * dy / controls->width * controls->rotateSpeed;
+        }
+        else {
+            // as OrbitControls: the width of the window is a full turn, and so is its height
+            pending[0] += 2 * (float)M_PI * dx / controls->width * controls->rotateSpeed;
+            pending[1] += 2 * (float)M_PI * dy / controls->height * controls->rotateSpeed;
+        }
+    }
+    else if (controls->dragAction == CONTROLS_ZOOM)
+        pending[1] += dy / controls->height * controls->zoomSpeed;  // the log of the change in distance
+    else {
+        pending[0] += dx / controls->height * controls->panSpeed;   // in heights of the window
+        pending[1] += dy / controls->height * controls->panSpeed;
+    }
+}
+
+static void rotate(CameraControls* controls, float across, float up) {
+    if (controls->mode == CONTROLS_TRACKBALL) {
+        // The scene turns under the mouse, about the axis in the screen
+        // perpendicular to the motion: the camera turns the other way.
+        float angle = sqrtf(across*across + up*up), turn[4];
+        quatFromAxisAngle(turn, up / angle, -across / angle, 0, angle);
+        quatMultiply(controls->rotation, controls->rotation, turn);
+        quatNormalize(controls->rotation);
+    }
+    else {
+        controls->theta -= across;
+        controls->phi += up;
+        clampPhi(controls);
+        quatFromOrbit(controls->rotation, controls->theta, controls->phi);
+    }
+}
+
+static void pan(CameraControls* controls, float across, float up) {
+    static const float right[3] = { 1, 0, 0 }, upward[3] = { 0, 1, 0 };
+    float x[3], y[3];
+    float scale = 2 * controls->distance * tanf(controls->fovy * (float)M_PI / 360);
+    int i;
+    quatRotate(controls->rotation, right, x);
+    quatRotate(controls->rotation, upward, y);
+    for (i = 0; i < 3; i++)
+        controls->target[i] -= (x[i] * across + y[i] * up) * scale;
+}
+
+int updateControls(CameraControls* controls, double dt) {
+    float decay = controls->damping < 1 ? powf(1 - controls->damping, 60 * (float)dt) : 0;
+    float smoothing = dt < CONTROLS_DRAG_SMOOTHING ? (float)dt / CONTROLS_DRAG_SMOOTHING : 1;
+    int moved = 0, action, i;
+    settle(controls);
+    for (action = 0; action < CONTROLS_ACTIONS; action++) {
+        float move[2];
+        for (i = 0; i < 2; i++) {
+            float* v = &controls->velocity[action][i];
+            if (action == controls->dragAction) {
+                // The camera follows the mouse exactly; the speed is kept for when it is let go.
+                move[i] = controls->pending[action][i];
+                *v += (move[i] / (float)dt - *v) * smoothing;
+            }
+            else {
+                move[i] = controls->pending[action][i] + *v * (float)dt;
+                *v *= decay;
+            }
+            if (fabsf(*v) < CONTROLS_REST_SPEED)
+                *v = 0;
+            controls->pending[action][i] = 0;
+        }
+        if (move[0] == 0 && move[1] == 0)
+            continue;
+        moved = 1;
+        if (action == CONTROLS_ROTATE)
+            rotate(controls, move[0], move[1]);
+        else if (action == CONTROLS_ZOOM) {
+            controls->distance *= expf(move[1]);
+            clampDistance(controls);
+        }
+        else
+            pan(controls, move[0], move[1]);
+    }
+    if (controls->mode == CONTROLS_ORBIT && controls->autoRotateSpeed != 0
+            && controls->dragAction != CONTROLS_ROTATE) {
+        controls->theta -= controls->autoRotateSpeed * (float)dt;
+        quatFromOrbit(controls->rotation, controls->theta, controls->phi);
+        moved = 1;
+    }
+    return moved;
+}
+
+int controlsMoving(const CameraControls* controls) {
+    int action;
+    if (controls->mode == CONTROLS_ORBIT && controls->autoRotateSpeed != 0)
+        return 1;
+    for (action = 0; action < CONTROLS_ACTIONS; action++)
+        if (controls->pending[action][0] != 0 || controls->pending[action][1] != 0
+                || controls->velocity[action][0] != 0 || controls->velocity[action][1] != 0)
+            return 1;
+    return 0;
+}
+
+/*  The orientation at alpha, by normalized linear interpolation, which is
+    close enough to a slerp for the turn of one update.  */
+static void interpolate(const CameraControls* controls, double alpha, float* q) {
+    const float* a = controls->previousRotation;
+    const float* b = controls->rotation;
+    float dot = a[0]*b[0] + a[1]*b[1] + a[2]*b[2] + a[3]*b[3];
+    float sign = dot < 0 ? -1 : 1;  // the shorter way round
+    int i;
+    for (i = 0; i < 4; i++)
+        q[i] = (float)(a[i] + (sign * b[i] - a[i]) * alpha);
+    quatNormalize(q);
+}
+
+void getControlsRotation(const CameraControls* controls, double alpha, float* rotation) {
+    static const float axes[3][3] = { {1,0,0}, {0,1,0}, {0,0,1} };
+    float q[4], axis[3];
+    int row, col;
+    interpolate(controls, alpha, q);
+    // The inverse of the camera's rotation: the rows are the camera's axes in world coordinates.
+    for (row = 0; row < 3; row++) {
+        quatRotate(q, axes[row], axis);
+        for (col = 0; col < 3; col++)
+            rotation[col*4 + row] = axis[col];
+        rotation[12 + row] = 0;
+        rotation[row*4 + 3] = 0;
+    }
+    rotation[15] = 1;
+}
+
+void getControlsView(const CameraControls* controls, double alpha, float* view) {
+    float target[3], distance;
+    int row;
+    for (row = 0; row < 3; row++)
+        target[row] = (float)(controls->previousTarget[row]
+                              + (controls->target[row] - controls->previousTarget[row]) * alpha);
+    distance = (float)(controls->previousDistance + (controls->distance - controls->previousDistance) * alpha);
+    getControlsRotation(controls, alpha, view);
+    // translate(0,0,-distance) * rotation * translate(-target)
+    for (row = 0; row < 3; row++)
+        view[12 + row] = -(view[row]*target[0] + view[4 + row]*target[1] + view[8 + row]*target[2]);
+    view[14] -= distance;
+}
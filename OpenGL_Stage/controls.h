@@ -0,0 +1,112 @@
+/*  Header file for controls.c, which turns a camera around a target with the
+    mouse, like the TrackballControls.js of Three.js_Ballbox and the
+    OrbitControls.js of Three.js_Ride:
+
+        CONTROLS_TRACKBALL  dragging rolls the camera around the target
+                            about any axis, as if the scene were a ball
+                            under the mouse; the camera's up direction
+                            turns with it;
+        CONTROLS_ORBIT      dragging across changes the azimuth and dragging
+                            up and down the polar angle, so the camera's up
+                            direction stays that of the y-axis and the
+                            camera never passes over a pole.
+
+    With the left button the mouse rotates, with the middle button it zooms
+    and with the right button it pans, as in the originals; the wheel zooms
+    too.  The orientation of the camera is a quaternion in both modes.
+
+    Mouse events only record how far the mouse moved; updateControls(),
+    called at the fixed steps of frameloop.c, applies the motion.  After the
+    button is let go the camera keeps moving at the speed that it had, which
+    dies away by the fraction damping every 1/60 second, like the
+    dynamicDampingFactor of TrackballControls; a damping of 1 stops it at
+    once.  When every speed has fallen below CONTROLS_REST_SPEED it is set
+    to 0, and controlsMoving() returns 0, so that a program can let
+    frameLoopSleepWhenStill() stop drawing a scene that is still.  */
+
+#ifndef CONTROLS_H
+#define CONTROLS_H
+
+#define CONTROLS_TRACKBALL 0
+#define CONTROLS_ORBIT 1
+
+//  What a drag does; controls->velocity and controls->pending have one pair for each.
+#define CONTROLS_ROTATE 0
+#define CONTROLS_ZOOM 1
+#define CONTROLS_PAN 2
+#define CONTROLS_ACTIONS 3
+
+#define CONTROLS_REST_SPEED 0.001f     // per second; slower than this is stopped
+#define CONTROLS_DRAG_SMOOTHING 0.05f  // seconds over which the speed of a drag is averaged
+
+typedef struct CameraControls {
+    int mode;                       // CONTROLS_TRACKBALL or CONTROLS_ORBIT
+    float target[3];                // the point that the camera looks at and turns around
+    float distance;                 // from the target to the camera
+    float rotation[4];              // x, y, z, w of the quaternion from camera to world coordinates
+    float theta, phi;               // in orbit mode, the azimuth and the polar angle, in radians
+
+    float previousTarget[3];        // at the update before the last, for interpolation
+    float previousDistance;
+    float previousRotation[4];
+    float homeTarget[3], homeEye[3];  // where resetControls() puts the camera
+
+    // Settings, with the defaults of the originals; a program may change them at any time.
+    float rotateSpeed, zoomSpeed, panSpeed;
+    int noRotate, noZoom, noPan;
+    float damping;                  // fraction of the speed lost every 1/60 second, from 0 to 1
+    float minDistance, maxDistance;
+    float minPolarAngle, maxPolarAngle;  // orbit mode only, in radians
+    float autoRotateSpeed;          // orbit mode only, radians per second around the y-axis; 0 for none
+    float fovy;                     // of the projection, in degrees, so that panning follows the mouse
+
+    int width, height;              // of the window
+    int dragAction;                 // CONTROLS_ROTATE, CONTROLS_ZOOM or CONTROLS_PAN; -1 if not dragging
+    int dragButton, lastX, lastY;
+    float pending[CONTROLS_ACTIONS][2];   // motion since the last update, across and up the screen
+    float velocity[CONTROLS_ACTIONS][2];  // per second
+} CameraControls;
+
+/*  Puts the camera at eye, looking at target, with the y-axis up, and sets
+    the defaults.  The window is width by height pixels; tell the controls
+    about a new size with resizeControls().  */
+void initControls(CameraControls* controls, int mode, const float* eye, const float* target,
+                  int width, int height);
+
+//  Puts the camera back where initControls() put it, and stops it.
+void resetControls(CameraControls* controls);
+
+/*  In orbit mode, turns the camera to the azimuth theta, in radians, around
+    the y-axis, at the same polar angle and distance, and stops it, as for
+    a turntable.  Does nothing in trackball mode.  */
+void setControlsAzimuth(CameraControls* controls, float theta);
+
+void resizeControls(CameraControls* controls, int width, int height);
+
+/*  Changes the mode, keeping the camera where it is.  The trackball's up
+    direction is lost in orbit mode, where it is always that of the y-axis.  */
+void setControlsMode(CameraControls* controls, int mode);
+
+/*  Pass the events of glutMouseFunc() and glutMotionFunc() on to these.
+    Without a glutMouseWheelFunc(), freeglut reports the wheel as buttons 3
+    and 4, which controlsMouseButton() takes as zooming in and out.  */
+void controlsMouseButton(CameraControls* controls, int button, int state, int x, int y);
+void controlsMouseMotion(CameraControls* controls, int x, int y);
+
+/*  Moves the camera by the motion of the mouse since the last update and by
+    its speed, over dt seconds.  Returns 1 if the camera moved.  */
+int updateControls(CameraControls* controls, double dt);
+
+//  Returns 1 if the camera will move at the next update.
+int controlsMoving(const CameraControls* controls);
+
+/*  Sets view to the viewing transform at the fraction alpha of the way from
+    the previous update to the last, as for frameLoopAlpha().  */
+void getControlsView(const CameraControls* controls, double alpha, float* view);
+
+/*  The rotation of the viewing transform alone, without moving the target to
+    the origin or the camera away from it, for a program that turns an
+    object in front of a camera of its own.  */
+void getControlsRotation(const CameraControls* controls, double alpha, float* rotation);
+
+#endif
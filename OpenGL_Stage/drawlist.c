@@ -0,0 +1,247 @@
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include "drawlist.h"
+#include "jobs.h"
+#include "mat4.h"
+
+/*  Layout of a sort key, from the most significant bits down: material
+    (8 bits), mesh (8 bits), level of detail (4 bits), depth (24 bits).  */
+#define DEPTH_BITS 24
+#define LOD_SHIFT 24
+#define MESH_SHIFT 28
+#define MATERIAL_SHIFT 36
+
+void initDrawList(DrawList* list) {
+    memset(list, 0, sizeof(DrawList));
+}
+
+void freeDrawList(DrawList* list) {
+    free(list->items);
+    free(list->unsorted);
+    free(list->entries);
+    free(list->entriesTemp);
+    free(list->chunkCounts);
+    free(list->chunkOffsets);
+    free(list->histograms);
+    free(list->chunkBits);
+    initDrawList(list);
+}
+
+static void reserve(DrawList* list, int count) {
+    int chunks = jobsChunkCount(count, DRAWLIST_GRAIN);
+    if (count > list->capacity) {
+        free(list->items);
+        free(list->unsorted);
+        free(list->entries);
+        free(list->entriesTemp);
+        list->items = malloc( count*sizeof(DrawItem) );
+        list->unsorted = malloc( count*sizeof(DrawItem) );
+        list->entries = malloc( count*sizeof(DrawSortEntry) );
+        list->entriesTemp = malloc( count*sizeof(DrawSortEntry) );
+        list->capacity = count;
+    }
+    if (chunks > list->chunkCapacity) {
+        free(list->chunkCounts);
+        free(list->chunkOffsets);
+        free(list->histograms);
+        free(list->chunkBits);
+        list->chunkCounts = malloc( chunks*sizeof(int) );
+        list->chunkOffsets = malloc( chunks*sizeof(int) );
+        list->histograms = malloc( chunks*256*sizeof(int) );
+        list->chunkBits = malloc( chunks*2*sizeof(unsigned long long) );
+        list->chunkCapacity = chunks;
+    }
+}
+
+// ------------------------- pass 1: transform, cull, LOD, key -------------------------
+
+typedef struct CullJob {
+    DrawList* list;
+    const SceneObject* objects;
+    const DrawView* view;
+    float tanX, tanY;        // tangents of the half-angles of the frustum
+    float sideX, sideY;      // 1/sqrt(1+tan^2), to normalize the side planes
+    float pixelsPerUnit;     // screen size of one unit at distance 1
+} CullJob;
+
+static int selectLOD(const CullJob* job, int mesh, float radius, float distance) {
+    int levels = job->view->lodCounts ? job->view->lodCounts[mesh] : 1;
+    float pixels;
+    int lod;
+    if (levels <= 1)
+        return 0;
+    if (distance < job->view->zNear)
+        distance = job->view->zNear;
+    pixels = radius * job->pixelsPerUnit / distance;
+    lod = (int)ceilf(log2f(pixels / job->view->lodPixels));
+    if (lod < 0)
+        return 0;
+    return lod < levels ? lod : levels - 1;
+}
+
+/*  Handles objects start to end-1.  The visible ones are written to the
+    unsorted array starting at index start, and their number goes in
+    chunkCounts[chunk].  */
+static void cullChunk(void* data, int start, int end, int chunk) {
+    const CullJob* job = data;
+    const DrawView* view = job->view;
+    DrawItem* out = &job->list->unsorted[start];
+    int i, visible = 0;
+    for (i = start; i < end; i++) {
+        const SceneObject* object = &job->objects[i];
+        float center[3];
+        float radius = object->radius * fabsf(object->scale);
+        mat4TransformPoint(view->viewMatrix, object->position, center);
+        float depth = -center[2];
+        if (depth + radius < view->zNear || depth - radius > view->zFar)
+            continue;
+        if ((fabsf(center[0]) - depth*job->tanX) * job->sideX > radius)
+            continue;
+        if ((fabsf(center[1]) - depth*job->tanY) * job->sideY > radius)
+            continue;
+
+        DrawItem* item = &out[visible++];
+        mat4PlaceObject(item->modelMatrix, object->position[0], object->position[1], object->position[2],
+                        object->yRotation, object->scale);
+        item->object = i;
+        item->mesh = object->mesh & 255;
+        item->material = object->material & 255;
+        item->lod = selectLOD(job, item->mesh, radius, depth);
+        float d = (depth - view->zNear) / (view->zFar - view->zNear);
+        d = d < 0 ? 0 : d > 1 ? 1 : d;
+        item->sortKey = ((unsigned long long)item->material << MATERIAL_SHIFT)
+                      | ((unsigned long long)item->mesh << MESH_SHIFT)
+                      | ((unsigned long long)(item->lod & 15) << LOD_SHIFT)
+                      | (unsigned long long)(d * ((1 << DEPTH_BITS) - 1));
+    }
+    job->list->chunkCounts[chunk] = visible;
+}
+
+// ----------------------- pass 2: gather the keys of visible items -----------------------
+
+/*  Copies the sort keys of the visible items of chunk into the entries array, and
+    records which key bits vary within the chunk.  */
+static void gatherChunk(void* data, int start, int end, int chunk) {
+    DrawList* list = data;
+    int i, n = list->chunkCounts[chunk];
+    DrawSortEntry* out = &list->entries[list->chunkOffsets[chunk]];
+    unsigned long long orBits = 0, andBits = ~0ull;
+    (void)end;
+    for (i = 0; i < n; i++) {
+        unsigned long long key = list->unsorted[start + i].sortKey;
+        out[i].key = key;
+        out[i].index = start + i;
+        orBits |= key;
+        andBits &= key;
+    }
+    list->chunkBits[2*chunk] = orBits;
+    list->chunkBits[2*chunk+1] = andBits;
+}
+
+// ------------------------------ pass 3: radix sort ------------------------------
+
+typedef struct SortPass {
+    DrawList* list;
+    DrawSortEntry* source;
+    DrawSortEntry* target;
+    int shift;
+} SortPass;
+
+static void histogramChunk(void* data, int start, int end, int chunk) {
+    const SortPass* pass = data;
+    int* histogram = &pass->list->histograms[256*chunk];
+    int i;
+    memset(histogram, 0, 256*sizeof(int));
+    for (i = start; i < end; i++)
+        histogram[(pass->source[i].key >> pass->shift) & 255]++;
+}
+
+static void scatterChunk(void* data, int start, int end, int chunk) {
+    const SortPass* pass = data;
+    int* offsets = &pass->list->histograms[256*chunk];
+    int i;
+    for (i = start; i < end; i++)
+        pass->target[offsets[(pass->source[i].key >> pass->shift) & 255]++] = pass->source[i];
+}
+
+/*  A stable least-significant-digit radix sort, one byte per pass.  Each pass
+    counts the digits of every chunk in parallel, turns the counts into a
+    starting position for each (digit, chunk) pair, and then moves the entries
+    of every chunk in parallel.  Bytes that are the same in every key are
+    skipped.  */
+static void sortEntries(DrawList* list, int count, unsigned long long varyingBits) {
+    int chunks = jobsChunkCount(count, DRAWLIST_GRAIN);
+    SortPass pass;
+    int shift, digit, chunk;
+    pass.list = list;
+    pass.source = list->entries;
+    pass.target = list->entriesTemp;
+    for (shift = 0; shift < 64; shift += 8) {
+        if (((varyingBits >> shift) & 255) == 0)
+            continue;
+        pass.shift = shift;
+        jobsParallelFor(count, DRAWLIST_GRAIN, histogramChunk, &pass);
+        int position = 0;
+        for (digit = 0; digit < 256; digit++)
+            for (chunk = 0; chunk < chunks; chunk++) {
+                int* counter = &list->histograms[256*chunk + digit];
+                int n = *counter;
+                *counter = position;
+                position += n;
+            }
+        jobsParallelFor(count, DRAWLIST_GRAIN, scatterChunk, &pass);
+        DrawSortEntry* swap = pass.source;
+        pass.source = pass.target;
+        pass.target = swap;
+    }
+    if (pass.source != list->entries) {
+        list->entriesTemp = list->entries;
+        list->entries = pass.source;
+    }
+}
+
+// ------------------------- pass 4: put the items in order -------------------------
+
+static void orderChunk(void* data, int start, int end, int chunk) {
+    DrawList* list = data;
+    int i;
+    (void)chunk;
+    for (i = start; i < end; i++)
+        list->items[i] = list->unsorted[list->entries[i].index];
+}
+
+void buildDrawList(DrawList* list, const SceneObject* objects, int count, const DrawView* view) {
+    CullJob job;
+    int chunk, chunks = jobsChunkCount(count, DRAWLIST_GRAIN);
+    reserve(list, count);
+
+    float halfAngle = view->fovy * (float)M_PI / 360;
+    job.list = list;
+    job.objects = objects;
+    job.view = view;
+    job.tanY = tanf(halfAngle);
+    job.tanX = job.tanY * view->aspect;
+    job.sideX = 1 / sqrtf(1 + job.tanX*job.tanX);
+    job.sideY = 1 / sqrtf(1 + job.tanY*job.tanY);
+    job.pixelsPerUnit = view->viewportHeight / (2 * job.tanY);
+    jobsParallelFor(count, DRAWLIST_GRAIN, cullChunk, &job);
+
+    int visible = 0;
+    for (chunk = 0; chunk < chunks; chunk++) {
+        list->chunkOffsets[chunk] = visible;
+        visible += list->chunkCounts[chunk];
+    }
+    jobsParallelFor(count, DRAWLIST_GRAIN, gatherChunk, list);
+
+    unsigned long long orBits = 0, andBits = ~0ull;
+    for (chunk = 0; chunk < chunks; chunk++) {
+        if (list->chunkCounts[chunk] == 0)
+            continue;
+        orBits |= list->chunkBits[2*chunk];
+        andBits &= list->chunkBits[2*chunk+1];
+    }
+    sortEntries(list, visible, orBits & ~andBits);
+    jobsParallelFor(visible, DRAWLIST_GRAIN, orderChunk, list);
+    list->count = visible;
+}
@@ -0,0 +1,90 @@
+/*  Header file for drawlist.c, which turns the objects placed on a stage into
+    a list of things to draw.  Building the list does all of the per-object
+    work of a frame:
+
+        computing each object's transformation matrix,
+        culling the objects that are outside the view frustum,
+        picking a level of detail from the object's size on the screen,
+        making a sort key, and sorting the visible objects by key.
+
+    None of that needs OpenGL, so buildDrawList() spreads it over all of the
+    cores with jobs.c.  Only drawing the sorted list has to happen on the thread
+    that owns the OpenGL context.  */
+
+#ifndef DRAWLIST_H
+#define DRAWLIST_H
+
+//  An object placed on the stage.
+typedef struct SceneObject {
+    float position[3];
+    float yRotation;   // rotation about the y-axis, in degrees
+    float scale;
+    float radius;      // radius of a bounding sphere centered at the object's origin, before scaling
+    int mesh;          // which model to draw; a number from 0 to 255
+    int material;      // a row of the materials table; a number from 0 to 255
+} SceneObject;
+
+//  The camera and viewport that a draw list is built for.
+typedef struct DrawView {
+    float viewMatrix[16];   // the viewing transform, as in the modelview matrix before any object is drawn
+    float fovy, aspect, zNear, zFar;  // as for gluPerspective()
+    int viewportHeight;     // in pixels
+
+    /*  lodCounts[m] is the number of levels of detail of mesh m, where level 0
+        is the coarsest.  An object whose bounding sphere is r pixels across on
+        the screen gets level ceil(log2(r/lodPixels)), which keeps the triangle
+        edges of a geodesic sphere about lodPixels long.  */
+    const int* lodCounts;
+    float lodPixels;
+} DrawView;
+
+//  One visible object.
+typedef struct DrawItem {
+    unsigned long long sortKey;
+    float modelMatrix[16];  // the object's transformation, to be multiplied onto the viewing transform
+    int object;             // index of the object in the array passed to buildDrawList()
+    int mesh;
+    int lod;
+    int material;
+} DrawItem;
+
+//  A sort key and the position of its item in DrawList.unsorted.
+typedef struct DrawSortEntry {
+    unsigned long long key;
+    int index;
+} DrawSortEntry;
+
+/*  A draw list.  After buildDrawList(), items[0] to items[count-1] are the
+    visible objects, sorted by material, then by mesh and level of detail, and
+    then front to back.  The other fields are scratch space that is kept from
+    frame to frame so that building the list does not allocate memory.  */
+typedef struct DrawList {
+    int count;
+    DrawItem* items;
+
+    int capacity;
+    DrawItem* unsorted;
+    DrawSortEntry* entries;       // for the radix sort
+    DrawSortEntry* entriesTemp;
+    int chunkCapacity;
+    int* chunkCounts;
+    int* chunkOffsets;
+    int* histograms;              // 256 counters per chunk
+    unsigned long long* chunkBits;  // OR and AND of the keys of each chunk
+} DrawList;
+
+//  Number of objects handled by one job when a draw list is built.
+#define DRAWLIST_GRAIN 1024
+
+//  Sets all of the fields of a new draw list to zero.
+void initDrawList(DrawList* list);
+
+//  Frees the arrays of a draw list.
+void freeDrawList(DrawList* list);
+
+/*  Builds the draw list for the given objects as seen from view.  The work is
+    split into jobs of DRAWLIST_GRAIN objects with jobsParallelFor(), so the
+    result is the same for any number of threads.  */
+void buildDrawList(DrawList* list, const SceneObject* objects, int count, const DrawView* view);
+
+#endif
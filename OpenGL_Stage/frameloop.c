@@ -0,0 +1,224 @@
+#include <GL/gl.h>
+#include <GL/glx.h>
+#include <GL/freeglut.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include "frameloop.h"
+
+// Longest stretch of time that updates will catch up on; after a longer
+// stall (such as a window being dragged), the simulation just skips ahead.
+#define MAX_CATCH_UP 0.25
+
+static UpdateFunction updateFunction;
+static double step;           // seconds per update
+static double frameInterval;  // minimum seconds per frame; 0 if uncapped
+static int statsShown;
+static MovingFunction movingFunction;  // set by frameLoopSleepWhenStill(), or NULL
+static int sleeping;                   // Is idle() turned off until frameLoopWake()?
+static int trackingChanges;            // set by frameLoopTrackChanges()
+static int changes;                    // marked since the last frame
+
+static double lastTime;       // clock time at the previous call to idle()
+static double accumulator;    // time not yet simulated, less than one step after idle()
+static double lastFrameEnd;
+static double nextFrameTime;
+static double lastReport;
+static int updatesSinceReport;
+
+static double frameTimes[FRAMELOOP_HISTORY];  // ring buffer, in seconds
+static int frameCount;                         // total frames recorded
+
+static const char* counterNames[FRAMELOOP_COUNTERS];
+static const double* counterValues[FRAMELOOP_COUNTERS];
+static int counterCount;
+
+static double now() {
+    struct timespec t;
+    clock_gettime(CLOCK_MONOTONIC, &t);
+    return t.tv_sec + t.tv_nsec * 1e-9;
+}
+
+/*  Asks GLX for the given swap interval (0 for no vsync, 1 for vsync),
+    trying each of the extensions that can set it.  Returns 1 on success.  */
+static int setSwapInterval(int interval) {
+    typedef void (*SwapIntervalEXT)(Display*, GLXDrawable, int);
+    typedef int (*SwapIntervalInt)(int);
+    SwapIntervalEXT ext = (SwapIntervalEXT)glXGetProcAddress((const GLubyte*)"glXSwapIntervalEXT");
+    SwapIntervalInt mesa = (SwapIntervalInt)glXGetProcAddress((const GLubyte*)"glXSwapIntervalMESA");
+    SwapIntervalInt sgi = (SwapIntervalInt)glXGetProcAddress((const GLubyte*)"glXSwapIntervalSGI");
+    Display* display = glXGetCurrentDisplay();
+    if (ext && display) {
+        ext(display, glXGetCurrentDrawable(), interval);
+        return 1;
+    }
+    if (mesa)
+        return mesa(interval) == 0;
+    if (sgi && interval > 0)  // SGI does not allow turning vsync off
+        return sgi(interval) == 0;
+    return 0;
+}
+
+static void idle() {
+    double time = now();
+    double elapsed = time - lastTime;
+    lastTime = time;
+    if (elapsed > MAX_CATCH_UP)
+        elapsed = MAX_CATCH_UP;
+    accumulator += elapsed;
+    while (accumulator >= step) {
+        updateFunction(step);
+        accumulator -= step;
+        updatesSinceReport++;
+    }
+    if (movingFunction && frameInterval > 0 && ! movingFunction()) {
+        // Draw the state of the last update, if it changed anything, then wait for an event.
+        accumulator = step;
+        sleeping = 1;
+        glutIdleFunc(NULL);
+        if ( ! trackingChanges || changes )
+            glutPostRedisplay();
+        return;
+    }
+
+    if (frameInterval > 0) {
+        // Sleep until the next frame is due, in case vsync is not doing it.
+        double wait = nextFrameTime - time;
+        if (wait > 0.001) {
+            struct timespec t;
+            t.tv_sec = 0;
+            t.tv_nsec = (long)((wait - 0.0005) * 1e9);
+            nanosleep(&t, NULL);
+            return;  // come back through idle() to do the updates for the time slept
+        }
+        nextFrameTime = (wait < -frameInterval ? time : nextFrameTime) + frameInterval;
+        if (trackingChanges && ! changes)
+            return;  // the frame would be the same as the last one; sleep until the next is due
+    }
+    // However many events and updates marked changes since the last frame,
+    // GLUT makes one call of display() for all of them.
+    glutPostRedisplay();
+}
+
+static void report() {
+    FrameStats stats;
+    char title[400];
+    int i, length;
+    frameLoopGetStats(&stats);
+    length = snprintf(title, sizeof(title), "%.1f fps, %.2f ms avg, %.2f min, %.2f max, %.2f p99, %.0f updates/s",
+                      stats.fps, stats.averageMs, stats.minMs, stats.maxMs, stats.p99Ms, stats.updatesPerSecond);
+    for (i = 0; i < counterCount && length < (int)sizeof(title); i++)
+        length += snprintf(title + length, sizeof(title) - length, ", %s %.2f ms",
+                           counterNames[i], *counterValues[i]);
+    glutSetWindowTitle(title);
+    printf("%s\n", title);
+    fflush(stdout);
+}
+
+void frameLoopStart(double updatesPerSecond, UpdateFunction update, double maxFramesPerSecond, int showStats) {
+    updateFunction = update;
+    step = 1.0 / updatesPerSecond;
+    frameInterval = maxFramesPerSecond > 0 ? 1.0 / maxFramesPerSecond : 0;
+    statsShown = showStats;
+    setSwapInterval(maxFramesPerSecond > 0 ? 1 : 0);
+    lastTime = lastFrameEnd = lastReport = nextFrameTime = now();
+    accumulator = 0;
+    frameCount = 0;
+    updatesSinceReport = 0;
+    sleeping = 0;
+    glutIdleFunc(idle);
+}
+
+void frameLoopSleepWhenStill(MovingFunction isMoving) {
+    movingFunction = isMoving;
+}
+
+void frameLoopTrackChanges() {
+    trackingChanges = 1;
+    changes = CHANGED_ALL;
+}
+
+void frameLoopMarkChanged(int what) {
+    changes |= what;
+    frameLoopWake();
+}
+
+int frameLoopTakeChanges() {
+    int what = changes;
+    if ( ! trackingChanges || frameInterval == 0 )
+        return CHANGED_ALL;
+    changes = 0;
+    return what;
+}
+
+void frameLoopWake() {
+    if ( ! sleeping )
+        return;
+    // Leave the accumulator full, so that the first idle() makes an update
+    // that starts from the state that was drawn last.
+    sleeping = 0;
+    lastTime = lastFrameEnd = nextFrameTime = now();
+    glutIdleFunc(idle);
+}
+
+double frameLoopAlpha() {
+    return step > 0 ? accumulator / step : 0;  // 0 before frameLoopStart()
+}
+
+void frameLoopEndFrame() {
+    double time = now();
+    frameTimes[frameCount % FRAMELOOP_HISTORY] = time - lastFrameEnd;
+    frameCount++;
+    lastFrameEnd = time;
+    if (statsShown && time - lastReport >= 1) {
+        report();
+        lastReport = time;
+        updatesSinceReport = 0;
+    }
+}
+
+static int compareDoubles(const void* a, const void* b) {
+    double x = *(const double*)a, y = *(const double*)b;
+    return x < y ? -1 : x > y;
+}
+
+void frameLoopGetStats(FrameStats* stats) {
+    double sorted[FRAMELOOP_HISTORY], total = 0;
+    int i, n = frameCount < FRAMELOOP_HISTORY ? frameCount : FRAMELOOP_HISTORY;
+    memset(stats, 0, sizeof(FrameStats));
+    stats->frames = n;
+    if (n == 0)
+        return;
+    for (i = 0; i < n; i++) {
+        sorted[i] = frameTimes[i];
+        total += frameTimes[i];
+    }
+    qsort(sorted, n, sizeof(double), compareDoubles);
+    stats->averageMs = total / n * 1000;
+    stats->fps = n / total;
+    stats->minMs = sorted[0] * 1000;
+    stats->maxMs = sorted[n-1] * 1000;
+    stats->p99Ms = sorted[(n-1) * 99 / 100] * 1000;
+    stats->updatesPerSecond = updatesSinceReport / (now() - lastReport);
+}
+
+void frameLoopAddCounter(const char* name, const double* milliseconds) {
+    if (counterCount == FRAMELOOP_COUNTERS)
+        return;
+    counterNames[counterCount] = name;
+    counterValues[counterCount] = milliseconds;
+    counterCount++;
+}
+
+void frameLoopParseArgs(int argc, char** argv, double* maxFramesPerSecond, int* showStats) {
+    int i;
+    for (i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "-uncapped") == 0) {
+            *maxFramesPerSecond = 0;
+            *showStats = 1;
+        }
+        else if (strcmp(argv[i], "-stats") == 0)
+            *showStats = 1;
+    }
+}
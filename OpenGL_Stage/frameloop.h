@@ -0,0 +1,123 @@
+/*  Header file for frameloop.c, a main loop for animated GLUT programs.
+
+    The simulation is advanced by a fixed time step, so its results do not
+    depend on the frame rate: the program's update function is called as many
+    times as needed to catch up with the clock, always with the same dt.
+    Frames are drawn as fast as the display allows, and since a frame usually
+    falls between two updates, display() should interpolate between the
+    previous and the current state using frameLoopAlpha().
+
+    In the normal, capped mode, frames are synchronized with the display's
+    refresh (and are also limited by a timer, in case vsync cannot be turned
+    on).  In uncapped mode, vsync is turned off and frames are drawn back to
+    back, which is what a benchmark wants.
+
+    A scene that only moves now and then, such as one that the user turns
+    with the mouse, need not be drawn while it is still.  With
+    frameLoopSleepWhenStill(), the loop stops calling update and display
+    when the program says that nothing moves, and GLUT just waits for
+    events, using no CPU or GPU time, until the program calls
+    frameLoopWake() from an event handler.  (GLUT still calls display() when
+    the window needs to be repainted.)
+
+    A program can also tell the loop what changed, with
+    frameLoopMarkChanged(), after calling frameLoopTrackChanges().  Then
+    the loop asks for a frame only when something was marked since the last
+    one, and display() finds out what with frameLoopTakeChanges(), so that
+    it can draw only what it must: the camera, the objects, their materials,
+    the lights or the textures of the scene, or an overlay drawn over it.
+    While the loop runs but nothing changes, it sleeps until the next frame
+    is due instead of drawing it.  An uncapped loop draws every frame.
+
+    The loop keeps statistics on the time between frames.  Call
+    frameLoopEndFrame() at the end of display(), after glutSwapBuffers().  */
+
+#ifndef FRAMELOOP_H
+#define FRAMELOOP_H
+
+//  Called by the loop to advance the simulation by dt seconds.
+typedef void (*UpdateFunction)(double dt);
+
+//  Frame time statistics, in milliseconds, over the last FRAMELOOP_HISTORY frames.
+typedef struct FrameStats {
+    int frames;         // number of frames that the statistics cover
+    double fps;
+    double averageMs;
+    double minMs;
+    double maxMs;
+    double p99Ms;       // 99% of the frames took at most this long
+    double updatesPerSecond;
+} FrameStats;
+
+#define FRAMELOOP_HISTORY 240
+
+/*  Starts the loop; call it from main() just before glutMainLoop(), after the
+    window has been created.  update is called updatesPerSecond times per
+    second of real time.  If maxFramesPerSecond is 0, the loop runs uncapped,
+    with vsync off.  If showStats is non-zero, the statistics are shown in the
+    window title and written to standard output once per second.  */
+void frameLoopStart(double updatesPerSecond, UpdateFunction update, double maxFramesPerSecond, int showStats);
+
+/*  How far the clock is between the last update and the next one, from 0 to 1.
+    The state to draw is previous + (current - previous)*frameLoopAlpha().
+    Before frameLoopStart() it is 0.  */
+double frameLoopAlpha();
+
+//  Records the end of a frame.  Call at the end of display().
+void frameLoopEndFrame();
+
+//  Gets the statistics for the most recent frames.
+void frameLoopGetStats(FrameStats* stats);
+
+/*  Adds a time, such as the GPU time of one rendering pass, to the statistics
+    that are shown.  The value is read from *milliseconds at every report, so
+    the program just keeps it up to date.  At most FRAMELOOP_COUNTERS can be
+    added.  */
+void frameLoopAddCounter(const char* name, const double* milliseconds);
+
+#define FRAMELOOP_COUNTERS 8
+
+/*  Called by the loop after its updates; returns 0 if nothing will move, or
+    change in any other way, until an event calls frameLoopWake().  */
+typedef int (*MovingFunction)(void);
+
+/*  Lets the loop sleep whenever isMoving returns 0, after drawing one last
+    frame of the state of the last update.  NULL keeps the loop running.  An
+    uncapped loop never sleeps, since it is a benchmark.  */
+void frameLoopSleepWhenStill(MovingFunction isMoving);
+
+/*  Starts the loop again if it is sleeping.  Call it from the handlers of
+    the events that start something moving, such as pressing a mouse button
+    or a key that starts an animation.  */
+void frameLoopWake();
+
+//  What changed since the last frame, for frameLoopMarkChanged().
+#define CHANGED_CAMERA 1
+#define CHANGED_OBJECTS 2      // the transforms of the objects, or which objects there are
+#define CHANGED_MATERIALS 4
+#define CHANGED_LIGHTS 8
+#define CHANGED_TEXTURES 16    // such as a level of a texture streaming in
+#define CHANGED_OVERLAY 32     // something drawn over the scene, such as text
+#define CHANGED_SCENE (CHANGED_CAMERA | CHANGED_OBJECTS | CHANGED_MATERIALS | CHANGED_LIGHTS | CHANGED_TEXTURES)
+#define CHANGED_ALL (CHANGED_SCENE | CHANGED_OVERLAY)
+
+/*  From now on, draws frames only when something has been marked as
+    changed, starting with everything.  */
+void frameLoopTrackChanges();
+
+/*  Records that something changed, as a combination of the CHANGED_
+    constants, and wakes the loop if it is sleeping.  Call it from the
+    update function and from event handlers; any number of calls between
+    two frames make one frame.  */
+void frameLoopMarkChanged(int what);
+
+/*  For display(): returns what was marked since the last frame, and clears
+    the marks.  Returns CHANGED_ALL if changes are not tracked, or the loop
+    is uncapped.  It can return 0, when GLUT redraws the window on its own,
+    such as when it is uncovered.  */
+int frameLoopTakeChanges();
+
+//  Parses the command-line options "-uncapped" and "-stats", which override the given defaults.
+void frameLoopParseArgs(int argc, char** argv, double* maxFramesPerSecond, int* showStats);
+
+#endif
@@ -0,0 +1,260 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <setjmp.h>
+#include <time.h>
+#include <unistd.h>
+#include <png.h>
+#include "framewriter.h"
+
+static double now() {
+    struct timespec t;
+    clock_gettime(CLOCK_MONOTONIC, &t);
+    return t.tv_sec + t.tv_nsec * 1e-9;
+}
+
+// ------------------------------- encoding ---------------------------------------
+
+//  Copies row y from the top of a bottom-up RGBA image into rgb, without the alpha.
+static void getRow(const unsigned char* pixels, int width, int height, int y, unsigned char* rgb) {
+    const unsigned char* in = pixels + (size_t)(height - 1 - y)*width*4;
+    int x;
+    for (x = 0; x < width; x++) {
+        rgb[3*x] = in[4*x];
+        rgb[3*x+1] = in[4*x+1];
+        rgb[3*x+2] = in[4*x+2];
+    }
+}
+
+static int writePPM(const char* path, int width, int height, const unsigned char* pixels) {
+    unsigned char* row = malloc((size_t)width*3);
+    FILE* file = fopen(path, "wb");
+    int y, ok;
+    if ( ! row || ! file ) {
+        free(row);
+        if (file)
+            fclose(file);
+        return 0;
+    }
+    ok = fprintf(file, "P6\n%d %d\n255\n", width, height) > 0;
+    for (y = 0; y < height && ok; y++) {
+        getRow(pixels, width, height, y, row);
+        ok = fwrite(row, 3, width, file) == (size_t)width;
+    }
+    free(row);
+    return fclose(file) == 0 && ok;
+}
+
+static int writePNG(const char* path, int width, int height, const unsigned char* pixels) {
+    png_structp png;
+    png_infop info;
+    unsigned char* volatile row = NULL;
+    FILE* file = fopen(path, "wb");
+    int y;
+    if ( ! file )
+        return 0;
+    png = png_create_write_struct(PNG_LIBPNG_VER_STRING, NULL, NULL, NULL);
+    info = png ? png_create_info_struct(png) : NULL;
+    if ( ! info ) {
+        png_destroy_write_struct(&png, NULL);
+        fclose(file);
+        return 0;
+    }
+    if (setjmp(png_jmpbuf(png))) {  // libpng has printed the error
+        png_destroy_write_struct(&png, &info);
+        fclose(file);
+        free(row);
+        return 0;
+    }
+    row = malloc((size_t)width*3);
+    if ( ! row )
+        png_error(png, "out of memory");
+    png_init_io(png, file);
+    png_set_IHDR(png, info, width, height, 8, PNG_COLOR_TYPE_RGB, PNG_INTERLACE_NONE,
+                 PNG_COMPRESSION_TYPE_DEFAULT, PNG_FILTER_TYPE_DEFAULT);
+    png_write_info(png, info);
+    for (y = 0; y < height; y++) {
+        getRow(pixels, width, height, y, row);
+        png_write_row(png, row);
+    }
+    png_write_end(png, NULL);
+    png_destroy_write_struct(&png, &info);
+    free(row);
+    return fclose(file) == 0;
+}
+
+// ---------------------------- writer threads ------------------------------------
+
+static void* writerMain(void* arg) {
+    FrameWriter* writer = arg;
+    for (;;) {
+        FrameImage frame;
+        char path[sizeof(writer->pattern) + 16];
+        int ok;
+        pthread_mutex_lock(&writer->lock);
+        while ( ! writer->stopping && writer->queueCount == 0 )
+            pthread_cond_wait(&writer->framesWaiting, &writer->lock);
+        if (writer->queueCount == 0) {  // stopping, with every frame written
+            pthread_mutex_unlock(&writer->lock);
+            return NULL;
+        }
+        frame = writer->queue[writer->queueHead];
+        writer->queueHead = (writer->queueHead + 1) % FRAME_WRITER_QUEUE;
+        writer->queueCount--;
+        pthread_cond_signal(&writer->spaceFree);
+        pthread_mutex_unlock(&writer->lock);
+
+        snprintf(path, sizeof(path), writer->pattern, frame.number);
+        if (writer->format == FRAME_PNG)
+            ok = writePNG(path, writer->width, writer->height, frame.pixels);
+        else
+            ok = writePPM(path, writer->width, writer->height, frame.pixels);
+        if ( ! ok )
+            printf("Cannot write the frame %s.\n", path);
+        free(frame.pixels);
+
+        pthread_mutex_lock(&writer->lock);
+        if (ok)
+            writer->written++;
+        else
+            writer->failed++;
+        pthread_mutex_unlock(&writer->lock);
+    }
+}
+
+/*  Is pattern a name with exactly one conversion of an int, such as %d or
+    %03d, and otherwise only %%, so that it is safe to give to snprintf()?  */
+static int checkPattern(const char* pattern) {
+    int conversions = 0;
+    const char* p;
+    for (p = pattern; *p; p++) {
+        if (*p != '%')
+            continue;
+        p++;
+        if (*p == '%')
+            continue;
+        while (*p >= '0' && *p <= '9')
+            p++;
+        if (*p != 'd')
+            return 0;
+        conversions++;
+    }
+    return conversions == 1;
+}
+
+int initFrameWriter(FrameWriter* writer, int width, int height, const char* pattern) {
+    size_t length = strlen(pattern), bytes = (size_t)width*height*4;
+    int cores = (int)sysconf(_SC_NPROCESSORS_ONLN), i;
+    memset(writer, 0, sizeof(FrameWriter));
+    if ( ! hasGLVersion(3, 2) ) {
+        printf("Writing frames needs OpenGL 3.2.\n");
+        return 0;
+    }
+    if ( length >= sizeof(writer->pattern) || ! checkPattern(pattern) ) {
+        printf("The file name %s needs one %%d, for the number of the frame.\n", pattern);
+        return 0;
+    }
+    strcpy(writer->pattern, pattern);
+    writer->format = length >= 4 && strcasecmp(pattern + length - 4, ".ppm") == 0 ? FRAME_PPM : FRAME_PNG;
+    writer->width = width;
+    writer->height = height;
+
+    glGenBuffers(FRAME_WRITER_READBACKS, writer->packBuffers);
+    for (i = 0; i < FRAME_WRITER_READBACKS; i++) {
+        glBindBuffer(GL_PIXEL_PACK_BUFFER, writer->packBuffers[i]);
+        glBufferData(GL_PIXEL_PACK_BUFFER, bytes, NULL, GL_STREAM_READ);
+    }
+    glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+
+    pthread_mutex_init(&writer->lock, NULL);
+    pthread_cond_init(&writer->framesWaiting, NULL);
+    pthread_cond_init(&writer->spaceFree, NULL);
+    writer->threadCount = cores < FRAME_WRITER_THREADS ? cores : FRAME_WRITER_THREADS;
+    if (writer->threadCount < 1)
+        writer->threadCount = 1;
+    for (i = 0; i < writer->threadCount; i++)
+        pthread_create(&writer->threads[i], NULL, writerMain, writer);
+    return 1;
+}
+
+// ------------------------------- readback ---------------------------------------
+
+/*  Waits for the copy into the pixel buffer of slot, copies the frame out
+    of it, and queues the frame for the writer threads, waiting for room in
+    the queue if it is full.  */
+static void passOn(FrameWriter* writer, int slot) {
+    size_t bytes = (size_t)writer->width*writer->height*4;
+    // The first wait flushes the commands, so that the fence is sure to be reached.
+    GLbitfield flags = GL_SYNC_FLUSH_COMMANDS_BIT;
+    double start = now();
+    FrameImage frame;
+    void* mapping;
+    while (glClientWaitSync(writer->fences[slot], flags, 1000000000) == GL_TIMEOUT_EXPIRED)
+        flags = 0;
+    glDeleteSync(writer->fences[slot]);
+    writer->fences[slot] = 0;
+    writer->waitMilliseconds += (now() - start) * 1000;
+
+    frame.number = writer->numbers[slot];
+    frame.pixels = malloc(bytes);
+    glBindBuffer(GL_PIXEL_PACK_BUFFER, writer->packBuffers[slot]);
+    mapping = glMapBufferRange(GL_PIXEL_PACK_BUFFER, 0, bytes, GL_MAP_READ_BIT);
+    if (frame.pixels && mapping)
+        memcpy(frame.pixels, mapping, bytes);
+    if (mapping)
+        glUnmapBuffer(GL_PIXEL_PACK_BUFFER);
+    glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+    if ( ! frame.pixels || ! mapping ) {
+        printf("Cannot read back the frame %d.\n", frame.number);
+        free(frame.pixels);
+        pthread_mutex_lock(&writer->lock);
+        writer->failed++;
+        pthread_mutex_unlock(&writer->lock);
+        return;
+    }
+
+    start = now();
+    pthread_mutex_lock(&writer->lock);
+    while (writer->queueCount == FRAME_WRITER_QUEUE)
+        pthread_cond_wait(&writer->spaceFree, &writer->lock);
+    writer->queue[(writer->queueHead + writer->queueCount) % FRAME_WRITER_QUEUE] = frame;
+    writer->queueCount++;
+    pthread_cond_signal(&writer->framesWaiting);
+    pthread_mutex_unlock(&writer->lock);
+    writer->waitMilliseconds += (now() - start) * 1000;
+}
+
+void captureFrame(FrameWriter* writer, int number) {
+    int slot = writer->next;
+    if (writer->fences[slot])
+        passOn(writer, slot);
+    glBindBuffer(GL_PIXEL_PACK_BUFFER, writer->packBuffers[slot]);
+    glReadPixels(0, 0, writer->width, writer->height, GL_RGBA, GL_UNSIGNED_BYTE, NULL);
+    glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+    writer->fences[slot] = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+    writer->numbers[slot] = number;
+    writer->next = (slot + 1) % FRAME_WRITER_READBACKS;
+}
+
+int finishFrameWriter(FrameWriter* writer) {
+    int i;
+    for (i = 0; i < FRAME_WRITER_READBACKS; i++) {  // oldest first
+        int slot = (writer->next + i) % FRAME_WRITER_READBACKS;
+        if (writer->fences[slot])
+            passOn(writer, slot);
+    }
+    pthread_mutex_lock(&writer->lock);
+    writer->stopping = 1;
+    pthread_cond_broadcast(&writer->framesWaiting);
+    pthread_mutex_unlock(&writer->lock);
+    for (i = 0; i < writer->threadCount; i++)
+        pthread_join(writer->threads[i], NULL);
+    writer->threadCount = 0;
+    pthread_mutex_destroy(&writer->lock);
+    pthread_cond_destroy(&writer->framesWaiting);
+    pthread_cond_destroy(&writer->spaceFree);
+    glDeleteBuffers(FRAME_WRITER_READBACKS, writer->packBuffers);
+    memset(writer->packBuffers, 0, sizeof(writer->packBuffers));
+    return writer->failed;
+}
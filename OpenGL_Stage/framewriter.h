@@ -0,0 +1,85 @@
+/*  Header file for framewriter.c, which writes a sequence of rendered
+    frames to image files, PNG or PPM, without making the rendering wait for
+    the encoding or the disk.
+
+    Reading a frame back with glReadPixels() into memory of the program
+    waits until the GPU has drawn it, and encoding a PNG takes far longer
+    than drawing the frame.  Here, captureFrame() only starts the copy: it
+    reads the framebuffer into the next of FRAME_WRITER_READBACKS pixel
+    buffer objects, which the GPU fills when it gets to it, and puts a fence
+    after the copy.  When that buffer comes round again, frames later, the
+    fence has normally long passed; the pixels are copied out of the mapped
+    buffer and queued for the writer threads, which turn the image the right
+    way up, encode it and write the file, one frame per thread at a time.
+
+    The writer threads are threads of their own, like the loader threads of
+    texture.c, at most FRAME_WRITER_THREADS and at most one per core.  The
+    queue holds at most FRAME_WRITER_QUEUE frames, so that a disk that cannot
+    keep up holds up the rendering instead of filling the memory.
+
+    Programs that use framewriter.c must be linked with -lpng and -pthread.
+    Requires OpenGL 3.2 (for fences).  */
+
+#ifndef FRAMEWRITER_H
+#define FRAMEWRITER_H
+
+#include <pthread.h>
+#include "shader.h"
+
+#define FRAME_WRITER_READBACKS 3   // pixel buffers: the frame being read, and two that the GPU may still be copying
+#define FRAME_WRITER_THREADS 4     // at most this many, and never more than the cores
+#define FRAME_WRITER_QUEUE 16      // frames waiting for a writer thread, at most
+
+#define FRAME_PPM 0
+#define FRAME_PNG 1
+
+//  A frame that has been read back, in RGBA bytes, bottom row first as OpenGL has it.
+typedef struct FrameImage {
+    int number;
+    unsigned char* pixels;
+} FrameImage;
+
+/*  The program only reads the fields width, height, format, written,
+    failed and waitMilliseconds; the rest belong to framewriter.c.  */
+typedef struct FrameWriter {
+    int width, height;         // of every frame
+    int format;                // FRAME_PNG or FRAME_PPM, from the extension of the pattern
+    char pattern[256];         // the file names, with one %d for the number of the frame
+
+    GLuint packBuffers[FRAME_WRITER_READBACKS];
+    GLsync fences[FRAME_WRITER_READBACKS];   // 0 for a buffer that holds no frame
+    int numbers[FRAME_WRITER_READBACKS];     // the frame in each buffer
+    int next;                  // the buffer that the next captureFrame() reads into
+    double waitMilliseconds;   // how long captureFrame() waited, for the GPU and for the queue, in all
+
+    // Shared with the writer threads.
+    pthread_mutex_t lock;
+    pthread_cond_t framesWaiting, spaceFree;
+    FrameImage queue[FRAME_WRITER_QUEUE];    // a ring buffer
+    int queueHead, queueCount;
+    int stopping;
+    int written, failed;       // files written, and frames that could not be
+    pthread_t threads[FRAME_WRITER_THREADS];
+    int threadCount;
+} FrameWriter;
+
+/*  Makes the pixel buffers for frames of width by height pixels and starts
+    the writer threads.  pattern is a file name for printf() with one
+    conversion of an int, such as "turntable%03d.png"; names that end in
+    .ppm are written as PPM, and all others as PNG.  Returns 0, after
+    printing a message, if the OpenGL version is too old or the pattern is
+    not of that form.  */
+int initFrameWriter(FrameWriter* writer, int width, int height, const char* pattern);
+
+/*  Starts reading the frame from the lower left corner of the framebuffer
+    that is bound to GL_READ_FRAMEBUFFER, as frame number, and passes on the
+    frame read FRAME_WRITER_READBACKS captures ago to the writer threads.  */
+void captureFrame(FrameWriter* writer, int number);
+
+/*  Passes on the frames that are still being read, waits until every frame
+    has been written, stops the threads and deletes the pixel buffers.
+    Returns the number of frames that could not be written; a message has
+    been printed for each.  */
+int finishFrameWriter(FrameWriter* writer);
+
+#endif
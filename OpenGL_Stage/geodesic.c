@@ -0,0 +1,255 @@
+#include <stdlib.h>
+#include <math.h>
+#include "geodesic.h"
+#include "meshopt.h"
+
+/*  A hash map from an edge (a pair of vertex numbers) to the vertex
+    that was created at its midpoint.  It uses open addressing with
+    linear probing, and is sized so that it is never more than half full.  */
+typedef struct EdgeMap {
+    int size;          // a power of two
+    long long* keys;   // -1 for an empty slot
+    int* values;
+} EdgeMap;
+
+static long long edgeKey(int a, int b) {
+    return a < b ? ((long long)a << 32) | (unsigned int)b : ((long long)b << 32) | (unsigned int)a;
+}
+
+static void initEdgeMap(EdgeMap* map, int edgeCount) {
+    int i;
+    map->size = 1;
+    while (map->size < 2*edgeCount)
+        map->size *= 2;
+    map->keys = malloc( map->size*sizeof(long long) );
+    map->values = malloc( map->size*sizeof(int) );
+    for (i = 0; i < map->size; i++)
+        map->keys[i] = -1;
+}
+
+/*  Returns the slot for the edge: either the slot that holds it, or the
+    empty slot where it should be inserted.  */
+static int findEdge(const EdgeMap* map, long long key) {
+    unsigned long long h = (unsigned long long)key * 0x9E3779B97F4A7C15ull;
+    int slot = (int)(h >> 32) & (map->size - 1);
+    while (map->keys[slot] != -1 && map->keys[slot] != key)
+        slot = (slot + 1) & (map->size - 1);
+    return slot;
+}
+
+/*  Counts the triangles in the fans of the faces of poly.  */
+static int countTriangles(Polyhedron poly) {
+    int i, j = 0, count = 0;
+    for (i = 0; i < poly.faceCount; i++) {
+        int n = 0;
+        while (poly.faces[j] != -1) {
+            n++;
+            j++;
+        }
+        j++;
+        if (n >= 3)
+            count += n - 2;
+    }
+    return count;
+}
+
+static void setNormal(double* normal, const double* a, const double* b, const double* c, const double* reference) {
+    double u[3] = { b[0]-a[0], b[1]-a[1], b[2]-a[2] };
+    double v[3] = { c[0]-a[0], c[1]-a[1], c[2]-a[2] };
+    double n[3] = { u[1]*v[2]-u[2]*v[1], u[2]*v[0]-u[0]*v[2], u[0]*v[1]-u[1]*v[0] };
+    double length = sqrt( n[0]*n[0] + n[1]*n[1] + n[2]*n[2] );
+    int k;
+    if (length == 0)
+        length = 1;
+    // The faces of the models in polyhedron.c are not all wound the same way,
+    // so the normal is made to point the same way as the face it came from.
+    if ( n[0]*reference[0] + n[1]*reference[1] + n[2]*reference[2] < 0 )
+        length = -length;
+    for (k = 0; k < 3; k++)
+        normal[k] = n[k] / length;
+}
+
+/*  One level of subdivision.  Every face of poly is split into a fan of
+    triangles (there is only one if poly came from triangulate()), and
+    every triangle into four.  */
+static Polyhedron subdivideOnce(Polyhedron poly, int projectToSphere, double radius) {
+    Polyhedron result;
+    int triangles = countTriangles(poly);
+    // A closed triangle mesh has 3T/2 edges; the fans' interior edges and any
+    // open boundary are covered by allowing for 3T.
+    int maxEdges = 3*triangles;
+    EdgeMap edges;
+    int i, j, k;
+
+    result.faceCount = 4*triangles;
+    result.vertices = malloc( (poly.vertexCount + maxEdges)*3*sizeof(double) );
+    result.normals = malloc( result.faceCount*3*sizeof(double) );
+    result.faces = malloc( result.faceCount*4*sizeof(int) );
+    result.faceColors = NULL;
+    for (i = 0; i < poly.vertexCount*3; i++)
+        result.vertices[i] = poly.vertices[i];
+    result.vertexCount = poly.vertexCount;
+    initEdgeMap(&edges, maxEdges);
+
+    int f = 0;
+    j = 0;
+    for (i = 0; i < poly.faceCount; i++) {
+        int first = poly.faces[j], n = 0;
+        while (poly.faces[j+n] != -1)
+            n++;
+        for (k = 1; k + 1 < n; k++) {
+            int corner[3] = { first, poly.faces[j+k], poly.faces[j+k+1] };
+            int mid[3], e, c;
+            for (e = 0; e < 3; e++) {
+                int a = corner[e], b = corner[(e+1)%3];
+                long long key = edgeKey(a, b);
+                int slot = findEdge(&edges, key);
+                if (edges.keys[slot] == -1) {
+                    double* p = &result.vertices[3*result.vertexCount];
+                    for (c = 0; c < 3; c++)
+                        p[c] = (result.vertices[3*a+c] + result.vertices[3*b+c]) / 2;
+                    if (projectToSphere) {
+                        double length = sqrt( p[0]*p[0] + p[1]*p[1] + p[2]*p[2] );
+                        if (length > 0)
+                            for (c = 0; c < 3; c++)
+                                p[c] *= radius / length;
+                    }
+                    edges.keys[slot] = key;
+                    edges.values[slot] = result.vertexCount++;
+                }
+                mid[e] = edges.values[slot];
+            }
+            int children[4][3] = {
+                { corner[0], mid[0], mid[2] },
+                { mid[0], corner[1], mid[1] },
+                { mid[2], mid[1], corner[2] },
+                { mid[0], mid[1], mid[2] }
+            };
+            for (e = 0; e < 4; e++) {
+                int* face = &result.faces[4*f];
+                for (c = 0; c < 3; c++)
+                    face[c] = children[e][c];
+                face[3] = -1;
+                setNormal(&result.normals[3*f], &result.vertices[3*face[0]], &result.vertices[3*face[1]],
+                          &result.vertices[3*face[2]], &poly.normals[3*i]);
+                f++;
+            }
+        }
+        j += n + 1;
+    }
+
+    result.vertices = realloc( result.vertices, result.vertexCount*3*sizeof(double) );
+    result.maxVertexLength = poly.maxVertexLength;
+    free(edges.keys);
+    free(edges.values);
+    return result;
+}
+
+/*  Returns a copy of poly in which every face is a triangle.  */
+static Polyhedron triangulate(Polyhedron poly) {
+    Polyhedron result;
+    int i, j = 0, k, c, f = 0;
+    result.vertexCount = poly.vertexCount;
+    result.faceCount = countTriangles(poly);
+    result.maxVertexLength = poly.maxVertexLength;
+    result.vertices = malloc( poly.vertexCount*3*sizeof(double) );
+    result.normals = malloc( result.faceCount*3*sizeof(double) );
+    result.faces = malloc( result.faceCount*4*sizeof(int) );
+    result.faceColors = NULL;
+    for (i = 0; i < poly.vertexCount*3; i++)
+        result.vertices[i] = poly.vertices[i];
+    for (i = 0; i < poly.faceCount; i++) {
+        int n = 0;
+        while (poly.faces[j+n] != -1)
+            n++;
+        for (k = 1; k + 1 < n; k++) {
+            result.faces[4*f] = poly.faces[j];
+            result.faces[4*f+1] = poly.faces[j+k];
+            result.faces[4*f+2] = poly.faces[j+k+1];
+            result.faces[4*f+3] = -1;
+            for (c = 0; c < 3; c++)
+                result.normals[3*f+c] = poly.normals[3*i+c];
+            f++;
+        }
+        j += n + 1;
+    }
+    return result;
+}
+
+/*  Recomputes the face normals of a polyhedron that is centered on the origin
+    and convex, such as a projected sphere, so that they all point outward, and
+    puts the vertices of each face in counterclockwise order as seen from
+    outside, so that OpenGL treats the outside as the front.  */
+static void setOutwardNormals(Polyhedron* poly) {
+    int i;
+    for (i = 0; i < poly->faceCount; i++) {
+        int* face = &poly->faces[4*i];
+        const double* a = &poly->vertices[3*face[0]];
+        const double* b = &poly->vertices[3*face[1]];
+        const double* c = &poly->vertices[3*face[2]];
+        double centroid[3] = { a[0]+b[0]+c[0], a[1]+b[1]+c[1], a[2]+b[2]+c[2] };
+        double u[3] = { b[0]-a[0], b[1]-a[1], b[2]-a[2] };
+        double v[3] = { c[0]-a[0], c[1]-a[1], c[2]-a[2] };
+        double turn = (u[1]*v[2] - u[2]*v[1]) * centroid[0] + (u[2]*v[0] - u[0]*v[2]) * centroid[1]
+                    + (u[0]*v[1] - u[1]*v[0]) * centroid[2];
+        setNormal(&poly->normals[3*i], a, b, c, centroid);
+        if (turn < 0) {
+            int swap = face[1];
+            face[1] = face[2];
+            face[2] = swap;
+        }
+    }
+}
+
+Polyhedron subdividePolyhedron(Polyhedron poly, int levels, int projectToSphere) {
+    Polyhedron current = triangulate(poly);
+    int i, level;
+    if (projectToSphere)
+        for (i = 0; i < current.vertexCount; i++) {
+            double* p = &current.vertices[3*i];
+            double length = sqrt( p[0]*p[0] + p[1]*p[1] + p[2]*p[2] );
+            if (length > 0) {
+                p[0] *= poly.maxVertexLength / length;
+                p[1] *= poly.maxVertexLength / length;
+                p[2] *= poly.maxVertexLength / length;
+            }
+        }
+    for (level = 0; level < levels; level++) {
+        Polyhedron next = subdivideOnce(current, projectToSphere, poly.maxVertexLength);
+        freePolyhedron(&current);
+        current = next;
+    }
+    if (projectToSphere)
+        setOutwardNormals(&current);
+    return current;
+}
+
+void freePolyhedron(Polyhedron* poly) {
+    free(poly->vertices);
+    free(poly->faces);
+    free(poly->faceColors);
+    free(poly->normals);
+    poly->vertices = poly->normals = poly->faceColors = NULL;
+    poly->faces = NULL;
+    poly->vertexCount = poly->faceCount = 0;
+}
+
+Polyhedron createGeodesicSphere(int levels) {
+    Polyhedron sphere = subdividePolyhedron(icosahedron, levels, 1);
+    int i;
+    // All of the vertices are on the sphere of radius maxVertexLength.
+    for (i = 0; i < sphere.vertexCount*3; i++)
+        sphere.vertices[i] /= icosahedron.maxVertexLength;
+    sphere.maxVertexLength = 1;
+    return sphere;
+}
+
+void createGeodesicLODs(TriMesh* lods, int count) {
+    int level;
+    for (level = 0; level < count; level++) {
+        Polyhedron sphere = createGeodesicSphere(level);
+        lods[level] = compilePolyhedronSmooth(sphere);
+        optimizeMesh(&lods[level], 1e-6f);
+        freePolyhedron(&sphere);
+    }
+}
@@ -0,0 +1,34 @@
+/*  Header file for geodesic.c, which subdivides polyhedra.  Each level of
+    subdivision splits every triangle into four by adding a vertex at the
+    midpoint of each edge.  Faces with more than three vertices are first
+    split into a fan of triangles, so a polyhedron with T triangles has
+    exactly T*4^levels faces after subdivision.
+
+    Seeded with the icosahedron and projected onto a sphere, this gives the
+    geodesic spheres that the stage uses in place of glutSolidSphere().  */
+
+#ifndef GEODESIC_H
+#define GEODESIC_H
+
+#include "mesh.h"
+
+/*  Returns a new polyhedron made by subdividing poly the given number of
+    times.  Midpoints are shared between the two faces of an edge through a
+    hash map, so each level does work proportional to the number of edges.  If
+    projectToSphere is non-zero, every new vertex is pushed out to the sphere
+    of radius poly.maxVertexLength.  The result has no face colors.  */
+Polyhedron subdividePolyhedron(Polyhedron poly, int levels, int projectToSphere);
+
+//  Frees the arrays of a polyhedron created by subdividePolyhedron().
+void freePolyhedron(Polyhedron* poly);
+
+/*  Returns a geodesic sphere of radius 1 made from the icosahedron.  It has
+    20*4^levels triangles.  createPolyhedra() must have been called.  */
+Polyhedron createGeodesicSphere(int levels);
+
+/*  Fills lods[0] to lods[count-1] with smooth-shaded meshes of geodesic spheres
+    of radius 1, with 0 to count-1 levels of subdivision.  Level L has
+    20*4^L triangles.  The meshes are optimized with optimizeMesh().  */
+void createGeodesicLODs(TriMesh* lods, int count);
+
+#endif
@@ -0,0 +1,212 @@
+#include <stdlib.h>
+#include <pthread.h>
+#include <sched.h>
+#include <unistd.h>
+#include <stdatomic.h>
+#include "jobs.h"
+
+#define MAX_THREADS 64
+
+typedef struct Job {
+    JobFunction function;
+    void* data;
+    int start, end, chunk;
+    atomic_int* remaining;   // chunks of the parallel-for that are not done yet
+} Job;
+
+/*  A queue of jobs, stored as a ring buffer.  The owning thread takes jobs
+    from the front; other threads steal from the back.  */
+typedef struct JobQueue {
+    pthread_mutex_t lock;
+    Job* jobs;
+    int capacity;
+    int head;
+    int count;
+} JobQueue;
+
+static JobQueue queues[MAX_THREADS];
+static pthread_t threads[MAX_THREADS];
+static int threadCount = 0;
+
+static atomic_int running;
+static atomic_int queuedJobs;   // jobs in all queues, used to decide when to sleep
+static pthread_mutex_t sleepLock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t wakeUp = PTHREAD_COND_INITIALIZER;
+
+static _Thread_local int workerIndex = 0;   // the thread that called jobsInit() is 0
+
+static void push(JobQueue* queue, Job job) {
+    if (queue->count == queue->capacity) {
+        int i, capacity = queue->capacity ? 2*queue->capacity : 64;
+        Job* jobs = malloc( capacity*sizeof(Job) );
+        for (i = 0; i < queue->count; i++)
+            jobs[i] = queue->jobs[(queue->head + i) % queue->capacity];
+        free(queue->jobs);
+        queue->jobs = jobs;
+        queue->capacity = capacity;
+        queue->head = 0;
+    }
+    queue->jobs[(queue->head + queue->count) % queue->capacity] = job;
+    queue->count++;
+}
+
+static int popFront(JobQueue* queue, Job* job) {
+    int found = 0;
+    pthread_mutex_lock(&queue->lock);
+    if (queue->count > 0) {
+        *job = queue->jobs[queue->head];
+        queue->head = (queue->head + 1) % queue->capacity;
+        queue->count--;
+        found = 1;
+    }
+    pthread_mutex_unlock(&queue->lock);
+    return found;
+}
+
+static int stealBack(JobQueue* queue, Job* job) {
+    int found = 0;
+    pthread_mutex_lock(&queue->lock);
+    if (queue->count > 0) {
+        *job = queue->jobs[(queue->head + queue->count - 1) % queue->capacity];
+        queue->count--;
+        found = 1;
+    }
+    pthread_mutex_unlock(&queue->lock);
+    return found;
+}
+
+static int findJob(int self, Job* job) {
+    int i;
+    if (popFront(&queues[self], job)) {
+        atomic_fetch_sub(&queuedJobs, 1);
+        return 1;
+    }
+    for (i = 1; i < threadCount; i++)
+        if (stealBack(&queues[(self + i) % threadCount], job)) {
+            atomic_fetch_sub(&queuedJobs, 1);
+            return 1;
+        }
+    return 0;
+}
+
+static void runJob(Job* job) {
+    job->function(job->data, job->start, job->end, job->chunk);
+    atomic_fetch_sub_explicit(job->remaining, 1, memory_order_release);
+}
+
+static void* workerMain(void* arg) {
+    Job job;
+    workerIndex = (int)(long)arg;
+    while (atomic_load(&running)) {
+        if (findJob(workerIndex, &job)) {
+            runJob(&job);
+            continue;
+        }
+        pthread_mutex_lock(&sleepLock);
+        while (atomic_load(&running) && atomic_load(&queuedJobs) == 0)
+            pthread_cond_wait(&wakeUp, &sleepLock);
+        pthread_mutex_unlock(&sleepLock);
+    }
+    return NULL;
+}
+
+void jobsInit(int count) {
+    long i;
+    if (threadCount > 0)
+        jobsShutdown();
+    if (count <= 0)
+        count = (int)sysconf(_SC_NPROCESSORS_ONLN);
+    if (count < 1)
+        count = 1;
+    if (count > MAX_THREADS)
+        count = MAX_THREADS;
+    threadCount = count;
+    workerIndex = 0;
+    atomic_store(&running, 1);
+    atomic_store(&queuedJobs, 0);
+    for (i = 0; i < count; i++) {
+        pthread_mutex_init(&queues[i].lock, NULL);
+        queues[i].jobs = NULL;
+        queues[i].capacity = queues[i].head = queues[i].count = 0;
+    }
+    for (i = 1; i < count; i++)
+        pthread_create(&threads[i], NULL, workerMain, (void*)i);
+}
+
+void jobsShutdown() {
+    int i;
+    if (threadCount == 0)
+        return;
+    pthread_mutex_lock(&sleepLock);
+    atomic_store(&running, 0);
+    pthread_cond_broadcast(&wakeUp);
+    pthread_mutex_unlock(&sleepLock);
+    for (i = 1; i < threadCount; i++)
+        pthread_join(threads[i], NULL);
+    for (i = 0; i < threadCount; i++) {
+        pthread_mutex_destroy(&queues[i].lock);
+        free(queues[i].jobs);
+    }
+    threadCount = 0;
+}
+
+int jobsThreadCount() {
+    return threadCount > 0 ? threadCount : 1;
+}
+
+int jobsChunkCount(int count, int grainSize) {
+    if (count <= 0)
+        return 0;
+    if (grainSize < 1)
+        grainSize = 1;
+    return (count + grainSize - 1) / grainSize;
+}
+
+void jobsParallelFor(int count, int grainSize, JobFunction function, void* data) {
+    int chunks = jobsChunkCount(count, grainSize);
+    int i, t;
+    Job job;
+    if (grainSize < 1)
+        grainSize = 1;
+    if (threadCount <= 1 || chunks <= 1) {
+        for (i = 0; i < chunks; i++) {
+            int end = (i+1)*grainSize < count ? (i+1)*grainSize : count;
+            function(data, i*grainSize, end, i);
+        }
+        return;
+    }
+
+    // Each thread's queue gets a contiguous block of chunks, so that a thread
+    // that is not stolen from walks through memory in order.
+    atomic_int remaining;
+    atomic_init(&remaining, chunks);
+    job.function = function;
+    job.data = data;
+    job.remaining = &remaining;
+    for (t = 0; t < threadCount; t++) {
+        int first = (int)((long long)chunks * t / threadCount);
+        int last = (int)((long long)chunks * (t+1) / threadCount);
+        JobQueue* queue = &queues[(workerIndex + t) % threadCount];
+        pthread_mutex_lock(&queue->lock);
+        for (i = first; i < last; i++) {
+            job.chunk = i;
+            job.start = i*grainSize;
+            job.end = (i+1)*grainSize < count ? (i+1)*grainSize : count;
+            push(queue, job);
+        }
+        pthread_mutex_unlock(&queue->lock);
+    }
+    pthread_mutex_lock(&sleepLock);
+    atomic_fetch_add(&queuedJobs, chunks);
+    pthread_cond_broadcast(&wakeUp);
+    pthread_mutex_unlock(&sleepLock);
+
+    // Help out until every chunk of this loop is done.  The jobs that this
+    // thread runs may belong to other loops, which is fine.
+    while (atomic_load_explicit(&remaining, memory_order_acquire) > 0) {
+        if (findJob(workerIndex, &job))
+            runJob(&job);
+        else
+            sched_yield();
+    }
+}
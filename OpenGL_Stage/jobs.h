@@ -0,0 +1,44 @@
+/*  Header file for jobs.c, a small job system for spreading work over all of
+    the cores.  It runs a pool of worker threads, each with its own queue of
+    jobs.  A thread takes jobs from the front of its own queue, and when that
+    is empty it steals from the back of another thread's queue, so a thread
+    that finishes early takes over work from one that is behind.
+
+    The only kind of job is a range of a loop, submitted with jobsParallelFor().
+    The range is cut into chunks of a fixed size, so the chunk boundaries
+    depend only on the count and the grain size and never on the number of
+    threads.  Code that writes each chunk's results to its own place therefore
+    gets the same results no matter how many threads run it.
+
+    Until jobsInit() is called, jobsParallelFor() simply runs every chunk on the
+    calling thread.  Programs that use jobs.c must be compiled with -pthread.  */
+
+#ifndef JOBS_H
+#define JOBS_H
+
+/*  A job: process items start to end-1.  chunk is the number of the chunk,
+    counting from 0, which can be used to find per-chunk scratch space.  */
+typedef void (*JobFunction)(void* data, int start, int end, int chunk);
+
+/*  Starts the worker threads.  threadCount is the total number of threads
+    that run jobs, including the thread that calls jobsParallelFor(); if it
+    is 0 or less, one thread per core is used.  Calling jobsInit() again
+    restarts the pool with the new count.  */
+void jobsInit(int threadCount);
+
+//  Stops the worker threads.
+void jobsShutdown();
+
+//  The number of threads that run jobs, including the calling thread.
+int jobsThreadCount();
+
+//  The number of chunks that jobsParallelFor() cuts count items into.
+int jobsChunkCount(int count, int grainSize);
+
+/*  Calls function for every chunk of grainSize items in the range 0 to
+    count-1, spread over all of the threads, and returns when all of the
+    chunks are done.  The calling thread runs chunks too.  A job may itself
+    call jobsParallelFor().  */
+void jobsParallelFor(int count, int grainSize, JobFunction function, void* data);
+
+#endif
@@ -0,0 +1,467 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <ctype.h>
+#include <math.h>
+#include "jsonmodel.h"
+
+//  The bits of the number that starts each face, as in THREE.JSONLoader.
+#define FACE_QUAD 1
+#define FACE_MATERIAL 2
+#define FACE_UV 4
+#define FACE_VERTEX_UVS 8
+#define FACE_NORMAL 16
+#define FACE_VERTEX_NORMALS 32
+#define FACE_COLOR 64
+#define FACE_VERTEX_COLORS 128
+
+#define MAX_DEPTH 64    // of nested arrays and objects in a part that is skipped
+
+//  The state of the stream that a model is read from.
+typedef struct Reader {
+    FILE* file;
+    const char* path;
+    int c;          // the next character, or EOF
+    int line;       // of the next character, for messages, or 0 once the whole file is read
+    int failed;     // a message has been printed
+} Reader;
+
+//  A growing array of numbers.
+typedef struct Numbers {
+    double* values;
+    int count, capacity;
+} Numbers;
+
+//  The morph targets or morph colors of a model: a name and an array of numbers for each.
+typedef struct Frames {
+    int count;
+    char (*names)[MORPH_NAME_LENGTH];
+    Numbers* values;
+} Frames;
+
+// ---------------------------------- JSON ----------------------------------------
+
+static void advance(Reader* r) {
+    if (r->c == '\n')
+        r->line++;
+    r->c = getc(r->file);
+}
+
+static void skipSpace(Reader* r) {
+    while (r->c == ' ' || r->c == '\t' || r->c == '\n' || r->c == '\r')
+        advance(r);
+}
+
+//  Prints a message for the first error only, and returns 0.
+static int fail(Reader* r, const char* message) {
+    if (r->failed)
+        return 0;
+    if (r->line > 0)
+        printf("Cannot read the model %s, line %d: %s.\n", r->path, r->line, message);
+    else
+        printf("Cannot read the model %s: %s.\n", r->path, message);
+    r->failed = 1;
+    return 0;
+}
+
+static int expect(Reader* r, int c) {
+    char message[32];
+    skipSpace(r);
+    if (r->c == c) {
+        advance(r);
+        return 1;
+    }
+    snprintf(message, sizeof(message), "expected '%c'", c);
+    return fail(r, message);
+}
+
+/*  Call in the condition of a loop over the items of an array or an object,
+    after its opening bracket, with first set to 1.  Reads the comma before
+    each item but the first, and returns 0 at the closing bracket or after
+    an error.  */
+static int moreItems(Reader* r, int close, int* first) {
+    if (r->failed)
+        return 0;
+    skipSpace(r);
+    if (r->c == close) {
+        advance(r);
+        return 0;
+    }
+    if (r->c == EOF)
+        return fail(r, "unexpected end of file");
+    if ( ! *first && ! expect(r, ',') )
+        return 0;
+    *first = 0;
+    return 1;
+}
+
+/*  Reads a string into text, cut to size-1 characters, or skips it if text
+    is NULL.  Escapes other than \" and \\ are kept as the letter after the
+    backslash, which is all that the names in a model need.  */
+static int readString(Reader* r, char* text, int size) {
+    int n = 0;
+    skipSpace(r);
+    if (r->c != '"')
+        return fail(r, "expected a string");
+    advance(r);
+    while (r->c != '"') {
+        if (r->c == EOF || r->c == '\n')
+            return fail(r, "unterminated string");
+        if (r->c == '\\')
+            advance(r);
+        if (text && n < size - 1)
+            text[n++] = (char)r->c;
+        advance(r);
+    }
+    advance(r);
+    if (text)
+        text[n] = 0;
+    return 1;
+}
+
+static int isNumberChar(int c) {
+    return (c >= '0' && c <= '9') || c == '-' || c == '+' || c == '.' || c == 'e' || c == 'E';
+}
+
+static int readNumber(Reader* r, double* value) {
+    char text[64], *end;
+    int n = 0;
+    skipSpace(r);
+    while (n < (int)sizeof(text) - 1 && isNumberChar(r->c)) {
+        text[n++] = (char)r->c;
+        advance(r);
+    }
+    text[n] = 0;
+    *value = strtod(text, &end);
+    if (n == 0 || *end)
+        return fail(r, "expected a number");
+    return 1;
+}
+
+static void addNumber(Numbers* list, double value) {
+    if (list->count == list->capacity) {
+        list->capacity = list->capacity ? 2*list->capacity : 1024;
+        list->values = realloc(list->values, list->capacity*sizeof(double));
+    }
+    list->values[list->count++] = value;
+}
+
+//  Reads an array of numbers, adding them to list.
+static int readNumbers(Reader* r, Numbers* list) {
+    int first = 1;
+    double value;
+    if ( ! expect(r, '[') )
+        return 0;
+    while (moreItems(r, ']', &first))
+        if (readNumber(r, &value))
+            addNumber(list, value);
+    return ! r->failed;
+}
+
+//  Skips a value of any kind; true, false and null are taken as any word.
+static int skipValue(Reader* r, int depth) {
+    int first = 1;
+    double number;
+    skipSpace(r);
+    if (depth > MAX_DEPTH)
+        return fail(r, "too deeply nested");
+    if (r->c == '"')
+        return readString(r, NULL, 0);
+    if (r->c == '[') {
+        advance(r);
+        while (moreItems(r, ']', &first))
+            skipValue(r, depth + 1);
+    }
+    else if (r->c == '{') {
+        advance(r);
+        while (moreItems(r, '}', &first))
+            if (readString(r, NULL, 0) && expect(r, ':'))
+                skipValue(r, depth + 1);
+    }
+    else if (isalpha(r->c))
+        while (isalpha(r->c))
+            advance(r);
+    else
+        readNumber(r, &number);
+    return ! r->failed;
+}
+
+/*  Reads an object's key and the colon after it.  Keys longer than the buffer
+    are cut, which is harmless, since none of the keys that are used is long.  */
+static int readKey(Reader* r, char* key, int size) {
+    return readString(r, key, size) && expect(r, ':');
+}
+
+// ---------------------------- the parts of a model --------------------------------
+
+static void freeFrames(Frames* frames) {
+    int i;
+    for (i = 0; i < frames->count; i++)
+        free(frames->values[i].values);
+    free(frames->names);
+    free(frames->values);
+    memset(frames, 0, sizeof(Frames));
+}
+
+/*  Reads an array of objects, each with a "name" and an array of numbers
+    under valuesKey, as the morph targets and the morph colors are.  */
+static int readFrames(Reader* r, const char* valuesKey, Frames* frames) {
+    int first = 1;
+    if ( ! expect(r, '[') )
+        return 0;
+    while (moreItems(r, ']', &first)) {
+        int i = frames->count, firstKey = 1;
+        char key[32];
+        frames->names = realloc(frames->names, (i + 1)*MORPH_NAME_LENGTH);
+        frames->values = realloc(frames->values, (i + 1)*sizeof(Numbers));
+        memset(frames->names[i], 0, MORPH_NAME_LENGTH);
+        memset(&frames->values[i], 0, sizeof(Numbers));
+        frames->count++;
+        if ( ! expect(r, '{') )
+            break;
+        while (moreItems(r, '}', &firstKey) && readKey(r, key, sizeof(key))) {
+            if (strcmp(key, "name") == 0)
+                readString(r, frames->names[i], MORPH_NAME_LENGTH);
+            else if (strcmp(key, valuesKey) == 0)
+                readNumbers(r, &frames->values[i]);
+            else
+                skipValue(r, 0);
+        }
+    }
+    return ! r->failed;
+}
+
+//  Reads the materials, keeping the diffuse color of each, or white if it has none.
+static int readMaterials(Reader* r, Numbers* colors) {
+    int first = 1;
+    if ( ! expect(r, '[') )
+        return 0;
+    while (moreItems(r, ']', &first)) {
+        Numbers diffuse = { NULL, 0, 0 };
+        int firstKey = 1, k;
+        char key[32];
+        if ( ! expect(r, '{') )
+            break;
+        while (moreItems(r, '}', &firstKey) && readKey(r, key, sizeof(key))) {
+            if (strcmp(key, "colorDiffuse") == 0)
+                readNumbers(r, &diffuse);
+            else
+                skipValue(r, 0);
+        }
+        for (k = 0; k < 3; k++)
+            addNumber(colors, diffuse.count == 3 ? diffuse.values[k] : 1);
+        free(diffuse.values);
+    }
+    return ! r->failed;
+}
+
+//  Reads the metadata, which must not give a formatVersion other than 3.
+static int readMetadata(Reader* r) {
+    int first = 1;
+    char key[32];
+    double version;
+    if ( ! expect(r, '{') )
+        return 0;
+    while (moreItems(r, '}', &first) && readKey(r, key, sizeof(key))) {
+        if (strcmp(key, "formatVersion") != 0)
+            skipValue(r, 0);
+        else if (readNumber(r, &version) && version != 3)
+            fail(r, "the model is not of format 3");
+    }
+    return ! r->failed;
+}
+
+//  Counts the uv layers, whose contents are not used.
+static int countLayers(Reader* r, int* layers) {
+    int first = 1;
+    if ( ! expect(r, '[') )
+        return 0;
+    while (moreItems(r, ']', &first))
+        if (skipValue(r, 0))
+            (*layers)++;
+    return ! r->failed;
+}
+
+// ---------------------------------- faces ----------------------------------------
+
+/*  Checks the packed faces and counts them and their vertices.  Returns 0,
+    after printing a message, if a face runs past the end of the array or uses
+    a vertex or material that does not exist.  */
+static int countFaces(Reader* r, const Numbers* faces, int uvLayers, int vertexCount, int materialCount,
+                      int* faceCount, int* cornerCount) {
+    int i = 0, k;
+    *faceCount = *cornerCount = 0;
+    while (i < faces->count) {
+        int type = (int)faces->values[i++];
+        int n = type & FACE_QUAD ? 4 : 3;
+        int end = i + n + (type & FACE_MATERIAL ? 1 : 0) + (type & FACE_UV ? uvLayers : 0)
+                  + (type & FACE_VERTEX_UVS ? n*uvLayers : 0) + (type & FACE_NORMAL ? 1 : 0)
+                  + (type & FACE_VERTEX_NORMALS ? n : 0) + (type & FACE_COLOR ? 1 : 0)
+                  + (type & FACE_VERTEX_COLORS ? n : 0);
+        if (end > faces->count)
+            return fail(r, "the last face is cut short");
+        for (k = 0; k < n; k++)
+            if (faces->values[i+k] < 0 || faces->values[i+k] >= vertexCount)
+                return fail(r, "a face uses a vertex that does not exist");
+        if ((type & FACE_MATERIAL) && materialCount > 0
+                && (faces->values[i+n] < 0 || faces->values[i+n] >= materialCount))
+            return fail(r, "a face uses a material that does not exist");
+        (*faceCount)++;
+        *cornerCount += n;
+        i = end;
+    }
+    return 1;
+}
+
+static void setFaceNormal(double* normal, const double* vertices, const int* face) {
+    const double* a = &vertices[3*face[0]];
+    const double* b = &vertices[3*face[1]];
+    const double* c = &vertices[3*face[2]];
+    double u[3] = { b[0]-a[0], b[1]-a[1], b[2]-a[2] };
+    double v[3] = { c[0]-a[0], c[1]-a[1], c[2]-a[2] };
+    double length;
+    normal[0] = u[1]*v[2] - u[2]*v[1];
+    normal[1] = u[2]*v[0] - u[0]*v[2];
+    normal[2] = u[0]*v[1] - u[1]*v[0];
+    length = sqrt( normal[0]*normal[0] + normal[1]*normal[1] + normal[2]*normal[2] );
+    if (length > 0) {
+        normal[0] /= length;
+        normal[1] /= length;
+        normal[2] /= length;
+    }
+}
+
+/*  Unpacks the faces into the polyhedron, whose vertices are set, with the
+    colors from faceColors, 3 per face, if it is not NULL, or else from the
+    materials, if there are any.  */
+static void unpackFaces(Polyhedron* poly, const Numbers* faces, int uvLayers, int cornerCount,
+                        const double* faceColors, const Numbers* materialColors) {
+    int i = 0, j = 0, f = 0, k;
+    poly->faces = malloc( (cornerCount + poly->faceCount)*sizeof(int) );
+    poly->normals = malloc( poly->faceCount*3*sizeof(double) );
+    poly->faceColors = faceColors || materialColors->count > 0 ? malloc( poly->faceCount*3*sizeof(double) ) : NULL;
+    while (i < faces->count) {
+        int type = (int)faces->values[i++];
+        int n = type & FACE_QUAD ? 4 : 3;
+        int material = type & FACE_MATERIAL ? (int)faces->values[i+n] : 0;
+        int* face = &poly->faces[j];
+        for (k = 0; k < n; k++)
+            poly->faces[j++] = (int)faces->values[i++];
+        poly->faces[j++] = -1;
+        setFaceNormal(&poly->normals[3*f], poly->vertices, face);
+        for (k = 0; k < 3 && poly->faceColors; k++)
+            poly->faceColors[3*f+k] = faceColors ? faceColors[3*f+k] : materialColors->values[3*material+k];
+        i += (type & FACE_MATERIAL ? 1 : 0) + (type & FACE_UV ? uvLayers : 0)
+             + (type & FACE_VERTEX_UVS ? n*uvLayers : 0) + (type & FACE_NORMAL ? 1 : 0)
+             + (type & FACE_VERTEX_NORMALS ? n : 0) + (type & FACE_COLOR ? 1 : 0)
+             + (type & FACE_VERTEX_COLORS ? n : 0);
+        f++;
+    }
+}
+
+// ---------------------------------- models ----------------------------------------
+
+int readJsonModel(const char* path, JsonModel* model) {
+    Reader reader = { NULL, path, 0, 1, 0 };
+    Reader* r = &reader;
+    Numbers vertices = { NULL, 0, 0 }, faces = { NULL, 0, 0 }, materialColors = { NULL, 0, 0 };
+    Frames targets = { 0, NULL, NULL }, colors = { 0, NULL, NULL };
+    double scale = 1;
+    int uvLayers = 0, first = 1, faceCount, cornerCount, i, m;
+    char key[32];
+    memset(model, 0, sizeof(JsonModel));
+    r->file = fopen(path, "r");
+    if ( ! r->file ) {
+        printf("Cannot open the model %s.\n", path);
+        return 0;
+    }
+    advance(r);
+    if (expect(r, '{'))
+        while (moreItems(r, '}', &first) && readKey(r, key, sizeof(key))) {
+            if (strcmp(key, "metadata") == 0)
+                readMetadata(r);
+            else if (strcmp(key, "scale") == 0)
+                readNumber(r, &scale);
+            else if (strcmp(key, "vertices") == 0)
+                readNumbers(r, &vertices);
+            else if (strcmp(key, "faces") == 0)
+                readNumbers(r, &faces);
+            else if (strcmp(key, "morphTargets") == 0)
+                readFrames(r, "vertices", &targets);
+            else if (strcmp(key, "morphColors") == 0)
+                readFrames(r, "colors", &colors);
+            else if (strcmp(key, "materials") == 0)
+                readMaterials(r, &materialColors);
+            else if (strcmp(key, "uvs") == 0)
+                countLayers(r, &uvLayers);
+            else
+                skipValue(r, 0);
+        }
+    skipSpace(r);
+    if ( ! r->failed && r->c != EOF )
+        fail(r, "there is more after the model");
+    fclose(r->file);
+    r->line = 0;
+
+    if ( ! r->failed && (vertices.count % 3 != 0 || scale == 0) )
+        fail(r, "the vertices or the scale are not valid");
+    for (m = 0; m < targets.count && ! r->failed; m++)
+        if (targets.values[m].count != vertices.count)
+            fail(r, "a morph target does not have a position for every vertex");
+    if ( ! r->failed )
+        countFaces(r, &faces, uvLayers, vertices.count/3, materialColors.count/3, &faceCount, &cornerCount);
+
+    if ( ! r->failed ) {
+        Polyhedron* poly = &model->poly;
+        const double* faceColors = colors.count > 0 && colors.values[0].count == 3*faceCount
+                                   ? colors.values[0].values : NULL;
+        poly->vertexCount = vertices.count/3;
+        poly->faceCount = faceCount;
+        poly->vertices = malloc( vertices.count*sizeof(double) );
+        poly->maxVertexLength = 0;
+        for (i = 0; i < vertices.count; i++)
+            poly->vertices[i] = vertices.values[i] / scale;
+        for (i = 0; i < poly->vertexCount; i++) {
+            const double* p = &poly->vertices[3*i];
+            double length = sqrt( p[0]*p[0] + p[1]*p[1] + p[2]*p[2] );
+            if (length > poly->maxVertexLength)
+                poly->maxVertexLength = length;
+        }
+        unpackFaces(poly, &faces, uvLayers, cornerCount, faceColors, &materialColors);
+        model->morphCount = targets.count;
+        model->morphNames = calloc( targets.count > 0 ? targets.count : 1, MORPH_NAME_LENGTH );
+        model->morphVertices = malloc( (size_t)targets.count*vertices.count*sizeof(double) );
+        for (m = 0; m < targets.count; m++) {
+            memcpy(model->morphNames[m], targets.names[m], MORPH_NAME_LENGTH);
+            for (i = 0; i < vertices.count; i++)
+                model->morphVertices[(size_t)m*vertices.count + i] = targets.values[m].values[i] / scale;
+        }
+    }
+    free(vertices.values);
+    free(faces.values);
+    free(materialColors.values);
+    freeFrames(&targets);
+    freeFrames(&colors);
+    return ! r->failed;
+}
+
+void freeJsonModel(JsonModel* model) {
+    free(model->poly.vertices);
+    free(model->poly.faces);
+    free(model->poly.faceColors);
+    free(model->poly.normals);
+    free(model->morphNames);
+    free(model->morphVertices);
+    memset(model, 0, sizeof(JsonModel));
+}
+
+MorphMesh compileJsonModel(const JsonModel* model) {
+    const char** names = malloc( (model->morphCount > 0 ? model->morphCount : 1)*sizeof(char*) );
+    MorphMesh morph;
+    int m;
+    for (m = 0; m < model->morphCount; m++)
+        names[m] = model->morphNames[m];
+    morph = compileMorphMesh(model->poly, model->morphCount, model->morphVertices, names);
+    free(names);
+    return morph;
+}
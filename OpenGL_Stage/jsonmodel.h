@@ -0,0 +1,64 @@
+/*  Header file for jsonmodel.c, which reads models in the JSON format 3 of
+    three.js, the format of THREE.JSONLoader, such as the horse of
+    Three.js_Ride/resources/horse.js, without a JavaScript runtime.
+
+    The file is read as a stream, a character at a time through stdio, and
+    only the parts that become part of the model are kept: nothing like a
+    tree of the whole JSON document is built.  The parts that are read are
+
+        "scale"          the vertices are divided by it, as three.js does;
+        "vertices"       3 numbers per vertex;
+        "faces"          packed faces: each face starts with a number whose
+                         bits say what follows it (a quad or a triangle, a
+                         material index, uv, normal and color indices);
+        "morphTargets"   frames of an animation, each with a name and a
+                         position for every vertex;
+        "morphColors"    a color for every face, used if there is one;
+        "materials"      otherwise, each face gets the diffuse color of its
+                         material.
+
+    The uvs, normals and colors that the faces refer to are skipped, since
+    a Polyhedron has no place for them; the normals are computed.  The face
+    colors become vertex colors of the mesh of compileJsonModel().  */
+
+#ifndef JSONMODEL_H
+#define JSONMODEL_H
+
+#include "polyhedron.h"
+#include "morphmesh.h"
+
+//  A model read from a JSON file.
+typedef struct JsonModel {
+
+    /*  The vertices, in the rest pose, and the faces.  The normal of each face
+    is computed from its first three vertices, which are counterclockwise as
+    seen from the front in three.js.  faceColors is NULL if the model has
+    neither face colors nor materials.  */
+    Polyhedron poly;
+
+    // Number of morph targets.  Can be 0.
+    int morphCount;
+
+    // The names of the morph targets.
+    char (*morphNames)[MORPH_NAME_LENGTH];
+
+    /*  The vertex positions of each morph target, scaled like poly.vertices, 3
+    numbers per vertex; length = morphCount*poly.vertexCount*3.  The data for
+    target m is at index m*poly.vertexCount*3.  */
+    double* morphVertices;
+
+} JsonModel;
+
+/*  Reads a JSON model of format 3.  Returns 0, after printing a message, if
+    the file cannot be read, is not valid JSON, or is not a model of that
+    format, for example if a face uses a vertex that does not exist.  */
+int readJsonModel(const char* path, JsonModel* model);
+
+//  Frees the arrays of a model and sets its counts to zero.
+void freeJsonModel(JsonModel* model);
+
+/*  Compiles a model into a morph mesh, with compileMorphMesh(), with a frame
+    for each morph target.  */
+MorphMesh compileJsonModel(const JsonModel* model);
+
+#endif
@@ -0,0 +1,332 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include "lighting.h"
+#include "mat4.h"
+#include "transparency.h"
+
+// For putting the values of the cluster constants into the shader source.
+#define STRING(x) #x
+#define VALUE_STRING(x) STRING(x)
+
+static const char* vertexShaderSource =
+    "#version 150 compatibility\n"
+    "out vec3 v_position;  // in view coordinates\n"
+    "out vec3 v_normal;\n"
+    "in int " MATERIAL_ATTRIBUTE ";\n"
+    "flat out int v_material;\n"
+    "void main() {\n"
+    "    v_material = " MATERIAL_ATTRIBUTE ";\n"
+    "    vec4 eyeCoords = gl_ModelViewMatrix * gl_Vertex;\n"
+    "    v_position = eyeCoords.xyz / eyeCoords.w;\n"
+    "    v_normal = gl_NormalMatrix * gl_Normal;\n"
+    "    gl_Position = gl_ProjectionMatrix * eyeCoords;\n"
+    "}\n";
+
+static const char* fragmentShaderSource =
+    "#version 150 compatibility\n"
+    MATERIAL_GLSL
+    TRANSPARENCY_GLSL
+    "uniform samplerBuffer u_lights;\n"
+    "uniform usamplerBuffer u_clusters;\n"
+    "uniform usamplerBuffer u_lightIndices;\n"
+    "uniform vec2 u_tileSize;\n"
+    "uniform float u_zNear;\n"
+    "uniform float u_sliceScale;\n"
+    "uniform vec4 u_keyLight;         // view position and radius; radius 0 if there is no key light\n"
+    "uniform vec3 u_keyLightColor;\n"
+    "uniform bool u_shadowed;\n"
+    "uniform mat4 u_shadowMatrix;\n"
+    "uniform sampler2DShadow u_shadowMap;\n"
+    "uniform bool u_hasEnvironment;\n"
+    "uniform samplerCube u_environmentMap;\n"
+    "uniform mat3 u_environmentRotation;  // from view directions to world directions\n"
+    "uniform bool u_transparent;          // for the transparent pass of transparency.c\n"
+    "in vec3 v_position;\n"
+    "in vec3 v_normal;\n"
+    "flat in int v_material;\n"
+    "const ivec3 clusterCount = ivec3(" VALUE_STRING(CLUSTER_TILES_X) ", " VALUE_STRING(CLUSTER_TILES_Y) ", "
+                                        VALUE_STRING(CLUSTER_SLICES) ");\n"
+    "// The fraction of the key light that reaches this point.  The map is sampled\n"
+    "// on a 3x3 grid of texels, and each sample is already a bilinear blend of\n"
+    "// four depth comparisons, so the edges of the shadows are soft.\n"
+    "float keyLightVisibility() {\n"
+    "    if ( ! u_shadowed )\n"
+    "        return 1.0;\n"
+    "    vec4 p = u_shadowMatrix * vec4(v_position, 1.0);\n"
+    "    if (p.w <= 0.0)\n"
+    "        return 1.0;\n"
+    "    p.xyz /= p.w;\n"
+    "    vec2 texel = 1.0 / vec2(textureSize(u_shadowMap, 0));\n"
+    "    float sum = 0.0;\n"
+    "    for (int y = -1; y <= 1; y++)\n"
+    "        for (int x = -1; x <= 1; x++)\n"
+    "            sum += texture(u_shadowMap, vec3(p.xy + vec2(x, y) * texel, p.z));\n"
+    "    return sum / 9.0;\n"
+    "}\n"
+    "void addLight(vec3 N, vec3 V, vec4 positionAndRadius, vec3 color, float shininess,\n"
+    "              inout vec3 diffuse, inout vec3 specular) {\n"
+    "    vec3 L = positionAndRadius.xyz - v_position;\n"
+    "    float distance = length(L);\n"
+    "    if (distance >= positionAndRadius.w)\n"
+    "        return;\n"
+    "    L /= distance;\n"
+    "    float falloff = 1.0 - pow(distance / positionAndRadius.w, 4.0);\n"
+    "    float attenuation = falloff * falloff;\n"
+    "    float NdotL = dot(N, L);\n"
+    "    if (NdotL <= 0.0)\n"
+    "        return;\n"
+    "    diffuse += color * (NdotL * attenuation);\n"
+    "    specular += color * (pow(max(dot(N, normalize(L + V)), 0.0), shininess) * attenuation);\n"
+    "}\n"
+    "void main() {\n"
+    "    vec3 N = normalize(v_normal);\n"
+    "    if ( ! gl_FrontFacing )\n"
+    "        N = -N;  // the materials are set for GL_FRONT_AND_BACK\n"
+    "    vec3 V = normalize(-v_position);\n"
+    "    Material material = getMaterial(v_material);\n"
+    "    float shininess = max(material.shininess, 1.0);\n"
+    "    // The headlight, like the default GL_LIGHT0: white, shining along -z.\n"
+    "    vec3 diffuse = vec3(max(N.z, 0.0));\n"
+    "    vec3 specular = N.z > 0.0 ? vec3(pow(max(dot(N, normalize(V + vec3(0,0,1))), 0.0), shininess)) : vec3(0.0);\n"
+    "    if (u_keyLight.w > 0.0)\n"
+    "        addLight(N, V, u_keyLight, u_keyLightColor * keyLightVisibility(), shininess, diffuse, specular);\n"
+    "    ivec3 cluster;\n"
+    "    cluster.xy = ivec2(gl_FragCoord.xy / u_tileSize);\n"
+    "    cluster.z = int(log(max(-v_position.z, u_zNear) / u_zNear) * u_sliceScale);\n"
+    "    cluster = clamp(cluster, ivec3(0), clusterCount - 1);\n"
+    "    uvec2 range = texelFetch(u_clusters, (cluster.z*clusterCount.y + cluster.y)*clusterCount.x + cluster.x).xy;\n"
+    "    for (uint i = 0u; i < range.y; i++) {\n"
+    "        int light = int(texelFetch(u_lightIndices, int(range.x + i)).r);\n"
+    "        addLight(N, V, texelFetch(u_lights, 2*light), texelFetch(u_lights, 2*light + 1).rgb,\n"
+    "                 shininess, diffuse, specular);\n"
+    "    }\n"
+    "    vec3 result = gl_LightModel.ambient.rgb * material.ambient.rgb\n"
+    "                + diffuse * material.diffuse.rgb\n"
+    "                + specular * material.specular.rgb;\n"
+    "    if (u_hasEnvironment && material.reflectivity > 0.0) {\n"
+    "        // Cube maps are looked up as if from inside the cube, so x is mirrored,\n"
+    "        // as three.js does for an envMap.\n"
+    "        vec3 R = u_environmentRotation * reflect(-V, N);\n"
+    "        vec3 reflected = texture(u_environmentMap, vec3(-R.x, R.y, R.z)).rgb * material.specular.rgb;\n"
+    "        result = mix(result, reflected, material.reflectivity);\n"
+    "    }\n"
+    "    if (u_transparent)\n"
+    "        writeTransparent(vec4(result, material.diffuse.a));\n"
+    "    else\n"
+    "        gl_FragData[0] = vec4(result, material.diffuse.a);\n"
+    "}\n";
+
+int initClusteredLighting(ClusteredLighting* lighting) {
+    memset(lighting, 0, sizeof(ClusteredLighting));
+    if ( ! hasGLVersion(3, 1) ) {
+        printf("Clustered lighting needs OpenGL 3.1; using fixed-function lighting.\n");
+        return 0;
+    }
+    lighting->program = createProgram("clustered lighting", vertexShaderSource, fragmentShaderSource);
+    if ( ! lighting->program ) {
+        printf("Using fixed-function lighting.\n");
+        return 0;
+    }
+    glUseProgram(lighting->program);
+    glUniform1i(glGetUniformLocation(lighting->program, "u_lights"), 1);
+    glUniform1i(glGetUniformLocation(lighting->program, "u_clusters"), 2);
+    glUniform1i(glGetUniformLocation(lighting->program, "u_lightIndices"), 3);
+    lighting->tileSizeLocation = glGetUniformLocation(lighting->program, "u_tileSize");
+    lighting->zNearLocation = glGetUniformLocation(lighting->program, "u_zNear");
+    lighting->sliceScaleLocation = glGetUniformLocation(lighting->program, "u_sliceScale");
+    lighting->materialLocation = useMaterialBlock(lighting->program);
+    glUniform1i(glGetUniformLocation(lighting->program, "u_shadowMap"), 4);
+    lighting->keyLightLocation = glGetUniformLocation(lighting->program, "u_keyLight");
+    lighting->keyLightColorLocation = glGetUniformLocation(lighting->program, "u_keyLightColor");
+    lighting->shadowedLocation = glGetUniformLocation(lighting->program, "u_shadowed");
+    lighting->shadowMatrixLocation = glGetUniformLocation(lighting->program, "u_shadowMatrix");
+    glUniform1i(glGetUniformLocation(lighting->program, "u_environmentMap"), 5);
+    lighting->hasEnvironmentLocation = glGetUniformLocation(lighting->program, "u_hasEnvironment");
+    lighting->environmentRotationLocation = glGetUniformLocation(lighting->program, "u_environmentRotation");
+    lighting->transparentLocation = glGetUniformLocation(lighting->program, "u_transparent");
+    glUseProgram(0);
+
+    GLuint buffers[3], textures[3];
+    GLenum formats[3] = { GL_RGBA32F, GL_RG32UI, GL_R32UI };
+    int i;
+    glGenBuffers(3, buffers);
+    glGenTextures(3, textures);
+    for (i = 0; i < 3; i++) {
+        glBindBuffer(GL_TEXTURE_BUFFER, buffers[i]);
+        glBufferData(GL_TEXTURE_BUFFER, 16, NULL, GL_STREAM_DRAW);
+        glBindTexture(GL_TEXTURE_BUFFER, textures[i]);
+        glTexBuffer(GL_TEXTURE_BUFFER, formats[i], buffers[i]);
+    }
+    glBindBuffer(GL_TEXTURE_BUFFER, 0);
+    glBindTexture(GL_TEXTURE_BUFFER, 0);
+    lighting->lightBuffer = buffers[0];
+    lighting->clusterBuffer = buffers[1];
+    lighting->indexBuffer = buffers[2];
+    lighting->lightTexture = textures[0];
+    lighting->clusterTexture = textures[1];
+    lighting->indexTexture = textures[2];
+
+    lighting->lightData = malloc( MAX_POINT_LIGHTS*8*sizeof(float) );
+    lighting->lightBoxes = malloc( MAX_POINT_LIGHTS*6*sizeof(int) );
+    lighting->clusters = malloc( CLUSTER_COUNT*2*sizeof(unsigned int) );
+    lighting->indexCapacity = 4*MAX_POINT_LIGHTS;
+    lighting->indices = malloc( lighting->indexCapacity*sizeof(unsigned int) );
+    return 1;
+}
+
+static int clampInt(int x, int low, int high) {
+    return x < low ? low : x > high ? high : x;
+}
+
+/*  The tile that contains the point at x in normalized device coordinates.  */
+static int tileOf(float x, int tiles) {
+    return clampInt((int)floorf((x + 1) * 0.5f * tiles), 0, tiles - 1);
+}
+
+void updateClusteredLighting(ClusteredLighting* lighting, const PointLight* lights, int count,
+                             const float* viewMatrix, float fovy, float aspect, float zNear, float zFar,
+                             int viewportWidth, int viewportHeight) {
+    float tanY = tanf(fovy * (float)M_PI / 360), tanX = tanY * aspect;
+    float sliceScale = CLUSTER_SLICES / logf(zFar / zNear);
+    unsigned int* clusters = lighting->clusters;
+    int i, x, y, z, used = 0;
+    if (count > MAX_POINT_LIGHTS)
+        count = MAX_POINT_LIGHTS;
+
+    // Find the box of clusters that each light's bounding sphere touches.  The
+    // x and y ranges come from projecting the sphere's bounding box, which is
+    // widest at either its nearest or its farthest depth.
+    memset(clusters, 0, CLUSTER_COUNT*2*sizeof(unsigned int));
+    int indexCount = 0;
+    for (i = 0; i < count; i++) {
+        float center[3], r = lights[i].radius;
+        mat4TransformPoint(viewMatrix, lights[i].position, center);
+        float depth = -center[2];
+        if (depth + r < zNear || depth - r > zFar)
+            continue;
+        float nearDepth = depth - r > zNear ? depth - r : zNear;
+        float farDepth = depth + r < zFar ? depth + r : zFar;
+        float left = fminf((center[0] - r) / nearDepth, (center[0] - r) / farDepth) / tanX;
+        float right = fmaxf((center[0] + r) / nearDepth, (center[0] + r) / farDepth) / tanX;
+        float bottom = fminf((center[1] - r) / nearDepth, (center[1] - r) / farDepth) / tanY;
+        float top = fmaxf((center[1] + r) / nearDepth, (center[1] + r) / farDepth) / tanY;
+        if (right < -1 || left > 1 || top < -1 || bottom > 1)
+            continue;
+        int* box = &lighting->lightBoxes[6*used];
+        box[0] = tileOf(left, CLUSTER_TILES_X);
+        box[1] = tileOf(right, CLUSTER_TILES_X);
+        box[2] = tileOf(bottom, CLUSTER_TILES_Y);
+        box[3] = tileOf(top, CLUSTER_TILES_Y);
+        box[4] = clampInt((int)(logf(nearDepth / zNear) * sliceScale), 0, CLUSTER_SLICES - 1);
+        box[5] = clampInt((int)(logf(farDepth / zNear) * sliceScale), 0, CLUSTER_SLICES - 1);
+        float* data = &lighting->lightData[8*used];
+        data[0] = center[0];
+        data[1] = center[1];
+        data[2] = center[2];
+        data[3] = r;
+        data[4] = lights[i].color[0];
+        data[5] = lights[i].color[1];
+        data[6] = lights[i].color[2];
+        data[7] = 0;
+        for (z = box[4]; z <= box[5]; z++)
+            for (y = box[2]; y <= box[3]; y++)
+                for (x = box[0]; x <= box[1]; x++)
+                    clusters[2*((z*CLUSTER_TILES_Y + y)*CLUSTER_TILES_X + x) + 1]++;
+        indexCount += (box[1]-box[0]+1) * (box[3]-box[2]+1) * (box[5]-box[4]+1);
+        used++;
+    }
+
+    // Turn the counts into starting positions, then fill in the light lists.
+    unsigned int start = 0;
+    for (i = 0; i < CLUSTER_COUNT; i++) {
+        clusters[2*i] = start;
+        start += clusters[2*i+1];
+        clusters[2*i+1] = 0;
+    }
+    if (indexCount > lighting->indexCapacity) {
+        lighting->indexCapacity = 2*indexCount;
+        free(lighting->indices);
+        lighting->indices = malloc( lighting->indexCapacity*sizeof(unsigned int) );
+    }
+    for (i = 0; i < used; i++) {
+        const int* box = &lighting->lightBoxes[6*i];
+        for (z = box[4]; z <= box[5]; z++)
+            for (y = box[2]; y <= box[3]; y++)
+                for (x = box[0]; x <= box[1]; x++) {
+                    unsigned int* cluster = &clusters[2*((z*CLUSTER_TILES_Y + y)*CLUSTER_TILES_X + x)];
+                    lighting->indices[cluster[0] + cluster[1]++] = i;
+                }
+    }
+    lighting->lightCount = used;
+    lighting->indexCount = indexCount;
+
+    // Orphan the old storage so that the upload does not wait for the GPU to
+    // finish with the previous frame's data.  (A texture buffer can't be empty.)
+    glBindBuffer(GL_TEXTURE_BUFFER, lighting->lightBuffer);
+    glBufferData(GL_TEXTURE_BUFFER, (used > 0 ? used : 1)*8*sizeof(float), NULL, GL_STREAM_DRAW);
+    glBufferSubData(GL_TEXTURE_BUFFER, 0, used*8*sizeof(float), lighting->lightData);
+    glBindBuffer(GL_TEXTURE_BUFFER, lighting->clusterBuffer);
+    glBufferData(GL_TEXTURE_BUFFER, CLUSTER_COUNT*2*sizeof(unsigned int), clusters, GL_STREAM_DRAW);
+    glBindBuffer(GL_TEXTURE_BUFFER, lighting->indexBuffer);
+    glBufferData(GL_TEXTURE_BUFFER, (indexCount > 0 ? indexCount : 1)*sizeof(unsigned int), NULL, GL_STREAM_DRAW);
+    glBufferSubData(GL_TEXTURE_BUFFER, 0, indexCount*sizeof(unsigned int), lighting->indices);
+    glBindBuffer(GL_TEXTURE_BUFFER, 0);
+
+    lighting->tileSize[0] = (float)viewportWidth / CLUSTER_TILES_X;
+    lighting->tileSize[1] = (float)viewportHeight / CLUSTER_TILES_Y;
+    lighting->zNear = zNear;
+    lighting->sliceScale = sliceScale;
+}
+
+void setKeyLight(ClusteredLighting* lighting, const PointLight* light, const float* viewMatrix,
+                 GLuint shadowTexture, const float* shadowMatrix) {
+    if (light == NULL) {
+        memset(lighting->keyLight, 0, sizeof(lighting->keyLight));
+        memset(lighting->keyLightColor, 0, sizeof(lighting->keyLightColor));
+        lighting->shadowTexture = 0;
+        return;
+    }
+    mat4TransformPoint(viewMatrix, light->position, lighting->keyLight);
+    lighting->keyLight[3] = light->radius;
+    memcpy(lighting->keyLightColor, light->color, sizeof(lighting->keyLightColor));
+    lighting->shadowTexture = shadowTexture;
+    if (shadowTexture)
+        memcpy(lighting->shadowMatrix, shadowMatrix, sizeof(lighting->shadowMatrix));
+}
+
+void setEnvironmentMap(ClusteredLighting* lighting, GLuint environmentMap, const float* viewMatrix) {
+    lighting->environmentMap = environmentMap;
+    if (environmentMap)
+        mat4ViewToWorldRotation(lighting->environmentRotation, viewMatrix);
+}
+
+void setTransparentLighting(ClusteredLighting* lighting, int transparent) {
+    lighting->transparent = transparent;
+}
+
+void useClusteredLighting(const ClusteredLighting* lighting) {
+    glUseProgram(lighting->program);
+    glUniform2fv(lighting->tileSizeLocation, 1, lighting->tileSize);
+    glUniform1f(lighting->zNearLocation, lighting->zNear);
+    glUniform1f(lighting->sliceScaleLocation, lighting->sliceScale);
+    glUniform4fv(lighting->keyLightLocation, 1, lighting->keyLight);
+    glUniform3fv(lighting->keyLightColorLocation, 1, lighting->keyLightColor);
+    glUniform1i(lighting->shadowedLocation, lighting->shadowTexture != 0);
+    glUniformMatrix4fv(lighting->shadowMatrixLocation, 1, GL_FALSE, lighting->shadowMatrix);
+    glUniform1i(lighting->hasEnvironmentLocation, lighting->environmentMap != 0);
+    glUniformMatrix3fv(lighting->environmentRotationLocation, 1, GL_FALSE, lighting->environmentRotation);
+    glUniform1i(lighting->transparentLocation, lighting->transparent);
+    glActiveTexture(GL_TEXTURE5);
+    glBindTexture(GL_TEXTURE_CUBE_MAP, lighting->environmentMap);
+    glActiveTexture(GL_TEXTURE4);
+    glBindTexture(GL_TEXTURE_2D, lighting->shadowTexture);
+    glActiveTexture(GL_TEXTURE1);
+    glBindTexture(GL_TEXTURE_BUFFER, lighting->lightTexture);
+    glActiveTexture(GL_TEXTURE2);
+    glBindTexture(GL_TEXTURE_BUFFER, lighting->clusterTexture);
+    glActiveTexture(GL_TEXTURE3);
+    glBindTexture(GL_TEXTURE_BUFFER, lighting->indexTexture);
+    glActiveTexture(GL_TEXTURE0);
+}
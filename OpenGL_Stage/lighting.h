@@ -0,0 +1,117 @@
+/*  Header file for lighting.c, which does per-pixel lighting with any number
+    of point lights, using "clustered" shading.
+
+    Fixed-function OpenGL lighting is computed per vertex and stops at eight
+    lights.  Here, the view frustum is divided into a grid of clusters:
+    CLUSTER_TILES_X by CLUSTER_TILES_Y tiles on the screen, and CLUSTER_SLICES
+    slices in depth, with the slices getting thicker farther from the viewer.
+    Every frame, the CPU works out which lights reach which clusters.  The
+    fragment shader finds the cluster of its pixel and adds up only the lights
+    in that cluster, so each pixel pays for the few lights near it instead of
+    for all of them.
+
+    Materials come from the table in materials.c: the number of an object's
+    material is passed in the vertex attribute at materialLocation, usually
+    with glVertexAttribI1i() before drawing the object.  Besides the
+    point lights, the shader has a directional "headlight" that matches the
+    default GL_LIGHT0, the global ambient light of the light model, and one
+    "key light" set with setKeyLight(), which can cast shadows from a shadow
+    map made with shadow.c.  Materials with a reflectivity also reflect the
+    cube map set with setEnvironmentMap(), tinted by their specular color.
+    The alpha of a fragment is that of the material's diffuse color; after
+    setTransparentLighting(), the shader writes to the targets of the
+    transparent pass of transparency.c instead of to the framebuffer.
+
+    Requires OpenGL 3.1 (for texture buffer objects and uniform buffers).  */
+
+#ifndef LIGHTING_H
+#define LIGHTING_H
+
+#include "materials.h"
+
+#define CLUSTER_TILES_X 16
+#define CLUSTER_TILES_Y 8
+#define CLUSTER_SLICES 24
+#define CLUSTER_COUNT (CLUSTER_TILES_X * CLUSTER_TILES_Y * CLUSTER_SLICES)
+#define MAX_POINT_LIGHTS 4096
+
+//  A point light.
+typedef struct PointLight {
+    float position[3];  // in world coordinates
+    float radius;       // the light has no effect at this distance and beyond
+    float color[3];     // used for both the diffuse and the specular color
+} PointLight;
+
+//  The OpenGL objects and scratch arrays for clustered lighting.
+typedef struct ClusteredLighting {
+    GLuint program;
+    GLuint lightBuffer, lightTexture;       // 2 RGBA32F texels per light: view position and radius, color
+    GLuint clusterBuffer, clusterTexture;   // 1 RG32UI texel per cluster: first index, number of lights
+    GLuint indexBuffer, indexTexture;       // 1 R32UI texel per (cluster, light) pair: the light's number
+
+    float* lightData;
+    unsigned int* clusters;
+    unsigned int* indices;
+    int indexCapacity;
+    int* lightBoxes;          // the range of clusters of each light: 6 numbers per light
+    int lightCount;           // lights that reach the view frustum in the last update
+    int indexCount;
+
+    float tileSize[2];        // in pixels
+    float zNear, sliceScale;  // slice = log(depth/zNear) * sliceScale
+    GLint tileSizeLocation, zNearLocation, sliceScaleLocation;
+    GLint materialLocation;   // the vertex attribute that holds the material number
+
+    float keyLight[4];        // view position and radius; radius 0 for no key light
+    float keyLightColor[3];
+    GLuint shadowTexture;     // 0 for no shadows
+    float shadowMatrix[16];
+    GLint keyLightLocation, keyLightColorLocation, shadowedLocation, shadowMatrixLocation;
+
+    GLuint environmentMap;    // a cube map texture, or 0 for no reflections
+    float environmentRotation[9];
+    GLint hasEnvironmentLocation, environmentRotationLocation;
+
+    int transparent;          // Is the shader drawing the transparent pass?
+    GLint transparentLocation;
+} ClusteredLighting;
+
+/*  Creates the shader program and the buffers.  Returns 0, after printing a
+    message, if the OpenGL version is too old or the shader does not compile.  */
+int initClusteredLighting(ClusteredLighting* lighting);
+
+/*  Transforms the lights to view coordinates, assigns them to clusters and
+    uploads the result.  The view is the viewing transform and the projection
+    used for the frame, as for gluPerspective(), and the size of the viewport.
+    At most MAX_POINT_LIGHTS lights are used.  */
+void updateClusteredLighting(ClusteredLighting* lighting, const PointLight* lights, int count,
+                             const float* viewMatrix, float fovy, float aspect, float zNear, float zFar,
+                             int viewportWidth, int viewportHeight);
+
+/*  Sets the key light, a point light that is handled apart from the clusters
+    so that it can have shadows, or turns it off if light is NULL.  viewMatrix
+    is the viewing transform for the frame.  For shadows, shadowTexture is the
+    depth texture of a ShadowMap and shadowMatrix comes from getShadowMatrix();
+    pass 0 and NULL for none.  */
+void setKeyLight(ClusteredLighting* lighting, const PointLight* light, const float* viewMatrix,
+                 GLuint shadowTexture, const float* shadowMatrix);
+
+/*  Sets the cube map that reflective materials reflect, such as one loaded
+    with loadCubeMap() from texture.c, or turns reflections off if
+    environmentMap is 0.  viewMatrix is the viewing transform for the frame;
+    the map is looked up with directions in world coordinates.  */
+void setEnvironmentMap(ClusteredLighting* lighting, GLuint environmentMap, const float* viewMatrix);
+
+/*  Makes the shader write its colors for the transparent pass of
+    transparency.c, between beginTransparency() and endTransparency(), or,
+    if transparent is 0, to the framebuffer as usual.  The change takes
+    effect at the next useClusteredLighting().  */
+void setTransparentLighting(ClusteredLighting* lighting, int transparent);
+
+/*  Makes the shader program current and binds the light data to texture units
+    1, 2 and 3, the shadow map to unit 4 and the environment map to unit 5.
+    The materials must already be in a buffer made by createMaterialBuffer().
+    Call glUseProgram(0) to go back to fixed-function drawing.  */
+void useClusteredLighting(const ClusteredLighting* lighting);
+
+#endif
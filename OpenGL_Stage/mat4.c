@@ -0,0 +1,148 @@
+#include <math.h>
+#include <string.h>
+#include "mat4.h"
+
+void mat4Identity(float* m) {
+    int i;
+    for (i = 0; i < 16; i++)
+        m[i] = (i % 5 == 0) ? 1 : 0;
+}
+
+void mat4Multiply(float* result, const float* a, const float* b) {
+    float product[16];
+    int row, col, k;
+    for (col = 0; col < 4; col++)
+        for (row = 0; row < 4; row++) {
+            float sum = 0;
+            for (k = 0; k < 4; k++)
+                sum += a[k*4+row] * b[col*4+k];
+            product[col*4+row] = sum;
+        }
+    memcpy(result, product, sizeof(product));
+}
+
+void mat4Translation(float* m, float x, float y, float z) {
+    mat4Identity(m);
+    m[12] = x;
+    m[13] = y;
+    m[14] = z;
+}
+
+void mat4Scaling(float* m, float x, float y, float z) {
+    mat4Identity(m);
+    m[0] = x;
+    m[5] = y;
+    m[10] = z;
+}
+
+void mat4Rotation(float* m, float angle, float x, float y, float z) {
+    float length = sqrtf(x*x + y*y + z*z);
+    float radians = angle * (float)M_PI / 180;
+    float c = cosf(radians), s = sinf(radians), t = 1 - c;
+    mat4Identity(m);
+    if (length == 0)
+        return;
+    x /= length;
+    y /= length;
+    z /= length;
+    m[0] = t*x*x + c;   m[4] = t*x*y - s*z; m[8] = t*x*z + s*y;
+    m[1] = t*x*y + s*z; m[5] = t*y*y + c;   m[9] = t*y*z - s*x;
+    m[2] = t*x*z - s*y; m[6] = t*y*z + s*x; m[10] = t*z*z + c;
+}
+
+static void normalize(float* v) {
+    float length = sqrtf(v[0]*v[0] + v[1]*v[1] + v[2]*v[2]);
+    if (length > 0) {
+        v[0] /= length;
+        v[1] /= length;
+        v[2] /= length;
+    }
+}
+
+static void cross(float* result, const float* a, const float* b) {
+    result[0] = a[1]*b[2] - a[2]*b[1];
+    result[1] = a[2]*b[0] - a[0]*b[2];
+    result[2] = a[0]*b[1] - a[1]*b[0];
+}
+
+void mat4LookAt(float* m, float eyeX, float eyeY, float eyeZ,
+                float centerX, float centerY, float centerZ,
+                float upX, float upY, float upZ) {
+    float f[3] = { centerX - eyeX, centerY - eyeY, centerZ - eyeZ };
+    float up[3] = { upX, upY, upZ };
+    float s[3], u[3];
+    normalize(f);
+    cross(s, f, up);
+    normalize(s);
+    cross(u, s, f);
+    mat4Identity(m);
+    m[0] = s[0];  m[4] = s[1];  m[8] = s[2];
+    m[1] = u[0];  m[5] = u[1];  m[9] = u[2];
+    m[2] = -f[0]; m[6] = -f[1]; m[10] = -f[2];
+    m[12] = -(s[0]*eyeX + s[1]*eyeY + s[2]*eyeZ);
+    m[13] = -(u[0]*eyeX + u[1]*eyeY + u[2]*eyeZ);
+    m[14] = f[0]*eyeX + f[1]*eyeY + f[2]*eyeZ;
+}
+
+void mat4Perspective(float* m, float fovy, float aspect, float zNear, float zFar) {
+    float f = 1 / tanf(fovy * (float)M_PI / 360);
+    memset(m, 0, 16*sizeof(float));
+    m[0] = f / aspect;
+    m[5] = f;
+    m[10] = (zFar + zNear) / (zNear - zFar);
+    m[11] = -1;
+    m[14] = 2*zFar*zNear / (zNear - zFar);
+}
+
+void mat4PlaceObject(float* m, float x, float y, float z, float yAngle, float s) {
+    float radians = yAngle * (float)M_PI / 180;
+    float c = cosf(radians) * s, sn = sinf(radians) * s;
+    memset(m, 0, 16*sizeof(float));
+    m[0] = c;   m[8] = sn;
+    m[5] = s;
+    m[2] = -sn; m[10] = c;
+    m[12] = x;  m[13] = y; m[14] = z;
+    m[15] = 1;
+}
+
+void mat4TransformPoint(const float* m, const float* point, float* result) {
+    float x = point[0], y = point[1], z = point[2];
+    result[0] = m[0]*x + m[4]*y + m[8]*z + m[12];
+    result[1] = m[1]*x + m[5]*y + m[9]*z + m[13];
+    result[2] = m[2]*x + m[6]*y + m[10]*z + m[14];
+}
+
+void mat4ViewToWorldRotation(float* result, const float* m) {
+    int row, column;
+    // The rotation of the view is orthogonal, so its inverse is its transpose.
+    for (column = 0; column < 3; column++)
+        for (row = 0; row < 3; row++)
+            result[column*3 + row] = m[row*4 + column];
+}
+
+int mat4Invert(float* result, const float* m) {
+    float inv[16], det;
+    int i;
+    inv[0] = m[5]*m[10]*m[15] - m[5]*m[11]*m[14] - m[9]*m[6]*m[15] + m[9]*m[7]*m[14] + m[13]*m[6]*m[11] - m[13]*m[7]*m[10];
+    inv[4] = -m[4]*m[10]*m[15] + m[4]*m[11]*m[14] + m[8]*m[6]*m[15] - m[8]*m[7]*m[14] - m[12]*m[6]*m[11] + m[12]*m[7]*m[10];
+    inv[8] = m[4]*m[9]*m[15] - m[4]*m[11]*m[13] - m[8]*m[5]*m[15] + m[8]*m[7]*m[13] + m[12]*m[5]*m[11] - m[12]*m[7]*m[9];
+    inv[12] = -m[4]*m[9]*m[14] + m[4]*m[10]*m[13] + m[8]*m[5]*m[14] - m[8]*m[6]*m[13] - m[12]*m[5]*m[10] + m[12]*m[6]*m[9];
+    inv[1] = -m[1]*m[10]*m[15] + m[1]*m[11]*m[14] + m[9]*m[2]*m[15] - m[9]*m[3]*m[14] - m[13]*m[2]*m[11] + m[13]*m[3]*m[10];
+    inv[5] = m[0]*m[10]*m[15] - m[0]*m[11]*m[14] - m[8]*m[2]*m[15] + m[8]*m[3]*m[14] + m[12]*m[2]*m[11] - m[12]*m[3]*m[10];
+    inv[9] = -m[0]*m[9]*m[15] + m[0]*m[11]*m[13] + m[8]*m[1]*m[15] - m[8]*m[3]*m[13] - m[12]*m[1]*m[11] + m[12]*m[3]*m[9];
+    inv[13] = m[0]*m[9]*m[14] - m[0]*m[10]*m[13] - m[8]*m[1]*m[14] + m[8]*m[2]*m[13] + m[12]*m[1]*m[10] - m[12]*m[2]*m[9];
+    inv[2] = m[1]*m[6]*m[15] - m[1]*m[7]*m[14] - m[5]*m[2]*m[15] + m[5]*m[3]*m[14] + m[13]*m[2]*m[7] - m[13]*m[3]*m[6];
+    inv[6] = -m[0]*m[6]*m[15] + m[0]*m[7]*m[14] + m[4]*m[2]*m[15] - m[4]*m[3]*m[14] - m[12]*m[2]*m[7] + m[12]*m[3]*m[6];
+    inv[10] = m[0]*m[5]*m[15] - m[0]*m[7]*m[13] - m[4]*m[1]*m[15] + m[4]*m[3]*m[13] + m[12]*m[1]*m[7] - m[12]*m[3]*m[5];
+    inv[14] = -m[0]*m[5]*m[14] + m[0]*m[6]*m[13] + m[4]*m[1]*m[14] - m[4]*m[2]*m[13] - m[12]*m[1]*m[6] + m[12]*m[2]*m[5];
+    inv[3] = -m[1]*m[6]*m[11] + m[1]*m[7]*m[10] + m[5]*m[2]*m[11] - m[5]*m[3]*m[10] - m[9]*m[2]*m[7] + m[9]*m[3]*m[6];
+    inv[7] = m[0]*m[6]*m[11] - m[0]*m[7]*m[10] - m[4]*m[2]*m[11] + m[4]*m[3]*m[10] + m[8]*m[2]*m[7] - m[8]*m[3]*m[6];
+    inv[11] = -m[0]*m[5]*m[11] + m[0]*m[7]*m[9] + m[4]*m[1]*m[11] - m[4]*m[3]*m[9] - m[8]*m[1]*m[7] + m[8]*m[3]*m[5];
+    inv[15] = m[0]*m[5]*m[10] - m[0]*m[6]*m[9] - m[4]*m[1]*m[10] + m[4]*m[2]*m[9] + m[8]*m[1]*m[6] - m[8]*m[2]*m[5];
+    det = m[0]*inv[0] + m[1]*inv[4] + m[2]*inv[8] + m[3]*inv[12];
+    if (det == 0)
+        return 0;
+    for (i = 0; i < 16; i++)
+        result[i] = inv[i] / det;
+    return 1;
+}
@@ -0,0 +1,41 @@
+/*  Header file for mat4.c, which has a few functions for 4x4 transformation
+    matrices.  A matrix is an array of 16 floats in column-major order, the
+    same layout that OpenGL uses, so the result of any of these functions can
+    be passed directly to glLoadMatrixf() or glMultMatrixf().  Angles are in
+    degrees, as they are for glRotatef().  */
+
+#ifndef MAT4_H
+#define MAT4_H
+
+void mat4Identity(float* m);
+
+//  Sets result to a*b.  result may be the same array as a or b.
+void mat4Multiply(float* result, const float* a, const float* b);
+
+//  The matrices that glTranslatef(), glScalef() and glRotatef() would multiply by.
+void mat4Translation(float* m, float x, float y, float z);
+void mat4Scaling(float* m, float x, float y, float z);
+void mat4Rotation(float* m, float angle, float x, float y, float z);
+
+//  The matrices that gluLookAt() and gluPerspective() would multiply by.
+void mat4LookAt(float* m, float eyeX, float eyeY, float eyeZ,
+                float centerX, float centerY, float centerZ,
+                float upX, float upY, float upZ);
+void mat4Perspective(float* m, float fovy, float aspect, float zNear, float zFar);
+
+/*  Sets m to translate(x,y,z) * rotate(yAngle about the y-axis) * scale(s),
+    the usual transform for an object placed on the stage.  */
+void mat4PlaceObject(float* m, float x, float y, float z, float yAngle, float s);
+
+//  Transforms the point (x,y,z,1) by m and stores x, y and z of the result.
+void mat4TransformPoint(const float* m, const float* point, float* result);
+
+/*  Sets result to the 3x3 matrix, column-major, that takes directions from
+    the eye coordinates of the viewing transform m back to world coordinates,
+    as for looking up a cube map.  m must be a rotation and a translation.  */
+void mat4ViewToWorldRotation(float* result, const float* m);
+
+//  Sets result to the inverse of m; returns 0 if m is singular.
+int mat4Invert(float* result, const float* m);
+
+#endif
@@ -0,0 +1,49 @@
+#include <string.h>
+#include "materials.h"
+
+/*  Copies rows of the table into the std140 layout of the uniform block.  */
+static void packMaterials(float* packed, float materials[][MATERIAL_FLOATS], int count) {
+    int i;
+    for (i = 0; i < count; i++) {
+        float* row = &packed[i * MATERIAL_VEC4S * 4];
+        memcpy(row, materials[i], 12*sizeof(float));
+        row[12] = materials[i][12];
+        row[13] = materials[i][13];
+        row[14] = row[15] = 0;
+    }
+}
+
+GLuint createMaterialBuffer(float materials[][MATERIAL_FLOATS], int count) {
+    float packed[MAX_MATERIALS * MATERIAL_VEC4S * 4];
+    GLuint buffer;
+    if ( ! hasGLVersion(3, 1) )
+        return 0;
+    if (count > MAX_MATERIALS)
+        count = MAX_MATERIALS;
+    memset(packed, 0, sizeof(packed));
+    packMaterials(packed, materials, count);
+    glGenBuffers(1, &buffer);
+    glBindBuffer(GL_UNIFORM_BUFFER, buffer);
+    glBufferData(GL_UNIFORM_BUFFER, sizeof(packed), packed, GL_STATIC_DRAW);
+    glBindBuffer(GL_UNIFORM_BUFFER, 0);
+    glBindBufferBase(GL_UNIFORM_BUFFER, MATERIAL_BINDING, buffer);
+    return buffer;
+}
+
+void updateMaterialBuffer(GLuint buffer, float materials[][MATERIAL_FLOATS], int first, int count) {
+    float packed[MAX_MATERIALS * MATERIAL_VEC4S * 4];
+    int rowSize = MATERIAL_VEC4S * 4 * sizeof(float);
+    if (first < 0 || first + count > MAX_MATERIALS || count <= 0)
+        return;
+    packMaterials(packed, materials + first, count);
+    glBindBuffer(GL_UNIFORM_BUFFER, buffer);
+    glBufferSubData(GL_UNIFORM_BUFFER, first * rowSize, count * rowSize, packed);
+    glBindBuffer(GL_UNIFORM_BUFFER, 0);
+}
+
+GLint useMaterialBlock(GLuint program) {
+    GLuint block = glGetUniformBlockIndex(program, "Materials");
+    if (block != GL_INVALID_INDEX)
+        glUniformBlockBinding(program, block, MATERIAL_BINDING);
+    return glGetAttribLocation(program, MATERIAL_ATTRIBUTE);
+}
@@ -0,0 +1,63 @@
+/*  Header file for materials.c, which puts a table of materials into a
+    uniform buffer, so that shaders can look a material up by its number.
+
+    The table has the layout of the materials array in code.c: each row holds
+    an ambient color (items 0 to 3), a diffuse color (4 to 7), a specular
+    color (8 to 11), a shininess (12) and a reflectivity (13), the fraction
+    of the color that comes from the environment map, if there is one; 0
+    for a material that reflects nothing.  In the buffer, a material takes
+    MATERIAL_VEC4S vec4s, in std140 layout.
+
+    The whole table is uploaded once.  An object then picks its material with
+    the generic vertex attribute named by MATERIAL_ATTRIBUTE, either as the
+    current attribute value for a whole draw call (glVertexAttribI1i()) or
+    from an array, with a divisor of 1 for instanced drawing.  Changing the
+    material is then just setting one integer, and objects with different
+    materials can be drawn together.
+
+    Requires OpenGL 3.1 (for uniform buffers).  */
+
+#ifndef MATERIALS_H
+#define MATERIALS_H
+
+#include "shader.h"
+
+#define MAX_MATERIALS 64
+#define MATERIAL_FLOATS 14     // the length of a row of the table
+#define MATERIAL_VEC4S 4       // ambient, diffuse, specular, (shininess, reflectivity, 0, 0)
+#define MATERIAL_BINDING 0     // the uniform buffer binding point used for the table
+
+#define MATERIAL_STRING(x) #x
+#define MATERIAL_VALUE_STRING(x) MATERIAL_STRING(x)
+
+/*  GLSL declarations for a shader that uses the table: the uniform block and
+    a function that fetches one row.  Paste it into the shader source after
+    the #version line.  */
+#define MATERIAL_GLSL \
+    "layout(std140) uniform Materials {\n" \
+    "    vec4 u_materials[" MATERIAL_VALUE_STRING(MAX_MATERIALS) " * " MATERIAL_VALUE_STRING(MATERIAL_VEC4S) "];\n" \
+    "};\n" \
+    "struct Material { vec4 ambient, diffuse, specular; float shininess, reflectivity; };\n" \
+    "Material getMaterial(int m) {\n" \
+    "    int i = m * " MATERIAL_VALUE_STRING(MATERIAL_VEC4S) ";\n" \
+    "    return Material(u_materials[i], u_materials[i+1], u_materials[i+2], u_materials[i+3].x, u_materials[i+3].y);\n" \
+    "}\n"
+
+//  The name of the vertex shader input, an int, that holds the material number.
+#define MATERIAL_ATTRIBUTE "a_material"
+
+/*  Uploads count rows of the table into a new uniform buffer and binds it to
+    MATERIAL_BINDING.  At most MAX_MATERIALS rows are used.  Returns the
+    buffer, or 0 if the OpenGL version is too old.  */
+GLuint createMaterialBuffer(float materials[][MATERIAL_FLOATS], int count);
+
+/*  Replaces rows first to first+count-1 of the table in the buffer, for a
+    material that changes after the table has been created.  */
+void updateMaterialBuffer(GLuint buffer, float materials[][MATERIAL_FLOATS], int first, int count);
+
+/*  Connects the Materials block of a program, which must include
+    MATERIAL_GLSL, to the table, and returns the location of the
+    MATERIAL_ATTRIBUTE input (-1 if the program does not use it).  */
+GLint useMaterialBlock(GLuint program);
+
+#endif
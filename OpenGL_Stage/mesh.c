@@ -0,0 +1,146 @@
+#include <stdlib.h>
+#include <math.h>
+#include "mesh.h"
+
+/*  The faces of the models in polyhedron.c are not all listed in the same
+    order, so the triangles first to end-1, which are the fan of one face, are
+    reversed if they wind clockwise as seen from the side the face's normal
+    points to.  That way, the front of every triangle is the side the normal
+    is on, as OpenGL expects.  */
+static void orientFan(TriMesh* mesh, int first, int end, const double* normal) {
+    const unsigned int* tri = &mesh->indices[3*first];
+    const float* a = &mesh->positions[3*tri[0]];
+    const float* b = &mesh->positions[3*tri[1]];
+    const float* c = &mesh->positions[3*tri[2]];
+    double u[3] = { b[0]-a[0], b[1]-a[1], b[2]-a[2] };
+    double v[3] = { c[0]-a[0], c[1]-a[1], c[2]-a[2] };
+    double turn = (u[1]*v[2] - u[2]*v[1]) * normal[0] + (u[2]*v[0] - u[0]*v[2]) * normal[1]
+                + (u[0]*v[1] - u[1]*v[0]) * normal[2];
+    int t;
+    if (first >= end || turn >= 0)
+        return;
+    for (t = first; t < end; t++) {
+        unsigned int swap = mesh->indices[3*t+1];
+        mesh->indices[3*t+1] = mesh->indices[3*t+2];
+        mesh->indices[3*t+2] = swap;
+    }
+}
+
+TriMesh compilePolyhedron(Polyhedron poly) {
+    TriMesh mesh;
+    int i, j, corners = 0, triangles = 0;
+
+    // First pass: count the corners and the fan triangles of every face.
+    j = 0;
+    for (i = 0; i < poly.faceCount; i++) {
+        int n = 0;
+        while (poly.faces[j] != -1) {
+            n++;
+            j++;
+        }
+        j++;  // skip the -1 that ends the face
+        corners += n;
+        if (n >= 3)
+            triangles += n - 2;
+    }
+
+    mesh.vertexCount = corners;
+    mesh.triangleCount = triangles;
+    mesh.positions = malloc( corners*3*sizeof(float) );
+    mesh.normals = malloc( corners*3*sizeof(float) );
+    mesh.colors = poly.faceColors ? malloc( corners*3*sizeof(float) ) : NULL;
+    mesh.indices = malloc( triangles*3*sizeof(unsigned int) );
+
+    // Second pass: copy one vertex per face corner and emit the fan.
+    int v = 0, t = 0;
+    j = 0;
+    for (i = 0; i < poly.faceCount; i++) {
+        int first = v, firstTriangle = t;
+        while (poly.faces[j] != -1) {
+            int vertexNum = poly.faces[j];
+            int k;
+            for (k = 0; k < 3; k++) {
+                mesh.positions[3*v+k] = (float)poly.vertices[3*vertexNum+k];
+                mesh.normals[3*v+k] = (float)poly.normals[3*i+k];
+                if (mesh.colors)
+                    mesh.colors[3*v+k] = (float)poly.faceColors[3*i+k];
+            }
+            if (v - first >= 2) {
+                mesh.indices[3*t] = first;
+                mesh.indices[3*t+1] = v - 1;
+                mesh.indices[3*t+2] = v;
+                t++;
+            }
+            v++;
+            j++;
+        }
+        j++;
+        orientFan(&mesh, firstTriangle, t, &poly.normals[3*i]);
+    }
+    return mesh;
+}
+
+TriMesh compilePolyhedronSmooth(Polyhedron poly) {
+    TriMesh mesh;
+    int i, j, k, triangles = 0;
+
+    j = 0;
+    for (i = 0; i < poly.faceCount; i++) {
+        int n = 0;
+        while (poly.faces[j] != -1) {
+            n++;
+            j++;
+        }
+        j++;
+        if (n >= 3)
+            triangles += n - 2;
+    }
+
+    mesh.vertexCount = poly.vertexCount;
+    mesh.triangleCount = triangles;
+    mesh.positions = malloc( poly.vertexCount*3*sizeof(float) );
+    mesh.normals = calloc( poly.vertexCount*3, sizeof(float) );
+    mesh.colors = NULL;
+    mesh.indices = malloc( triangles*3*sizeof(unsigned int) );
+    for (i = 0; i < poly.vertexCount*3; i++)
+        mesh.positions[i] = (float)poly.vertices[i];
+
+    int t = 0;
+    j = 0;
+    for (i = 0; i < poly.faceCount; i++) {
+        int first = j, firstTriangle = t;
+        while (poly.faces[j] != -1) {
+            int vertexNum = poly.faces[j];
+            for (k = 0; k < 3; k++)
+                mesh.normals[3*vertexNum+k] += (float)poly.normals[3*i+k];
+            if (j - first >= 2) {
+                mesh.indices[3*t] = poly.faces[first];
+                mesh.indices[3*t+1] = poly.faces[j-1];
+                mesh.indices[3*t+2] = vertexNum;
+                t++;
+            }
+            j++;
+        }
+        j++;
+        orientFan(&mesh, firstTriangle, t, &poly.normals[3*i]);
+    }
+
+    for (i = 0; i < mesh.vertexCount; i++) {
+        float* n = &mesh.normals[3*i];
+        float length = sqrtf( n[0]*n[0] + n[1]*n[1] + n[2]*n[2] );
+        if (length > 0)
+            for (k = 0; k < 3; k++)
+                n[k] /= length;
+    }
+    return mesh;
+}
+
+void freeTriMesh(TriMesh* mesh) {
+    free(mesh->positions);
+    free(mesh->normals);
+    free(mesh->colors);
+    free(mesh->indices);
+    mesh->positions = mesh->normals = mesh->colors = NULL;
+    mesh->indices = NULL;
+    mesh->vertexCount = mesh->triangleCount = 0;
+}
@@ -0,0 +1,54 @@
+/*  Header file for TriMesh, a "compiled" triangle mesh.  A Polyhedron
+    stores faces as variable-length polygons with one normal per face,
+    which is convenient for describing a model but has to be drawn one
+    glBegin()/glEnd() pair per face.  A TriMesh stores the same model as
+    plain triangles over a shared vertex list, so that it can be drawn
+    with a single glDrawElements() call.
+
+    A TriMesh is a struct with the following fields.  */
+
+#ifndef MESH_H
+#define MESH_H
+
+#include "polyhedron.h"
+
+//  Data type for compiled triangle meshes.
+typedef struct TriMesh {
+
+    // Number of vertices in the mesh.
+    int vertexCount;
+    // Number of triangles in the mesh.
+    int triangleCount;
+
+    // Array of vertex coordinates, 3 numbers per vertex; length = vertexCount*3
+    float* positions;
+
+    // Array of vertex normals, 3 numbers per vertex; length = vertexCount*3
+    float* normals;
+
+    /*  Can be NULL.  Otherwise, an array of RGB colors, 3 numbers per vertex;
+    length = vertexCount*3.  */
+    float* colors;
+
+    /*  Array of vertex numbers, 3 for each triangle; length = triangleCount*3.
+    The data for triangle n is at index 3*n.  */
+    unsigned int* indices;
+
+} TriMesh;
+
+/*  Compiles a polyhedron into a triangle mesh.  Each face is split into a fan
+    of triangles, wound counterclockwise as seen from the side that the face's
+    normal points to.  Since the polyhedron has one normal per face, every corner of
+    every face gets its own vertex; use weldVertices() from meshopt.h to merge
+    the copies that turn out to be identical.  */
+TriMesh compilePolyhedron(Polyhedron poly);
+
+/*  Compiles a polyhedron into a smooth-shaded triangle mesh.  The mesh has the
+    same vertices as the polyhedron, and the normal at each vertex is the average
+    of the normals of the faces around it.  The face colors are not used.  */
+TriMesh compilePolyhedronSmooth(Polyhedron poly);
+
+//  Frees the arrays of a mesh and sets its counts to zero.
+void freeTriMesh(TriMesh* mesh);
+
+#endif
@@ -0,0 +1,58 @@
+#include "meshbuffer.h"
+
+static GLuint createBuffer(GLenum target, int size, const void* data) {
+    GLuint buffer;
+    glGenBuffers(1, &buffer);
+    glBindBuffer(target, buffer);
+    glBufferData(target, size, data, GL_STATIC_DRAW);
+    glBindBuffer(target, 0);
+    return buffer;
+}
+
+void uploadTriMesh(MeshBuffer* buffer, const TriMesh* mesh) {
+    int vertexBytes = mesh->vertexCount*3*sizeof(float);
+    buffer->vertexCount = mesh->vertexCount;
+    buffer->indexCount = mesh->triangleCount*3;
+    buffer->positionBuffer = createBuffer(GL_ARRAY_BUFFER, vertexBytes, mesh->positions);
+    buffer->normalBuffer = createBuffer(GL_ARRAY_BUFFER, vertexBytes, mesh->normals);
+    buffer->colorBuffer = mesh->colors ? createBuffer(GL_ARRAY_BUFFER, vertexBytes, mesh->colors) : 0;
+    buffer->indexBuffer = createBuffer(GL_ELEMENT_ARRAY_BUFFER, buffer->indexCount*sizeof(unsigned int),
+                                       mesh->indices);
+}
+
+void freeMeshBuffer(MeshBuffer* buffer) {
+    GLuint buffers[4] = { buffer->positionBuffer, buffer->normalBuffer, buffer->colorBuffer,
+                          buffer->indexBuffer };
+    glDeleteBuffers(4, buffers);  // (Zeros are ignored.)
+    buffer->positionBuffer = buffer->normalBuffer = buffer->colorBuffer = buffer->indexBuffer = 0;
+    buffer->vertexCount = buffer->indexCount = 0;
+}
+
+void bindMeshBufferPositions(const MeshBuffer* buffer) {
+    glBindBuffer(GL_ARRAY_BUFFER, buffer->positionBuffer);
+    glVertexPointer(3, GL_FLOAT, 0, 0);
+    glEnableClientState(GL_VERTEX_ARRAY);
+    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, buffer->indexBuffer);
+}
+
+void unbindMeshBuffer() {
+    glDisableClientState(GL_VERTEX_ARRAY);
+    glBindBuffer(GL_ARRAY_BUFFER, 0);
+    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, 0);
+}
+
+void drawMeshBuffer(const MeshBuffer* buffer) {
+    bindMeshBufferPositions(buffer);
+    glBindBuffer(GL_ARRAY_BUFFER, buffer->normalBuffer);
+    glNormalPointer(GL_FLOAT, 0, 0);
+    glEnableClientState(GL_NORMAL_ARRAY);
+    if (buffer->colorBuffer) {
+        glBindBuffer(GL_ARRAY_BUFFER, buffer->colorBuffer);
+        glColorPointer(3, GL_FLOAT, 0, 0);
+        glEnableClientState(GL_COLOR_ARRAY);
+    }
+    glDrawElements(GL_TRIANGLES, buffer->indexCount, GL_UNSIGNED_INT, 0);
+    glDisableClientState(GL_COLOR_ARRAY);
+    glDisableClientState(GL_NORMAL_ARRAY);
+    unbindMeshBuffer();
+}
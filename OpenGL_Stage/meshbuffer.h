@@ -0,0 +1,41 @@
+/*  Header file for meshbuffer.c, which copies a compiled TriMesh into OpenGL
+    buffer objects.  Drawing from buffers saves sending the vertex data to
+    the GPU again for every draw call, and a shader can draw many copies of a
+    buffered mesh with a single instanced draw call.
+
+    Requires OpenGL 1.5 (for buffer objects).  */
+
+#ifndef MESHBUFFER_H
+#define MESHBUFFER_H
+
+#include "shader.h"
+#include "mesh.h"
+
+//  The buffers that hold one mesh.
+typedef struct MeshBuffer {
+    GLuint positionBuffer;  // 3 floats per vertex
+    GLuint normalBuffer;    // 3 floats per vertex
+    GLuint colorBuffer;     // 3 floats per vertex, or 0 if the mesh has no colors
+    GLuint indexBuffer;     // unsigned ints, 3 per triangle
+    int vertexCount;
+    int indexCount;
+} MeshBuffer;
+
+//  Creates the buffers for a mesh and uploads its data.
+void uploadTriMesh(MeshBuffer* buffer, const TriMesh* mesh);
+
+//  Deletes the buffers and sets all of the fields to 0.
+void freeMeshBuffer(MeshBuffer* buffer);
+
+/*  Draws the mesh with a single glDrawElements() call, using the standard
+    vertex, normal and color arrays, as for fixed-function drawing or for a
+    shader that reads gl_Vertex and gl_Normal.  */
+void drawMeshBuffer(const MeshBuffer* buffer);
+
+/*  Makes the mesh's positions the vertex array and binds its index buffer,
+    for callers that set up more arrays of their own before drawing, such as
+    per-instance attributes.  Call unbindMeshBuffer() when done.  */
+void bindMeshBufferPositions(const MeshBuffer* buffer);
+void unbindMeshBuffer();
+
+#endif
@@ -0,0 +1,83 @@
+/**
+ * Converts a three.js JSON model of format 3, such as
+ * ../Three.js_Ride/resources/horse.js, into a mesh file of morphmesh.c,
+ * then reads the mesh file back, checks that it matches, and reports how
+ * long the JSON and the mesh file take to read.  Usage:
+ *
+ *        meshconvert model.js model.mesh
+ *
+ * Compile with
+ *
+ *        gcc -O2 -o meshconvert meshconvert.c jsonmodel.c morphmesh.c mesh.c meshopt.c -lm
+ */
+
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+#include "jsonmodel.h"
+#include "morphmesh.h"
+#include "meshopt.h"
+
+static double now() {
+    struct timespec t;
+    clock_gettime(CLOCK_MONOTONIC, &t);
+    return t.tv_sec + t.tv_nsec * 1e-9;
+}
+
+static int sameFloats(const float* a, const float* b, int count) {
+    return (a == NULL) == (b == NULL) && ( ! a || memcmp(a, b, count*sizeof(float)) == 0 );
+}
+
+//  Checks that the mesh read from the file is the one that was written.
+static int sameMorphMesh(const MorphMesh* a, const MorphMesh* b) {
+    int size = a->mesh.vertexCount*3, f;
+    if (a->mesh.vertexCount != b->mesh.vertexCount || a->mesh.triangleCount != b->mesh.triangleCount
+            || a->frameCount != b->frameCount)
+        return 0;
+    if ( ! sameFloats(a->mesh.positions, b->mesh.positions, size)
+            || ! sameFloats(a->mesh.normals, b->mesh.normals, size)
+            || ! sameFloats(a->mesh.colors, b->mesh.colors, size)
+            || memcmp(a->mesh.indices, b->mesh.indices, a->mesh.triangleCount*3*sizeof(unsigned int)) != 0 )
+        return 0;
+    for (f = 0; f < a->frameCount; f++)
+        if (strcmp(a->frameNames[f], b->frameNames[f]) != 0)
+            return 0;
+    return sameFloats(a->framePositions, b->framePositions, a->frameCount*size)
+           && sameFloats(a->frameNormals, b->frameNormals, a->frameCount*size);
+}
+
+int main(int argc, char** argv) {
+    JsonModel model;
+    MorphMesh morph, check;
+    double start, parseTime, compileTime, readTime;
+    int ok;
+    if (argc != 3) {
+        printf("Usage: %s model.js model.mesh\n", argv[0]);
+        return 1;
+    }
+    start = now();
+    if ( ! readJsonModel(argv[1], &model) )
+        return 1;
+    parseTime = now() - start;
+    start = now();
+    morph = compileJsonModel(&model);
+    compileTime = now() - start;
+    printf("%s: %d vertices, %d faces, %d morph targets, %s\n", argv[1], model.poly.vertexCount,
+           model.poly.faceCount, model.morphCount, model.poly.faceColors ? "face colors" : "no colors");
+    printf("Mesh: %d triangles, ACMR %.3f\n", morph.mesh.triangleCount,
+           computeACMR(&morph.mesh, MESHOPT_ACMR_CACHE_SIZE));
+    if ( ! writeMorphMesh(argv[2], &morph) )
+        return 1;
+    start = now();
+    if ( ! readMorphMesh(argv[2], &check) )
+        return 1;
+    readTime = now() - start;
+    ok = sameMorphMesh(&morph, &check);
+    printf("Reading the JSON took %.2f ms and compiling it %.2f ms; reading %s took %.2f ms.\n",
+           parseTime*1000, compileTime*1000, argv[2], readTime*1000);
+    printf(ok ? "The mesh file matches.\n" : "The mesh file does NOT match!\n");
+    freeMorphMesh(&check);
+    freeMorphMesh(&morph);
+    freeJsonModel(&model);
+    return ok ? 0 : 1;
+}
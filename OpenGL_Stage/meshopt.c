@@ -0,0 +1,308 @@
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include "meshopt.h"
+
+// ------------------------------ vertex welding ------------------------------
+
+static unsigned int hashCell(int x, int y, int z) {
+    return (unsigned int)x*73856093u ^ (unsigned int)y*19349663u ^ (unsigned int)z*83492791u;
+}
+
+static int closeEnough(const float* a, const float* b, float epsilon) {
+    return fabsf(a[0]-b[0]) <= epsilon && fabsf(a[1]-b[1]) <= epsilon && fabsf(a[2]-b[2]) <= epsilon;
+}
+
+/*  Vertices k and i are the same if all of their attributes match.  */
+static int sameVertex(const TriMesh* mesh, int k, int i, float epsilon) {
+    if ( ! closeEnough(&mesh->positions[3*k], &mesh->positions[3*i], epsilon) )
+        return 0;
+    if ( ! closeEnough(&mesh->normals[3*k], &mesh->normals[3*i], epsilon) )
+        return 0;
+    if ( mesh->colors && ! closeEnough(&mesh->colors[3*k], &mesh->colors[3*i], epsilon) )
+        return 0;
+    return 1;
+}
+
+int weldVertices(TriMesh* mesh, float epsilon) {
+    int n = mesh->vertexCount;
+    int tableSize = 1;
+    while (tableSize < 2*n)
+        tableSize *= 2;
+
+    // The hash is on grid cells of size epsilon, so a matching vertex is always
+    // in the same cell or one of the 26 cells around it.
+    float cellSize = epsilon > 0 ? epsilon : 1e-6f;
+    int* head = malloc( tableSize*sizeof(int) );
+    int* next = malloc( n*sizeof(int) );
+    int* cells = malloc( n*3*sizeof(int) );
+    int* remap = malloc( n*sizeof(int) );
+    int i, k, kept = 0;
+    for (i = 0; i < tableSize; i++)
+        head[i] = -1;
+
+    for (i = 0; i < n; i++) {
+        int c[3], dx, dy, dz, found = -1;
+        for (k = 0; k < 3; k++)
+            c[k] = (int)floorf(mesh->positions[3*i+k] / cellSize);
+        for (dx = -1; dx <= 1 && found < 0; dx++)
+            for (dy = -1; dy <= 1 && found < 0; dy++)
+                for (dz = -1; dz <= 1 && found < 0; dz++) {
+                    int x = c[0]+dx, y = c[1]+dy, z = c[2]+dz;
+                    for (k = head[hashCell(x,y,z) & (tableSize-1)]; k != -1; k = next[k]) {
+                        if (cells[3*k] == x && cells[3*k+1] == y && cells[3*k+2] == z
+                                && sameVertex(mesh, k, i, epsilon)) {
+                            found = k;
+                            break;
+                        }
+                    }
+                }
+        if (found >= 0) {
+            remap[i] = found;
+            continue;
+        }
+        // A new vertex: move it down to the end of the kept vertices.  (Since
+        // kept <= i, this never overwrites a vertex that is still to be read.)
+        for (k = 0; k < 3; k++) {
+            mesh->positions[3*kept+k] = mesh->positions[3*i+k];
+            mesh->normals[3*kept+k] = mesh->normals[3*i+k];
+            if (mesh->colors)
+                mesh->colors[3*kept+k] = mesh->colors[3*i+k];
+            cells[3*kept+k] = c[k];
+        }
+        unsigned int h = hashCell(c[0],c[1],c[2]) & (tableSize-1);
+        next[kept] = head[h];
+        head[h] = kept;
+        remap[i] = kept++;
+    }
+
+    // Remap the triangles, dropping the ones that collapsed.
+    int t, triangles = 0;
+    for (t = 0; t < mesh->triangleCount; t++) {
+        unsigned int a = remap[mesh->indices[3*t]];
+        unsigned int b = remap[mesh->indices[3*t+1]];
+        unsigned int d = remap[mesh->indices[3*t+2]];
+        if (a == b || b == d || a == d)
+            continue;
+        mesh->indices[3*triangles] = a;
+        mesh->indices[3*triangles+1] = b;
+        mesh->indices[3*triangles+2] = d;
+        triangles++;
+    }
+
+    mesh->vertexCount = kept;
+    mesh->triangleCount = triangles;
+    if (kept > 0) {
+        mesh->positions = realloc( mesh->positions, kept*3*sizeof(float) );
+        mesh->normals = realloc( mesh->normals, kept*3*sizeof(float) );
+        if (mesh->colors)
+            mesh->colors = realloc( mesh->colors, kept*3*sizeof(float) );
+    }
+
+    free(head);
+    free(next);
+    free(cells);
+    free(remap);
+    return kept;
+}
+
+// ----------------------- triangle order for the vertex cache -----------------------
+
+#define FORSYTH_CACHE_SIZE 32
+
+/*  The vertex score from Forsyth's article: vertices that were used very
+    recently, and vertices that have few triangles left, are preferred.  */
+static float forsythScore(int cachePosition, int activeTriangles) {
+    float score = 0;
+    if (activeTriangles == 0)
+        return -1;
+    if (cachePosition >= 0) {
+        if (cachePosition < 3)
+            score = 0.75f; // the last triangle's vertices get a fixed score
+        else
+            score = powf(1.0f - (cachePosition - 3) * (1.0f / (FORSYTH_CACHE_SIZE - 3)), 1.5f);
+    }
+    return score + 2.0f / sqrtf((float)activeTriangles);
+}
+
+void optimizeVertexCache(TriMesh* mesh) {
+    int n = mesh->vertexCount, triCount = mesh->triangleCount;
+    int i, k, t;
+    if (triCount <= 0)
+        return;
+
+    // Triangles that use each vertex, as ranges into a single array.
+    int* active = calloc( n, sizeof(int) );
+    int* offsets = malloc( (n+1)*sizeof(int) );
+    int* adjacency = malloc( triCount*3*sizeof(int) );
+    for (i = 0; i < triCount*3; i++)
+        active[mesh->indices[i]]++;
+    offsets[0] = 0;
+    for (i = 0; i < n; i++)
+        offsets[i+1] = offsets[i] + active[i];
+    for (i = 0; i < n; i++)
+        active[i] = 0;
+    for (t = 0; t < triCount; t++)
+        for (k = 0; k < 3; k++) {
+            int v = mesh->indices[3*t+k];
+            adjacency[offsets[v] + active[v]++] = t;
+        }
+
+    int* cachePosition = malloc( n*sizeof(int) );
+    float* vertexScore = malloc( n*sizeof(float) );
+    float* triangleScore = malloc( triCount*sizeof(float) );
+    char* emitted = calloc( triCount, 1 );
+    unsigned int* output = malloc( triCount*3*sizeof(unsigned int) );
+    int cache[FORSYTH_CACHE_SIZE+3], newCache[FORSYTH_CACHE_SIZE+3];
+    int cacheCount = 0;
+
+    for (i = 0; i < n; i++) {
+        cachePosition[i] = -1;
+        vertexScore[i] = forsythScore(-1, active[i]);
+    }
+    int best = 0;
+    for (t = 0; t < triCount; t++) {
+        triangleScore[t] = vertexScore[mesh->indices[3*t]] + vertexScore[mesh->indices[3*t+1]]
+                               + vertexScore[mesh->indices[3*t+2]];
+        if (triangleScore[t] > triangleScore[best])
+            best = t;
+    }
+
+    int emittedCount = 0, cursor = 0;
+    while (emittedCount < triCount) {
+        if (best < 0) {
+            // Nothing in the cache has triangles left; restart from the first
+            // triangle (in input order) that has not been emitted yet.
+            while (emitted[cursor])
+                cursor++;
+            best = cursor;
+        }
+        const unsigned int* tri = &mesh->indices[3*best];
+        emitted[best] = 1;
+        for (k = 0; k < 3; k++) {
+            output[3*emittedCount+k] = tri[k];
+            // Remove this triangle from the vertex's list of active triangles.
+            int v = tri[k], *list = &adjacency[offsets[v]];
+            for (i = 0; i < active[v]; i++)
+                if (list[i] == best) {
+                    list[i] = list[active[v]-1];
+                    break;
+                }
+            active[v]--;
+        }
+        emittedCount++;
+
+        // The triangle's vertices go to the front of the cache, followed by
+        // the previous contents of the cache.
+        int newCount = 0;
+        for (k = 0; k < 3; k++)
+            newCache[newCount++] = tri[k];
+        for (i = 0; i < cacheCount; i++) {
+            int v = cache[i];
+            if (v != (int)tri[0] && v != (int)tri[1] && v != (int)tri[2])
+                newCache[newCount++] = v;
+        }
+        for (i = 0; i < newCount; i++) {
+            int v = newCache[i];
+            cachePosition[v] = i < FORSYTH_CACHE_SIZE ? i : -1;
+            vertexScore[v] = forsythScore(cachePosition[v], active[v]);
+        }
+        cacheCount = newCount < FORSYTH_CACHE_SIZE ? newCount : FORSYTH_CACHE_SIZE;
+        memcpy(cache, newCache, cacheCount*sizeof(int));
+
+        // Rescore the remaining triangles of everything that was in the cache
+        // and pick the best of them.
+        float bestScore = -1;
+        best = -1;
+        for (i = 0; i < newCount; i++) {
+            int v = newCache[i];
+            for (k = 0; k < active[v]; k++) {
+                int u = adjacency[offsets[v]+k];
+                const unsigned int* other = &mesh->indices[3*u];
+                float score = vertexScore[other[0]] + vertexScore[other[1]] + vertexScore[other[2]];
+                triangleScore[u] = score;
+                if (score > bestScore) {
+                    bestScore = score;
+                    best = u;
+                }
+            }
+        }
+    }
+
+    memcpy(mesh->indices, output, triCount*3*sizeof(unsigned int));
+    free(active);
+    free(offsets);
+    free(adjacency);
+    free(cachePosition);
+    free(vertexScore);
+    free(triangleScore);
+    free(emitted);
+    free(output);
+}
+
+// ------------------------ vertex order for fetching ------------------------
+
+static void permute(float** array, const int* newIndex, int oldCount, int newCount) {
+    float* result = malloc( newCount*3*sizeof(float) );
+    int i, k;
+    for (i = 0; i < oldCount; i++)
+        if (newIndex[i] >= 0)
+            for (k = 0; k < 3; k++)
+                result[3*newIndex[i]+k] = (*array)[3*i+k];
+    free(*array);
+    *array = result;
+}
+
+void optimizeVertexFetch(TriMesh* mesh) {
+    int n = mesh->vertexCount;
+    int* newIndex = malloc( n*sizeof(int) );
+    int i, count = 0;
+    for (i = 0; i < n; i++)
+        newIndex[i] = -1;
+    for (i = 0; i < mesh->triangleCount*3; i++) {
+        unsigned int v = mesh->indices[i];
+        if (newIndex[v] < 0)
+            newIndex[v] = count++;
+        mesh->indices[i] = newIndex[v];
+    }
+    permute(&mesh->positions, newIndex, n, count);
+    permute(&mesh->normals, newIndex, n, count);
+    if (mesh->colors)
+        permute(&mesh->colors, newIndex, n, count);
+    mesh->vertexCount = count;
+    free(newIndex);
+}
+
+// --------------------------------- measuring ---------------------------------
+
+double computeACMR(const TriMesh* mesh, int cacheSize) {
+    if (mesh->triangleCount == 0)
+        return 0;
+    // stamp[v] is the value of misses when v was loaded; v is still in the
+    // FIFO if fewer than cacheSize vertices have been loaded since then.
+    int* stamp = malloc( mesh->vertexCount*sizeof(int) );
+    int i, misses = 0;
+    for (i = 0; i < mesh->vertexCount; i++)
+        stamp[i] = -cacheSize - 1;
+    for (i = 0; i < mesh->triangleCount*3; i++) {
+        unsigned int v = mesh->indices[i];
+        if (misses - stamp[v] > cacheSize)
+            stamp[v] = misses++;
+    }
+    free(stamp);
+    return (double)misses / mesh->triangleCount;
+}
+
+MeshOptStats optimizeMesh(TriMesh* mesh, float weldEpsilon) {
+    MeshOptStats stats;
+    stats.vertexCountBefore = mesh->vertexCount;
+    stats.triangleCountBefore = mesh->triangleCount;
+    stats.acmrBefore = computeACMR(mesh, MESHOPT_ACMR_CACHE_SIZE);
+    weldVertices(mesh, weldEpsilon);
+    optimizeVertexCache(mesh);
+    optimizeVertexFetch(mesh);
+    stats.vertexCountAfter = mesh->vertexCount;
+    stats.triangleCountAfter = mesh->triangleCount;
+    stats.acmrAfter = computeACMR(mesh, MESHOPT_ACMR_CACHE_SIZE);
+    return stats;
+}
@@ -0,0 +1,59 @@
+/*  Header file for meshopt.c, which optimizes compiled triangle meshes
+    (see mesh.h) for drawing.  The passes are meant to be run in order:
+
+        weldVertices()         merges duplicate vertices;
+        optimizeVertexCache()  reorders triangles so that the GPU's
+                               post-transform vertex cache gets more hits;
+        optimizeVertexFetch()  renumbers the vertices in the order in
+                               which the triangles use them.
+
+    optimizeMesh() runs all three and reports the effect.  The quality of
+    the triangle order is measured by the ACMR (average cache miss ratio):
+    the number of vertices that have to be transformed per triangle.  It
+    is 3 for a mesh with no vertex reuse and approaches 0.5 for a large,
+    well-ordered regular grid.  */
+
+#ifndef MESHOPT_H
+#define MESHOPT_H
+
+#include "mesh.h"
+
+//  Cache size used by optimizeMesh() when it measures the ACMR.
+#define MESHOPT_ACMR_CACHE_SIZE 16
+
+//  What optimizeMesh() did to a mesh.
+typedef struct MeshOptStats {
+    int vertexCountBefore;
+    int vertexCountAfter;
+    int triangleCountBefore;
+    int triangleCountAfter;
+    double acmrBefore;
+    double acmrAfter;
+} MeshOptStats;
+
+/*  Merges vertices whose positions, normals and colors all agree to within
+    epsilon.  Candidates are found with a spatial hash on the positions, so the
+    cost is linear in the number of vertices.  Triangles that become degenerate
+    are removed.  Returns the new number of vertices.  */
+int weldVertices(TriMesh* mesh, float epsilon);
+
+/*  Reorders the triangles of the mesh for post-transform vertex cache locality,
+    using Tom Forsyth's "linear-speed vertex cache optimisation" scoring.  The
+    vertices themselves are not changed.  */
+void optimizeVertexCache(TriMesh* mesh);
+
+/*  Renumbers the vertices in the order in which they are first used by the
+    index array, so that vertex fetches walk through memory sequentially.
+    Vertices that no triangle uses are dropped.  */
+void optimizeVertexFetch(TriMesh* mesh);
+
+/*  Returns the average cache miss ratio of the mesh, simulating a FIFO
+    vertex cache with the given number of entries.  */
+double computeACMR(const TriMesh* mesh, int cacheSize);
+
+/*  Runs weldVertices(), optimizeVertexCache() and optimizeVertexFetch() on
+    the mesh, in that order, and returns the vertex counts and the ACMR
+    before and after.  */
+MeshOptStats optimizeMesh(TriMesh* mesh, float weldEpsilon);
+
+#endif
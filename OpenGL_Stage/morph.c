@@ -0,0 +1,237 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include "morph.h"
+#include "jobs.h"
+
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+static float* allocateArray(size_t count) {
+    // aligned_alloc() wants the size to be a multiple of the alignment.
+    size_t bytes = (count*sizeof(float) + MORPH_ALIGNMENT - 1) / MORPH_ALIGNMENT * MORPH_ALIGNMENT;
+    float* array = aligned_alloc(MORPH_ALIGNMENT, bytes > 0 ? bytes : MORPH_ALIGNMENT);
+    if (array)
+        memset(array, 0, bytes);
+    return array;
+}
+
+static void cross(double* result, const double* u, const double* v) {
+    result[0] = u[1]*v[2] - u[2]*v[1];
+    result[1] = u[2]*v[0] - u[0]*v[2];
+    result[2] = u[0]*v[1] - u[1]*v[0];
+}
+
+/*  Computes P, Q and R for the pair of frames a and b.  A triangle's edges
+    are (1-t) ea1 + t eb1 and (1-t) ea2 + t eb2, so its normal, their cross
+    product, is (1-t)^2 ea1 x ea2 + t(1-t) (ea1 x eb2 + eb1 x ea2) + t^2 eb1 x eb2,
+    and each vertex adds up those of its triangles.  The sums are done in
+    doubles, since the terms of Q cancel out in part.  */
+static void computePairNormals(MorphAnimator* animator, int a, int b, double* sums) {
+    const float* frameA = &animator->frames[3*a*animator->stride];
+    const float* frameB = &animator->frames[3*b*animator->stride];
+    float* pair = &animator->pairNormals[(size_t)9*a*animator->stride];
+    int stride = animator->stride, i, j, k;
+    memset(sums, 0, (size_t)9*animator->vertexCount*sizeof(double));
+    for (i = 0; i < animator->triangleCount; i++) {
+        const unsigned int* tri = &animator->indices[3*i];
+        double ea1[3], ea2[3], eb1[3], eb2[3], p[3], q1[3], q2[3], r[3];
+        for (k = 0; k < 3; k++) {
+            ea1[k] = (double)frameA[k*stride + tri[1]] - frameA[k*stride + tri[0]];
+            ea2[k] = (double)frameA[k*stride + tri[2]] - frameA[k*stride + tri[0]];
+            eb1[k] = (double)frameB[k*stride + tri[1]] - frameB[k*stride + tri[0]];
+            eb2[k] = (double)frameB[k*stride + tri[2]] - frameB[k*stride + tri[0]];
+        }
+        cross(p, ea1, ea2);
+        cross(q1, ea1, eb2);
+        cross(q2, eb1, ea2);
+        cross(r, eb1, eb2);
+        for (j = 0; j < 3; j++) {
+            double* sum = &sums[9*tri[j]];
+            for (k = 0; k < 3; k++) {
+                sum[k] += p[k];
+                sum[3+k] += q1[k] + q2[k];
+                sum[6+k] += r[k];
+            }
+        }
+    }
+    for (i = 0; i < animator->vertexCount; i++)
+        for (k = 0; k < 9; k++)
+            pair[k*stride + i] = (float)sums[9*i + k];
+}
+
+int initMorphAnimator(MorphAnimator* animator, const MorphMesh* morph) {
+    int vertexCount = morph->mesh.vertexCount, f, i, k;
+    double* sums;
+    memset(animator, 0, sizeof(MorphAnimator));
+    if (morph->frameCount < 1) {
+        printf("The mesh has no morph targets to animate.\n");
+        return 0;
+    }
+    animator->vertexCount = vertexCount;
+    animator->stride = (vertexCount + 15) & ~15;
+    animator->frameCount = morph->frameCount;
+    animator->triangleCount = morph->mesh.triangleCount;
+    animator->indices = malloc( (size_t)morph->mesh.triangleCount*3*sizeof(unsigned int) );
+    animator->frames = allocateArray( (size_t)3*morph->frameCount*animator->stride );
+    animator->pairNormals = allocateArray( (size_t)9*morph->frameCount*animator->stride );
+    sums = malloc( (size_t)9*vertexCount*sizeof(double) );
+    if ( ! animator->indices || ! animator->frames || ! animator->pairNormals || ! sums ) {
+        printf("Not enough memory to animate the mesh.\n");
+        free(sums);
+        freeMorphAnimator(animator);
+        return 0;
+    }
+    memcpy(animator->indices, morph->mesh.indices, (size_t)morph->mesh.triangleCount*3*sizeof(unsigned int));
+    for (f = 0; f < morph->frameCount; f++)
+        for (i = 0; i < vertexCount; i++)
+            for (k = 0; k < 3; k++)
+                animator->frames[(3*f + k)*animator->stride + i] = morph->framePositions[((size_t)f*vertexCount + i)*3 + k];
+    for (f = 0; f < morph->frameCount; f++)
+        computePairNormals(animator, f, (f + 1) % morph->frameCount, sums);
+    free(sums);
+    return 1;
+}
+
+void freeMorphAnimator(MorphAnimator* animator) {
+    free(animator->indices);
+    free(animator->frames);
+    free(animator->pairNormals);
+    memset(animator, 0, sizeof(MorphAnimator));
+}
+
+int morphVertexFloats(const MorphAnimator* animator) {
+    return MORPH_ARRAYS*animator->stride;
+}
+
+float* allocateMorphVertices(const MorphAnimator* animator, int count) {
+    return allocateArray( (size_t)count*morphVertexFloats(animator) );
+}
+
+//  Finds the pair of frames for a time, and the weight t of the second frame.
+static int findPair(const MorphAnimator* animator, float time, float* t) {
+    float wrapped = time - animator->frameCount * floorf(time / animator->frameCount);
+    int a = (int)wrapped;
+    if (a >= animator->frameCount)  // wrapped can round up to frameCount
+        a = animator->frameCount - 1;
+    if (a < 0)
+        a = 0;
+    *t = wrapped - a;
+    return a;
+}
+
+void morphAtTimeScalar(const MorphAnimator* animator, float time, float* vertices) {
+    int stride = animator->stride, i, k;
+    float t, s, caa, cab, cbb;
+    int a = findPair(animator, time, &t);
+    int b = (a + 1) % animator->frameCount;
+    const float* frameA = &animator->frames[3*a*stride];
+    const float* frameB = &animator->frames[3*b*stride];
+    const float* pair = &animator->pairNormals[(size_t)9*a*stride];
+    s = 1 - t;
+    caa = s*s;
+    cab = t*s;
+    cbb = t*t;
+    for (i = 0; i < animator->vertexCount; i++) {
+        float n[3], length;
+        for (k = 0; k < 3; k++) {
+            vertices[k*stride + i] = s*frameA[k*stride + i] + t*frameB[k*stride + i];
+            n[k] = caa*pair[k*stride + i] + cab*pair[(3+k)*stride + i] + cbb*pair[(6+k)*stride + i];
+        }
+        length = sqrtf(n[0]*n[0] + n[1]*n[1] + n[2]*n[2]);
+        for (k = 0; k < 3; k++)
+            vertices[(3+k)*stride + i] = length > 0 ? n[k] / length : n[k];
+    }
+}
+
+void morphAtTime(const MorphAnimator* animator, float time, float* vertices) {
+#ifdef __SSE2__
+    int stride = animator->stride, i, k;
+    float t;
+    int a = findPair(animator, time, &t);
+    int b = (a + 1) % animator->frameCount;
+    const float* frameA = &animator->frames[3*a*stride];
+    const float* frameB = &animator->frames[3*b*stride];
+    const float* pair = &animator->pairNormals[(size_t)9*a*stride];
+    const float s = 1 - t;
+    const __m128 wa = _mm_set1_ps(s), wb = _mm_set1_ps(t);
+    const __m128 caa = _mm_set1_ps(s*s), cab = _mm_set1_ps(t*s), cbb = _mm_set1_ps(t*t);
+    const __m128 zero = _mm_setzero_ps(), one = _mm_set1_ps(1);
+    // The arrays are padded to a multiple of 16 floats, so there is no scalar tail.
+    for (i = 0; i < stride; i += 4) {
+        __m128 n[3], length, hasLength;
+        for (k = 0; k < 3; k++) {
+            __m128 p = _mm_add_ps(_mm_mul_ps(wa, _mm_load_ps(&frameA[k*stride + i])),
+                                  _mm_mul_ps(wb, _mm_load_ps(&frameB[k*stride + i])));
+            _mm_store_ps(&vertices[k*stride + i], p);
+            n[k] = _mm_add_ps(_mm_add_ps(_mm_mul_ps(caa, _mm_load_ps(&pair[k*stride + i])),
+                                         _mm_mul_ps(cab, _mm_load_ps(&pair[(3+k)*stride + i]))),
+                              _mm_mul_ps(cbb, _mm_load_ps(&pair[(6+k)*stride + i])));
+        }
+        length = _mm_sqrt_ps(_mm_add_ps(_mm_add_ps(_mm_mul_ps(n[0], n[0]), _mm_mul_ps(n[1], n[1])),
+                                        _mm_mul_ps(n[2], n[2])));
+        // Divide by 1 where the length is 0, as the scalar code leaves such a normal alone.
+        hasLength = _mm_cmpgt_ps(length, zero);
+        length = _mm_or_ps(_mm_and_ps(hasLength, length), _mm_andnot_ps(hasLength, one));
+        for (k = 0; k < 3; k++)
+            _mm_store_ps(&vertices[(3+k)*stride + i], _mm_div_ps(n[k], length));
+    }
+#else
+    morphAtTimeScalar(animator, time, vertices);
+#endif
+}
+
+//  What the jobs of morphInstances() work on.
+typedef struct InstanceJob {
+    const MorphAnimator* animator;
+    const float* times;
+    float* vertices;
+} InstanceJob;
+
+static void instanceJob(void* data, int start, int end, int chunk) {
+    const InstanceJob* job = (const InstanceJob*)data;
+    int floats = morphVertexFloats(job->animator), i;
+    for (i = start; i < end; i++)
+        morphAtTime(job->animator, job->times[i], &job->vertices[(size_t)i*floats]);
+}
+
+void morphInstances(const MorphAnimator* animator, int count, const float* times, float* vertices) {
+    InstanceJob job = { animator, times, vertices };
+    jobsParallelFor(count, MORPH_INSTANCE_GRAIN, instanceJob, &job);
+}
+
+void blendMorph(const MorphAnimator* animator, int count, const int* frames, const float* weights,
+                float* vertices) {
+    int stride = animator->stride, i, j, k;
+    float* normals = &vertices[3*stride];
+    memset(vertices, 0, (size_t)morphVertexFloats(animator)*sizeof(float));
+    for (j = 0; j < count; j++) {
+        const float* frame = &animator->frames[3*frames[j]*stride];
+        float w = weights[j];
+        for (i = 0; i < 3*stride; i++)
+            vertices[i] += w*frame[i];
+    }
+    for (i = 0; i < animator->triangleCount; i++) {
+        const unsigned int* tri = &animator->indices[3*i];
+        float e1[3], e2[3], n[3];
+        for (k = 0; k < 3; k++) {
+            e1[k] = vertices[k*stride + tri[1]] - vertices[k*stride + tri[0]];
+            e2[k] = vertices[k*stride + tri[2]] - vertices[k*stride + tri[0]];
+        }
+        n[0] = e1[1]*e2[2] - e1[2]*e2[1];
+        n[1] = e1[2]*e2[0] - e1[0]*e2[2];
+        n[2] = e1[0]*e2[1] - e1[1]*e2[0];
+        for (j = 0; j < 3; j++)
+            for (k = 0; k < 3; k++)
+                normals[k*stride + tri[j]] += n[k];
+    }
+    for (i = 0; i < animator->vertexCount; i++) {
+        float length = sqrtf(normals[i]*normals[i] + normals[stride + i]*normals[stride + i]
+                             + normals[2*stride + i]*normals[2*stride + i]);
+        if (length > 0)
+            for (k = 0; k < 3; k++)
+                normals[k*stride + i] /= length;
+    }
+}
@@ -0,0 +1,102 @@
+/*  Header file for morph.c, which animates a MorphMesh (see morphmesh.h) by
+    blending its frames, as three.js does for the galloping horse of
+    Three.js_Ride with THREE.MorphAnimMesh, for any number of instances,
+    each at a time of its own.
+
+    The frames are kept as a "structure of arrays": for each frame, one array
+    of x coordinates, one of y and one of z, padded with zeros to a multiple
+    of 16 vertices and aligned to MORPH_ALIGNMENT bytes.  A blend then streams
+    through plain float arrays, which the SSE version does four vertices at a
+    time.  The result, for each instance, has the same layout: the x, y, z,
+    normal x, normal y and normal z arrays, one after the other.
+
+    The normals are those of the blended mesh: at each vertex, the sum of the
+    normals of the triangles around it, weighted by their areas, normalized.
+    Recomputing them from the triangles every frame would cost far more than
+    the blend itself, and updating only the vertices that moved does not
+    help, since the whole horse moves from frame to frame.  Instead, for a
+    blend of frames a and b with weights 1-t and t, the unnormalized normal is
+    a quadratic in t,
+
+        N(t) = (1-t)^2 P + t(1-t) Q + t^2 R,
+
+    because each triangle's normal is the cross product of two edges that
+    are linear in t.  P, Q and R are computed once per vertex for each pair of
+    consecutive frames, so an animated normal costs about as much as a
+    blended position, and it is exact, not an interpolation of the normals of
+    the two frames.  morphbuffer.c evaluates the same formula in a vertex
+    shader.
+
+    morphInstances() spreads the instances over all of the cores with
+    jobsParallelFor() from jobs.c, MORPH_INSTANCE_GRAIN instances per job.
+    Each instance is blended on its own, so the results are the same for any
+    number of threads.  */
+
+#ifndef MORPH_H
+#define MORPH_H
+
+#include "morphmesh.h"
+
+#define MORPH_ALIGNMENT 64
+#define MORPH_INSTANCE_GRAIN 16
+
+//  The arrays in the vertices of an instance: x, y, z, nx, ny, nz.
+#define MORPH_ARRAYS 6
+
+//  A morph mesh prepared for blending.  All arrays are aligned to MORPH_ALIGNMENT bytes.
+typedef struct MorphAnimator {
+    int vertexCount;
+    int stride;             // floats in each array: vertexCount rounded up to a multiple of 16
+    int frameCount;
+    int triangleCount;
+    unsigned int* indices;  // 3 per triangle, as in the TriMesh
+
+    /*  The x, y and z arrays of the positions in each frame; frame f starts
+    at index 3*f*stride.  */
+    float* frames;
+
+    /*  For the pair of frames f and f+1 (and for the last frame, the pair of
+    it and frame 0), the x, y and z arrays of P, then of Q, then of R;
+    pair f starts at index 9*f*stride.  */
+    float* pairNormals;
+} MorphAnimator;
+
+/*  Prepares the frames of a morph mesh for blending.  Returns 0, after
+    printing a message, if the mesh has no frames.  */
+int initMorphAnimator(MorphAnimator* animator, const MorphMesh* morph);
+
+//  Frees the arrays of an animator.
+void freeMorphAnimator(MorphAnimator* animator);
+
+/*  The floats in the vertices of one instance, MORPH_ARRAYS*stride.  Arrays
+    of vertices for morphAtTime() and the other functions here should be
+    allocated with allocateMorphVertices().  */
+int morphVertexFloats(const MorphAnimator* animator);
+
+//  Allocates the vertices of count instances, aligned to MORPH_ALIGNMENT bytes.  Free them with free().
+float* allocateMorphVertices(const MorphAnimator* animator, int count);
+
+/*  Sets vertices to the mesh at the given time, in frames: time 3.25 is
+    frame 3 blended with frame 4, with weights 0.75 and 0.25.  Time wraps
+    around, so that frame 0 follows the last frame, as in a loop of a gallop.
+    Uses SSE when the compiler supports it (as on any x86-64), and otherwise
+    the same code as morphAtTimeScalar(); both give exactly the same
+    results.  */
+void morphAtTime(const MorphAnimator* animator, float time, float* vertices);
+
+//  The same blend, one vertex at a time.
+void morphAtTimeScalar(const MorphAnimator* animator, float time, float* vertices);
+
+/*  Sets the vertices of count instances, instance i at times[i], with
+    morphAtTime(); the vertices of instance i start at index
+    i*morphVertexFloats(animator).  The work is split into jobs.  */
+void morphInstances(const MorphAnimator* animator, int count, const float* times, float* vertices);
+
+/*  Blends any number of frames, with the given weights, which should add up to
+    1.  The normals are recomputed from the triangles of the blended mesh,
+    since P, Q and R are only known for pairs of consecutive frames, so this
+    is several times slower than morphAtTime().  */
+void blendMorph(const MorphAnimator* animator, int count, const int* frames, const float* weights,
+                float* vertices);
+
+#endif
@@ -0,0 +1,64 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include "morphbuffer.h"
+
+int uploadMorphBuffer(MorphBuffer* buffer, const MorphAnimator* animator) {
+    int vertexCount = animator->vertexCount, frameCount = animator->frameCount, stride = animator->stride;
+    int texels = 4*frameCount*vertexCount, f, i, k;
+    GLint maxTexels;
+    float* data;
+    buffer->buffer = buffer->texture = 0;
+    if ( ! hasGLVersion(3, 1) ) {
+        printf("Blending in a vertex shader requires OpenGL 3.1.\n");
+        return 0;
+    }
+    glGetIntegerv(GL_MAX_TEXTURE_BUFFER_SIZE, &maxTexels);
+    if (texels > maxTexels) {
+        printf("The frames need %d texels, and a texture buffer can only have %d.\n", texels, maxTexels);
+        return 0;
+    }
+    data = malloc( (size_t)texels*4*sizeof(float) );
+    for (f = 0; f < frameCount; f++) {
+        const float* frame = &animator->frames[3*f*stride];
+        const float* pair = &animator->pairNormals[(size_t)9*f*stride];
+        float* positions = &data[(size_t)4*f*vertexCount];
+        float* normals = &data[(size_t)4*(frameCount*vertexCount + 3*f*vertexCount)];
+        for (i = 0; i < vertexCount; i++) {
+            for (k = 0; k < 3; k++) {
+                positions[4*i + k] = frame[k*stride + i];
+                normals[12*i + k] = pair[k*stride + i];          // P
+                normals[12*i + 4 + k] = pair[(3+k)*stride + i];  // Q
+                normals[12*i + 8 + k] = pair[(6+k)*stride + i];  // R
+            }
+            positions[4*i + 3] = normals[12*i + 3] = normals[12*i + 7] = normals[12*i + 11] = 0;
+        }
+    }
+    glGenBuffers(1, &buffer->buffer);
+    glBindBuffer(GL_TEXTURE_BUFFER, buffer->buffer);
+    glBufferData(GL_TEXTURE_BUFFER, (size_t)texels*4*sizeof(float), data, GL_STATIC_DRAW);
+    glBindBuffer(GL_TEXTURE_BUFFER, 0);
+    glGenTextures(1, &buffer->texture);
+    glBindTexture(GL_TEXTURE_BUFFER, buffer->texture);
+    glTexBuffer(GL_TEXTURE_BUFFER, GL_RGBA32F, buffer->buffer);
+    glBindTexture(GL_TEXTURE_BUFFER, 0);
+    free(data);
+    buffer->vertexCount = vertexCount;
+    buffer->frameCount = frameCount;
+    return 1;
+}
+
+void freeMorphBuffer(MorphBuffer* buffer) {
+    glDeleteTextures(1, &buffer->texture);
+    glDeleteBuffers(1, &buffer->buffer);
+    buffer->buffer = buffer->texture = 0;
+    buffer->vertexCount = buffer->frameCount = 0;
+}
+
+void useMorphBuffer(const MorphBuffer* buffer, GLuint program, int textureUnit) {
+    glActiveTexture(GL_TEXTURE0 + textureUnit);
+    glBindTexture(GL_TEXTURE_BUFFER, buffer->texture);
+    glActiveTexture(GL_TEXTURE0);
+    glUniform1i(glGetUniformLocation(program, "u_morphData"), textureUnit);
+    glUniform1i(glGetUniformLocation(program, "u_morphVertexCount"), buffer->vertexCount);
+    glUniform1i(glGetUniformLocation(program, "u_morphFrameCount"), buffer->frameCount);
+}
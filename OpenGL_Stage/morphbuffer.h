@@ -0,0 +1,66 @@
+/*  Header file for morphbuffer.c, which puts the frames of a MorphAnimator
+    (see morph.h) into a texture buffer, so that a vertex shader can do the
+    blend of morphAtTime() on the GPU, with MORPH_GLSL.  Then nothing per
+    vertex is done on the CPU at all, and a single instanced draw call can
+    draw every instance at a time of its own.
+
+    The texture holds a texel of 4 floats for each vertex of each frame, its
+    position, followed by P, Q and R of each vertex of each pair of frames, 3
+    texels each; see morph.h for what they are.  The shader finds the vertex
+    from gl_VertexID, so the mesh must be drawn with the vertex numbers of
+    the MorphMesh, for example from a MeshBuffer of its TriMesh.  (The
+    positions of that buffer should still be bound as the vertex array, since
+    a compatibility context draws nothing without it.)
+
+    Requires OpenGL 3.1 (for texture buffers).  */
+
+#ifndef MORPHBUFFER_H
+#define MORPHBUFFER_H
+
+#include "shader.h"
+#include "morph.h"
+
+//  A texture buffer with the frames of a mesh.
+typedef struct MorphBuffer {
+    GLuint buffer;
+    GLuint texture;         // a GL_TEXTURE_BUFFER of GL_RGBA32F texels
+    int vertexCount;
+    int frameCount;
+} MorphBuffer;
+
+/*  GLSL declarations for a vertex shader that blends the frames: the
+    uniforms and a function that returns the position and the normal of the
+    current vertex at a time in frames, which wraps around as in
+    morphAtTime().  Paste it into the shader source after the #version line,
+    which must be at least 150.  */
+#define MORPH_GLSL \
+    "uniform samplerBuffer u_morphData;\n" \
+    "uniform int u_morphVertexCount;\n" \
+    "uniform int u_morphFrameCount;\n" \
+    "void morphVertex(float time, out vec3 position, out vec3 normal) {\n" \
+    "    float count = float(u_morphFrameCount);\n" \
+    "    float wrapped = time - count * floor(time / count);\n" \
+    "    int a = min(int(wrapped), u_morphFrameCount - 1);\n" \
+    "    int b = a + 1 == u_morphFrameCount ? 0 : a + 1;\n" \
+    "    float t = wrapped - float(a), s = 1.0 - t;\n" \
+    "    int pair = u_morphFrameCount*u_morphVertexCount + 3*(a*u_morphVertexCount + gl_VertexID);\n" \
+    "    position = s * texelFetch(u_morphData, a*u_morphVertexCount + gl_VertexID).xyz\n" \
+    "               + t * texelFetch(u_morphData, b*u_morphVertexCount + gl_VertexID).xyz;\n" \
+    "    vec3 n = s*s * texelFetch(u_morphData, pair).xyz + t*s * texelFetch(u_morphData, pair + 1).xyz\n" \
+    "             + t*t * texelFetch(u_morphData, pair + 2).xyz;\n" \
+    "    normal = length(n) > 0.0 ? normalize(n) : n;\n" \
+    "}\n"
+
+/*  Creates the texture buffer and copies the frames into it.  Returns 0,
+    after printing a message, if the OpenGL version is too old or the
+    texture would be too big.  */
+int uploadMorphBuffer(MorphBuffer* buffer, const MorphAnimator* animator);
+
+//  Deletes the buffer and the texture and sets all of the fields to 0.
+void freeMorphBuffer(MorphBuffer* buffer);
+
+/*  Binds the texture to the given texture unit and sets the uniforms of
+    MORPH_GLSL in the program, which must be the current program.  */
+void useMorphBuffer(const MorphBuffer* buffer, GLuint program, int textureUnit);
+
+#endif
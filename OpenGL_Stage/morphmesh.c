@@ -0,0 +1,180 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include "morphmesh.h"
+#include "meshopt.h"
+
+/*  Sets the normal of each vertex to the sum of the normals of the triangles
+    around it, weighted by their areas, normalized, for the given positions
+    of the vertices.  This is the normal that morph.c blends.  */
+static void computeNormals(const TriMesh* mesh, const float* positions, float* normals) {
+    int i, k;
+    memset(normals, 0, mesh->vertexCount*3*sizeof(float));
+    for (i = 0; i < mesh->triangleCount; i++) {
+        const unsigned int* tri = &mesh->indices[3*i];
+        const float* a = &positions[3*tri[0]];
+        const float* b = &positions[3*tri[1]];
+        const float* c = &positions[3*tri[2]];
+        float u[3] = { b[0]-a[0], b[1]-a[1], b[2]-a[2] };
+        float v[3] = { c[0]-a[0], c[1]-a[1], c[2]-a[2] };
+        float n[3] = { u[1]*v[2]-u[2]*v[1], u[2]*v[0]-u[0]*v[2], u[0]*v[1]-u[1]*v[0] };
+        for (k = 0; k < 3; k++) {
+            normals[3*tri[0]+k] += n[k];
+            normals[3*tri[1]+k] += n[k];
+            normals[3*tri[2]+k] += n[k];
+        }
+    }
+    for (i = 0; i < mesh->vertexCount; i++) {
+        float* n = &normals[3*i];
+        float length = sqrtf( n[0]*n[0] + n[1]*n[1] + n[2]*n[2] );
+        if (length > 0)
+            for (k = 0; k < 3; k++)
+                n[k] /= length;
+    }
+}
+
+/*  The color of each vertex: the average of the colors of the faces around
+    it, since the smooth mesh shares each vertex between its faces.  NULL if
+    the polyhedron has no face colors.  */
+static float* averageFaceColors(Polyhedron poly) {
+    float* colors;
+    int* counts;
+    int i, j = 0, k;
+    if ( ! poly.faceColors )
+        return NULL;
+    colors = calloc( poly.vertexCount*3, sizeof(float) );
+    counts = calloc( poly.vertexCount, sizeof(int) );
+    for (i = 0; i < poly.faceCount; i++) {
+        for ( ; poly.faces[j] != -1; j++) {
+            int v = poly.faces[j];
+            for (k = 0; k < 3; k++)
+                colors[3*v+k] += (float)poly.faceColors[3*i+k];
+            counts[v]++;
+        }
+        j++;
+    }
+    for (i = 0; i < poly.vertexCount; i++)
+        if (counts[i] > 1)
+            for (k = 0; k < 3; k++)
+                colors[3*i+k] /= counts[i];
+    free(counts);
+    return colors;
+}
+
+MorphMesh compileMorphMesh(Polyhedron poly, int frameCount, const double* frameVertices, const char** names) {
+    MorphMesh morph;
+    int size = poly.vertexCount*3, f, i;
+    morph.mesh = compilePolyhedronSmooth(poly);
+    morph.mesh.colors = averageFaceColors(poly);
+    optimizeVertexCache(&morph.mesh);
+    morph.frameCount = frameCount;
+    morph.framePositions = malloc( (size_t)frameCount*size*sizeof(float) );
+    morph.frameNormals = malloc( (size_t)frameCount*size*sizeof(float) );
+    morph.frameNames = calloc( frameCount > 0 ? frameCount : 1, MORPH_NAME_LENGTH );
+    for (f = 0; f < frameCount; f++) {
+        float* positions = &morph.framePositions[(size_t)f*size];
+        for (i = 0; i < size; i++)
+            positions[i] = (float)frameVertices[(size_t)f*size + i];
+        computeNormals(&morph.mesh, positions, &morph.frameNormals[(size_t)f*size]);
+        if (names)
+            strncpy(morph.frameNames[f], names[f], MORPH_NAME_LENGTH - 1);
+        else
+            snprintf(morph.frameNames[f], MORPH_NAME_LENGTH, "frame %d", f);
+    }
+    return morph;
+}
+
+void freeMorphMesh(MorphMesh* morph) {
+    freeTriMesh(&morph->mesh);
+    free(morph->framePositions);
+    free(morph->frameNormals);
+    free(morph->frameNames);
+    morph->framePositions = morph->frameNormals = NULL;
+    morph->frameNames = NULL;
+    morph->frameCount = 0;
+}
+
+int writeMorphMesh(const char* path, const MorphMesh* morph) {
+    const TriMesh* mesh = &morph->mesh;
+    size_t size = (size_t)mesh->vertexCount*3;
+    MorphMeshHeader header;
+    int f, ok;
+    FILE* file = fopen(path, "wb");
+    if ( ! file ) {
+        printf("Cannot create the mesh file %s.\n", path);
+        return 0;
+    }
+    header.magic = MORPH_MESH_MAGIC;
+    header.version = MORPH_MESH_VERSION;
+    header.vertexCount = mesh->vertexCount;
+    header.triangleCount = mesh->triangleCount;
+    header.frameCount = morph->frameCount;
+    header.flags = mesh->colors ? MORPH_MESH_COLORS : 0;
+    ok = fwrite(&header, sizeof(header), 1, file) == 1
+         && fwrite(mesh->positions, sizeof(float), size, file) == size
+         && fwrite(mesh->normals, sizeof(float), size, file) == size
+         && ( ! mesh->colors || fwrite(mesh->colors, sizeof(float), size, file) == size )
+         && fwrite(mesh->indices, sizeof(unsigned int), (size_t)mesh->triangleCount*3, file)
+                == (size_t)mesh->triangleCount*3;
+    for (f = 0; ok && f < morph->frameCount; f++)
+        ok = fwrite(morph->frameNames[f], MORPH_NAME_LENGTH, 1, file) == 1
+             && fwrite(&morph->framePositions[f*size], sizeof(float), size, file) == size
+             && fwrite(&morph->frameNormals[f*size], sizeof(float), size, file) == size;
+    if (fclose(file) != 0)
+        ok = 0;
+    if ( ! ok )
+        printf("Cannot write the mesh file %s.\n", path);
+    return ok;
+}
+
+int readMorphMesh(const char* path, MorphMesh* morph) {
+    TriMesh* mesh = &morph->mesh;
+    MorphMeshHeader header;
+    size_t size;
+    int f, ok;
+    FILE* file = fopen(path, "rb");
+    memset(morph, 0, sizeof(MorphMesh));
+    if ( ! file ) {
+        printf("Cannot open the mesh file %s.\n", path);
+        return 0;
+    }
+    if (fread(&header, sizeof(header), 1, file) != 1 || header.magic != MORPH_MESH_MAGIC
+            || header.version != MORPH_MESH_VERSION || header.vertexCount < 0
+            || header.triangleCount < 0 || header.frameCount < 0) {
+        printf("%s is not a mesh file of version %d.\n", path, MORPH_MESH_VERSION);
+        fclose(file);
+        return 0;
+    }
+    size = (size_t)header.vertexCount*3;
+    mesh->vertexCount = header.vertexCount;
+    mesh->triangleCount = header.triangleCount;
+    mesh->positions = malloc( size*sizeof(float) );
+    mesh->normals = malloc( size*sizeof(float) );
+    mesh->colors = header.flags & MORPH_MESH_COLORS ? malloc( size*sizeof(float) ) : NULL;
+    mesh->indices = malloc( (size_t)header.triangleCount*3*sizeof(unsigned int) );
+    morph->frameCount = header.frameCount;
+    morph->framePositions = malloc( header.frameCount*size*sizeof(float) );
+    morph->frameNormals = malloc( header.frameCount*size*sizeof(float) );
+    morph->frameNames = calloc( header.frameCount > 0 ? header.frameCount : 1, MORPH_NAME_LENGTH );
+    ok = fread(mesh->positions, sizeof(float), size, file) == size
+         && fread(mesh->normals, sizeof(float), size, file) == size
+         && ( ! mesh->colors || fread(mesh->colors, sizeof(float), size, file) == size )
+         && fread(mesh->indices, sizeof(unsigned int), (size_t)header.triangleCount*3, file)
+                == (size_t)header.triangleCount*3;
+    for (f = 0; ok && f < header.frameCount; f++) {
+        ok = fread(morph->frameNames[f], MORPH_NAME_LENGTH, 1, file) == 1
+             && fread(&morph->framePositions[f*size], sizeof(float), size, file) == size
+             && fread(&morph->frameNormals[f*size], sizeof(float), size, file) == size;
+        morph->frameNames[f][MORPH_NAME_LENGTH-1] = 0;
+    }
+    fclose(file);
+    for (f = 0; ok && f < header.triangleCount*3; f++)
+        if (mesh->indices[f] >= (unsigned int)header.vertexCount)
+            ok = 0;
+    if ( ! ok ) {
+        printf("The mesh file %s is truncated or damaged.\n", path);
+        freeMorphMesh(morph);
+    }
+    return ok;
+}
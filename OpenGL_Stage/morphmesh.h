@@ -0,0 +1,85 @@
+/*  Header file for morphmesh.c.  A MorphMesh is a compiled TriMesh (see
+    mesh.h) with morph targets: frames of an animation, each of which gives
+    a new position and normal to every vertex of the mesh, as the frames of
+    the galloping horse of Three.js_Ride/resources/horse.js do.  The
+    triangles are the same in every frame.
+
+    A MorphMesh can be written to and read from a binary file, so that a
+    model converted once, for example by meshconvert.c from a three.js JSON
+    model, loads with a few fread() calls and no parsing.  The file is:
+
+        a MorphMeshHeader;
+        the positions and the normals of the mesh, vertexCount*3 floats each;
+        the colors, vertexCount*3 floats, if the flags have MORPH_MESH_COLORS;
+        the indices, triangleCount*3 unsigned ints;
+        for each frame, its name, in MORPH_NAME_LENGTH chars, then its
+        positions and its normals, vertexCount*3 floats each.
+
+    Numbers are in the byte order of the machine that wrote the file; a file
+    in the other order is rejected because its magic number does not match.  */
+
+#ifndef MORPHMESH_H
+#define MORPHMESH_H
+
+#include "mesh.h"
+
+#define MORPH_NAME_LENGTH 32         // including the 0 at the end
+#define MORPH_MESH_MAGIC 0x4853454d  // "MESH", read as a little-endian int
+#define MORPH_MESH_VERSION 1
+#define MORPH_MESH_COLORS 1          // a flag: the mesh has vertex colors
+
+//  Data type for meshes with morph targets.
+typedef struct MorphMesh {
+
+    // The triangles, and the vertices in the rest pose of the model.
+    TriMesh mesh;
+
+    // Number of morph targets.  Can be 0.
+    int frameCount;
+
+    /*  The positions, then the normals, of the vertices in each frame, 3
+    numbers per vertex; length = frameCount*mesh.vertexCount*3 each.  The data
+    for frame f is at index f*mesh.vertexCount*3.  */
+    float* framePositions;
+    float* frameNormals;
+
+    // The names of the frames, such as "horse_A_001".
+    char (*frameNames)[MORPH_NAME_LENGTH];
+
+} MorphMesh;
+
+//  The start of a mesh file.
+typedef struct MorphMeshHeader {
+    unsigned int magic;     // MORPH_MESH_MAGIC
+    int version;            // MORPH_MESH_VERSION
+    int vertexCount;
+    int triangleCount;
+    int frameCount;
+    int flags;              // MORPH_MESH_COLORS, or 0
+} MorphMeshHeader;
+
+/*  Makes a morph mesh from a polyhedron and the positions of its vertices in
+    each of frameCount frames, 3 numbers per vertex, frame after frame.  The
+    mesh is compiled with compilePolyhedronSmooth(), so the vertices of the
+    mesh are those of the polyhedron; the normal of a vertex in a frame is the
+    sum of the normals of the triangles around it, weighted by their areas.
+    If the polyhedron has face colors, the color of a vertex is the average
+    of the colors of the faces around it, and the mesh has MORPH_MESH_COLORS.
+    The triangles are reordered with optimizeVertexCache(); the vertices are
+    not renumbered, so that they still match the frames.  names can be NULL,
+    for frames named by number.  */
+MorphMesh compileMorphMesh(Polyhedron poly, int frameCount, const double* frameVertices, const char** names);
+
+//  Frees the arrays of a morph mesh and sets its counts to zero.
+void freeMorphMesh(MorphMesh* morph);
+
+/*  Writes a morph mesh to a file.  Returns 0, after printing a message, if
+    the file cannot be written.  */
+int writeMorphMesh(const char* path, const MorphMesh* morph);
+
+/*  Reads a morph mesh from a file written by writeMorphMesh().  Returns 0,
+    after printing a message, if the file cannot be read or is not a mesh
+    file of this version.  */
+int readMorphMesh(const char* path, MorphMesh* morph);
+
+#endif
@@ -0,0 +1,152 @@
+#include "overlay.h"
+#include <GL/freeglut.h>
+#include <stdio.h>
+#include <string.h>
+
+int initOverlay(Overlay* overlay) {
+    memset(overlay, 0, sizeof(Overlay));
+    if ( ! hasGLVersion(3, 0) ) {
+        fprintf(stderr, "The overlay needs OpenGL 3.0; whole frames will be drawn.\n");
+        return 0;
+    }
+    glGenFramebuffers(1, &overlay->framebuffer);
+    glGenRenderbuffers(1, &overlay->colorBuffer);
+    glGenRenderbuffers(1, &overlay->depthBuffer);
+    return 1;
+}
+
+void freeOverlay(Overlay* overlay) {
+    glDeleteFramebuffers(1, &overlay->framebuffer);
+    glDeleteRenderbuffers(1, &overlay->colorBuffer);
+    glDeleteRenderbuffers(1, &overlay->depthBuffer);
+    memset(overlay, 0, sizeof(Overlay));
+}
+
+void beginOverlayScene(Overlay* overlay, int width, int height) {
+    if (width != overlay->width || height != overlay->height) {
+        glBindRenderbuffer(GL_RENDERBUFFER, overlay->colorBuffer);
+        glRenderbufferStorage(GL_RENDERBUFFER, GL_RGBA8, width, height);
+        glBindRenderbuffer(GL_RENDERBUFFER, overlay->depthBuffer);
+        glRenderbufferStorage(GL_RENDERBUFFER, GL_DEPTH_COMPONENT24, width, height);
+        glBindRenderbuffer(GL_RENDERBUFFER, 0);
+        glBindFramebuffer(GL_FRAMEBUFFER, overlay->framebuffer);
+        glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_RENDERBUFFER, overlay->colorBuffer);
+        glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, GL_RENDERBUFFER, overlay->depthBuffer);
+        overlay->width = width;
+        overlay->height = height;
+    }
+    glBindFramebuffer(GL_FRAMEBUFFER, overlay->framebuffer);
+    glViewport(0, 0, width, height);
+    overlay->cached = 0;
+}
+
+void endOverlayScene(Overlay* overlay) {
+    glBindFramebuffer(GL_FRAMEBUFFER, 0);
+    overlay->cached = 1;
+}
+
+int overlaySceneCached(const Overlay* overlay, int width, int height) {
+    return overlay->cached && overlay->width == width && overlay->height == height;
+}
+
+//  Copies a rectangle of the cached scene to the same place in the window's draw buffer.
+static void copyScene(const Overlay* overlay, int x, int y, int width, int height) {
+    glBindFramebuffer(GL_READ_FRAMEBUFFER, overlay->framebuffer);
+    glBindFramebuffer(GL_DRAW_FRAMEBUFFER, 0);
+    glBlitFramebuffer(x, y, x + width, y + height, x, y, x + width, y + height,
+                      GL_COLOR_BUFFER_BIT, GL_NEAREST);
+    glBindFramebuffer(GL_FRAMEBUFFER, 0);
+}
+
+//  Sets panel to the rectangle that the lines take, in a window of the given height.
+static void measurePanel(const char* const* lines, int count, int height, int* panel) {
+    int i, textWidth = 0;
+    panel[0] = panel[1] = panel[2] = panel[3] = 0;
+    if (count <= 0)
+        return;
+    for (i = 0; i < count; i++) {
+        int w = glutBitmapLength(GLUT_BITMAP_HELVETICA_12, (const unsigned char*)lines[i]);
+        if (w > textWidth)
+            textWidth = w;
+    }
+    panel[2] = textWidth + 2*OVERLAY_PADDING;
+    panel[3] = count*OVERLAY_LINE_HEIGHT + 2*OVERLAY_PADDING;
+    panel[0] = OVERLAY_MARGIN;
+    panel[1] = height - OVERLAY_MARGIN - panel[3];
+}
+
+void drawOverlayPanel(const char* const* lines, int count, int width, int height, int* panel) {
+    int i;
+    if (count > OVERLAY_MAX_LINES)
+        count = OVERLAY_MAX_LINES;
+    measurePanel(lines, count, height, panel);
+    if (count <= 0)
+        return;
+
+    glPushAttrib(GL_ENABLE_BIT | GL_COLOR_BUFFER_BIT | GL_CURRENT_BIT | GL_VIEWPORT_BIT);
+    glUseProgram(0);
+    glDisable(GL_DEPTH_TEST);
+    glDisable(GL_LIGHTING);
+    glDisable(GL_TEXTURE_2D);
+    glDisable(GL_CULL_FACE);
+    glEnable(GL_BLEND);
+    glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
+    glViewport(0, 0, width, height);
+    glMatrixMode(GL_PROJECTION);
+    glPushMatrix();
+    glLoadIdentity();
+    glOrtho(0, width, 0, height, -1, 1);
+    glMatrixMode(GL_MODELVIEW);
+    glPushMatrix();
+    glLoadIdentity();
+
+    glColor4f(0, 0, 0, 0.6f);
+    glRecti(panel[0], panel[1], panel[0] + panel[2], panel[1] + panel[3]);
+    glColor4f(1, 1, 1, 1);
+    for (i = 0; i < count; i++) {
+        // The baseline of a line is a little above the bottom of its row.
+        glWindowPos2i(panel[0] + OVERLAY_PADDING,
+                      panel[1] + panel[3] - OVERLAY_PADDING - (i+1)*OVERLAY_LINE_HEIGHT + 4);
+        glutBitmapString(GLUT_BITMAP_HELVETICA_12, (const unsigned char*)lines[i]);
+    }
+
+    glPopMatrix();
+    glMatrixMode(GL_PROJECTION);
+    glPopMatrix();
+    glMatrixMode(GL_MODELVIEW);
+    glPopAttrib();
+}
+
+void presentOverlay(Overlay* overlay, const char* const* lines, int count) {
+    copyScene(overlay, 0, 0, overlay->width, overlay->height);
+    drawOverlayPanel(lines, count, overlay->width, overlay->height, overlay->panel);
+}
+
+void updateOverlayPanel(Overlay* overlay, const char* const* lines, int count) {
+    const int* old = overlay->panel;
+    int next[4], area[4], i;
+    measurePanel(lines, count < OVERLAY_MAX_LINES ? count : OVERLAY_MAX_LINES, overlay->height, next);
+    // The smallest rectangle that covers both panels.
+    if (old[2] == 0)
+        memcpy(area, next, sizeof(area));
+    else if (next[2] == 0)
+        memcpy(area, old, sizeof(area));
+    else
+        for (i = 0; i < 2; i++) {
+            int low = old[i] < next[i] ? old[i] : next[i];
+            int high = old[i] + old[i+2] > next[i] + next[i+2] ? old[i] + old[i+2] : next[i] + next[i+2];
+            area[i] = low;
+            area[i+2] = high - low;
+        }
+    if (area[2] == 0)
+        return;
+
+    glDrawBuffer(GL_FRONT);
+    glEnable(GL_SCISSOR_TEST);
+    glScissor(area[0], area[1], area[2], area[3]);
+    copyScene(overlay, area[0], area[1], area[2], area[3]);
+    drawOverlayPanel(lines, count, overlay->width, overlay->height, overlay->panel);
+    glDisable(GL_SCISSOR_TEST);
+    glDrawBuffer(GL_BACK);
+    glFlush();
+}
@@ -0,0 +1,71 @@
+/*  Header file for overlay.c, which draws a panel of text over a scene, and
+    can change the panel without drawing the scene again.
+
+    The scene is drawn into a framebuffer object, the scene cache, between
+    beginOverlayScene() and endOverlayScene(), and presentOverlay() copies
+    it into the window's back buffer and draws the panel over it.  When only
+    the text has changed, updateOverlayPanel() copies back just the part of
+    the cached scene that the old and the new panel cover, scissored to that
+    rectangle, and draws the new panel there, straight into the front buffer,
+    since after a swap the back buffer holds nothing that can be kept.  A
+    window that is uncovered can be redrawn from the cache as well.
+
+    The panel is drawn with the fixed-function pipeline, as a translucent
+    rectangle with lines of GLUT bitmap text, in the upper left corner.
+
+    Requires OpenGL 3.0 (for framebuffer objects).  */
+
+#ifndef OVERLAY_H
+#define OVERLAY_H
+
+#include "shader.h"
+
+#define OVERLAY_MARGIN 10        // pixels between the panel and the corner of the window
+#define OVERLAY_PADDING 6        // pixels between the text and the edge of the panel
+#define OVERLAY_LINE_HEIGHT 16   // for GLUT_BITMAP_HELVETICA_12
+#define OVERLAY_MAX_LINES 32
+
+typedef struct Overlay {
+    GLuint framebuffer, colorBuffer, depthBuffer;   // the scene cache
+    int width, height;       // of the cache, which is made again when the window changes size
+    int cached;              // Does the cache hold a whole scene?
+    int panel[4];            // x, y, width and height of the panel last drawn, from the lower left;
+                             //   the width is 0 if there was no panel
+} Overlay;
+
+/*  Sets up an overlay with no cache yet.  Returns 0, after printing a
+    message, if the OpenGL version is too old; then the program should draw
+    whole frames, drawing the panel with drawOverlayPanel().  */
+int initOverlay(Overlay* overlay);
+
+void freeOverlay(Overlay* overlay);
+
+/*  Binds the scene cache, made or remade width by height pixels, and sets
+    the viewport to all of it.  Draw the scene after this, as into the
+    window.  */
+void beginOverlayScene(Overlay* overlay, int width, int height);
+
+//  Binds the window's framebuffer again; the cache now holds the scene.
+void endOverlayScene(Overlay* overlay);
+
+/*  Returns 1 if the cache holds a scene of the given size, so that the
+    scene need not be drawn again.  */
+int overlaySceneCached(const Overlay* overlay, int width, int height);
+
+/*  Copies the cached scene into the back buffer of the window and draws
+    count lines over it; count can be 0, for no panel.  Call
+    glutSwapBuffers() afterwards.  */
+void presentOverlay(Overlay* overlay, const char* const* lines, int count);
+
+/*  Draws the panel again, with new lines, into the front buffer of the
+    window, over the cached scene; only the rectangle that the old and the
+    new panel cover is drawn.  No swap is needed.  The cache must hold a
+    scene of the size of the window.  */
+void updateOverlayPanel(Overlay* overlay, const char* const* lines, int count);
+
+/*  Draws a panel into the current framebuffer, which is width by height
+    pixels, and stores where it went in panel; for a program that draws
+    whole frames.  */
+void drawOverlayPanel(const char* const* lines, int count, int width, int height, int* panel);
+
+#endif
@@ -4,6 +4,9 @@
 
     A polyhedron is a struct of type Polyhedron, with the following fields.  */
 
+#ifndef POLYHEDRON_H
+#define POLYHEDRON_H
+
 //  Data type for polyhedra.
 typedef struct Polyhedron {
 
@@ -39,16 +42,18 @@ typedef struct Polyhedron {
 void createPolyhedra();
 
 //  The available polyhedral models.
-Polyhedron house;
-Polyhedron cube;
-Polyhedron dodecahedron;
-Polyhedron icosahedron;
-Polyhedron octahedron;
-Polyhedron rhombicDodecahedron;
-Polyhedron socerBall;
-Polyhedron stellatedDodecahedron;
-Polyhedron stellatedIcosahedron;
-Polyhedron stellatedOctahedron;
-Polyhedron tetrahedron;
-Polyhedron truncatedIcosahedron;
-Polyhedron truncatedRhombicDodecahedron;
+extern Polyhedron house;
+extern Polyhedron cube;
+extern Polyhedron dodecahedron;
+extern Polyhedron icosahedron;
+extern Polyhedron octahedron;
+extern Polyhedron rhombicDodecahedron;
+extern Polyhedron socerBall;
+extern Polyhedron stellatedDodecahedron;
+extern Polyhedron stellatedIcosahedron;
+extern Polyhedron stellatedOctahedron;
+extern Polyhedron tetrahedron;
+extern Polyhedron truncatedIcosahedron;
+extern Polyhedron truncatedRhombicDodecahedron;
+
+#endif
@@ -0,0 +1,77 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "shader.h"
+
+static GLuint compileShader(const char* name, GLenum type, const char* source) {
+    GLuint shader = glCreateShader(type);
+    GLint ok;
+    glShaderSource(shader, 1, &source, NULL);
+    glCompileShader(shader);
+    glGetShaderiv(shader, GL_COMPILE_STATUS, &ok);
+    if ( ! ok ) {
+        char log[4096];
+        glGetShaderInfoLog(shader, sizeof(log), NULL, log);
+        fprintf(stderr, "%s: %s shader did not compile:\n%s\n", name,
+                type == GL_VERTEX_SHADER ? "vertex" : type == GL_GEOMETRY_SHADER ? "geometry" : "fragment", log);
+        glDeleteShader(shader);
+        return 0;
+    }
+    return shader;
+}
+
+GLuint createProgram(const char* name, const char* vertexSource, const char* fragmentSource) {
+    return createProgramWithGeometry(name, vertexSource, NULL, fragmentSource);
+}
+
+GLuint createProgramWithGeometry(const char* name, const char* vertexSource, const char* geometrySource,
+                                 const char* fragmentSource) {
+    GLuint vertexShader = compileShader(name, GL_VERTEX_SHADER, vertexSource);
+    GLuint geometryShader = geometrySource ? compileShader(name, GL_GEOMETRY_SHADER, geometrySource) : 0;
+    GLuint fragmentShader = compileShader(name, GL_FRAGMENT_SHADER, fragmentSource);
+    GLuint program;
+    GLint ok;
+    if ( ! vertexShader || ! fragmentShader || (geometrySource && ! geometryShader) ) {
+        glDeleteShader(vertexShader);
+        glDeleteShader(geometryShader);
+        glDeleteShader(fragmentShader);
+        return 0;
+    }
+    program = glCreateProgram();
+    glAttachShader(program, vertexShader);
+    if (geometryShader)
+        glAttachShader(program, geometryShader);
+    glAttachShader(program, fragmentShader);
+    glLinkProgram(program);
+    glDeleteShader(vertexShader);  // (They stay alive as long as the program does.)
+    glDeleteShader(geometryShader);
+    glDeleteShader(fragmentShader);
+    glGetProgramiv(program, GL_LINK_STATUS, &ok);
+    if ( ! ok ) {
+        char log[4096];
+        glGetProgramInfoLog(program, sizeof(log), NULL, log);
+        fprintf(stderr, "%s: program did not link:\n%s\n", name, log);
+        glDeleteProgram(program);
+        return 0;
+    }
+    return program;
+}
+
+int hasGLVersion(int major, int minor) {
+    const char* version = (const char*)glGetString(GL_VERSION);
+    int actualMajor = 0, actualMinor = 0;
+    if (version == NULL || sscanf(version, "%d.%d", &actualMajor, &actualMinor) != 2)
+        return 0;
+    return actualMajor > major || (actualMajor == major && actualMinor >= minor);
+}
+
+int hasGLExtension(const char* name) {
+    GLint count = 0, i;
+    if ( ! hasGLVersion(3, 0) )
+        return 0;
+    glGetIntegerv(GL_NUM_EXTENSIONS, &count);
+    for (i = 0; i < count; i++)
+        if (strcmp((const char*)glGetStringi(GL_EXTENSIONS, i), name) == 0)
+            return 1;
+    return 0;
+}
@@ -0,0 +1,31 @@
+/*  Header file for shader.c, which compiles and links GLSL programs.
+
+    Files that use shaders should include this header instead of <GL/gl.h>,
+    so that the prototypes of the OpenGL 2.0 and later functions are declared.
+    (On Linux, libGL exports all of those functions.)  */
+
+#ifndef SHADER_H
+#define SHADER_H
+
+#define GL_GLEXT_PROTOTYPES
+#include <GL/gl.h>
+#include <GL/glext.h>
+
+/*  Compiles a vertex shader and a fragment shader and links them into a
+    program.  If something goes wrong, the log is printed to standard error,
+    prefixed with name, and 0 is returned.  */
+GLuint createProgram(const char* name, const char* vertexSource, const char* fragmentSource);
+
+//  The same, with a geometry shader as well.  Requires OpenGL 3.2.
+GLuint createProgramWithGeometry(const char* name, const char* vertexSource, const char* geometrySource,
+                                 const char* fragmentSource);
+
+/*  Returns 1 if the context supports at least the given OpenGL version,
+    such as 3, 1 for OpenGL 3.1.  */
+int hasGLVersion(int major, int minor);
+
+/*  Returns 1 if the context has the named extension, such as
+    "GL_ARB_buffer_storage".  Requires OpenGL 3.0 (for glGetStringi()).  */
+int hasGLExtension(const char* name);
+
+#endif
@@ -0,0 +1,159 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "shadow.h"
+#include "mat4.h"
+
+static const char* depthVertexShaderSource =
+    "#version 150 compatibility\n"
+    "uniform mat4 u_lightViewProjection;\n"
+    "in mat4 a_model;  // one per instance\n"
+    "void main() {\n"
+    "    gl_Position = u_lightViewProjection * (a_model * gl_Vertex);\n"
+    "}\n";
+
+static const char* depthFragmentShaderSource =
+    "#version 150 compatibility\n"
+    "void main() {\n"
+    "}\n";
+
+int initShadowMap(ShadowMap* shadow, int size) {
+    memset(shadow, 0, sizeof(ShadowMap));
+    if ( ! hasGLVersion(3, 3) ) {
+        printf("Shadows need OpenGL 3.3.\n");
+        return 0;
+    }
+    shadow->program = createProgram("shadow depth", depthVertexShaderSource, depthFragmentShaderSource);
+    if ( ! shadow->program )
+        return 0;
+    shadow->lightViewProjectionLocation = glGetUniformLocation(shadow->program, "u_lightViewProjection");
+    shadow->modelLocation = glGetAttribLocation(shadow->program, "a_model");
+    shadow->size = size;
+
+    // The map is read with hardware depth comparison, and linear filtering,
+    // which makes each lookup a bilinear blend of four comparisons.  Points
+    // outside of the map compare against the border depth, 1, and are lit.
+    float border[4] = { 1, 1, 1, 1 };
+    glGenTextures(1, &shadow->depthTexture);
+    glBindTexture(GL_TEXTURE_2D, shadow->depthTexture);
+    glTexImage2D(GL_TEXTURE_2D, 0, GL_DEPTH_COMPONENT24, size, size, 0, GL_DEPTH_COMPONENT, GL_FLOAT, NULL);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_BORDER);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_BORDER);
+    glTexParameterfv(GL_TEXTURE_2D, GL_TEXTURE_BORDER_COLOR, border);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_COMPARE_MODE, GL_COMPARE_REF_TO_TEXTURE);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_COMPARE_FUNC, GL_LEQUAL);
+    glBindTexture(GL_TEXTURE_2D, 0);
+
+    glGenFramebuffers(1, &shadow->framebuffer);
+    glBindFramebuffer(GL_FRAMEBUFFER, shadow->framebuffer);
+    glFramebufferTexture2D(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, GL_TEXTURE_2D, shadow->depthTexture, 0);
+    glDrawBuffer(GL_NONE);
+    glReadBuffer(GL_NONE);
+    GLenum status = glCheckFramebufferStatus(GL_FRAMEBUFFER);
+    glBindFramebuffer(GL_FRAMEBUFFER, 0);
+    if (status != GL_FRAMEBUFFER_COMPLETE) {
+        printf("Shadow map framebuffer is incomplete (0x%x).\n", status);
+        return 0;
+    }
+
+    glGenBuffers(1, &shadow->instanceBuffer);
+    glGenQueries(2, shadow->timerQueries);
+    mat4Identity(shadow->lightView);
+    mat4Identity(shadow->lightProjection);
+    return 1;
+}
+
+void aimShadowMap(ShadowMap* shadow, const float* position, const float* target, const float* up,
+                  float fovy, float zNear, float zFar) {
+    mat4LookAt(shadow->lightView, position[0], position[1], position[2],
+               target[0], target[1], target[2], up[0], up[1], up[2]);
+    mat4Perspective(shadow->lightProjection, fovy, 1, zNear, zFar);
+}
+
+void beginShadowPass(ShadowMap* shadow) {
+    float viewProjection[16];
+    glBeginQuery(GL_TIME_ELAPSED, shadow->timerQueries[shadow->frame % 2]);
+    glGetIntegerv(GL_DRAW_FRAMEBUFFER_BINDING, &shadow->outputFramebuffer);
+    glBindFramebuffer(GL_FRAMEBUFFER, shadow->framebuffer);
+    glViewport(0, 0, shadow->size, shadow->size);
+    glClear(GL_DEPTH_BUFFER_BIT);
+    // Pushing the depths back a little, more on steep slopes, keeps surfaces
+    // that face the light from shadowing themselves ("shadow acne").
+    glPolygonOffset(2, 4);
+    glEnable(GL_POLYGON_OFFSET_FILL);
+    glMatrixMode(GL_PROJECTION);
+    glLoadMatrixf(shadow->lightProjection);
+    glMatrixMode(GL_MODELVIEW);
+    glLoadMatrixf(shadow->lightView);
+    mat4Multiply(viewProjection, shadow->lightProjection, shadow->lightView);
+    glUseProgram(shadow->program);
+    glUniformMatrix4fv(shadow->lightViewProjectionLocation, 1, GL_FALSE, viewProjection);
+}
+
+void setShadowInstances(ShadowMap* shadow, const float* matrices, int count) {
+    int bytes = count*16*sizeof(float);
+    glBindBuffer(GL_ARRAY_BUFFER, shadow->instanceBuffer);
+    if (count > shadow->instanceCapacity)
+        shadow->instanceCapacity = 2*count;
+    // Orphan the previous frame's matrices instead of waiting for the GPU to finish with them.
+    glBufferData(GL_ARRAY_BUFFER, shadow->instanceCapacity*16*sizeof(float), NULL, GL_STREAM_DRAW);
+    glBufferSubData(GL_ARRAY_BUFFER, 0, bytes, matrices);
+    glBindBuffer(GL_ARRAY_BUFFER, 0);
+}
+
+void drawShadowInstances(ShadowMap* shadow, const MeshBuffer* mesh, int first, int count) {
+    int column;
+    if (count <= 0)
+        return;
+    bindMeshBufferPositions(mesh);
+    // A mat4 attribute takes four locations, one per column.
+    glBindBuffer(GL_ARRAY_BUFFER, shadow->instanceBuffer);
+    for (column = 0; column < 4; column++) {
+        GLuint location = shadow->modelLocation + column;
+        glVertexAttribPointer(location, 4, GL_FLOAT, GL_FALSE, 16*sizeof(float),
+                              (const char*)NULL + (first*16 + column*4)*sizeof(float));
+        glVertexAttribDivisor(location, 1);
+        glEnableVertexAttribArray(location);
+    }
+    glDrawElementsInstanced(GL_TRIANGLES, mesh->indexCount, GL_UNSIGNED_INT, 0, count);
+    for (column = 0; column < 4; column++) {
+        glDisableVertexAttribArray(shadow->modelLocation + column);
+        glVertexAttribDivisor(shadow->modelLocation + column, 0);
+    }
+    unbindMeshBuffer();
+}
+
+void endShadowPass(ShadowMap* shadow, int viewportWidth, int viewportHeight, const float* projection) {
+    GLuint previous = shadow->timerQueries[(shadow->frame + 1) % 2];
+    GLint available = 0;
+    glUseProgram(0);
+    glDisable(GL_POLYGON_OFFSET_FILL);
+    glBindFramebuffer(GL_FRAMEBUFFER, shadow->outputFramebuffer);
+    glViewport(0, 0, viewportWidth, viewportHeight);
+    glMatrixMode(GL_PROJECTION);
+    glLoadMatrixf(projection);
+    glMatrixMode(GL_MODELVIEW);
+    glEndQuery(GL_TIME_ELAPSED);
+
+    // Read the previous frame's timer, if the GPU has got that far.
+    if (shadow->frame > 0)
+        glGetQueryObjectiv(previous, GL_QUERY_RESULT_AVAILABLE, &available);
+    if (available) {
+        GLuint64 nanoseconds;
+        glGetQueryObjectui64v(previous, GL_QUERY_RESULT, &nanoseconds);
+        shadow->gpuMilliseconds = nanoseconds * 1e-6;
+    }
+    shadow->frame++;
+}
+
+void getShadowMatrix(const ShadowMap* shadow, const float* cameraView, float* result) {
+    // bias maps clip coordinates from -1..1 to 0..1.
+    float bias[16] = { 0.5f,0,0,0, 0,0.5f,0,0, 0,0,0.5f,0, 0.5f,0.5f,0.5f,1 };
+    float inverseView[16];
+    mat4Invert(inverseView, cameraView);
+    mat4Multiply(result, shadow->lightView, inverseView);
+    mat4Multiply(result, shadow->lightProjection, result);
+    mat4Multiply(result, bias, result);
+}
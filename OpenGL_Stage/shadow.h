@@ -0,0 +1,76 @@
+/*  Header file for shadow.c, which renders a shadow map for one light.
+
+    The scene is drawn from the light's point of view into a depth texture.
+    Later, when the scene is drawn from the camera, a point is in shadow if
+    it is farther from the light than the depth stored for it in the map.
+    The lighting shader does that test with percentage-closer filtering
+    (several filtered samples of the map), which softens the shadow edges.
+
+    The depth pass only needs positions, so it uses a shader that draws
+    meshes from their buffers with one instanced draw call per mesh: the
+    model matrices of all of the copies are uploaded at once with
+    setShadowInstances().  The GPU time of each pass is measured with a timer
+    query, which is read a frame later so that it never stalls the pipeline.
+
+    Requires OpenGL 3.3 (for instanced attributes and timer queries).  */
+
+#ifndef SHADOW_H
+#define SHADOW_H
+
+#include "meshbuffer.h"
+
+//  A shadow map and the state for rendering it.
+typedef struct ShadowMap {
+    int size;                   // width and height of the map, in pixels
+    GLuint framebuffer, depthTexture;
+    GLuint program;             // the depth-only instanced shader
+    GLint lightViewProjectionLocation, modelLocation;
+    GLuint instanceBuffer;      // model matrices, 16 floats per instance
+    int instanceCapacity;
+
+    float lightView[16];        // the light's viewing transform and projection
+    float lightProjection[16];
+
+    GLint outputFramebuffer;    // bound when the pass began, and bound again when it ends
+
+    GLuint timerQueries[2];     // used on alternate frames
+    int frame;
+    double gpuMilliseconds;     // GPU time of the most recent pass that has finished
+} ShadowMap;
+
+/*  Creates the depth texture, framebuffer and shader for a map of size by
+    size pixels.  Returns 0, after printing a message, if the OpenGL version
+    is too old or something fails.  */
+int initShadowMap(ShadowMap* shadow, int size);
+
+/*  Sets up the light's view, as for gluLookAt() and gluPerspective() with an
+    aspect ratio of 1.  The frustum should hold everything that can cast a
+    shadow onto the visible part of the scene.  */
+void aimShadowMap(ShadowMap* shadow, const float* position, const float* target, const float* up,
+                  float fovy, float zNear, float zFar);
+
+/*  Starts the depth pass: binds the map's framebuffer and clears it, loads
+    the light's view into the projection and modelview matrices, so that
+    fixed-function drawing also goes into the map, and makes the instanced
+    shader current.  */
+void beginShadowPass(ShadowMap* shadow);
+
+/*  Uploads the model matrices, 16 floats each, of all of the instances that
+    will be drawn in this pass.  */
+void setShadowInstances(ShadowMap* shadow, const float* matrices, int count);
+
+/*  Draws instances first to first+count-1, from the matrices given to
+    setShadowInstances(), using the positions of mesh.  */
+void drawShadowInstances(ShadowMap* shadow, const MeshBuffer* mesh, int first, int count);
+
+/*  Ends the depth pass, binds the framebuffer that was bound when it began,
+    and restores the given viewport and the projection matrix.  The
+    modelview matrix is left as the light's view, and no shader is current.  */
+void endShadowPass(ShadowMap* shadow, int viewportWidth, int viewportHeight, const float* projection);
+
+/*  Computes the matrix that takes a point in the camera's view coordinates
+    to the map: x and y as texture coordinates and z as the depth to compare
+    with, after division by w.  */
+void getShadowMatrix(const ShadowMap* shadow, const float* cameraView, float* result);
+
+#endif
@@ -0,0 +1,93 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include "streambuffer.h"
+
+static double now() {
+    struct timespec t;
+    clock_gettime(CLOCK_MONOTONIC, &t);
+    return t.tv_sec + t.tv_nsec * 1e-9;
+}
+
+int initStreamBuffer(StreamBuffer* stream, GLsizeiptr slotSize, int persistent) {
+    const GLbitfield flags = GL_MAP_WRITE_BIT | GL_MAP_PERSISTENT_BIT | GL_MAP_COHERENT_BIT;
+    memset(stream, 0, sizeof(StreamBuffer));
+    if ( ! hasGLVersion(3, 2) ) {
+        printf("Stream buffers need OpenGL 3.2.\n");
+        return 0;
+    }
+    stream->slotSize = (slotSize + STREAM_ALIGNMENT - 1) / STREAM_ALIGNMENT * STREAM_ALIGNMENT;
+    stream->persistent = persistent && (hasGLVersion(4, 4) || hasGLExtension("GL_ARB_buffer_storage"));
+    glGenBuffers(1, &stream->buffer);
+    glBindBuffer(GL_ARRAY_BUFFER, stream->buffer);
+    if (stream->persistent) {
+        glBufferStorage(GL_ARRAY_BUFFER, STREAM_SLOTS*stream->slotSize, NULL, flags);
+        stream->mapping = glMapBufferRange(GL_ARRAY_BUFFER, 0, STREAM_SLOTS*stream->slotSize, flags);
+        if (stream->mapping == NULL) {
+            printf("Could not map a stream buffer of %ld bytes.\n", (long)(STREAM_SLOTS*stream->slotSize));
+            glBindBuffer(GL_ARRAY_BUFFER, 0);
+            freeStreamBuffer(stream);
+            return 0;
+        }
+    }
+    else {
+        stream->staging = malloc(stream->slotSize);
+        if (stream->staging == NULL) {
+            glBindBuffer(GL_ARRAY_BUFFER, 0);
+            freeStreamBuffer(stream);
+            return 0;
+        }
+    }
+    glBindBuffer(GL_ARRAY_BUFFER, 0);
+    return 1;
+}
+
+void freeStreamBuffer(StreamBuffer* stream) {
+    int i;
+    for (i = 0; i < STREAM_SLOTS; i++)
+        if (stream->fences[i])
+            glDeleteSync(stream->fences[i]);
+    if (stream->mapping) {
+        glBindBuffer(GL_ARRAY_BUFFER, stream->buffer);
+        glUnmapBuffer(GL_ARRAY_BUFFER);
+        glBindBuffer(GL_ARRAY_BUFFER, 0);
+    }
+    glDeleteBuffers(1, &stream->buffer);
+    free(stream->staging);
+    memset(stream, 0, sizeof(StreamBuffer));
+}
+
+void* beginStreamSlot(StreamBuffer* stream) {
+    GLsync fence = stream->fences[stream->slot];
+    stream->waitMilliseconds = 0;
+    if ( ! stream->persistent )
+        return stream->staging;
+    if (fence) {
+        double start = now();
+        // The first wait flushes the commands, so that the fence is sure to be reached.
+        GLbitfield flags = GL_SYNC_FLUSH_COMMANDS_BIT;
+        while (glClientWaitSync(fence, flags, 1000000000) == GL_TIMEOUT_EXPIRED)
+            flags = 0;
+        glDeleteSync(fence);
+        stream->fences[stream->slot] = 0;
+        stream->waitMilliseconds = (now() - start) * 1000;
+    }
+    return stream->mapping + stream->slot*stream->slotSize;
+}
+
+GLintptr finishStreamSlot(StreamBuffer* stream, GLsizeiptr bytes) {
+    glBindBuffer(GL_ARRAY_BUFFER, stream->buffer);
+    if (stream->persistent)
+        return stream->slot*stream->slotSize;  // coherent, so the writes need no flush
+    glBufferData(GL_ARRAY_BUFFER, stream->slotSize, NULL, GL_STREAM_DRAW);
+    glBufferSubData(GL_ARRAY_BUFFER, 0, bytes, stream->staging);
+    return 0;
+}
+
+void fenceStreamSlot(StreamBuffer* stream) {
+    if ( ! stream->persistent )
+        return;
+    stream->fences[stream->slot] = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+    stream->slot = (stream->slot + 1) % STREAM_SLOTS;
+}
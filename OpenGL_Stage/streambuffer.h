@@ -0,0 +1,67 @@
+/*  Header file for streambuffer.c, which streams data that changes every
+    frame, such as the positions of moving points, into a vertex buffer.
+
+    The usual way, glBufferData() or glBufferSubData() every frame, copies
+    the data twice: from the program's array into memory of the driver, and
+    from there to the GPU.  glBufferSubData() into storage that the GPU is
+    still drawing from must also wait, or make a copy, and glBufferData()
+    asks for new storage every frame.
+
+    Here, the buffer has STREAM_SLOTS slots and is mapped once, for good,
+    with the persistent, coherent mapping of ARB_buffer_storage (core in
+    OpenGL 4.4).  Each frame writes its data straight into the next slot,
+    where the GPU can read it, and the draw calls read it from there.  After
+    the draw calls, a fence is put into the command stream for the slot;
+    before the slot comes round again, three frames later, the CPU waits on
+    the fence, which has normally long passed, so the CPU never writes over
+    data that the GPU has still to read, and never waits for the frame that
+    the GPU is drawing.
+
+    Without ARB_buffer_storage, a slot is memory of the program's own, which
+    finishStreamSlot() copies into orphaned storage with glBufferSubData(),
+    so a program can use a stream buffer either way.
+
+    Requires OpenGL 3.2 (for fences), and ARB_buffer_storage for the mapping.  */
+
+#ifndef STREAMBUFFER_H
+#define STREAMBUFFER_H
+
+#include "shader.h"
+
+#define STREAM_SLOTS 3        // the frame being written, and two that the GPU may still be drawing
+#define STREAM_ALIGNMENT 64   // slots start on this many bytes
+
+typedef struct StreamBuffer {
+    GLuint buffer;
+    GLsizeiptr slotSize;      // bytes per slot, a multiple of STREAM_ALIGNMENT
+    int slot;                 // the slot that the next frame writes
+    int persistent;           // Is the buffer mapped?  Otherwise slots are copied from staging.
+    char* mapping;            // all of the slots, if persistent
+    char* staging;            // one slot, if not
+    GLsync fences[STREAM_SLOTS];  // 0 for a slot that the GPU is not reading
+    double waitMilliseconds;  // how long beginStreamSlot() last waited for the GPU
+} StreamBuffer;
+
+/*  Makes a buffer with slots of at least slotSize bytes, mapped if the
+    context has ARB_buffer_storage and persistent is 1.  Returns 0, after
+    printing a message, if the OpenGL version is too old or there is not
+    enough memory.  */
+int initStreamBuffer(StreamBuffer* stream, GLsizeiptr slotSize, int persistent);
+
+void freeStreamBuffer(StreamBuffer* stream);
+
+/*  Waits until the GPU has finished with the next slot, and returns the
+    memory to write up to slotSize bytes of the frame's data into.  Write it
+    in order, and never read it: if it is mapped, it is uncached memory.  */
+void* beginStreamSlot(StreamBuffer* stream);
+
+/*  Makes the first bytes of the slot ready for drawing, binds the buffer to
+    GL_ARRAY_BUFFER, and returns the offset of the slot in the buffer, for
+    glVertexAttribPointer().  */
+GLintptr finishStreamSlot(StreamBuffer* stream, GLsizeiptr bytes);
+
+/*  Call after the last draw call that reads the slot: fences the slot and
+    moves on to the next.  */
+void fenceStreamSlot(StreamBuffer* stream);
+
+#endif
@@ -0,0 +1,589 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <setjmp.h>
+#include <pthread.h>
+#include <unistd.h>
+#include <jpeglib.h>
+#include "texture.h"
+
+//  A face of a texture that a loader thread has to decode.
+typedef struct LoadRequest {
+    Texture* texture;
+    int face;
+} LoadRequest;
+
+// The queue of requests, as a ring buffer, shared with the loader threads.
+static pthread_mutex_t lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t requestsWaiting = PTHREAD_COND_INITIALIZER;
+static LoadRequest* requests;
+static int requestCapacity, requestHead, requestCount;
+static int stopping;
+static pthread_t loaders[TEXTURE_LOADER_THREADS];
+static int loaderCount;
+
+// Used only on the thread that owns the OpenGL context.
+static Texture* textures;      // the cache; scenes have a few textures, so it is just a list
+static GLuint uploadBuffer;    // a pixel buffer object for copying levels into textures
+static unsigned frame = 1;     // counted by updateTextures()
+static size_t budget = TEXTURE_DEFAULT_BUDGET;
+static size_t residentBytes, uploadedBytes;
+static int evictions;
+
+// ------------------------------- decoding ---------------------------------------
+
+//  A libjpeg error manager that jumps back to readTextureImage() instead of exiting.
+typedef struct JpegError {
+    struct jpeg_error_mgr manager;
+    jmp_buf jump;
+} JpegError;
+
+static void jpegErrorExit(j_common_ptr info) {
+    JpegError* error = (JpegError*)info->err;
+    longjmp(error->jump, 1);
+}
+
+/*  Makes level from the level before it: each pixel is the average of a
+    block of 2 by 2 pixels, or of the pixels of the block that exist, where a
+    side of odd length is halved.  */
+static void halveImage(const unsigned char* source, int width, int height, unsigned char* result) {
+    int halfWidth = width > 1 ? width/2 : 1;
+    int halfHeight = height > 1 ? height/2 : 1;
+    int x, y, c;
+    for (y = 0; y < halfHeight; y++) {
+        const unsigned char* row0 = source + 2*y*width*4;
+        const unsigned char* row1 = height > 1 ? row0 + width*4 : row0;
+        unsigned char* out = result + y*halfWidth*4;
+        for (x = 0; x < halfWidth; x++) {
+            int left = 2*x*4, right = width > 1 ? left + 4 : left;
+            for (c = 0; c < 4; c++)
+                out[4*x + c] = (unsigned char)((row0[left + c] + row0[right + c] + row1[left + c]
+                                                + row1[right + c] + 2) >> 2);
+        }
+    }
+}
+
+int readTextureImage(const char* path, int bottomUp, TextureImage* image) {
+    struct jpeg_decompress_struct info;
+    JpegError error;
+    unsigned char* volatile rgba = NULL;
+    unsigned char* volatile row = NULL;
+    int width, height, level, x;
+    FILE* file = fopen(path, "rb");
+    memset(image, 0, sizeof(TextureImage));
+    if ( ! file ) {
+        printf("Cannot open the image %s.\n", path);
+        return 0;
+    }
+    info.err = jpeg_std_error(&error.manager);
+    error.manager.error_exit = jpegErrorExit;
+    if (setjmp(error.jump)) {
+        char message[JMSG_LENGTH_MAX];
+        error.manager.format_message((j_common_ptr)&info, message);
+        printf("Cannot read the image %s: %s\n", path, message);
+        jpeg_destroy_decompress(&info);
+        fclose(file);
+        free(rgba);
+        free(row);
+        return 0;
+    }
+    jpeg_create_decompress(&info);
+    jpeg_stdio_src(&info, file);
+    jpeg_read_header(&info, TRUE);
+    info.out_color_space = JCS_RGB;
+    jpeg_start_decompress(&info);
+    width = info.output_width;
+    height = info.output_height;
+    rgba = malloc((size_t)width*height*4);
+    row = malloc((size_t)width*3);
+    if ( ! rgba || ! row ) {
+        printf("Not enough memory for the image %s.\n", path);
+        longjmp(error.jump, 1);
+    }
+    while (info.output_scanline < info.output_height) {
+        int y = bottomUp ? height - 1 - info.output_scanline : info.output_scanline;
+        unsigned char* out = rgba + (size_t)y*width*4;
+        JSAMPROW rows[1] = { row };
+        jpeg_read_scanlines(&info, rows, 1);
+        for (x = 0; x < width; x++) {
+            out[4*x] = row[3*x];
+            out[4*x+1] = row[3*x+1];
+            out[4*x+2] = row[3*x+2];
+            out[4*x+3] = 255;
+        }
+    }
+    jpeg_finish_decompress(&info);
+    jpeg_destroy_decompress(&info);
+    fclose(file);
+    free(row);
+
+    image->width = width;
+    image->height = height;
+    image->levels[0] = rgba;
+    image->levelCount = 1;
+    for (level = 1; level < TEXTURE_MAX_LEVELS && (width > 1 || height > 1); level++) {
+        int halfWidth = width > 1 ? width/2 : 1;
+        int halfHeight = height > 1 ? height/2 : 1;
+        image->levels[level] = malloc((size_t)halfWidth*halfHeight*4);
+        if ( ! image->levels[level] )
+            break;  // the texture just has fewer mipmaps
+        halveImage(image->levels[level-1], width, height, image->levels[level]);
+        image->levelCount++;
+        width = halfWidth;
+        height = halfHeight;
+    }
+    return 1;
+}
+
+void freeTextureImage(TextureImage* image) {
+    int level;
+    for (level = 0; level < image->levelCount; level++)
+        free(image->levels[level]);
+    memset(image, 0, sizeof(TextureImage));
+}
+
+// ---------------------------- loader threads ------------------------------------
+
+static void* loaderMain(void* arg) {
+    for (;;) {
+        LoadRequest request;
+        TextureImage image;
+        int ok;
+        pthread_mutex_lock(&lock);
+        while ( ! stopping && requestCount == 0 )
+            pthread_cond_wait(&requestsWaiting, &lock);
+        if (stopping) {
+            pthread_mutex_unlock(&lock);
+            return NULL;
+        }
+        request = requests[requestHead];
+        requestHead = (requestHead + 1) % requestCapacity;
+        requestCount--;
+        pthread_mutex_unlock(&lock);
+
+        ok = readTextureImage(request.texture->paths[request.face], request.texture->target == GL_TEXTURE_2D, &image);
+
+        pthread_mutex_lock(&lock);
+        request.texture->images[request.face] = image;
+        request.texture->decoded[request.face] = ok;
+        if ( ! ok )
+            request.texture->failed = 1;
+        request.texture->outstanding--;
+        pthread_mutex_unlock(&lock);
+    }
+}
+
+void texturesInit() {
+    int cores = (int)sysconf(_SC_NPROCESSORS_ONLN), i;
+    if (loaderCount > 0)
+        return;
+    loaderCount = cores < TEXTURE_LOADER_THREADS ? cores : TEXTURE_LOADER_THREADS;
+    if (loaderCount < 1)
+        loaderCount = 1;
+    stopping = 0;
+    for (i = 0; i < loaderCount; i++)
+        pthread_create(&loaders[i], NULL, loaderMain, NULL);
+}
+
+void texturesShutdown() {
+    int i;
+    pthread_mutex_lock(&lock);
+    stopping = 1;
+    pthread_cond_broadcast(&requestsWaiting);
+    pthread_mutex_unlock(&lock);
+    for (i = 0; i < loaderCount; i++)
+        pthread_join(loaders[i], NULL);
+    loaderCount = 0;
+}
+
+// ---------------------------------- the cache -----------------------------------
+
+//  Returns the texture in the cache for the files, or NULL.
+static Texture* findTexture(const char** paths, int faceCount) {
+    Texture* texture;
+    int face;
+    for (texture = textures; texture; texture = texture->next) {
+        if (texture->faceCount != faceCount)
+            continue;
+        for (face = 0; face < faceCount; face++)
+            if (strcmp(texture->paths[face], paths[face]) != 0)
+                break;
+        if (face == faceCount)
+            return texture;
+    }
+    return NULL;
+}
+
+static Texture* startLoading(const char** paths, int faceCount, GLenum target) {
+    Texture* texture = findTexture(paths, faceCount);
+    int face;
+    if (texture) {
+        texture->references++;
+        texture->lastUsed = frame;
+        return texture;
+    }
+    texture = calloc(1, sizeof(Texture));
+    texture->target = target;
+    texture->state = TEXTURE_LOADING;
+    texture->faceCount = faceCount;
+    texture->outstanding = faceCount;
+    texture->references = 1;
+    texture->lastUsed = frame;
+    for (face = 0; face < faceCount; face++)
+        texture->paths[face] = strdup(paths[face]);
+    texture->next = textures;
+    textures = texture;
+
+    pthread_mutex_lock(&lock);
+    if (requestCount + faceCount > requestCapacity) {
+        int capacity = 2*(requestCount + faceCount), i;
+        LoadRequest* grown = malloc(capacity*sizeof(LoadRequest));
+        for (i = 0; i < requestCount; i++)
+            grown[i] = requests[(requestHead + i) % requestCapacity];
+        free(requests);
+        requests = grown;
+        requestCapacity = capacity;
+        requestHead = 0;
+    }
+    for (face = 0; face < faceCount; face++) {
+        LoadRequest request = { texture, face };
+        requests[(requestHead + requestCount) % requestCapacity] = request;
+        requestCount++;
+    }
+    pthread_cond_broadcast(&requestsWaiting);
+    pthread_mutex_unlock(&lock);
+    return texture;
+}
+
+Texture* loadTexture(const char* path) {
+    return startLoading(&path, 1, GL_TEXTURE_2D);
+}
+
+Texture* loadCubeMap(const char* paths[6]) {
+    return startLoading(paths, 6, GL_TEXTURE_CUBE_MAP);
+}
+
+void releaseTexture(Texture* texture) {
+    if (texture && texture->references > 0)
+        texture->references--;
+}
+
+void markTextureUsed(Texture* texture) {
+    texture->lastUsed = frame;
+}
+
+void setTextureBudget(size_t bytes) {
+    budget = bytes;
+}
+
+void getTextureStats(TextureStats* stats) {
+    Texture* texture;
+    stats->textures = 0;
+    for (texture = textures; texture; texture = texture->next)
+        stats->textures++;
+    stats->residentBytes = residentBytes;
+    stats->budget = budget;
+    stats->uploadedBytes = uploadedBytes;
+    stats->evictions = evictions;
+}
+
+//  Takes a texture out of the cache, and frees it.  Its faces must all be done.
+static void destroyTexture(Texture* texture) {
+    Texture** link;
+    int face;
+    for (link = &textures; *link; link = &(*link)->next)
+        if (*link == texture) {
+            *link = texture->next;
+            break;
+        }
+    if (texture->name)
+        glDeleteTextures(1, &texture->name);
+    residentBytes -= texture->residentBytes;
+    for (face = 0; face < texture->faceCount; face++) {
+        freeTextureImage(&texture->images[face]);
+        free(texture->paths[face]);
+    }
+    free(texture);
+}
+
+// -------------------------- copying into textures --------------------------------
+
+static void levelSize(const TextureImage* image, int level, int* width, int* height) {
+    *width = image->width >> level;
+    *height = image->height >> level;
+    if (*width < 1)
+        *width = 1;
+    if (*height < 1)
+        *height = 1;
+}
+
+//  The bytes of the levels from the given one down to 1 by 1, for all faces.
+static size_t bytesFromLevel(const Texture* texture, int level) {
+    const TextureImage* image = &texture->images[0];
+    size_t bytes = 0;
+    int width, height;
+    for (; level < image->levelCount; level++) {
+        levelSize(image, level, &width, &height);
+        bytes += (size_t)width*height*4;
+    }
+    return bytes*texture->faceCount;
+}
+
+//  The level that is copied as soon as the texture is decoded: the largest of at most TEXTURE_TAIL_SIZE pixels.
+static int tailLevel(const Texture* texture) {
+    const TextureImage* image = &texture->images[0];
+    int level = 0;
+    while (level < image->levelCount - 1
+            && ((image->width >> level) > TEXTURE_TAIL_SIZE || (image->height >> level) > TEXTURE_TAIL_SIZE))
+        level++;
+    return level;
+}
+
+//  The target for glTexImage2D() of a face of the texture.
+static GLenum faceTarget(const Texture* texture, int face) {
+    return texture->target == GL_TEXTURE_CUBE_MAP ? GL_TEXTURE_CUBE_MAP_POSITIVE_X + face : GL_TEXTURE_2D;
+}
+
+/*  Makes the texture object, with storage for the tail levels, from the
+    given one down, copied from the decoded images, and no other storage.
+    Returns the bytes copied.  */
+static size_t makeTail(Texture* texture, int level) {
+    const TextureImage* image = &texture->images[0];
+    size_t bytes = bytesFromLevel(texture, level), offset = 0;
+    int face, i, width, height;
+    glGenTextures(1, &texture->name);
+    glBindTexture(texture->target, texture->name);
+    glTexParameteri(texture->target, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
+    glTexParameteri(texture->target, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+    // Only the levels from the base level down are drawn, so levels above it can be missing.
+    glTexParameteri(texture->target, GL_TEXTURE_BASE_LEVEL, level);
+    glTexParameteri(texture->target, GL_TEXTURE_MAX_LEVEL, image->levelCount - 1);
+    if (texture->target == GL_TEXTURE_CUBE_MAP) {
+        glTexParameteri(texture->target, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+        glTexParameteri(texture->target, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+        if ( hasGLVersion(3, 2) )
+            glEnable(GL_TEXTURE_CUBE_MAP_SEAMLESS);  // filter across the edges of the faces
+    }
+    else {
+        glTexParameteri(texture->target, GL_TEXTURE_WRAP_S, GL_REPEAT);
+        glTexParameteri(texture->target, GL_TEXTURE_WRAP_T, GL_REPEAT);
+    }
+    if ( ! uploadBuffer )
+        glGenBuffers(1, &uploadBuffer);
+    // Orphan the buffer, so that the driver need not wait for the previous copy out of it.
+    glBindBuffer(GL_PIXEL_UNPACK_BUFFER, uploadBuffer);
+    glBufferData(GL_PIXEL_UNPACK_BUFFER, bytes, NULL, GL_STREAM_DRAW);
+    for (face = 0; face < texture->faceCount; face++)
+        for (i = level; i < image->levelCount; i++) {
+            size_t size;
+            levelSize(image, i, &width, &height);
+            size = (size_t)width*height*4;
+            glBufferSubData(GL_PIXEL_UNPACK_BUFFER, offset, size, texture->images[face].levels[i]);
+            glTexImage2D(faceTarget(texture, face), i, GL_RGBA8, width, height, 0, GL_RGBA, GL_UNSIGNED_BYTE,
+                         (const void*)offset);
+            offset += size;
+        }
+    glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+    texture->residentLevel = level;
+    texture->residentBytes = bytes;
+    residentBytes += bytes;
+    uploadedBytes += bytes;
+    return bytes;
+}
+
+/*  Gives the texture storage for the level above its resident level, in
+    every face, to be filled by copyRows().  */
+static void startLevel(Texture* texture) {
+    int level = texture->residentLevel - 1, face, width, height;
+    size_t bytes;
+    levelSize(&texture->images[0], level, &width, &height);
+    bytes = (size_t)width*height*4*texture->faceCount;
+    glBindTexture(texture->target, texture->name);
+    for (face = 0; face < texture->faceCount; face++)
+        glTexImage2D(faceTarget(texture, face), level, GL_RGBA8, width, height, 0, GL_RGBA, GL_UNSIGNED_BYTE, NULL);
+    texture->streaming = 1;
+    texture->streamFace = texture->streamRow = 0;
+    texture->residentBytes += bytes;
+    residentBytes += bytes;
+}
+
+/*  Copies the next rows of the level that is streaming in, as many as fit
+    in available bytes, but at least one if atLeastOne is set, and no further
+    than the end of the face.  When the last face is complete, the level
+    becomes the base level.  Returns the bytes copied, 0 if not even a row
+    fits.  */
+static size_t copyRows(Texture* texture, size_t available, int atLeastOne) {
+    int level = texture->residentLevel - 1, width, height, rows;
+    size_t rowBytes, bytes;
+    levelSize(&texture->images[0], level, &width, &height);
+    rowBytes = (size_t)width*4;
+    rows = available / rowBytes < (size_t)(height - texture->streamRow) ? (int)(available / rowBytes)
+                                                                        : height - texture->streamRow;
+    if (rows == 0 && atLeastOne)
+        rows = 1;
+    if (rows == 0)
+        return 0;
+    bytes = rows*rowBytes;
+    glBindTexture(texture->target, texture->name);
+    glBindBuffer(GL_PIXEL_UNPACK_BUFFER, uploadBuffer);
+    glBufferData(GL_PIXEL_UNPACK_BUFFER, bytes, NULL, GL_STREAM_DRAW);  // orphaned, as in makeTail()
+    glBufferSubData(GL_PIXEL_UNPACK_BUFFER, 0, bytes,
+                    texture->images[texture->streamFace].levels[level] + texture->streamRow*rowBytes);
+    glTexSubImage2D(faceTarget(texture, texture->streamFace), level, 0, texture->streamRow, width, rows,
+                    GL_RGBA, GL_UNSIGNED_BYTE, NULL);
+    glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+    uploadedBytes += bytes;
+    texture->streamRow += rows;
+    if (texture->streamRow == height) {
+        texture->streamRow = 0;
+        if (++texture->streamFace == texture->faceCount) {
+            texture->streaming = 0;
+            texture->streamFace = 0;
+            texture->residentLevel = level;
+            glTexParameteri(texture->target, GL_TEXTURE_BASE_LEVEL, level);
+        }
+    }
+    return bytes;
+}
+
+/*  Returns the texture that should give up memory first, for a texture used
+    in the frame before: one that no one has loaded, or else the least
+    recently used, as long as it has levels above its tail, complete or
+    streaming in.  keep is never chosen.  Returns NULL if there is none.  */
+static Texture* findVictim(const Texture* keep, unsigned before) {
+    Texture *texture, *victim = NULL;
+    for (texture = textures; texture; texture = texture->next) {
+        if (texture == keep || texture->state != TEXTURE_READY)
+            continue;
+        if (texture->references == 0)
+            return texture;
+        if (texture->lastUsed >= before || (texture->residentLevel >= tailLevel(texture) && ! texture->streaming))
+            continue;
+        if ( ! victim || texture->lastUsed < victim->lastUsed )
+            victim = texture;
+    }
+    return victim;
+}
+
+//  The bytes that would be left, apart from keep, if every victim for it were evicted as far as it can be.
+static size_t bytesThatStay(const Texture* keep, unsigned before) {
+    Texture* texture;
+    size_t bytes = 0;
+    for (texture = textures; texture; texture = texture->next) {
+        if (texture == keep || texture->references == 0)
+            continue;
+        if (texture->state == TEXTURE_READY && texture->lastUsed < before
+                && (texture->residentLevel < tailLevel(texture) || texture->streaming))
+            bytes += bytesFromLevel(texture, tailLevel(texture));
+        else
+            bytes += texture->residentBytes;
+    }
+    return bytes;
+}
+
+/*  Drops the victim, if no one has loaded it, or else the level that is
+    streaming into it, or its base level.  Nothing is copied: the base
+    level moves up, and the dropped level is given an empty image, which
+    gives its memory back.  */
+static void evict(Texture* victim) {
+    int level, face, width, height;
+    size_t bytes;
+    evictions++;
+    if (victim->references == 0) {
+        destroyTexture(victim);
+        return;
+    }
+    glBindTexture(victim->target, victim->name);
+    if (victim->streaming) {
+        level = victim->residentLevel - 1;
+        victim->streaming = 0;
+        victim->streamFace = victim->streamRow = 0;
+    }
+    else {
+        level = victim->residentLevel++;
+        glTexParameteri(victim->target, GL_TEXTURE_BASE_LEVEL, victim->residentLevel);
+    }
+    for (face = 0; face < victim->faceCount; face++)
+        glTexImage2D(faceTarget(victim, face), level, GL_RGBA8, 0, 0, 0, GL_RGBA, GL_UNSIGNED_BYTE, NULL);
+    levelSize(&victim->images[0], level, &width, &height);
+    bytes = (size_t)width*height*4*victim->faceCount;
+    victim->residentBytes -= bytes;
+    residentBytes -= bytes;
+}
+
+//  Returns the texture whose next larger level should be copied first, or NULL if all are complete.
+static Texture* nextToStream() {
+    Texture *texture, *best = NULL;
+    for (texture = textures; texture; texture = texture->next)
+        if (texture->state == TEXTURE_READY && texture->residentLevel > 0 && texture->references > 0
+                && ( ! best || texture->lastUsed > best->lastUsed
+                     || (texture->lastUsed == best->lastUsed && texture->residentLevel > best->residentLevel) ))
+            best = texture;
+    return best;
+}
+
+//  Makes a texture whose faces are all decoded ready, with its tail levels, or failed.
+static size_t finishLoading(Texture* texture) {
+    int face;
+    for (face = 1; face < texture->faceCount; face++)
+        if (texture->images[face].width != texture->images[0].width
+                || texture->images[face].height != texture->images[0].height
+                || texture->images[face].levelCount != texture->images[0].levelCount) {
+            // The faces of a cube map must match, or the texture would be incomplete.
+            printf("The faces of the cube map %s are not all the same size.\n", texture->paths[0]);
+            texture->state = TEXTURE_FAILED;
+            return 0;
+        }
+    texture->width = texture->images[0].width;
+    texture->height = texture->images[0].height;
+    texture->state = TEXTURE_READY;
+    return makeTail(texture, tailLevel(texture));
+}
+
+int updateTextures(int maxBytes) {
+    Texture *texture, *victim, *next;
+    size_t bytes = 0, copied;
+    int finished = 0;
+    frame++;
+    for (texture = textures; texture; texture = next) {
+        int outstanding = 0, failed;
+        next = texture->next;
+        pthread_mutex_lock(&lock);
+        outstanding = texture->outstanding;
+        failed = texture->failed;
+        pthread_mutex_unlock(&lock);
+        if (texture->state == TEXTURE_LOADING && failed) {
+            texture->state = TEXTURE_FAILED;
+            finished++;
+        }
+        // A tail that does not fit in what is left of maxBytes waits for the next frame.
+        else if (texture->state == TEXTURE_LOADING && outstanding == 0
+                 && (bytes == 0 || bytes + bytesFromLevel(texture, tailLevel(texture)) <= (size_t)maxBytes)) {
+            bytes += finishLoading(texture);
+            finished++;
+        }
+        if (texture->state == TEXTURE_FAILED && texture->references == 0 && outstanding == 0)
+            destroyTexture(texture);
+    }
+    // The budget may have been lowered.
+    while (residentBytes > budget && (victim = findVictim(NULL, frame + 1)))
+        evict(victim);
+    while (bytes < (size_t)maxBytes && (texture = nextToStream())) {
+        if ( ! texture->streaming ) {
+            size_t larger = bytesFromLevel(texture, texture->residentLevel - 1);
+            if (larger + bytesThatStay(texture, texture->lastUsed) > budget)
+                break;  // the budget is full of textures used as recently as this one
+            while (residentBytes - texture->residentBytes + larger > budget
+                    && (victim = findVictim(texture, texture->lastUsed)))
+                evict(victim);
+            startLevel(texture);
+        }
+        copied = copyRows(texture, maxBytes - bytes, bytes == 0);
+        if (copied == 0)
+            break;  // not another row fits in this frame
+        bytes += copied;
+    }
+    glBindTexture(GL_TEXTURE_2D, 0);
+    glBindTexture(GL_TEXTURE_CUBE_MAP, 0);
+    return finished;
+}
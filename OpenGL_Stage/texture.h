@@ -0,0 +1,166 @@
+/*  Header file for texture.c, which loads JPEG images into OpenGL textures
+    without holding up the frames that are drawn while they load, and keeps
+    the textures in a cache, within a budget of GPU memory.
+
+    Loading a texture has three parts, and only the last needs OpenGL:
+
+       1. Decoding the JPEG file, with libjpeg.
+       2. Making the chain of mipmaps, each half the size of the one
+          before, down to 1 by 1, by averaging blocks of 2 by 2 pixels.
+       3. Copying the levels into the texture.
+
+    Parts 1 and 2 run on loader threads of their own, started by
+    texturesInit().  They are not the threads of jobs.c, because a thread
+    that waits in jobsParallelFor() helps with any job in the pool, and a
+    frame must never end up waiting for a decode.  The six faces of a cube
+    map are decoded in parallel, as separate images.
+
+    Part 3 is done by updateTextures(), which the program calls once per
+    frame on the thread that owns the OpenGL context, and which copies at
+    most a given number of bytes per call, so that loading never holds up a
+    frame.  The levels are streamed in from the smallest up: once the images
+    are decoded, the levels of TEXTURE_TAIL_SIZE pixels and less are copied,
+    and the texture is ready to be drawn, blurred.  Then the next larger
+    level is given storage in the same texture object and copied in bands of
+    rows, face by face, as many rows per call as fit in the bytes that are
+    left, through a pixel buffer object, so that the copy is done by the
+    driver while the CPU goes on.  GL_TEXTURE_BASE_LEVEL keeps the level out
+    of sight until all of it is in, then moves down to it.  The smaller
+    levels are not copied again, and the name of a texture never changes.
+
+    The textures are cached by file name.  Loading a file that is already in
+    the cache returns the same texture, so scenes that put one image on many
+    objects decode it once and hold it once.  The decoded levels stay in
+    memory, so that levels given up to the budget can be copied in again
+    without decoding.  When a larger level would take the GPU memory of the
+    textures over the budget, the least recently used textures give up their
+    largest levels, down to the tail, and textures that are no longer loaded
+    by anyone are dropped from the cache entirely.  Giving up a level copies
+    nothing: the base level moves to the next smaller level, and the larger
+    one is emptied.
+    The program says that it used a texture for a frame with
+    markTextureUsed().
+
+    Programs that use texture.c must be linked with -ljpeg and -pthread.
+    Requires OpenGL 2.1 (for pixel buffer objects).  */
+
+#ifndef TEXTURE_H
+#define TEXTURE_H
+
+#include <stddef.h>
+#include "shader.h"
+
+#define TEXTURE_MAX_LEVELS 16      // enough for 32768 by 32768 pixels
+#define TEXTURE_LOADER_THREADS 4   // at most this many, and never more than the cores
+#define TEXTURE_TAIL_SIZE 64       // levels no larger than this are copied as soon as a texture is decoded
+
+//  The GPU memory that the textures may use, unless setTextureBudget() says otherwise.
+#define TEXTURE_DEFAULT_BUDGET ((size_t)256 << 20)
+
+//  The bytes that updateTextures() copies per frame by default: a 1024 by 1024 image.
+#define TEXTURE_UPLOAD_BYTES (4 << 20)
+
+//  An image, in RGBA bytes, with its mipmaps; level 0 is the full image.
+typedef struct TextureImage {
+    int width, height;      // of level 0
+    int levelCount;
+    unsigned char* levels[TEXTURE_MAX_LEVELS];
+} TextureImage;
+
+#define TEXTURE_LOADING 0   // the images are being decoded
+#define TEXTURE_READY 1     // it can be drawn, though perhaps not all of its levels are in it yet
+#define TEXTURE_FAILED 2    // an image could not be read; a message has been printed
+
+/*  A texture that is loading or loaded.  The program only reads the fields
+    name, target, state, width, height and residentLevel; the rest belong to
+    texture.c.  */
+typedef struct Texture {
+    GLuint name;            // 0 until the texture is ready
+    GLenum target;          // GL_TEXTURE_2D or GL_TEXTURE_CUBE_MAP
+    int state;              // TEXTURE_LOADING, TEXTURE_READY or TEXTURE_FAILED
+    int width, height;      // of the full image, once it is ready
+    int residentLevel;      // the largest level that is in the texture; 0 when all of them are
+
+    int faceCount;          // 1, or 6 for a cube map
+    char* paths[6];         // the key of the texture in the cache
+    TextureImage images[6];
+    int decoded[6];         // set by a loader thread when images[face] is done, under texture.c's lock
+    int failed;
+    int outstanding;        // faces that the loader threads have not finished
+    int references;         // loads of the texture that have not been released
+    unsigned lastUsed;      // the frame of the last load or markTextureUsed()
+    size_t residentBytes;   // of the levels in the texture object, including one streaming in
+    int streaming;          // Has the level above residentLevel been given storage, to be copied into?
+    int streamFace, streamRow;  // where the copy of that level has got to
+    struct Texture* next;   // in the cache
+} Texture;
+
+//  What the cache holds and has done, for showing with the frame statistics.
+typedef struct TextureStats {
+    int textures;           // in the cache, including those that are loading
+    size_t residentBytes;   // of GPU memory, in all the texture objects
+    size_t budget;
+    size_t uploadedBytes;   // copied into textures since texturesInit()
+    int evictions;          // levels given up, and textures dropped, to stay within the budget
+} TextureStats;
+
+/*  Starts the loader threads, at most TEXTURE_LOADER_THREADS and at most one
+    per core, but at least one.  */
+void texturesInit();
+
+/*  Stops the loader threads.  Textures that have not finished decoding will
+    never be ready.  */
+void texturesShutdown();
+
+/*  Starts loading a 2D texture from a JPEG file, and returns it at once, with
+    its state TEXTURE_LOADING, or returns the texture in the cache for the
+    file, in whatever state it is.  Each call must be matched by a call of
+    releaseTexture().  texturesInit() must have been called.  */
+Texture* loadTexture(const char* path);
+
+/*  Starts loading a cube map from six JPEG files, in the order +x, -x, +y,
+    -y, +z, -z, as for THREE.ImageUtils.loadTextureCube().  The faces must
+    all be square and the same size.  Cube maps are cached by all six file
+    names.  */
+Texture* loadCubeMap(const char* paths[6]);
+
+/*  Makes textures whose images have been decoded ready, then copies rows of
+    larger levels into the textures, the most recently used first, evicting
+    levels of less recently used textures where the budget requires it.  It
+    copies at most maxBytes, except that the first tail or the first row of
+    a call is copied however large it is, so that a small maxBytes still
+    makes progress.  Call once per frame, on the thread that
+    owns the OpenGL context; each call starts a new frame for
+    markTextureUsed().  Returns the number of textures that became ready or
+    failed in this call.  */
+int updateTextures(int maxBytes);
+
+/*  Records that the texture is drawn in the current frame, so that it is
+    streamed in before, and evicted after, textures that were drawn longer
+    ago.  */
+void markTextureUsed(Texture* texture);
+
+/*  Sets the GPU memory that the textures may use.  If they use more, the
+    next updateTextures() evicts levels until they fit, as far as it can
+    without going below TEXTURE_TAIL_SIZE.  */
+void setTextureBudget(size_t bytes);
+
+void getTextureStats(TextureStats* stats);
+
+/*  Releases a texture returned by loadTexture() or loadCubeMap().  When no
+    load of it is left, it stays in the cache, in case it is loaded again,
+    until its memory is needed for other textures.  */
+void releaseTexture(Texture* texture);
+
+/*  Reads a JPEG file into image, as RGBA, and makes its mipmaps.  If
+    bottomUp is non-zero, the top row of the file becomes the last row of the
+    image, since the first row of a 2D texture is at the bottom; the faces of
+    a cube map are stored top row first.  Returns 0 if the file cannot be
+    read; then a message has been printed.  This is what the loader threads
+    do; it can be called from any thread.  */
+int readTextureImage(const char* path, int bottomUp, TextureImage* image);
+
+//  Frees the levels of an image.
+void freeTextureImage(TextureImage* image);
+
+#endif
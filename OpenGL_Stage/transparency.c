@@ -0,0 +1,125 @@
+#include "transparency.h"
+#include <stdio.h>
+#include <string.h>
+
+static const char* compositeVertexShaderSource =
+    "#version 130\n"
+    "void main() {\n"
+    "    gl_Position = vec4(gl_Vertex.xy, 0.0, 1.0);\n"
+    "}\n";
+
+static const char* compositeFragmentShaderSource =
+    "#version 130\n"
+    "uniform sampler2D u_accumulation;\n"
+    "uniform sampler2D u_weights;\n"
+    "void main() {\n"
+    "    ivec2 pixel = ivec2(gl_FragCoord.xy);\n"
+    "    vec4 accumulation = texelFetch(u_accumulation, pixel, 0);\n"
+    "    float revealage = accumulation.a;\n"
+    "    if (revealage >= 1.0)\n"
+    "        discard;  // nothing transparent covers this pixel\n"
+    "    float weight = texelFetch(u_weights, pixel, 0).r;\n"
+    "    gl_FragColor = vec4(accumulation.rgb / max(weight, 1e-5), 1.0 - revealage);\n"
+    "}\n";
+
+int initTransparency(Transparency* transparency) {
+    static const GLenum drawBuffers[2] = { GL_COLOR_ATTACHMENT0, GL_COLOR_ATTACHMENT1 };
+    GLint output;
+    memset(transparency, 0, sizeof(Transparency));
+    if ( ! hasGLVersion(3, 0) ) {
+        printf("Order-independent transparency needs OpenGL 3.0.\n");
+        return 0;
+    }
+    transparency->program = createProgram("transparency composite", compositeVertexShaderSource,
+                                          compositeFragmentShaderSource);
+    if ( ! transparency->program )
+        return 0;
+    glUseProgram(transparency->program);
+    glUniform1i(glGetUniformLocation(transparency->program, "u_accumulation"), 0);
+    glUniform1i(glGetUniformLocation(transparency->program, "u_weights"), 1);
+    glUseProgram(0);
+
+    glGenTextures(1, &transparency->accumulationTexture);
+    glGenTextures(1, &transparency->weightTexture);
+    glGenFramebuffers(1, &transparency->framebuffer);
+    glGetIntegerv(GL_DRAW_FRAMEBUFFER_BINDING, &output);
+    glBindFramebuffer(GL_FRAMEBUFFER, transparency->framebuffer);
+    glDrawBuffers(2, drawBuffers);
+    glBindFramebuffer(GL_FRAMEBUFFER, output);
+    return 1;
+}
+
+void freeTransparency(Transparency* transparency) {
+    glDeleteFramebuffers(1, &transparency->framebuffer);
+    glDeleteTextures(1, &transparency->accumulationTexture);
+    glDeleteTextures(1, &transparency->weightTexture);
+    glDeleteProgram(transparency->program);
+    memset(transparency, 0, sizeof(Transparency));
+}
+
+//  Gives texture the storage for a target of the given format, read with texelFetch().
+static void makeTarget(GLuint texture, GLenum internalFormat, GLenum format, int width, int height) {
+    glBindTexture(GL_TEXTURE_2D, texture);
+    glTexImage2D(GL_TEXTURE_2D, 0, internalFormat, width, height, 0, format, GL_FLOAT, NULL);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+    glBindTexture(GL_TEXTURE_2D, 0);
+}
+
+void beginTransparency(Transparency* transparency, int width, int height, GLuint depthBuffer) {
+    static const float clearAccumulation[4] = { 0, 0, 0, 1 }, clearWeights[4] = { 0, 0, 0, 0 };
+    glGetIntegerv(GL_DRAW_FRAMEBUFFER_BINDING, &transparency->outputFramebuffer);
+    // Saved while the output framebuffer is bound, so that its draw buffer comes back with it.
+    glPushAttrib(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT | GL_ENABLE_BIT);
+    glBindFramebuffer(GL_FRAMEBUFFER, transparency->framebuffer);
+    if (width != transparency->width || height != transparency->height) {
+        makeTarget(transparency->accumulationTexture, GL_RGBA32F, GL_RGBA, width, height);
+        makeTarget(transparency->weightTexture, GL_R32F, GL_RED, width, height);
+        glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D,
+                               transparency->accumulationTexture, 0);
+        glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT1, GL_TEXTURE_2D,
+                               transparency->weightTexture, 0);
+        transparency->width = width;
+        transparency->height = height;
+    }
+    if (depthBuffer != transparency->depthBuffer) {
+        glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, GL_RENDERBUFFER, depthBuffer);
+        transparency->depthBuffer = depthBuffer;
+    }
+    glClearBufferfv(GL_COLOR, 0, clearAccumulation);
+    glClearBufferfv(GL_COLOR, 1, clearWeights);
+
+    // Color adds up in every target; alpha, which only the accumulation target
+    // has, is multiplied by 1 - alpha.
+    glEnable(GL_BLEND);
+    glBlendFuncSeparate(GL_ONE, GL_ONE, GL_ZERO, GL_ONE_MINUS_SRC_ALPHA);
+    glDepthMask(GL_FALSE);
+}
+
+void endTransparency(Transparency* transparency) {
+    glBindFramebuffer(GL_FRAMEBUFFER, transparency->outputFramebuffer);
+    glPopAttrib();
+
+    glPushAttrib(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT | GL_ENABLE_BIT);
+    glDisable(GL_DEPTH_TEST);
+    glDepthMask(GL_FALSE);
+    glDisable(GL_CULL_FACE);
+    glEnable(GL_BLEND);
+    glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);  // alpha is 1 - revealage
+    glUseProgram(transparency->program);
+    glActiveTexture(GL_TEXTURE1);
+    glBindTexture(GL_TEXTURE_2D, transparency->weightTexture);
+    glActiveTexture(GL_TEXTURE0);
+    glBindTexture(GL_TEXTURE_2D, transparency->accumulationTexture);
+    glBegin(GL_TRIANGLES);  // one triangle that covers the viewport
+    glVertex2f(-1, -1);
+    glVertex2f(3, -1);
+    glVertex2f(-1, 3);
+    glEnd();
+    glBindTexture(GL_TEXTURE_2D, 0);
+    glActiveTexture(GL_TEXTURE1);
+    glBindTexture(GL_TEXTURE_2D, 0);
+    glActiveTexture(GL_TEXTURE0);
+    glUseProgram(0);
+    glPopAttrib();
+}
@@ -0,0 +1,80 @@
+/*  Header file for transparency.c, which draws transparent surfaces in any
+    order, with the weighted, blended order-independent transparency of
+    McGuire and Bavoil (2013).
+
+    Blending each surface over the ones behind it gives the right picture
+    only if the surfaces are drawn from back to front, which needs a sort by
+    depth every frame, and even then fails where surfaces cross.  Here, the
+    transparent surfaces are drawn, after the opaque ones, into two targets
+    of their own, with additive blending, which does not care about order:
+
+        the accumulation target (RGBA32F) adds up, in rgb, each color times
+        its alpha and a weight, and multiplies together, in alpha, 1 - alpha
+        of every surface, the "revealage": how much of the opaque scene
+        still shows through;
+        the weight target (R32F) adds up each alpha times its weight.
+
+    endTransparency() then divides the two sums, which gives an average of
+    the transparent colors, weighted so that nearer and more opaque surfaces
+    count for more, and blends it over the opaque scene with the revealage.
+    Both targets are filled by one blend function, so that OpenGL 3.0, which
+    has no blend function per draw buffer, is enough.  The sums are 32-bit
+    floats, since thousands of points covering one pixel would overflow or
+    stop adding up in 16 bits.
+
+    A fragment shader for the transparent pass pastes in TRANSPARENCY_GLSL
+    and ends with writeTransparent(color) instead of setting gl_FragColor;
+    it must then write gl_FragData[0] when it draws anything else.  The
+    surfaces are depth tested against the opaque scene, but do not write
+    depth.
+
+    Requires OpenGL 3.0 (for framebuffer objects and float textures).  */
+
+#ifndef TRANSPARENCY_H
+#define TRANSPARENCY_H
+
+#include "shader.h"
+
+/*  GLSL for the fragment shader of the transparent pass, for #version 120
+    and later.  The weight falls off with the cube of the depth in the depth
+    buffer, as in equation 9 of the paper, so that of two surfaces of the
+    same alpha the nearer one shows more.  */
+#define TRANSPARENCY_GLSL \
+    "void writeTransparent(vec4 color) {\n" \
+    "    float weight = color.a * clamp(3e3 * pow(1.0 - gl_FragCoord.z, 3.0), 1e-2, 3e3);\n" \
+    "    gl_FragData[0] = vec4(color.rgb * weight, color.a);\n" \
+    "    gl_FragData[1] = vec4(weight);\n" \
+    "}\n"
+
+typedef struct Transparency {
+    GLuint framebuffer;
+    GLuint accumulationTexture;   // RGBA32F: the sum of color times weight, and the revealage
+    GLuint weightTexture;         // R32F: the sum of the weights
+    GLuint program;               // for compositing the targets over the scene
+    int width, height;            // of the targets, which are made again when the size changes
+    GLuint depthBuffer;           // the renderbuffer attached for the depth test; not owned
+    GLint outputFramebuffer;      // bound when the pass began, and bound again when it ends
+} Transparency;
+
+/*  Creates the framebuffer and the compositing shader; the targets are made
+    by the first pass.  Returns 0, after printing a message, if the OpenGL
+    version is too old or the shader does not compile.  */
+int initTransparency(Transparency* transparency);
+
+void freeTransparency(Transparency* transparency);
+
+/*  Starts the transparent pass: binds the targets, made or remade width by
+    height pixels, clears them, and sets up the blending.  depthBuffer is the
+    depth renderbuffer of the framebuffer object that holds the opaque scene,
+    which is attached for the depth test, or 0 for a scene without depth.
+    Draw the transparent surfaces after this, with shaders that use
+    TRANSPARENCY_GLSL.  */
+void beginTransparency(Transparency* transparency, int width, int height, GLuint depthBuffer);
+
+/*  Ends the pass, binds the framebuffer that was bound when it began, puts
+    back the state that beginTransparency() changed, and composites the
+    transparent surfaces over the scene in that framebuffer.  No shader is
+    current afterwards.  */
+void endTransparency(Transparency* transparency);
+
+#endif
@@ -1,16 +1,24 @@
 /*
- * Some objects in 3D.  The arrow keys
+ * Some objects in 3D.  Dragging with the mouse rolls the object like a
+ * trackball, with controls.c from OpenGL_Stage, and it keeps turning for
+ * a moment when it is let go.  The arrow keys
  * can be used to rotate the object.  The number keys 1 through 5
  * select the object.  The space bar toggles the use of anaglyph
- * stereo.  Compile this program with:
+ * stereo.  The object turns smoothly to each new rotation, animated by
+ * frameloop.c from OpenGL_Stage, which stops drawing while the object is
+ * still; run with -uncapped to draw as fast as
+ * possible with vsync off, or -stats to show frame times.
+ * Compile this program with:
  *
- *           gcc -o code code.c -lGL -lglut
+ *           gcc -o code code.c ../OpenGL_Stage/frameloop.c ../OpenGL_Stage/controls.c -lGL -lglut -lm
  */
 
 #include <GL/gl.h>
 #include <GL/freeglut.h>
 #include <stdio.h>
 #include <stdlib.h> // used for Math functions like random
+#include "../OpenGL_Stage/frameloop.h"
+#include "../OpenGL_Stage/controls.h"
 
 //-------------------Data for stellated dodecahedron ------------------
 
@@ -124,13 +132,31 @@ int rotateX = 0;    //   Rotations of the cube about the axes.
 int rotateY = 0;    //   (Controlled by arrow, PageUp, PageDown keys;
 int rotateZ = 0;    //   Home key sets all rotations to 0.)
 
+double angles[3];          // The rotations that are shown, which turn towards
+double previousAngles[3];  //   rotateX, rotateY and rotateZ; see update().
+#define TURN_SPEED 180     // degrees per second
+
+CameraControls trackball;  // turned by the mouse; applied before the rotations of the keys
+#define UPDATES_PER_SECOND 120
+
+unsigned char shapeColors[6][3];  // Random colors for shape(), picked when it is selected.
+
+void pickShapeColors() {
+    int i;
+    for (i=0; i<6; i++) {
+        shapeColors[i][0] = rand()%255;
+        shapeColors[i][1] = rand()%255;
+        shapeColors[i][2] = rand()%255;
+    }
+}
+
 void shape() {
     glPushMatrix();
     glBegin( GL_TRIANGLE_FAN );
     float vertices[6][2] = { {-3,0}, {-5,5}, {5,5}, {3,0}, {5,-5}, {-5,-5} };
     int i; int n = sizeof(vertices) / sizeof(vertices[0]);
     for (i=0; i<n; i++) {
-        glColor3ub( rand()%255, rand()%255, rand()%255 );
+        glColor3ubv( shapeColors[i] );
         glVertex2f( vertices[i][0], vertices[i][1] );
     }
     glEnd();
@@ -248,9 +274,17 @@ void cage() {
  */
 void draw() {
 
-    glRotatef(rotateZ,0,0,1);   // Apply rotations to complete object.
-    glRotatef(rotateY,0,1,0);
-    glRotatef(rotateX,1,0,0);
+    double alpha = frameLoopAlpha();  // Interpolate between the last two updates.
+    double a[3];
+    float rotation[16];
+    int i;
+    for (i=0; i<3; i++)
+        a[i] = previousAngles[i] + (angles[i] - previousAngles[i]) * alpha;
+    getControlsRotation(&trackball, alpha, rotation);
+    glMultMatrixf(rotation);
+    glRotated(a[2],0,0,1);   // Apply rotations to complete object.
+    glRotated(a[1],0,1,0);
+    glRotated(a[0],1,0,0);
 
     // TODO: Draw the currently selected object, number 1, 2, 3, 4, or 5.
     // (Objects should lie in the cube with x, y, and z coordinates in the
@@ -321,6 +355,7 @@ void display() {  // Display function will draw the image.
     }
 
     glutSwapBuffers(); // Required AT THE END to copy color buffer onto the screen.
+    frameLoopEndFrame();
 
 } // end display()
 
@@ -342,6 +377,41 @@ void initGL() {
     glEnable(GL_DEPTH_TEST);
 }
 
+//-------------------- Animation ---------------------------
+
+/*
+ * update() is called by the frame loop UPDATES_PER_SECOND times per second
+ * to turn the object towards the rotation that was picked with the keys.
+ */
+void update(double dt) {
+    int target[3] = { rotateX, rotateY, rotateZ };
+    int i;
+    for (i=0; i<3; i++) {
+        double difference = target[i] - angles[i];
+        double maxTurn = TURN_SPEED * dt;
+        previousAngles[i] = angles[i];
+        if (difference > maxTurn)
+            difference = maxTurn;
+        else if (difference < -maxTurn)
+            difference = -maxTurn;
+        angles[i] += difference;
+    }
+    updateControls(&trackball, dt);
+}
+
+/*
+ * isMoving() is called by the frame loop after its updates; while it returns
+ * 0, nothing is drawn until a key or the mouse wakes the loop.
+ */
+int isMoving() {
+    int target[3] = { rotateX, rotateY, rotateZ };
+    int i;
+    for (i=0; i<3; i++)
+        if (angles[i] != target[i] || previousAngles[i] != target[i])
+            return 1;
+    return controlsMoving(&trackball);
+}
+
 //-------------------- Key-handling functions ---------------------------
 
 void doSpecialKey(int key, int x, int y) {
@@ -359,18 +429,22 @@ void doSpecialKey(int key, int x, int y) {
        rotateZ += 15;
     else if ( key == GLUT_KEY_PAGE_DOWN )
        rotateZ -= 15;
-    else if ( key == GLUT_KEY_HOME )
+    else if ( key == GLUT_KEY_HOME ) {
        rotateX = rotateY = rotateZ = 0;
+       resetControls(&trackball);
+    }
     else
        redraw = 0;
     if (redraw)
-        glutPostRedisplay(); // will repaint the window
+        frameLoopWake(); // will repaint the window, for as long as the object turns
 }
 
 void doKeyboard( unsigned char ch, int x, int y ) {
     int redraw = 1;
-    if ( ch == '1')
+    if ( ch == '1') {
         objectNumber = 1;
+        pickShapeColors();
+    }
     else if ( ch == '2')
         objectNumber = 2;
     else if ( ch == '3')
@@ -386,7 +460,20 @@ void doKeyboard( unsigned char ch, int x, int y ) {
     else
        redraw = 0;
     if (redraw)
-        glutPostRedisplay(); // will repaint the window
+        frameLoopWake(); // will repaint the window
+}
+
+//-------------------- Mouse-handling functions ---------------------------
+
+void doMouse(int button, int state, int x, int y) {
+    resizeControls(&trackball, glutGet(GLUT_WINDOW_WIDTH), glutGet(GLUT_WINDOW_HEIGHT));
+    controlsMouseButton(&trackball, button, state, x, y);
+    frameLoopWake();
+}
+
+void doMotion(int x, int y) {
+    controlsMouseMotion(&trackball, x, y);
+    frameLoopWake();
 }
 
 
@@ -394,15 +481,26 @@ void doKeyboard( unsigned char ch, int x, int y ) {
 
 int main( int argc, char** argv ) {  // Initialize GLUT and open the window
 
+    double maxFramesPerSecond = 60;
+    int showStats = 0;
     glutInit(&argc, argv);
+    frameLoopParseArgs(argc, argv, &maxFramesPerSecond, &showStats);
+    pickShapeColors();
     glutInitDisplayMode(GLUT_DOUBLE | GLUT_DEPTH);  // Use double-buffering and depth buffer.
     glutInitWindowSize(700,700);            // Size of display area, in pixels.
     glutInitWindowPosition(100,100);        // Location of window in screen coordinates.
     glutCreateWindow("Starter"); // Parameter is window title.
     initGL();   // Call the OpenGL initialization function, defined above; must be after glutCreateWindow.
+    float eye[3] = { 0, 0, 15 }, center[3] = { 0, 0, 0 };
+    initControls(&trackball, CONTROLS_TRACKBALL, eye, center, 700, 700);
+    trackball.noZoom = trackball.noPan = 1;  // the object only turns
     glutDisplayFunc(display);               // display() is called when the window needs to be redrawn.
     glutKeyboardFunc(doKeyboard);           // doKeyboard() is called to process normal keys.
     glutSpecialFunc(doSpecialKey);          // doSpecialKey() is called to process other keys (such as arrows).
+    glutMouseFunc(doMouse);                 // doMouse() is called when a mouse button is pressed or released.
+    glutMotionFunc(doMotion);               // doMotion() is called when the mouse is dragged.
+    frameLoopStart(UPDATES_PER_SECOND, update, maxFramesPerSecond, showStats);
+    frameLoopSleepWhenStill(isMoving);      // Redraws only while something moves.
     glutMainLoop();
     return 0;
 }